@@ -162,6 +162,37 @@ int ir_shader_assemble(struct ir_shader *shader,
 		uint32_t *dwords, int sizedwords,
 		struct ir_shader_info *info);
 
+/* CPU executor (sim.c), which runs vertices or pixels in batches of
+ * IR_SIM_LANES.  The lane callbacks are called per lane before and after
+ * each batch runs, to set up the input registers (for a vertex shader,
+ * R0.x is the vertex index) and collect the exports.  Vertex fetch reads
+ * from the buffers bound with ir_sim_set_fetch(), ie. CONST(idx, sel):
+ */
+#define IR_SIM_LANES 64
+
+struct ir_sim;
+
+typedef void (*ir_sim_lane_t)(struct ir_sim *sim, unsigned lane,
+		uint32_t invocation, void *priv);
+typedef void (*ir_sim_sample_t)(void *priv, unsigned const_idx,
+		const float *coord, float *texel);
+
+struct ir_sim * ir_sim_create(struct ir_shader *shader);
+void ir_sim_destroy(struct ir_sim *sim);
+void ir_sim_set_const(struct ir_sim *sim, int num, const float *val);
+int ir_sim_set_fetch(struct ir_sim *sim, unsigned const_idx, unsigned sel,
+		const void *ptr, uint32_t size);
+void ir_sim_set_sampler(struct ir_sim *sim, ir_sim_sample_t sample,
+		void *priv);
+void ir_sim_set_reg(struct ir_sim *sim, unsigned lane, int num,
+		const float *val);
+void ir_sim_get_reg(struct ir_sim *sim, unsigned lane, int num, float *val);
+void ir_sim_get_export(struct ir_sim *sim, unsigned lane, int num,
+		float *val);
+bool ir_sim_killed(struct ir_sim *sim, unsigned lane);
+int ir_sim_run(struct ir_sim *sim, uint32_t first, uint32_t count,
+		ir_sim_lane_t setup, ir_sim_lane_t finish, void *priv);
+
 struct ir_attribute * ir_attribute_create(struct ir_shader *shader,
 		int rstart, int num, const char *name);
 struct ir_const * ir_const_create(struct ir_shader *shader,
@@ -33,15 +33,15 @@
 
 #include "ir.h"
 #include "util.h"
+#include "read-file.h"
 
 int main(int argc, char **argv)
 {
 	struct ir_shader *shader;
 	struct ir_shader_info info;
-	static char src[256 * 1024];
 	static uint32_t dwords[64 * 1024];
 	static int sizedwords;
-	char *infile, *outfile;
+	char *infile, *outfile, *src;
 	int fd, ret;
 
 	if (argc != 3) {
@@ -52,22 +52,14 @@ int main(int argc, char **argv)
 	infile = argv[1];
 	outfile = argv[2];
 
-	fd = open(infile, O_RDONLY);
-	if (fd < 0) {
-		ERROR_MSG("could not open '%s': %s", infile, strerror(errno));
+	src = read_file(infile);
+	if (!src)
 		return -1;
-	}
 
-	ret = read(fd, src, sizeof(src) - 1);
-	if (ret <= 0) {
-		ERROR_MSG("could not read '%s': %s", infile, strerror(errno));
-		return -1;
-	}
 	printf("parsing:\n%s\n", src);
 
-	close(fd);
-
 	shader = fd_asm_parse(src);
+	free(src);
 	if (!shader) {
 		ERROR_MSG("parse failed");
 		return -1;
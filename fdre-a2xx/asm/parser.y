@@ -29,40 +29,26 @@
 #include <string.h>
 #include "ir.h"
 
-static struct ir_shader      *shader;  /* current shader program */
-static struct ir_cf          *cf;      /* current CF block */
-static struct ir_instruction *instr;   /* current ALU/FETCH instruction */
-
-#ifdef YYDEBUG
-int yydebug;
-#endif
+/* all parser state is kept in a parse_state, which is passed to the
+ * (pure) parser along with the (reentrant) scanner, so that multiple
+ * shaders can be assembled in parallel:
+ */
+struct parse_state {
+	struct ir_shader      *shader;  /* current shader program */
+	struct ir_cf          *cf;      /* current CF block */
+	struct ir_instruction *instr;   /* current ALU/FETCH instruction */
+};
 
-extern int yylex(void);
 typedef void *YY_BUFFER_STATE;
-extern YY_BUFFER_STATE asm_yy_scan_string(const char *);
-extern void asm_yy_delete_buffer(YY_BUFFER_STATE);
+extern int asm_yylex_init(void **scanner);
+extern int asm_yylex_destroy(void *scanner);
+extern YY_BUFFER_STATE asm_yy_scan_string(const char *, void *scanner);
+extern void asm_yy_delete_buffer(YY_BUFFER_STATE, void *scanner);
 
-int yyparse(void);
-
-void yyerror(const char *error)
+void yyerror(void *scanner, struct parse_state *state, const char *error)
 {
 	fprintf(stderr, "%s\n", error);
 }
-
-/* TODO return IR data structure */
-struct ir_shader * fd_asm_parse(const char *src)
-{
-	YY_BUFFER_STATE buffer = asm_yy_scan_string(src);
-#ifdef YYDEBUG
-	yydebug = 1;
-#endif
-	if (yyparse()) {
-		ir_shader_destroy(shader);
-		shader = NULL;
-	}
-	asm_yy_delete_buffer(buffer);
-	return shader;
-}
 %}
 
 %union {
@@ -85,8 +71,19 @@ static void print_token(FILE *file, int type, YYSTYPE value)
 }
 
 #define YYPRINT(file, type, value) print_token(file, type, value)
+
+extern int yylex(YYSTYPE *lval, void *scanner);
 %}
 
+%code requires {
+struct parse_state;
+}
+
+%define api.pure
+%lex-param   {void *scanner}
+%parse-param {void *scanner}
+%parse-param {struct parse_state *state}
+
 %token <num> T_INT
 %token <num> T_HEX
 %token <flt> T_FLOAT
@@ -236,7 +233,7 @@ static void print_token(FILE *file, int type, YYSTYPE value)
 
 %%
 
-shader:            { shader = ir_shader_create(); } headers cfs
+shader:            { state->shader = ir_shader_create(); } headers cfs
 
 headers:           
 |                  header headers
@@ -248,23 +245,23 @@ header:            attribute_header
 |                  varying_header
 
 attribute_header:  T_A_ATTRIBUTE '(' reg_range ')' T_IDENTIFIER {
-                       ir_attribute_create(shader, $3.start, $3.num, $5);
+                       ir_attribute_create(state->shader, $3.start, $3.num, $5);
 }
 
 const_header:      T_A_CONST '(' T_CONSTANT ')' T_FLOAT ',' T_FLOAT ',' T_FLOAT ',' T_FLOAT {
-                       ir_const_create(shader, $3, $5, $7, $9, $11);
+                       ir_const_create(state->shader, $3, $5, $7, $9, $11);
 }
 
 sampler_header:    T_A_SAMPLER '(' number ')' T_IDENTIFIER {
-                       ir_sampler_create(shader, $3, $5);
+                       ir_sampler_create(state->shader, $3, $5);
 }
 
 uniform_header:    T_A_UNIFORM '(' const_range ')' T_IDENTIFIER {
-                       ir_uniform_create(shader, $3.start, $3.num, $5);
+                       ir_uniform_create(state->shader, $3.start, $3.num, $5);
 }
 
 varying_header:    T_A_VARYING '(' reg_range ')' T_IDENTIFIER {
-                       ir_varying_create(shader, $3.start, $3.num, $5);
+                       ir_varying_create(state->shader, $3.start, $3.num, $5);
 }
 
 reg_range:         T_REGISTER                { $$.start = $1; $$.num = 1; }
@@ -276,14 +273,14 @@ const_range:       T_CONSTANT                { $$.start = $1; $$.num = 1; }
 cfs:               cf
 |                  cf cfs
 
-cf:                { cf = ir_cf_create(shader, T_NOP); }      T_NOP
-|                  { cf = ir_cf_create(shader, T_ALLOC); }    cf_alloc
-|                  { cf = ir_cf_create(shader, T_EXEC); }     cf_exec
-|                  { cf = ir_cf_create(shader, T_EXEC_END); } cf_exec_end
+cf:                { state->cf = ir_cf_create(state->shader, T_NOP); }      T_NOP
+|                  { state->cf = ir_cf_create(state->shader, T_ALLOC); }    cf_alloc
+|                  { state->cf = ir_cf_create(state->shader, T_EXEC); }     cf_exec
+|                  { state->cf = ir_cf_create(state->shader, T_EXEC_END); } cf_exec_end
 
 cf_alloc:          T_ALLOC cf_alloc_type T_SIZE '(' number ')' { 
-                       cf->alloc.type = $2;
-                       cf->alloc.size = $5;
+                       state->cf->alloc.type = $2;
+                       state->cf->alloc.size = $5;
 }
 
 cf_alloc_type:     T_POSITION
@@ -298,18 +295,18 @@ cf_exec_end:       T_EXEC_END cf_exec_addr_cnt instrs
 |                  T_EXEC_END
 
 cf_exec_addr_cnt:  T_ADDR '(' number ')' T_CNT '(' number ')' { 
-                       cf->exec.addr = $3;
-                       cf->exec.cnt = $7;
+                       state->cf->exec.addr = $3;
+                       state->cf->exec.cnt = $7;
 }
 
 instrs:            instr
 |                  instr instrs
 
 instr:             fetch_or_alu
-|                  T_SYNC fetch_or_alu { instr->sync = 1; }
+|                  T_SYNC fetch_or_alu { state->instr->sync = 1; }
 
-fetch_or_alu:      { instr = ir_instr_create(cf, T_FETCH); } T_FETCH fetch
-|                  { instr = ir_instr_create(cf, T_ALU); }   T_ALU   alu
+fetch_or_alu:      { state->instr = ir_instr_create(state->cf, T_FETCH); } T_FETCH fetch
+|                  { state->instr = ir_instr_create(state->cf, T_ALU); }   T_ALU   alu
 
 fetch:             fetch_sample
 |                  fetch_vertex
@@ -319,17 +316,17 @@ fetch:             fetch_sample
  * combine the grammar nodes later.
  */
 fetch_sample:      T_SAMPLE reg '=' reg T_CONST '(' number ')' {
-                       instr->fetch.opc = $1;
-                       instr->fetch.const_idx = $7;
+                       state->instr->fetch.opc = $1;
+                       state->instr->fetch.const_idx = $7;
 }
 
 fetch_vertex:      T_VERTEX reg '=' reg format signedness T_STRIDE '(' number ')' T_CONST '(' number ',' number ')' {
-                       instr->fetch.opc = $1;
-                       instr->fetch.fmt = $5;
-                       instr->fetch.sign = $6;
-                       instr->fetch.stride = $9;
-                       instr->fetch.const_idx = $13;
-                       instr->fetch.const_idx_sel = $15;
+                       state->instr->fetch.opc = $1;
+                       state->instr->fetch.fmt = $5;
+                       state->instr->fetch.sign = $6;
+                       state->instr->fetch.stride = $9;
+                       state->instr->fetch.const_idx = $13;
+                       state->instr->fetch.const_idx_sel = $15;
 }
 
 format:            T_FMT_1_REVERSE
@@ -352,11 +349,11 @@ signedness:        T_SIGNED
 
 /* TODO can we combine a 3src vec op w/ a scalar?? */
 alu:               alu_vec {
-                       instr->alu.vector_opc = $1;
+                       state->instr->alu.vector_opc = $1;
 }
 |                  alu_vec alu_scalar {
-                       instr->alu.vector_opc = $1;
-                       instr->alu.scalar_opc = $2;
+                       state->instr->alu.vector_opc = $1;
+                       state->instr->alu.scalar_opc = $2;
 }
 
 alu_vec:           alu_vec_3src_op reg_or_export '=' alu_src_reg ',' alu_src_reg ',' alu_src_reg
@@ -456,27 +453,52 @@ alu_src_reg:       reg_or_const
 |                  '-' alu_src_reg       { $2->flags |= IR_REG_NEGATE; }
 
 reg:               T_REGISTER {
-                       $$ = ir_reg_create(instr, $1, NULL, 0);
+                       $$ = ir_reg_create(state->instr, $1, NULL, 0);
 }
 |                  T_REGISTER T_SWIZZLE {
-                       $$ = ir_reg_create(instr, $1, $2, 0);
+                       $$ = ir_reg_create(state->instr, $1, $2, 0);
 }
 
 reg_or_const:      reg
 |                  T_CONSTANT {
-                       $$ = ir_reg_create(instr, $1, NULL, IR_REG_CONST);
+                       $$ = ir_reg_create(state->instr, $1, NULL, IR_REG_CONST);
 }
 |                  T_CONSTANT T_SWIZZLE {
-                       $$ = ir_reg_create(instr, $1, $2, IR_REG_CONST);
+                       $$ = ir_reg_create(state->instr, $1, $2, IR_REG_CONST);
 }
 
 reg_or_export:     reg
 |                  T_EXPORT {
-                       $$ = ir_reg_create(instr, $1, NULL, IR_REG_EXPORT);
+                       $$ = ir_reg_create(state->instr, $1, NULL, IR_REG_EXPORT);
 }
 |                  T_EXPORT T_SWIZZLE {
-                       $$ = ir_reg_create(instr, $1, $2, IR_REG_EXPORT);
+                       $$ = ir_reg_create(state->instr, $1, $2, IR_REG_EXPORT);
 }
 
 number:            T_INT
 |                  T_HEX
+
+%%
+
+/* TODO return IR data structure */
+struct ir_shader * fd_asm_parse(const char *src)
+{
+	struct parse_state state = {0};
+	YY_BUFFER_STATE buffer;
+	void *scanner;
+
+	if (asm_yylex_init(&scanner))
+		return NULL;
+
+	buffer = asm_yy_scan_string(src, scanner);
+
+	if (yyparse(scanner, &state)) {
+		ir_shader_destroy(state.shader);
+		state.shader = NULL;
+	}
+
+	asm_yy_delete_buffer(buffer, scanner);
+	asm_yylex_destroy(scanner);
+
+	return state.shader;
+}
@@ -0,0 +1,10 @@
+#!/bin/sh
+
+cd `dirname $0`
+
+# check that assembling from multiple threads gives the same result:
+./stress tests/*.asm
+if [ $? != 0 ]; then
+	echo "stress test failed"
+	exit 1
+fi
@@ -0,0 +1,725 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ir.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <float.h>
+
+#include "util.h"
+
+/*
+ * CPU executor for a2xx shaders, which runs the CF/EXEC/ALU/FETCH program
+ * for IR_SIM_LANES vertices or pixels at a time.  Registers are stored
+ * SoA, ie. each component of a register is an array of lanes, so every
+ * ALU instruction is a handful of straight loops over the lanes which the
+ * compiler can turn into SIMD.
+ *
+ * There is no flow control in the parser (just EXEC/EXEC_END clauses,
+ * which run in order), nor predicates or address register, so those
+ * instructions are rejected up front in ir_sim_create().  Killed lanes
+ * keep executing, but are reported by ir_sim_killed().
+ */
+
+#define LANES      IR_SIM_LANES
+#define NREGS      64
+#define NEXPORTS   64
+#define NCONSTS    256
+#define NFETCH     32   /* vertex/texture fetch consts */
+
+typedef float lanes_t[LANES];
+
+struct sim_buf {
+	const void *ptr;
+	uint32_t size;
+};
+
+struct ir_sim {
+	struct ir_shader *shader;
+
+	lanes_t regs[NREGS][4];
+	lanes_t exports[NEXPORTS][4];
+	lanes_t prev;               /* previous scalar result */
+	uint8_t killed[LANES];
+
+	float consts[NCONSTS][4];
+
+	/* scratch for exec_alu(): */
+	lanes_t s1[4], s2[4], s3[4], vres[4];
+	lanes_t sa, sb, sres;
+
+	/* vertex fetch consts, three per fetch const: */
+	struct sim_buf fetch[NFETCH][3];
+
+	ir_sim_sample_t sample;
+	void *sample_priv;
+};
+
+static int chan(char c)
+{
+	switch (c) {
+	case 'x': return 0;
+	case 'y': return 1;
+	case 'z': return 2;
+	case 'w': return 3;
+	default:  return -1;
+	}
+}
+
+/* swizzle'd component of a src, short swizzles repeat the last channel: */
+static int swz(struct ir_register *reg, int c)
+{
+	int n;
+
+	if (!reg->swizzle)
+		return c;
+
+	n = strlen(reg->swizzle);
+	if (c >= n)
+		c = n - 1;
+
+	return max(chan(reg->swizzle[c]), 0);
+}
+
+static bool writes(struct ir_register *reg, int c)
+{
+	return !reg->swizzle || (reg->swizzle[c] != '_');
+}
+
+/*
+ * ALU:
+ */
+
+static void read_src(struct ir_sim *sim, struct ir_register *reg,
+		lanes_t *src)
+{
+	int c, l;
+
+	if (!reg) {
+		memset(src, 0, 4 * sizeof(lanes_t));
+		return;
+	}
+
+	for (c = 0; c < 4; c++) {
+		float *s = src[c];
+		int sc = swz(reg, c);
+
+		if (reg->flags & IR_REG_CONST) {
+			float v = sim->consts[reg->num][sc];
+			for (l = 0; l < LANES; l++)
+				s[l] = v;
+		} else {
+			memcpy(s, sim->regs[reg->num][sc], sizeof(lanes_t));
+		}
+
+		if (reg->flags & IR_REG_ABS)
+			for (l = 0; l < LANES; l++)
+				s[l] = fabsf(s[l]);
+
+		if (reg->flags & IR_REG_NEGATE)
+			for (l = 0; l < LANES; l++)
+				s[l] = -s[l];
+	}
+}
+
+static lanes_t * dst_reg(struct ir_sim *sim, struct ir_register *reg)
+{
+	if (reg->flags & IR_REG_EXPORT)
+		return sim->exports[reg->num];
+	return sim->regs[reg->num];
+}
+
+static bool vector_1src(int opc)
+{
+	switch (opc) {
+	case T_FRACv:
+	case T_TRUNCv:
+	case T_FLOORv:
+	case T_MAX4v:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* unary scalar ops take the .w channel of the (swizzled) src, binary
+ * ones take .x and .w:
+ */
+static bool scalar_2src(int opc)
+{
+	switch (opc) {
+	case T_ADDs:
+	case T_MULs:
+	case T_MAXs:
+	case T_MINs:
+	case T_SUBs:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool vector_supported(int opc)
+{
+	switch (opc) {
+	case T_ADDv:      case T_MULv:      case T_MAXv:      case T_MINv:
+	case T_SETEv:     case T_SETGTv:    case T_SETGTEv:   case T_SETNEv:
+	case T_FRACv:     case T_TRUNCv:    case T_FLOORv:    case T_MULADDv:
+	case T_CNDEv:     case T_CNDGTEv:   case T_CNDGTv:    case T_DOT4v:
+	case T_DOT3v:     case T_DOT2ADDv:  case T_MAX4v:     case T_KILLEv:
+	case T_KILLGTv:   case T_KILLGTEv:  case T_KILLNEv:   case T_DSTv:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool scalar_supported(int opc)
+{
+	switch (opc) {
+	case 0:
+	case T_ADDs:          case T_ADD_PREVs:     case T_MULs:
+	case T_MUL_PREVs:     case T_MAXs:          case T_MINs:
+	case T_SETEs:         case T_SETGTs:        case T_SETGTEs:
+	case T_SETNEs:        case T_FRACs:         case T_TRUNCs:
+	case T_FLOORs:        case T_EXP_IEEE:      case T_LOG_CLAMP:
+	case T_LOG_IEEE:      case T_RECIP_CLAMP:   case T_RECIP_FF:
+	case T_RECIP_IEEE:    case T_RECIPSQ_CLAMP: case T_RECIPSQ_FF:
+	case T_RECIPSQ_IEEE:  case T_SUBs:          case T_SUB_PREVs:
+	case T_KILLEs:        case T_KILLGTs:       case T_KILLGTEs:
+	case T_KILLNEs:       case T_KILLONEs:      case T_SQRT_IEEE:
+	case T_SIN:           case T_COS:
+		return true;
+	default:
+		return false;
+	}
+}
+
+#define VEC_OP(expr) do {                                    \
+		for (c = 0; c < 4; c++) {                            \
+			const float *a = s1[c], *b = s2[c], *d = s3[c];  \
+			float *r = vres[c];                              \
+			(void)a; (void)b; (void)d;                       \
+			for (l = 0; l < LANES; l++)                      \
+				r[l] = (expr);                               \
+		}                                                    \
+	} while (0)
+
+#define VEC_KILL(cond) do {                                  \
+		for (l = 0; l < LANES; l++) {                        \
+			bool k = false;                                  \
+			for (c = 0; c < 4; c++) {                        \
+				float a = s1[c][l], b = s2[c][l];            \
+				k |= (cond);                                 \
+			}                                                \
+			sim->killed[l] |= k;                             \
+			vres[0][l] = k ? 1.0 : 0.0;                      \
+		}                                                    \
+		for (c = 1; c < 4; c++)                              \
+			memcpy(vres[c], vres[0], sizeof(lanes_t));       \
+	} while (0)
+
+#define SCA_OP(expr) do {                                    \
+		for (l = 0; l < LANES; l++) {                        \
+			float a = sa[l], b = sb[l], p = sim->prev[l];    \
+			(void)b; (void)p;                                \
+			sres[l] = (expr);                                \
+		}                                                    \
+	} while (0)
+
+#define SCA_KILL(cond) do {                                  \
+		for (l = 0; l < LANES; l++) {                        \
+			float a = sa[l];                                 \
+			bool k = (cond);                                 \
+			sim->killed[l] |= k;                             \
+			sres[l] = k ? 1.0 : 0.0;                         \
+		}                                                    \
+	} while (0)
+
+static float clampf(float v)
+{
+	return max(min(v, FLT_MAX), -FLT_MAX);
+}
+
+static void exec_alu(struct ir_sim *sim, struct ir_instruction *instr)
+{
+	lanes_t *s1 = sim->s1, *s2 = sim->s2, *s3 = sim->s3, *vres = sim->vres;
+	float *sa = sim->sa, *sb = sim->sb, *sres = sim->sres;
+	int vopc = instr->alu.vector_opc;
+	int sopc = instr->alu.scalar_opc;
+	struct ir_register *dst, *src1, *src2 = NULL, *src3 = NULL;
+	struct ir_register *sdst = NULL;
+	lanes_t *d;
+	int c, l, r = 0;
+
+	dst = instr->regs[r++];
+	if (vopc == T_MULADDv)
+		src3 = instr->regs[r++];
+	src1 = instr->regs[r++];
+	if (!vector_1src(vopc))
+		src2 = instr->regs[r++];
+	if (vopc == T_DOT2ADDv)
+		src3 = instr->regs[r++];
+	if (sopc) {
+		sdst = instr->regs[r++];
+		/* the scalar src is src3: */
+		src3 = instr->regs[r++];
+	}
+
+	read_src(sim, src1, s1);
+	read_src(sim, src2, s2);
+	read_src(sim, src3, s3);
+
+	switch (vopc) {
+	case T_ADDv:     VEC_OP(a[l] + b[l]);                          break;
+	case T_MULv:     VEC_OP(a[l] * b[l]);                          break;
+	case T_MAXv:     VEC_OP(max(a[l], b[l]));                      break;
+	case T_MINv:     VEC_OP(min(a[l], b[l]));                      break;
+	case T_SETEv:    VEC_OP((a[l] == b[l]) ? 1.0 : 0.0);           break;
+	case T_SETGTv:   VEC_OP((a[l] > b[l]) ? 1.0 : 0.0);            break;
+	case T_SETGTEv:  VEC_OP((a[l] >= b[l]) ? 1.0 : 0.0);           break;
+	case T_SETNEv:   VEC_OP((a[l] != b[l]) ? 1.0 : 0.0);           break;
+	case T_FRACv:    VEC_OP(a[l] - floorf(a[l]));                  break;
+	case T_TRUNCv:   VEC_OP(truncf(a[l]));                         break;
+	case T_FLOORv:   VEC_OP(floorf(a[l]));                         break;
+	case T_MULADDv:  VEC_OP(a[l] * b[l] + d[l]);                   break;
+	case T_CNDEv:    VEC_OP((a[l] == 0.0) ? b[l] : d[l]);          break;
+	case T_CNDGTEv:  VEC_OP((a[l] >= 0.0) ? b[l] : d[l]);          break;
+	case T_CNDGTv:   VEC_OP((a[l] > 0.0) ? b[l] : d[l]);           break;
+	case T_KILLEv:   VEC_KILL(a == b);                             break;
+	case T_KILLGTv:  VEC_KILL(a > b);                              break;
+	case T_KILLGTEv: VEC_KILL(a >= b);                             break;
+	case T_KILLNEv:  VEC_KILL(a != b);                             break;
+	case T_DOT4v:
+	case T_DOT3v:
+	case T_DOT2ADDv:
+		for (l = 0; l < LANES; l++)
+			vres[0][l] = s1[0][l] * s2[0][l] + s1[1][l] * s2[1][l];
+		if (vopc == T_DOT2ADDv) {
+			for (l = 0; l < LANES; l++)
+				vres[0][l] += s3[0][l];
+		} else {
+			for (c = 2; c < ((vopc == T_DOT4v) ? 4 : 3); c++)
+				for (l = 0; l < LANES; l++)
+					vres[0][l] += s1[c][l] * s2[c][l];
+		}
+		for (c = 1; c < 4; c++)
+			memcpy(vres[c], vres[0], sizeof(lanes_t));
+		break;
+	case T_MAX4v:
+		for (l = 0; l < LANES; l++)
+			vres[0][l] = max(max(s1[0][l], s1[1][l]), max(s1[2][l], s1[3][l]));
+		for (c = 1; c < 4; c++)
+			memcpy(vres[c], vres[0], sizeof(lanes_t));
+		break;
+	case T_DSTv:
+		for (l = 0; l < LANES; l++) {
+			vres[0][l] = 1.0;
+			vres[1][l] = s1[1][l] * s2[1][l];
+			vres[2][l] = s1[2][l];
+			vres[3][l] = s2[3][l];
+		}
+		break;
+	}
+
+	if (sopc) {
+		memcpy(sa, s3[scalar_2src(sopc) ? 0 : 3], sizeof(lanes_t));
+		memcpy(sb, s3[3], sizeof(lanes_t));
+
+		switch (sopc) {
+		case T_ADDs:          SCA_OP(a + b);                       break;
+		case T_ADD_PREVs:     SCA_OP(a + p);                       break;
+		case T_MULs:          SCA_OP(a * b);                       break;
+		case T_MUL_PREVs:     SCA_OP(a * p);                       break;
+		case T_MAXs:          SCA_OP(max(a, b));                   break;
+		case T_MINs:          SCA_OP(min(a, b));                   break;
+		case T_SUBs:          SCA_OP(a - b);                       break;
+		case T_SUB_PREVs:     SCA_OP(a - p);                       break;
+		case T_SETEs:         SCA_OP((a == 0.0) ? 1.0 : 0.0);      break;
+		case T_SETGTs:        SCA_OP((a > 0.0) ? 1.0 : 0.0);       break;
+		case T_SETGTEs:       SCA_OP((a >= 0.0) ? 1.0 : 0.0);      break;
+		case T_SETNEs:        SCA_OP((a != 0.0) ? 1.0 : 0.0);      break;
+		case T_FRACs:         SCA_OP(a - floorf(a));               break;
+		case T_TRUNCs:        SCA_OP(truncf(a));                   break;
+		case T_FLOORs:        SCA_OP(floorf(a));                   break;
+		case T_EXP_IEEE:      SCA_OP(exp2f(a));                    break;
+		case T_LOG_IEEE:      SCA_OP(log2f(a));                    break;
+		case T_LOG_CLAMP:     SCA_OP(clampf(log2f(a)));            break;
+		case T_RECIP_IEEE:
+		case T_RECIP_FF:      SCA_OP(1.0 / a);                     break;
+		case T_RECIP_CLAMP:   SCA_OP(clampf(1.0 / a));             break;
+		case T_RECIPSQ_IEEE:
+		case T_RECIPSQ_FF:    SCA_OP(1.0 / sqrtf(a));              break;
+		case T_RECIPSQ_CLAMP: SCA_OP(clampf(1.0 / sqrtf(a)));      break;
+		case T_SQRT_IEEE:     SCA_OP(sqrtf(a));                    break;
+		case T_SIN:           SCA_OP(sinf(a));                     break;
+		case T_COS:           SCA_OP(cosf(a));                     break;
+		case T_KILLEs:        SCA_KILL(a == 0.0);                  break;
+		case T_KILLGTs:       SCA_KILL(a > 0.0);                   break;
+		case T_KILLGTEs:      SCA_KILL(a >= 0.0);                  break;
+		case T_KILLNEs:       SCA_KILL(a != 0.0);                  break;
+		case T_KILLONEs:      SCA_KILL(a == 1.0);                  break;
+		}
+
+		memcpy(sim->prev, sres, sizeof(lanes_t));
+	}
+
+	/* both results are computed before either is written back: */
+	d = dst_reg(sim, dst);
+	for (c = 0; c < 4; c++)
+		if (writes(dst, c))
+			memcpy(d[c], vres[c], sizeof(lanes_t));
+
+	if (sdst) {
+		d = dst_reg(sim, sdst);
+		for (c = 0; c < 4; c++)
+			if (writes(sdst, c))
+				memcpy(d[c], sres, sizeof(lanes_t));
+	}
+}
+
+/*
+ * FETCH:
+ */
+
+static const struct {
+	uint8_t ncomp, bits, flt;
+} formats[] = {
+	[FMT_8]                 = { 1, 8,  0 },
+	[FMT_8_8]               = { 2, 8,  0 },
+	[FMT_8_8_8_8]           = { 4, 8,  0 },
+	[FMT_16]                = { 1, 16, 0 },
+	[FMT_16_16]             = { 2, 16, 0 },
+	[FMT_16_16_16_16]       = { 4, 16, 0 },
+	[FMT_32]                = { 1, 32, 0 },
+	[FMT_32_32]             = { 2, 32, 0 },
+	[FMT_32_32_32_32]       = { 4, 32, 0 },
+	[FMT_32_FLOAT]          = { 1, 32, 1 },
+	[FMT_32_32_FLOAT]       = { 2, 32, 1 },
+	[FMT_32_32_32_FLOAT]    = { 3, 32, 1 },
+	[FMT_32_32_32_32_FLOAT] = { 4, 32, 1 },
+};
+
+static float fetch_comp(const uint8_t *p, int fmt, bool sign)
+{
+	float f;
+
+	switch (formats[fmt].bits) {
+	case 8:
+		return sign ? *(const int8_t *)p : *p;
+	case 16:
+		return sign ? *(const int16_t *)p : *(const uint16_t *)p;
+	default:
+		if (formats[fmt].flt) {
+			memcpy(&f, p, sizeof(f));
+			return f;
+		}
+		return sign ? *(const int32_t *)p : *(const uint32_t *)p;
+	}
+}
+
+static void write_fetch_dst(struct ir_sim *sim, struct ir_register *dst,
+		int l, const float *v)
+{
+	int c;
+
+	for (c = 0; c < 4; c++) {
+		char s = dst->swizzle ? dst->swizzle[c] : "xyzw"[c];
+		float f;
+
+		switch (s) {
+		case '_': continue;
+		case '0': f = 0.0; break;
+		case '1': f = 1.0; break;
+		default:  f = v[chan(s)]; break;
+		}
+
+		sim->regs[dst->num][c][l] = f;
+	}
+}
+
+static int exec_fetch(struct ir_sim *sim, struct ir_instruction *instr,
+		unsigned n)
+{
+	struct ir_register *dst = instr->regs[0];
+	struct ir_register *src = instr->regs[1];
+	unsigned l;
+	int c;
+
+	if (instr->fetch.opc == T_VERTEX) {
+		struct sim_buf *buf = &sim->fetch[instr->fetch.const_idx]
+				[instr->fetch.const_idx_sel];
+		int fmt = instr->fetch.fmt;
+		uint32_t sz = formats[fmt].ncomp * formats[fmt].bits / 8;
+		const float *idx = sim->regs[src->num][swz(src, 0)];
+
+		for (l = 0; l < n; l++) {
+			float v[4] = { 0.0, 0.0, 0.0, 1.0 };
+			uint32_t off = (uint32_t)idx[l] * instr->fetch.stride;
+
+			if (!buf->ptr || (idx[l] < 0) || ((off + sz) > buf->size)) {
+				ERROR_MSG("vertex fetch out of bounds: CONST(%u, %u), "
+						"index %d", instr->fetch.const_idx,
+						instr->fetch.const_idx_sel, (int)idx[l]);
+				return -1;
+			}
+
+			for (c = 0; c < formats[fmt].ncomp; c++) {
+				v[c] = fetch_comp((const uint8_t *)buf->ptr + off +
+						(c * formats[fmt].bits / 8), fmt,
+						instr->fetch.sign == T_SIGNED);
+			}
+
+			write_fetch_dst(sim, dst, l, v);
+		}
+	} else {
+		for (l = 0; l < n; l++) {
+			float coord[3], texel[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+			for (c = 0; c < 3; c++)
+				coord[c] = sim->regs[src->num][swz(src, c)][l];
+
+			if (sim->sample)
+				sim->sample(sim->sample_priv, instr->fetch.const_idx,
+						coord, texel);
+
+			write_fetch_dst(sim, dst, l, texel);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * API:
+ */
+
+static int check_reg(struct ir_register *reg)
+{
+	if (!reg)
+		return 0;
+	if (reg->flags & IR_REG_CONST)
+		return (reg->num < NCONSTS) ? 0 : -1;
+	return (reg->num < NREGS) ? 0 : -1;
+}
+
+static int check_instr(struct ir_instruction *instr)
+{
+	unsigned i;
+
+	for (i = 0; i < instr->regs_count; i++) {
+		if (check_reg(instr->regs[i])) {
+			ERROR_MSG("register out of range: %d", instr->regs[i]->num);
+			return -1;
+		}
+	}
+
+	if (instr->instr_type == T_FETCH) {
+		if (instr->fetch.const_idx >= NFETCH) {
+			ERROR_MSG("invalid fetch const: %u", instr->fetch.const_idx);
+			return -1;
+		}
+		if ((instr->fetch.opc == T_VERTEX) &&
+				((instr->fetch.fmt >= ARRAY_SIZE(formats)) ||
+				!formats[instr->fetch.fmt].ncomp ||
+				(instr->fetch.const_idx_sel > 2))) {
+			ERROR_MSG("unsupported vertex fetch: fmt %d", instr->fetch.fmt);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!vector_supported(instr->alu.vector_opc)) {
+		ERROR_MSG("unsupported vector opc: %d", instr->alu.vector_opc);
+		return -1;
+	}
+
+	if (!scalar_supported(instr->alu.scalar_opc)) {
+		ERROR_MSG("unsupported scalar opc: %d", instr->alu.scalar_opc);
+		return -1;
+	}
+
+	return 0;
+}
+
+struct ir_sim * ir_sim_create(struct ir_shader *shader)
+{
+	struct ir_sim *sim;
+	unsigned i, j;
+
+	for (i = 0; i < shader->cfs_count; i++) {
+		struct ir_cf *cf = shader->cfs[i];
+
+		if ((cf->cf_type != T_EXEC) && (cf->cf_type != T_EXEC_END))
+			continue;
+
+		for (j = 0; j < cf->exec.instrs_count; j++)
+			if (check_instr(cf->exec.instrs[j]))
+				return NULL;
+	}
+
+	sim = calloc(1, sizeof(*sim));
+	if (!sim)
+		return NULL;
+
+	sim->shader = shader;
+
+	for (i = 0; i < shader->consts_count; i++)
+		ir_sim_set_const(sim, shader->consts[i]->cstart,
+				shader->consts[i]->val);
+
+	return sim;
+}
+
+void ir_sim_destroy(struct ir_sim *sim)
+{
+	free(sim);
+}
+
+void ir_sim_set_const(struct ir_sim *sim, int num, const float *val)
+{
+	assert((num >= 0) && (num < NCONSTS));
+	memcpy(sim->consts[num], val, sizeof(sim->consts[num]));
+}
+
+int ir_sim_set_fetch(struct ir_sim *sim, unsigned const_idx, unsigned sel,
+		const void *ptr, uint32_t size)
+{
+	if ((const_idx >= NFETCH) || (sel > 2)) {
+		ERROR_MSG("invalid fetch const: %u, %u", const_idx, sel);
+		return -1;
+	}
+
+	sim->fetch[const_idx][sel].ptr = ptr;
+	sim->fetch[const_idx][sel].size = size;
+
+	return 0;
+}
+
+void ir_sim_set_sampler(struct ir_sim *sim, ir_sim_sample_t sample,
+		void *priv)
+{
+	sim->sample = sample;
+	sim->sample_priv = priv;
+}
+
+void ir_sim_set_reg(struct ir_sim *sim, unsigned lane, int num,
+		const float *val)
+{
+	int c;
+
+	assert((lane < LANES) && (num >= 0) && (num < NREGS));
+	for (c = 0; c < 4; c++)
+		sim->regs[num][c][lane] = val[c];
+}
+
+void ir_sim_get_reg(struct ir_sim *sim, unsigned lane, int num, float *val)
+{
+	int c;
+
+	assert((lane < LANES) && (num >= 0) && (num < NREGS));
+	for (c = 0; c < 4; c++)
+		val[c] = sim->regs[num][c][lane];
+}
+
+void ir_sim_get_export(struct ir_sim *sim, unsigned lane, int num,
+		float *val)
+{
+	int c;
+
+	assert((lane < LANES) && (num >= 0) && (num < NEXPORTS));
+	for (c = 0; c < 4; c++)
+		val[c] = sim->exports[num][c][lane];
+}
+
+bool ir_sim_killed(struct ir_sim *sim, unsigned lane)
+{
+	assert(lane < LANES);
+	return sim->killed[lane];
+}
+
+static int exec_batch(struct ir_sim *sim, unsigned n)
+{
+	struct ir_shader *shader = sim->shader;
+	unsigned i, j;
+	int ret;
+
+	for (i = 0; i < shader->cfs_count; i++) {
+		struct ir_cf *cf = shader->cfs[i];
+
+		if ((cf->cf_type != T_EXEC) && (cf->cf_type != T_EXEC_END))
+			continue;
+
+		for (j = 0; j < cf->exec.instrs_count; j++) {
+			struct ir_instruction *instr = cf->exec.instrs[j];
+
+			if (instr->instr_type == T_FETCH) {
+				ret = exec_fetch(sim, instr, n);
+				if (ret)
+					return ret;
+			} else {
+				exec_alu(sim, instr);
+			}
+		}
+
+		if (cf->cf_type == T_EXEC_END)
+			break;
+	}
+
+	return 0;
+}
+
+int ir_sim_run(struct ir_sim *sim, uint32_t first, uint32_t count,
+		ir_sim_lane_t setup, ir_sim_lane_t finish, void *priv)
+{
+	uint32_t base;
+	unsigned l, n;
+	int ret;
+
+	for (base = 0; base < count; base += LANES) {
+		n = min(count - base, LANES);
+
+		memset(sim->regs, 0, sizeof(sim->regs));
+		memset(sim->exports, 0, sizeof(sim->exports));
+		memset(sim->prev, 0, sizeof(sim->prev));
+		memset(sim->killed, 0, sizeof(sim->killed));
+
+		if (setup)
+			for (l = 0; l < n; l++)
+				setup(sim, l, first + base + l, priv);
+
+		ret = exec_batch(sim, n);
+		if (ret)
+			return ret;
+
+		if (finish)
+			for (l = 0; l < n; l++)
+				finish(sim, l, first + base + l, priv);
+	}
+
+	return 0;
+}
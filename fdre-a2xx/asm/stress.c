@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2012 Rob Clark <robdclark@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "ir.h"
+#include "util.h"
+#include "asm-stress.h"
+
+/* stress test for the reentrant parser, the driver is in asm-stress.h.
+ * Returns sizedwords, or -1 on error:
+ */
+static int assemble(const char *src, uint32_t **dwords)
+{
+	struct ir_shader *shader;
+	struct ir_shader_info info;
+	int sizedwords = 64 * 1024;
+
+	shader = fd_asm_parse(src);
+	if (!shader)
+		return -1;
+
+	*dwords = malloc(sizedwords * 4);
+
+	sizedwords = ir_shader_assemble(shader, *dwords, sizedwords, &info);
+	ir_shader_destroy(shader);
+
+	if (sizedwords <= 0) {
+		free(*dwords);
+		return -1;
+	}
+
+	return sizedwords;
+}
+
+int main(int argc, char **argv)
+{
+	return asm_stress_main(argc, argv, assemble);
+}
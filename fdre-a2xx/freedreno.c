@@ -25,11 +25,15 @@
 #include "config.h"
 #endif
 
+#include <math.h>
+
 #include "util.h"
+#include "fnv.h"
 #include "msm_kgsl.h"
 #include "freedreno.h"
 #include "program.h"
 #include "ring.h"
+#include "upload.h"
 #include "ir.h"
 #include "ws.h"
 #include "bmp.h"
@@ -102,13 +106,12 @@ struct fd_state {
 
 	/* attribute related params: */
 	struct {
-		/* gpu buffer used for passing parameters by ptr to the gpu..
-		 * it is used in a circular buffer fashion, wrapping around,
-		 * so we don't immediately overwrite the parameters for the
-		 * last draw cmd which the gpu may still be using:
+		/* streaming buffer used for passing client vertex data and
+		 * indices by ptr to the gpu.  Space is only reused once the
+		 * submit which used it has retired, and it grows if all of
+		 * it is used by the current (not yet flushed) draws:
 		 */
-		struct fd_bo *bo;
-		uint32_t off;
+		struct fd_upload *upload;
 
 		struct fd_parameters params;
 	} attributes;
@@ -140,6 +143,9 @@ struct fd_state {
 	/* have there been any render cmds since last flush? */
 	bool dirty;
 
+	/* FD_SIM: also run the shaders on the CPU, see sim_draw(): */
+	bool sim;
+
 	struct {
 		struct {
 			float x, y, z;
@@ -336,6 +342,8 @@ struct fd_state * fd_init(void)
 	state = calloc(1, sizeof(*state));
 	assert(state);
 
+	state->sim = !!getenv("FD_SIM");
+
 #ifdef HAVE_X11
 	state->ws = fd_winsys_dri2_open();
 	if (!state->ws)
@@ -343,6 +351,12 @@ struct fd_state * fd_init(void)
 #endif
 	if (!state->ws)
 		state->ws = fd_winsys_fbdev_open();
+	if (!state->ws) {
+		ERROR_MSG("failed to open fbdev, rendering offscreen");
+		state->ws = fd_winsys_null_open();
+	}
+	if (!state->ws)
+		goto fail;
 
 	fd_pipe_get_param(state->ws->pipe, FD_GMEM_SIZE, &val);
 	state->gmemsize_bytes = val;
@@ -357,8 +371,9 @@ struct fd_state * fd_init(void)
 
 	state->solid_const = fd_bo_new(state->ws->dev, 0x1000, 0);
 
-	/* allocate bo to pass vertices: */
-	state->attributes.bo = fd_bo_new(state->ws->dev, 0x20000, 0);
+	/* allocate buffer to pass vertices: */
+	state->attributes.upload = fd_upload_new(state->ws->dev,
+			state->ws->pipe, 0x20000);
 
 	state->program = fd_program_new();
 
@@ -426,9 +441,13 @@ fail:
 void fd_fini(struct fd_state *state)
 {
 	fd_surface_del(state, state->render_target.surface);
-	fd_ringbuffer_del(state->ring);
-	fd_ringbuffer_del(state->ring_tile);
-	state->ws->destroy(state->ws);
+	if (state->ring)
+		fd_ringbuffer_del(state->ring);
+	if (state->ring_tile)
+		fd_ringbuffer_del(state->ring_tile);
+	fd_upload_del(state->attributes.upload);
+	if (state->ws)
+		state->ws->destroy(state->ws);
 	free(state);
 }
 
@@ -1169,38 +1188,40 @@ int fd_tex_param(struct fd_state *state, GLenum name, GLint param)
 	}
 }
 
-static int upload_attributes(struct fd_bo *bo, uint32_t off,
-		struct fd_param *p, uint32_t start, uint32_t count)
+static void upload_attributes(struct fd_state *state,
+		struct fd_param *p, uint32_t start, uint32_t count,
+		struct fd_shader_const *shader_const)
 {
 	uint32_t group_size = p->elem_size * p->size;
 	uint32_t total_size = group_size * count;
 	uint32_t align_size = ALIGN(total_size, 32);
 	uint32_t data_off   = group_size * start;
+	uint8_t *ptr;
 
-	if ((off + align_size) > fd_bo_size(bo))
-		return -1;
+	ptr = fd_upload_alloc(state->attributes.upload, align_size, 32,
+			&shader_const->bo, &shader_const->offset);
 
-	memcpy(fd_bo_map(bo) + off, p->data + data_off, total_size);
+	memcpy(ptr, p->data + data_off, total_size);
 
 	/* zero pad up to multiple of 32 */
-	memset(fd_bo_map(bo) + off + total_size, 0, align_size - total_size);
+	memset(ptr + total_size, 0, align_size - total_size);
 
-	return align_size;
+	shader_const->sz = align_size;
 }
 
-static uint32_t emit_attributes(struct fd_state *state,
+/* returns the bo/offset of the uploaded indices, if any: */
+static struct fd_bo * emit_attributes(struct fd_state *state,
 		uint32_t start, uint32_t count,
-		uint32_t idx_size, const void *indices)
+		uint32_t idx_size, const void *indices, uint32_t *idx_offset)
 {
-	struct fd_bo *bo = state->attributes.bo;
 	struct fd_shader_const shader_const[MAX_PARAMS];
 	struct ir_attribute **attributes;
+	struct fd_bo *idx_bo = NULL;
 	int n, attributes_count;
-	uint32_t idx_offset = 0;
 
 	attributes = fd_program_attributes(state->program,
 			FD_SHADER_VERTEX, &attributes_count);
-retry:
+
 	for (n = 0; n < attributes_count; n++) {
 		struct fd_param *p = find_param(&state->attributes.params,
 				attributes[n]->name);
@@ -1210,44 +1231,25 @@ retry:
 			shader_const[n].bo = p->bo;
 			shader_const[n].sz = fd_bo_size(p->bo);
 		} else {
-			int align_size = upload_attributes(bo, state->attributes.off,
-					p, start, indices ? p->count : count);
-
-			/* if we reach end of bo, then wrap-around: */
-			if (align_size < 0) {
-				state->attributes.off = 0;
-				n = 0;
-				goto retry;
-			}
-
-			shader_const[n].offset = state->attributes.off;
-			shader_const[n].bo = bo;
-			shader_const[n].sz = align_size;
-
-			state->attributes.off += align_size;
+			upload_attributes(state, p, start,
+					indices ? p->count : count, &shader_const[n]);
 		}
 
 		shader_const[n].format  = COLORX_8;
 	}
 
-	if (n > 0) {
+	if (n > 0)
 		emit_shader_const(state->ring, 0x78, shader_const, n);
-		if (indices) {
-			uint32_t align_size = ALIGN(idx_size, 32);
 
-			if ((state->attributes.off + align_size) > fd_bo_size(bo)) {
-				state->attributes.off = 0;
-				n = 0;
-				goto retry;
-			}
-
-			memcpy(fd_bo_map(bo) + state->attributes.off, indices, idx_size);
-			idx_offset = state->attributes.off;
-			state->attributes.off += align_size;
-		}
+	/* an indexed draw needs the indices even if the shader has no
+	 * attributes:
+	 */
+	if (indices) {
+		fd_upload_data(state->attributes.upload, indices,
+				idx_size, 32, &idx_bo, idx_offset);
 	}
 
-	return idx_offset;
+	return idx_bo;
 }
 
 /* in the cmdstream, uniforms and conts are the same */
@@ -1369,6 +1371,263 @@ static void emit_cacheflush(struct fd_state *state)
 	}
 }
 
+/* ************************************************************************* */
+/* CPU execution of draws (FD_SIM), for regression testing without looking
+ * at the render target.  The vertex shader is run for each vertex of the
+ * draw, with the same attribute buffers and uniforms as emitted to the gpu,
+ * then the fragment shader is run once per vertex, with the vertex shader
+ * params as varyings.  The results are folded into a per-draw checksum.
+ *
+ * This is an approximation: there is no rasterization, so each vertex
+ * stands in for one pixel.  Interpolation, clipping, culling, depth and
+ * stencil, blending, and anything else which depends on what actually
+ * gets drawn where, are not covered.  The checksum catches changes to
+ * the shaders, the values fed to them and the executor, not to the
+ * image.  tests/check-sim.sh compares against known checksums.
+ */
+
+struct sim_draw {
+	struct fd_state *state;
+	GLenum type;
+	const void *indices;
+	uint32_t nparams;
+	float (*params)[4];     /* per vertex, position then params */
+	uint32_t killed;
+	uint32_t checksum;
+};
+
+static void sim_checksum(struct sim_draw *d, const float *val, int n)
+{
+	d->checksum = fnv32(d->checksum, val, n * sizeof(val[0]));
+}
+
+static void sim_uniforms(struct fd_state *state, struct ir_sim *sim,
+		enum fd_shader_type type)
+{
+	struct ir_uniform **uniforms;
+	int n, uniforms_count;
+	uint32_t i;
+
+	uniforms = fd_program_uniforms(state->program, type, &uniforms_count);
+
+	for (n = 0; n < uniforms_count; n++) {
+		struct fd_param *p = find_param(&state->uniforms.params,
+				uniforms[n]->name);
+		const float *data = p->data;
+
+		/* same layout as emit_uniconst(), one const per row: */
+		for (i = 0; i < p->count; i++) {
+			float val[4] = {0};
+			memcpy(val, data, min(p->size, 4) * sizeof(float));
+			ir_sim_set_const(sim, uniforms[n]->cstart + i, val);
+			data += p->size;
+		}
+	}
+}
+
+static void sim_attributes(struct fd_state *state, struct ir_sim *sim,
+		uint32_t start, uint32_t count, const void *indices)
+{
+	struct ir_attribute **attributes;
+	int n, attributes_count;
+
+	attributes = fd_program_attributes(state->program,
+			FD_SHADER_VERTEX, &attributes_count);
+
+	/* emit_attributes() puts attribute n in the n'th (two dword) vertex
+	 * fetch const starting at 0x78, ie. CONST(20 + n/3, n%3):
+	 */
+	for (n = 0; n < attributes_count; n++) {
+		struct fd_param *p = find_param(&state->attributes.params,
+				attributes[n]->name);
+		uint32_t slot = (0x78 / 2) + n;
+
+		if (p->type == FD_PARAM_ATTRIBUTE_VBO) {
+			ir_sim_set_fetch(sim, slot / 3, slot % 3,
+					fd_bo_map(p->bo), fd_bo_size(p->bo));
+		} else {
+			uint32_t group_size = p->elem_size * p->size;
+			ir_sim_set_fetch(sim, slot / 3, slot % 3,
+					(const uint8_t *)p->data + (group_size * start),
+					group_size * (indices ? p->count : count));
+		}
+	}
+}
+
+static void sim_vs_setup(struct ir_sim *sim, unsigned lane,
+		uint32_t i, void *priv)
+{
+	struct sim_draw *d = priv;
+	float val[4] = {0};
+
+	if (!d->indices)
+		val[0] = i;
+	else if (d->type == GL_UNSIGNED_BYTE)
+		val[0] = ((const uint8_t *)d->indices)[i];
+	else if (d->type == GL_UNSIGNED_SHORT)
+		val[0] = ((const uint16_t *)d->indices)[i];
+	else
+		val[0] = ((const uint32_t *)d->indices)[i];
+
+	ir_sim_set_reg(sim, lane, 0, val);
+}
+
+static void sim_vs_finish(struct ir_sim *sim, unsigned lane,
+		uint32_t i, void *priv)
+{
+	struct sim_draw *d = priv;
+	float (*out)[4] = &d->params[i * (d->nparams + 1)];
+	uint32_t n;
+
+	ir_sim_get_export(sim, lane, 62, out[0]);
+	for (n = 0; n < d->nparams; n++)
+		ir_sim_get_export(sim, lane, n, out[n + 1]);
+
+	sim_checksum(d, out[0], 4 * (d->nparams + 1));
+}
+
+static void sim_fs_setup(struct ir_sim *sim, unsigned lane,
+		uint32_t i, void *priv)
+{
+	struct sim_draw *d = priv;
+	uint32_t n;
+
+	for (n = 0; n < d->nparams; n++)
+		ir_sim_set_reg(sim, lane, n, d->params[i * (d->nparams + 1) + n + 1]);
+}
+
+static void sim_fs_finish(struct ir_sim *sim, unsigned lane,
+		uint32_t i, void *priv)
+{
+	struct sim_draw *d = priv;
+	float color[4];
+
+	if (ir_sim_killed(sim, lane)) {
+		d->killed++;
+		return;
+	}
+
+	ir_sim_get_export(sim, lane, 0, color);
+	sim_checksum(d, color, 4);
+}
+
+static int sim_wrap(enum sq_tex_clamp clamp, float f, int size)
+{
+	int i = floorf(f * size);
+
+	switch (clamp) {
+	case SQ_TEX_WRAP:
+		i %= size;
+		return (i < 0) ? i + size : i;
+	case SQ_TEX_MIRROR:
+		i %= 2 * size;
+		if (i < 0)
+			i += 2 * size;
+		return (i < size) ? i : (2 * size) - 1 - i;
+	default:
+		return max(min(i, size - 1), 0);
+	}
+}
+
+/* point sampled, which is all emit_textures() sets up: */
+static void sim_sample(void *priv, unsigned const_idx,
+		const float *coord, float *texel)
+{
+	struct sim_draw *d = priv;
+	struct fd_state *state = d->state;
+	struct ir_sampler **samplers;
+	struct fd_surface *tex;
+	const uint8_t *ptr;
+	int samplers_count, x, y, c;
+
+	samplers = fd_program_samplers(state->program,
+			FD_SHADER_FRAGMENT, &samplers_count);
+	if ((int)const_idx >= samplers_count)
+		return;
+
+	tex = find_param(&state->textures.params,
+			samplers[const_idx]->name)->tex;
+	if (!tex)
+		return;
+
+	x = sim_wrap(state->textures.clamp_x, coord[0], tex->width);
+	y = sim_wrap(state->textures.clamp_y, coord[1], tex->height);
+	ptr = (const uint8_t *)fd_bo_map(tex->bo) +
+			(((y * tex->pitch) + x) * tex->cpp);
+
+	switch (tex->color) {
+	case COLORX_8_8_8_8:
+		for (c = 0; c < 4; c++)
+			texel[c] = ptr[c] / 255.0;
+		break;
+	case COLORX_32_32_32_32_FLOAT:
+		memcpy(texel, ptr, 4 * sizeof(float));
+		break;
+	default:
+		break;
+	}
+}
+
+static int sim_draw(struct fd_state *state, GLint first, GLsizei count,
+		GLenum type, const GLvoid *indices)
+{
+	struct ir_shader *vs_ir, *fs_ir;
+	struct ir_sim *vs = NULL, *fs = NULL;
+	struct sim_draw d = {
+			.state = state,
+			.type = type,
+			.indices = indices,
+			.checksum = FNV32_INIT,
+	};
+	uint32_t i;
+	int ret = -1;
+
+	vs_ir = fd_program_ir(state->program, FD_SHADER_VERTEX);
+	fs_ir = fd_program_ir(state->program, FD_SHADER_FRAGMENT);
+
+	/* params are passed to the fragment shader in R0.., so count the
+	 * registers it expects:
+	 */
+	for (i = 0; i < fs_ir->varyings_count; i++)
+		d.nparams += fs_ir->varyings[i]->num;
+
+	d.params = calloc(count * (d.nparams + 1), sizeof(d.params[0]));
+	vs = ir_sim_create(vs_ir);
+	fs = ir_sim_create(fs_ir);
+	if (!d.params || !vs || !fs) {
+		ERROR_MSG("failed to set up shader sim");
+		goto out;
+	}
+
+	sim_uniforms(state, vs, FD_SHADER_VERTEX);
+	sim_uniforms(state, fs, FD_SHADER_FRAGMENT);
+	sim_attributes(state, vs, first, count, indices);
+	ir_sim_set_sampler(fs, sim_sample, &d);
+
+	ret = ir_sim_run(vs, 0, count, sim_vs_setup, sim_vs_finish, &d);
+	if (ret) {
+		ERROR_MSG("vertex shader sim failed");
+		goto out;
+	}
+
+	ret = ir_sim_run(fs, 0, count, sim_fs_setup, sim_fs_finish, &d);
+	if (ret) {
+		ERROR_MSG("fragment shader sim failed");
+		goto out;
+	}
+
+	INFO_MSG("sim: %d vertices (fs run per vertex), %u killed, "
+			"checksum %08x", count, d.killed, d.checksum);
+
+out:
+	if (vs)
+		ir_sim_destroy(vs);
+	if (fs)
+		ir_sim_destroy(fs);
+	free(d.params);
+	return ret;
+}
+
 static int draw_impl(struct fd_state *state, GLenum mode,
 		GLint first, GLsizei count, GLenum type, const GLvoid *indices)
 {
@@ -1376,7 +1635,8 @@ static int draw_impl(struct fd_state *state, GLenum mode,
 	struct fd_surface *surface = state->render_target.surface;
 	enum pc_di_index_size idx_type = INDEX_SIZE_IGN;
 	enum pc_di_src_sel src_sel;
-	uint32_t idx_offset, idx_size;
+	struct fd_bo *idx_bo;
+	uint32_t idx_offset = 0, idx_size;
 
 	if (indices) {
 		switch (type) {
@@ -1460,7 +1720,8 @@ static int draw_impl(struct fd_state *state, GLenum mode,
 	emit_constants(state, FD_SHADER_VERTEX);
 	emit_constants(state, FD_SHADER_FRAGMENT);
 
-	idx_offset = emit_attributes(state, first, count, idx_size, indices);
+	idx_bo = emit_attributes(state, first, count, idx_size, indices,
+			&idx_offset);
 
 	fd_program_emit_shader(state->program, FD_SHADER_VERTEX, ring);
 
@@ -1513,7 +1774,7 @@ static int draw_impl(struct fd_state *state, GLenum mode,
 	}
 	OUT_RING(ring, count);				/* NumIndices */
 	if (indices) {
-		OUT_RELOC(ring, state->attributes.bo, idx_offset, 0);
+		OUT_RELOC(ring, idx_bo, idx_offset, 0);
 		OUT_RING (ring, idx_size);
 	}
 
@@ -1523,6 +1784,9 @@ static int draw_impl(struct fd_state *state, GLenum mode,
 
 	emit_cacheflush(state);
 
+	if (state->sim)
+		sim_draw(state, first, count, type, indices);
+
 	return 0;
 }
 
@@ -1615,6 +1879,7 @@ int fd_flush(struct fd_state *state)
 
 	fd_ringbuffer_flush(ring);
 	fd_pipe_wait(state->ws->pipe, fd_ringbuffer_timestamp(ring));
+	fd_upload_fence(state->attributes.upload, fd_ringbuffer_timestamp(ring));
 	fd_ringbuffer_reset(state->ring);
 	fd_ringbuffer_reset(state->ring_tile);
 
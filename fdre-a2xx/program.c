@@ -84,6 +84,12 @@ int fd_program_attach_asm(struct fd_program *program,
 	return 0;
 }
 
+struct ir_shader * fd_program_ir(struct fd_program *program,
+		enum fd_shader_type type)
+{
+	return get_shader(program, type)->ir;
+}
+
 struct ir_attribute ** fd_program_attributes(struct fd_program *program,
 		enum fd_shader_type type, int *cnt)
 {
@@ -38,11 +38,14 @@ struct fd_program * fd_program_new(void);
 int fd_program_attach_asm(struct fd_program *program,
 		enum fd_shader_type type, const char *src);
 
+struct ir_shader;
 struct ir_attribute;
 struct ir_const;
 struct ir_sampler;
 struct ir_uniform;
 
+struct ir_shader * fd_program_ir(struct fd_program *program,
+		enum fd_shader_type type);
 struct ir_attribute ** fd_program_attributes(struct fd_program *program,
 		enum fd_shader_type type, int *cnt);
 struct ir_const ** fd_program_consts(struct fd_program *program,
@@ -54,7 +54,16 @@ OUT_RELOC(struct fd_ringbuffer *ring, struct fd_bo *bo,
 		DEBUG_MSG("ring[%p]: OUT_RELOC  %04x:  %p+%u", ring,
 				(uint32_t)(ring->cur - ring->last_start), bo, offset);
 	}
+#ifdef HAVE_STRUCT_FD_RELOC
+	fd_ringbuffer_reloc(ring, &(struct fd_reloc){
+		.bo = bo,
+		.flags = FD_RELOC_READ | FD_RELOC_WRITE,
+		.offset = offset,
+		.or = or,
+	});
+#else
 	fd_ringbuffer_emit_reloc(ring, bo, offset, or);
+#endif
 }
 
 static inline void BEGIN_RING(struct fd_ringbuffer *ring, uint32_t ndwords)
@@ -87,7 +96,11 @@ OUT_IB(struct fd_ringbuffer *ring, struct fd_ringmarker *start,
 		struct fd_ringmarker *end)
 {
 	OUT_PKT3(ring, CP_INDIRECT_BUFFER_PFD, 2);
+#ifdef HAVE_STRUCT_FD_RELOC
+	fd_ringbuffer_emit_reloc_ring(ring, start, end);
+#else
 	fd_ringbuffer_emit_reloc_ring(ring, start);
+#endif
 	OUT_RING(ring, fd_ringmarker_dwords(start, end));
 }
 
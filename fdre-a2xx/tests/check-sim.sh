@@ -0,0 +1,41 @@
+#!/bin/sh
+
+# Runs each test with FD_SIM=1, and compares the per-draw checksums (and
+# any sim errors) against sim/<test>.txt.  Run from the directory with the
+# test binaries.  With -u, the expected files are (re)written instead.
+#
+# The checksums are of floats, from a build with gcc on x86-64.  Other
+# compilers/arches can round differently (for example, gcc on arm64 fuses
+# mul+add by default), in which case regenerate them with -u on a known
+# good tree first.  See sim_draw() in freedreno.c for what is (and is not)
+# covered.
+
+srcdir=${srcdir:-`dirname $0`}
+
+update=0
+if [ "$1" = "-u" ]; then
+	update=1
+fi
+
+tests="cube-textured cube lolscat stencil fan-smoothed strip-smoothed
+	triangle-smoothed triangle-quad quad-flat"
+
+errors=0
+for t in $tests; do
+	expected=$srcdir/sim/$t.txt
+	FD_SIM=1 ./$t 2>&1 | grep -E 'sim: |shader sim' | \
+		sed -e 's/^\[.\] //' -e 's/ ([a-z_]*:[0-9]*)$//' > $t.sim
+	if [ $update = 1 ]; then
+		mv $t.sim $expected
+	elif diff -u $expected $t.sim; then
+		rm -f $t.sim
+	else
+		echo "$t: sim mismatch"
+		errors=$((errors + 1))
+	fi
+done
+
+if [ $errors != 0 ]; then
+	echo "$errors tests failed"
+	exit 1
+fi
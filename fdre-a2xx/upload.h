@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef UPLOAD_H_
+#define UPLOAD_H_
+
+#include <stdint.h>
+
+/*
+ * Streaming upload buffer, for transient data (client vertex arrays,
+ * index buffers) which is only needed until the cmds referencing it
+ * have been submitted and retired.  Allocations are carved out of a
+ * ring of large bo's, and a bo is only recycled once the timestamp
+ * of the last submit which used it has passed.  If the next bo in
+ * the ring is still used by cmds which have not been submitted yet,
+ * a new bo is inserted, so the ring grows as needed.
+ */
+
+struct fd_upload;
+struct fd_device;
+struct fd_pipe;
+struct fd_bo;
+
+struct fd_upload * fd_upload_new(struct fd_device *dev,
+		struct fd_pipe *pipe, uint32_t size);
+void fd_upload_del(struct fd_upload *up);
+
+/* returns a cpu ptr to write the data to, and the bo/offset for the
+ * cmdstream.  The bo is owned by the upload buffer, so no reference
+ * is taken:
+ */
+void * fd_upload_alloc(struct fd_upload *up, uint32_t size,
+		uint32_t align, struct fd_bo **bo, uint32_t *offset);
+void fd_upload_data(struct fd_upload *up, const void *data,
+		uint32_t size, uint32_t align,
+		struct fd_bo **bo, uint32_t *offset);
+
+/* to be called after a submit, with its timestamp, so that anything
+ * allocated since the previous fence can be recycled once it retires.
+ * Returns the new fence count, allocations from a previous fence
+ * must not be used for new cmds:
+ */
+uint32_t fd_upload_fence(struct fd_upload *up, uint32_t timestamp);
+
+#endif /* UPLOAD_H_ */
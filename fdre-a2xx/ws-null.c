@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* offscreen winsys, for when there is no display (ie. running against
+ * the null-drm backend).  The size comes from $FD_OFFSCREEN=WxH:
+ */
+
+#include "ws.h"
+#include "util.h"
+
+struct fd_winsys_null {
+	struct fd_winsys base;
+	struct fd_surface *surface;
+	uint32_t width, height;
+};
+
+static inline struct fd_winsys_null * to_null_ws(struct fd_winsys *ws)
+{
+	return (struct fd_winsys_null *)ws;
+}
+
+static void destroy(struct fd_winsys *ws)
+{
+	struct fd_winsys_null *ws_null = to_null_ws(ws);
+
+	if (ws->pipe)
+		fd_pipe_del(ws->pipe);
+
+	if (ws->dev)
+		fd_device_del(ws->dev);
+
+	free(ws_null);
+}
+
+static struct fd_surface * get_surface(struct fd_winsys *ws,
+		uint32_t *width, uint32_t *height)
+{
+	struct fd_winsys_null *ws_null = to_null_ws(ws);
+	struct fd_surface *surface;
+
+	if (!ws_null->surface) {
+		surface = calloc(1, sizeof(*surface));
+		assert(surface);
+
+		surface->color  = COLORX_8_8_8_8;
+		surface->cpp    = 4;
+		surface->width  = ws_null->width;
+		surface->height = ws_null->height;
+		surface->pitch  = ALIGN(surface->width, 32);
+
+		surface->bo = fd_bo_new(ws->dev,
+				surface->pitch * surface->height * surface->cpp, 0);
+
+		ws_null->surface = surface;
+	} else {
+		surface = ws_null->surface;
+	}
+
+	if (width)
+		*width = surface->width;
+
+	if (height)
+		*height = surface->height;
+
+	return surface;
+}
+
+static int post_surface(struct fd_winsys *ws, struct fd_surface *surface)
+{
+	/* nothing to display it on */
+	return 0;
+}
+
+struct fd_winsys * fd_winsys_null_open(void)
+{
+	struct fd_winsys_null *ws_null = calloc(1, sizeof(*ws_null));
+	struct fd_winsys *ws = &ws_null->base;
+	const char *size = getenv("FD_OFFSCREEN");
+	int fd;
+
+	ws_null->width  = 1024;
+	ws_null->height = 768;
+
+	if (size && (sscanf(size, "%ux%u", &ws_null->width,
+			&ws_null->height) != 2)) {
+		ERROR_MSG("invalid FD_OFFSCREEN: %s", size);
+		goto fail;
+	}
+
+	fd = drmOpen("msm", NULL);
+	if (fd < 0) {
+		ERROR_MSG("could not open msm device: %d (%s)",
+				fd, strerror(errno));
+		goto fail;
+	}
+
+	ws->dev = fd_device_new(fd);
+	ws->pipe = fd_pipe_new(ws->dev, FD_PIPE_3D);
+
+	INFO_MSG("offscreen %dx%d", ws_null->width, ws_null->height);
+
+	ws->destroy = destroy;
+	ws->get_surface = get_surface;
+	ws->post_surface = post_surface;
+
+	return ws;
+
+fail:
+	destroy(ws);
+	return NULL;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ir-a3xx.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "util.h"
+#include "instr-a3xx.h"
+
+/*
+ * Optional peephole pass over the instructions, before they are assembled:
+ *
+ *  + runs of nop's are folded into a single (rptN)nop, which takes the
+ *    same number of cycles, up to the 3 bit repeat field (8 nop's)
+ *  + (sy)/(ss) flags are dropped when there is nothing to wait for, ie.
+ *    no tex/mem fetch (sy) or sfu (ss) instruction since the last time
+ *    the flag was set
+ *
+ * Anything which can be reached by a branch is treated conservatively:
+ * branch targets start a new nop run, and assume both sync flags may be
+ * needed.  Branch offsets are fixed up for the removed instructions.
+ */
+
+#define MAX_REPEAT 7    /* (rpt7) == 8 nop's */
+
+static bool is_branch(struct ir3_instruction *instr)
+{
+	return (instr->category == 0) && ((instr->opc == OPC_BR) ||
+			(instr->opc == OPC_JUMP) || (instr->opc == OPC_CALL));
+}
+
+static bool is_nop(struct ir3_instruction *instr)
+{
+	return (instr->category == 0) && (instr->opc == OPC_NOP) &&
+			!instr->cat0.immed && !instr->cat0.inv && !instr->cat0.comp;
+}
+
+int ir3_shader_compact(struct ir3_shader *shader)
+{
+	uint32_t i, n = shader->instrs_count, count = 0;
+	bool need_sy = true, need_ss = true;
+	struct ir3_instruction **instrs;
+	bool *target;
+	uint32_t *map;
+	int t;
+
+	if (!n)
+		return 0;
+
+	/* the original order, shader->instrs is compacted in place: */
+	instrs = malloc(n * sizeof(*instrs));
+	memcpy(instrs, shader->instrs, n * sizeof(*instrs));
+
+	target = calloc(n + 1, sizeof(*target));
+	map = calloc(n + 1, sizeof(*map));
+
+	/* find branch targets, branch offsets are relative to the branch: */
+	for (i = 0; i < n; i++) {
+		struct ir3_instruction *instr = instrs[i];
+
+		if (instr->flags & IR3_INSTR_JP)
+			target[i] = true;
+
+		if (!is_branch(instr))
+			continue;
+
+		t = (int)i + instr->cat0.immed;
+
+		if ((t < 0) || (t > (int)n)) {
+			/* don't know where it goes, so leave things alone: */
+			WARN_MSG("branch out of range at line %d", instr->line);
+			count = n;
+			goto out;
+		}
+
+		target[t] = true;
+	}
+
+	/* drop redundant sync flags: */
+	for (i = 0; i < n; i++) {
+		struct ir3_instruction *instr = instrs[i];
+
+		if (target[i])
+			need_sy = need_ss = true;
+
+		if (instr->flags & IR3_INSTR_SY) {
+			if (!need_sy)
+				instr->flags &= ~IR3_INSTR_SY;
+			need_sy = false;
+		}
+
+		if (instr->flags & IR3_INSTR_SS) {
+			if (!need_ss)
+				instr->flags &= ~IR3_INSTR_SS;
+			need_ss = false;
+		}
+
+		switch (instr->category) {
+		case 4:
+			need_ss = true;
+			break;
+		case 5:
+			need_sy = true;
+			break;
+		case 6:
+			need_sy = need_ss = true;
+			break;
+		}
+	}
+
+	/* fold nop runs, the first nop of a run can have sync flags, but
+	 * the rest can't since the wait would move earlier:
+	 */
+	for (i = 0; i < n; i++) {
+		struct ir3_instruction *instr = instrs[i];
+		struct ir3_instruction *prev = count ? shader->instrs[count - 1] : NULL;
+
+		if (prev && is_nop(prev) && is_nop(instr) && !instr->flags &&
+				!target[i] && (prev->repeat + instr->repeat + 1) <= MAX_REPEAT) {
+			prev->repeat += instr->repeat + 1;
+			map[i] = count - 1;
+			continue;
+		}
+
+		map[i] = count;
+		shader->instrs[count++] = instr;
+	}
+	map[n] = count;
+
+	/* and fix up branch offsets: */
+	for (i = 0; i < n; i++) {
+		struct ir3_instruction *instr = instrs[i];
+
+		if (!is_branch(instr))
+			continue;
+
+		t = (int)i + instr->cat0.immed;
+		instr->cat0.immed = (int)map[t] - (int)map[i];
+	}
+
+	shader->instrs_count = count;
+
+out:
+	free(instrs);
+	free(target);
+	free(map);
+	return count;
+}
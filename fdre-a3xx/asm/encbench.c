@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "ir-a3xx.h"
+#include "util.h"
+#include "read-file.h"
+
+/*
+ * Encoder benchmark: assembles each shader with both the table driven
+ * encoder and the original bitfield based one (ir3_shader_assemble_ref()),
+ * checks that the output and register accounting are bit-exact, and
+ * reports the throughput of each in instructions/second.  Besides the
+ * given .asm files, a large program of randomly generated (but valid)
+ * instructions covering all the src encodings is benchmarked.  Each
+ * shader is encoded repeatedly, until about ninstrs instructions have
+ * been encoded:
+ *
+ *   ./encbench [-n ninstrs] [-g ngenerated] tests/*.asm
+ */
+
+#define BATCH 50
+
+static int ninstrs = 2000000;
+static int ngen = 100000;
+static int failures;
+
+static double total_ref, total_tbl;
+static long total_instrs;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* deterministic, so a mismatch can be reproduced: */
+static uint32_t rnd(uint32_t n)
+{
+	static uint32_t x = 0x12345678;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x % n;
+}
+
+#define CHANCE(pct)  (rnd(100) < (pct))
+
+static uint32_t gpr(void)
+{
+	/* mostly low registers, plus the occasional a0/p0: */
+	if (CHANCE(2))
+		return (CHANCE(50) ? REG_A0 : REG_P0) << 2;
+	return rnd(48 * 4);
+}
+
+/* a cat2/cat3/cat4 style src, in one of the gpr/immed/const/relative forms: */
+static void gen_src(struct ir3_instruction *instr, uint32_t half,
+		int immed, int abs)
+{
+	uint32_t flags = half;
+	struct ir3_register *reg;
+	int n = rnd(100);
+
+	if (CHANCE(20))
+		flags |= IR3_REG_NEGATE;
+	if (abs && CHANCE(10))
+		flags |= IR3_REG_ABS;
+	if (CHANCE(5))
+		flags |= IR3_REG_R;
+
+	if (n < 60) {
+		reg = ir3_reg_create(instr, gpr(), flags);
+	} else if (n < 80) {
+		reg = ir3_reg_create(instr, rnd(256 * 4), flags | IR3_REG_CONST);
+	} else if (n < 90) {
+		flags |= CHANCE(50) ? IR3_REG_CONST : 0;
+		reg = ir3_reg_create(instr, 0, flags | IR3_REG_RELATIV);
+		reg->offset = (int)rnd(128) - 32;
+	} else if (immed) {
+		reg = ir3_reg_create(instr, 0, (flags & ~IR3_REG_R) | IR3_REG_IMMED);
+		reg->iim_val = (int)rnd(2048) - 1024;
+	} else {
+		reg = ir3_reg_create(instr, gpr(), flags);
+	}
+}
+
+static void gen_instr(struct ir3_shader *shader)
+{
+	static const uint8_t cat3_half[16] = {
+		[OPC_MAD_F16] = 1, [OPC_MAD_U16] = 1, [OPC_MAD_S16] = 1,
+		[OPC_SEL_B16] = 1, [OPC_SEL_S16] = 1, [OPC_SEL_F16] = 1,
+		[OPC_SAD_S16] = 1, [OPC_SAD_S32] = 1,
+	};
+	struct ir3_instruction *instr;
+	struct ir3_register *reg;
+	uint32_t half = CHANCE(20) ? IR3_REG_HALF : 0;
+	int n = rnd(100), opc;
+
+	/* roughly the mix seen in real shaders: */
+	if (n < 5) {
+		instr = ir3_instr_create(shader, 0, OPC_NOP);
+		instr->repeat = rnd(8);
+		instr->cat0.immed = (int)rnd(256) - 128;
+	} else if (n < 35) {
+		type_t type = half ? TYPE_F16 : TYPE_F32;
+		instr = ir3_instr_create(shader, 1, 0);
+		instr->cat1.src_type = type;
+		instr->cat1.dst_type = CHANCE(10) ? (TYPE_F16 + TYPE_F32 - type) : type;
+		ir3_reg_create(instr, gpr(),
+				((type_size(instr->cat1.dst_type) == 32) ? 0 : IR3_REG_HALF) |
+				(CHANCE(5) ? IR3_REG_EVEN : 0) |
+				(CHANCE(5) ? IR3_REG_POS_INF : 0));
+		n = rnd(100);
+		if (n < 20) {
+			reg = ir3_reg_create(instr, 0, IR3_REG_IMMED);
+			reg->iim_val = rnd(0xffffffff);
+		} else if (n < 30) {
+			reg = ir3_reg_create(instr, 0, half | IR3_REG_RELATIV |
+					(CHANCE(50) ? IR3_REG_CONST : 0));
+			reg->offset = (int)rnd(128) - 32;
+		} else {
+			ir3_reg_create(instr, (n < 60) ? rnd(256 * 4) : gpr(),
+					half | ((n < 60) ? IR3_REG_CONST : 0) |
+					(CHANCE(5) ? IR3_REG_R : 0));
+		}
+	} else if (n < 70) {
+		instr = ir3_instr_create(shader, 2, rnd(64));
+		instr->cat2.condition = rnd(6);
+		ir3_reg_create(instr, gpr(), (CHANCE(10) ? (half ^ IR3_REG_HALF) : half) |
+				(CHANCE(5) ? IR3_REG_EI : 0));
+		gen_src(instr, half, 1, 1);
+		if (CHANCE(80))
+			gen_src(instr, half, 1, 1);
+	} else if (n < 85) {
+		opc = rnd(16);
+		half = cat3_half[opc] ? IR3_REG_HALF : 0;
+		instr = ir3_instr_create(shader, 3, opc);
+		ir3_reg_create(instr, gpr(), half);
+		gen_src(instr, half, 0, 0);
+		ir3_reg_create(instr, CHANCE(30) ? rnd(64) : gpr(), half |
+				(CHANCE(30) ? IR3_REG_CONST : 0) |
+				(CHANCE(20) ? IR3_REG_NEGATE : 0));
+		gen_src(instr, half, 0, 0);
+	} else if (n < 92) {
+		instr = ir3_instr_create(shader, 4, rnd(64));
+		ir3_reg_create(instr, gpr(), half);
+		gen_src(instr, half, 1, 1);
+	} else if (n < 97) {
+		instr = ir3_instr_create(shader, 5, rnd(32));
+		instr->cat5.type = half ? TYPE_F16 : TYPE_F32;
+		instr->cat5.samp = rnd(16);
+		instr->cat5.tex  = rnd(16);
+		reg = ir3_reg_create(instr, gpr(), half);
+		reg->wrmask = 1 + rnd(15);
+		ir3_reg_create(instr, gpr(), 0);
+		if (CHANCE(50))
+			ir3_reg_create(instr, gpr(), 0);
+	} else {
+		instr = ir3_instr_create(shader, 6, rnd(32));
+		instr->cat6.type = TYPE_F32;
+		instr->cat6.src_offset = CHANCE(50) ? rnd(256) : 0;
+		instr->cat6.dst_offset = CHANCE(30) ? rnd(256) : 0;
+		ir3_reg_create(instr, gpr(), 0);
+		ir3_reg_create(instr, gpr(), 0);
+		if (CHANCE(50)) {
+			reg = ir3_reg_create(instr, 0, IR3_REG_IMMED);
+			reg->iim_val = rnd(256);
+		}
+	}
+
+	if (instr->category > 0)
+		instr->repeat = CHANCE(10) ? rnd(4) : 0;
+	instr->flags |= CHANCE(10) ? IR3_INSTR_SY : 0;
+	instr->flags |= CHANCE(10) ? IR3_INSTR_SS : 0;
+	instr->flags |= CHANCE(3)  ? IR3_INSTR_JP : 0;
+}
+
+static int bench(const char *name, struct ir3_shader *shader)
+{
+	struct ir3_shader_info info_ref = {0}, info_tbl = {0};
+	uint32_t *ref, *tbl;
+	int i, sizedwords, niters, ret_ref, ret_tbl;
+	double t_ref = 0, t_tbl = 0, t;
+
+	sizedwords = 2 * ALIGN(shader->instrs_count, 4);
+	ref = malloc(max(sizedwords, 1) * 4);
+	tbl = malloc(max(sizedwords, 1) * 4);
+
+	/* check first, before spending time on it: */
+	ret_ref = ir3_shader_assemble_ref(shader, ref, sizedwords, &info_ref);
+	ret_tbl = ir3_shader_assemble(shader, tbl, sizedwords, &info_tbl);
+
+	if ((ret_ref != ret_tbl) || (ret_ref <= 0) ||
+			memcmp(ref, tbl, ret_ref * 4) ||
+			memcmp(&info_ref, &info_tbl, sizeof(info_ref))) {
+		ERROR_MSG("%s: mismatch (%d vs %d dwords)", name, ret_tbl, ret_ref);
+		for (i = 0; i < min(ret_ref, ret_tbl); i += 2) {
+			if ((ref[i] != tbl[i]) || (ref[i+1] != tbl[i+1])) {
+				ERROR_MSG("  instr %d: %08x_%08x vs %08x_%08x", i / 2,
+						tbl[i+1], tbl[i], ref[i+1], ref[i]);
+				break;
+			}
+		}
+		failures++;
+		goto out;
+	}
+
+	/* encode roughly the same number of instructions for each shader: */
+	niters = max(ninstrs / (ret_ref / 2), 1);
+
+	/* time batches, as clock_gettime() is not free compared to encoding
+	 * a small shader, and alternate between the two encoders so that
+	 * neither gets an unfair advantage:
+	 */
+	for (i = 0; i < niters; i += BATCH) {
+		int j, n = min(BATCH, niters - i);
+
+		t = now();
+		for (j = 0; j < n; j++)
+			ir3_shader_assemble_ref(shader, ref, sizedwords, &info_ref);
+		t_ref += now() - t;
+
+		t = now();
+		for (j = 0; j < n; j++)
+			ir3_shader_assemble(shader, tbl, sizedwords, &info_tbl);
+		t_tbl += now() - t;
+	}
+
+	printf("%-40s %7d instrs: %8.2f Minstr/s (ref %8.2f Minstr/s), %.2fx\n",
+			name, ret_ref / 2,
+			(double)ret_ref / 2 * niters / t_tbl / 1000000.0,
+			(double)ret_ref / 2 * niters / t_ref / 1000000.0,
+			t_ref / t_tbl);
+
+	total_instrs += (long)ret_ref / 2 * niters;
+	total_ref += t_ref;
+	total_tbl += t_tbl;
+
+out:
+	free(ref);
+	free(tbl);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct ir3_shader *shader;
+	int i;
+
+	while ((argc >= 3) && (argv[1][0] == '-')) {
+		if (!strcmp(argv[1], "-n")) {
+			ninstrs = strtol(argv[2], NULL, 0);
+		} else if (!strcmp(argv[1], "-g")) {
+			ngen = strtol(argv[2], NULL, 0);
+		} else {
+			break;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if ((argc >= 2) && (argv[1][0] == '-')) {
+		ERROR_MSG("usage: %s [-n ninstrs] [-g ngenerated] [infile...]", argv[0]);
+		return -1;
+	}
+
+	for (i = 1; i < argc; i++) {
+		char *src = read_file(argv[i]);
+		if (!src)
+			return -1;
+
+		shader = fd_asm_parse(src);
+		free(src);
+		if (!shader) {
+			ERROR_MSG("could not parse %s, skipping", argv[i]);
+			continue;
+		}
+
+		bench(argv[i], shader);
+		ir3_shader_destroy(shader);
+	}
+
+	if (ngen > 0) {
+		shader = ir3_shader_create();
+		for (i = 0; i < ngen; i++)
+			gen_instr(shader);
+
+		bench("<generated>", shader);
+		ir3_shader_destroy(shader);
+	}
+
+	if (total_tbl > 0) {
+		printf("total: %.2f Minstr/s (ref %.2f Minstr/s), %.2fx\n",
+				total_instrs / total_tbl / 1000000.0,
+				total_instrs / total_ref / 1000000.0,
+				total_ref / total_tbl);
+	}
+
+	printf("%d mismatches\n", failures);
+
+	return failures ? -1 : 0;
+}
@@ -0,0 +1,571 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ir-a3xx.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "util.h"
+#include "instr-a3xx.h"
+#include "ir3-fields.h"
+
+/*
+ * Table driven instruction encoder.  Rather than filling in the bitfield
+ * structs from instr-a3xx.h one field at a time, each instruction is built
+ * up in a 64b word, using the field positions in ir3-fields.h, which is
+ * generated from the bitfields by gen-ir3-fields.  The sources which
+ * can be gpr/immed, const or relative (cat2, cat3 src1/src3, cat4) share
+ * one encode_src(), driven by a per-operand layout table.  Plain gpr (and
+ * immed) cat2/cat3 sources, by far the most common, skip the table.
+ *
+ * The output is bit-exact with the original per-category encoder, which
+ * is kept as ir3_shader_assemble_ref() for encbench to check against.
+ */
+
+/* unlike in the reference encoder, bad input is an error rather than an
+ * assert, so one bad shader fails on its own rather than taking down a
+ * whole fdasm -b batch:
+ */
+#define iassert(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "bogus instruction at line %d: %s\n", \
+				instr->line, #cond); \
+		return -1; \
+	} } while (0)
+
+/* ir3-fields.h defines each field as "shift, bits", and PUT() truncates
+ * val to the field width, same as assigning to the bitfield would:
+ */
+#define PUT(f, val)           PUT_((val), f)
+#define FLAG(f, flags, flag)  PUT_(!!((flags) & (flag)), f)
+#define PUT_(val, shift, bits) \
+	((((uint64_t)(val)) & (~0ull >> (64 - (bits)))) << (shift))
+
+struct field {
+	uint8_t shift, bits;
+};
+
+#define F(f) { f }
+
+/* fields of width zero (not present for the operand) encode nothing: */
+static inline uint64_t put(struct field f, uint32_t val)
+{
+	return ((uint64_t)val & ((1ull << f.bits) - 1)) << f.shift;
+}
+
+/* layout of a source which can be a gpr (or immed), const, or relative: */
+struct src_layout {
+	struct field reg, c, c_flag, rel, rel_c, rel_flag;
+	struct field im, neg, abs, r;
+	uint32_t valid;        /* valid flags, for a gpr/immed src */
+};
+
+static const struct src_layout cat2_src1 = {
+	.reg = F(CAT2_SRC1),
+	.c   = F(CAT2_C1_SRC1),   .c_flag = F(CAT2_C1_SRC1_C),
+	.rel = F(CAT2_REL1_SRC1), .rel_c  = F(CAT2_REL1_SRC1_C), .rel_flag = F(CAT2_REL1_SRC1_REL),
+	.im  = F(CAT2_SRC1_IM),   .neg    = F(CAT2_SRC1_NEG),
+	.abs = F(CAT2_SRC1_ABS),  .r      = F(CAT2_SRC1_R),
+	.valid = IR3_REG_IMMED | IR3_REG_NEGATE | IR3_REG_ABS |
+			IR3_REG_R | IR3_REG_HALF,
+};
+
+static const struct src_layout cat2_src2 = {
+	.reg = F(CAT2_SRC2),
+	.c   = F(CAT2_C2_SRC2),   .c_flag = F(CAT2_C2_SRC2_C),
+	.rel = F(CAT2_REL2_SRC2), .rel_c  = F(CAT2_REL2_SRC2_C), .rel_flag = F(CAT2_REL2_SRC2_REL),
+	.im  = F(CAT2_SRC2_IM),   .neg    = F(CAT2_SRC2_NEG),
+	.abs = F(CAT2_SRC2_ABS),  .r      = F(CAT2_SRC2_R),
+	.valid = IR3_REG_IMMED | IR3_REG_NEGATE | IR3_REG_ABS |
+			IR3_REG_R | IR3_REG_HALF,
+};
+
+static const struct src_layout cat3_src1 = {
+	.reg = F(CAT3_SRC1),
+	.c   = F(CAT3_C1_SRC1),   .c_flag = F(CAT3_C1_SRC1_C),
+	.rel = F(CAT3_REL1_SRC1), .rel_c  = F(CAT3_REL1_SRC1_C), .rel_flag = F(CAT3_REL1_SRC1_REL),
+	.neg = F(CAT3_SRC1_NEG),  .r      = F(CAT3_SRC1_R),
+	.valid = IR3_REG_NEGATE | IR3_REG_R | IR3_REG_HALF,
+};
+
+static const struct src_layout cat3_src3 = {
+	.reg = F(CAT3_SRC3),
+	.c   = F(CAT3_C2_SRC3),   .c_flag = F(CAT3_C2_SRC3_C),
+	.rel = F(CAT3_REL2_SRC3), .rel_c  = F(CAT3_REL2_SRC3_C), .rel_flag = F(CAT3_REL2_SRC3_REL),
+	.neg = F(CAT3_SRC3_NEG),  .r      = F(CAT3_SRC3_R),
+	.valid = IR3_REG_NEGATE | IR3_REG_R | IR3_REG_HALF,
+};
+
+static const struct src_layout cat4_src = {
+	.reg = F(CAT4_SRC),
+	.c   = F(CAT4_C_SRC),     .c_flag = F(CAT4_C_SRC_C),
+	.rel = F(CAT4_REL_SRC),   .rel_c  = F(CAT4_REL_SRC_C),   .rel_flag = F(CAT4_REL_SRC_REL),
+	.im  = F(CAT4_SRC_IM),    .neg    = F(CAT4_SRC_NEG),
+	.abs = F(CAT4_SRC_ABS),   .r      = F(CAT4_SRC_R),
+	.valid = IR3_REG_IMMED | IR3_REG_NEGATE | IR3_REG_ABS |
+			IR3_REG_R | IR3_REG_HALF,
+};
+
+/* cat3 opcodes which take half precision sources: */
+static const uint8_t cat3_half[16] = {
+	[OPC_MAD_F16] = 1,
+	[OPC_MAD_U16] = 1,
+	[OPC_MAD_S16] = 1,
+	[OPC_SEL_B16] = 1,
+	[OPC_SEL_S16] = 1,
+	[OPC_SEL_F16] = 1,
+	[OPC_SAD_S16] = 1,
+	[OPC_SAD_S32] = 1,  /* as emit_cat3(), checked with encbench */
+};
+
+/* the encoded register value (ie. reg_t), plus the register accounting: */
+static inline uint32_t regval(struct ir3_register *reg,
+		struct ir3_shader_info *info, uint32_t repeat)
+{
+	int8_t max;
+
+	if (reg->flags & IR3_REG_IMMED)
+		return reg->iim_val & 0x7ff;
+
+	if (!(reg->flags & IR3_REG_R))
+		repeat = 0;
+
+	max = (reg->num + repeat) >> 2;
+
+	if (reg->flags & IR3_REG_CONST) {
+		info->max_const = max(info->max_const, max);
+	} else if ((max != REG_A0) && (max != REG_P0)) {
+		if (reg->flags & IR3_REG_HALF) {
+			info->max_half_reg = max(info->max_half_reg, max);
+		} else {
+			info->max_reg = max(info->max_reg, max);
+		}
+	}
+
+	/* comp in the low two bits, num above: */
+	return reg->num & 0xfff;
+}
+
+static int encode_src(struct ir3_instruction *instr, uint64_t *bits,
+		const struct src_layout *l, struct ir3_register *src,
+		struct ir3_shader_info *info)
+{
+	uint32_t flags = src->flags;
+	uint32_t valid = (l->valid & ~IR3_REG_IMMED) | IR3_REG_CONST;
+	uint64_t v;
+
+	if (flags & IR3_REG_RELATIV) {
+		iassert(src->num < (1 << 10));
+		iassert(!(flags & ~(valid | IR3_REG_RELATIV)));
+		v = put(l->rel, regval(src, info, instr->repeat)) |
+				put(l->rel_c, !!(flags & IR3_REG_CONST)) |
+				put(l->rel_flag, 1);
+	} else if (flags & IR3_REG_CONST) {
+		iassert(src->num < (1 << 12));
+		iassert(!(flags & ~valid));
+		v = put(l->c, regval(src, info, instr->repeat)) |
+				put(l->c_flag, 1);
+	} else {
+		iassert(src->num < (1 << 11));
+		iassert(!(flags & ~l->valid));
+		v = put(l->reg, regval(src, info, instr->repeat));
+	}
+
+	v |= put(l->im,  !!(flags & IR3_REG_IMMED)) |
+			put(l->neg, !!(flags & IR3_REG_NEGATE)) |
+			put(l->abs, !!(flags & IR3_REG_ABS)) |
+			put(l->r,   !!(flags & IR3_REG_R));
+
+	*bits |= v;
+
+	return 0;
+}
+
+/* a gpr or immed src, ie. neither const nor relative: */
+#define PLAIN(reg) \
+	(!((reg)->flags & (IR3_REG_CONST | IR3_REG_RELATIV)))
+
+static int encode_cat0(struct ir3_instruction *instr, uint64_t *bits,
+		struct ir3_shader_info *info)
+{
+	*bits = PUT(CAT0_IMMED, instr->cat0.immed) |
+			PUT(CAT0_REPEAT, instr->repeat) |
+			FLAG(CAT0_SS, instr->flags, IR3_INSTR_SS) |
+			PUT(CAT0_INV, instr->cat0.inv) |
+			PUT(CAT0_COMP, instr->cat0.comp) |
+			PUT(CAT0_OPC, instr->opc) |
+			FLAG(CAT0_JMP_TGT, instr->flags, IR3_INSTR_JP) |
+			FLAG(CAT0_SYNC, instr->flags, IR3_INSTR_SY) |
+			PUT(CAT0_OPC_CAT, 0);
+
+	return 0;
+}
+
+static uint32_t type_flags(type_t type)
+{
+	return (type_size(type) == 32) ? 0 : IR3_REG_HALF;
+}
+
+static int encode_cat1(struct ir3_instruction *instr, uint64_t *bits,
+		struct ir3_shader_info *info)
+{
+	struct ir3_register *dst = instr->regs[0];
+	struct ir3_register *src = instr->regs[1];
+	uint64_t v;
+
+	iassert(instr->regs_count == 2);
+	iassert(!((dst->flags ^ type_flags(instr->cat1.dst_type)) & IR3_REG_HALF));
+	iassert((src->flags & IR3_REG_IMMED) ||
+			!((src->flags ^ type_flags(instr->cat1.src_type)) & IR3_REG_HALF));
+	iassert(!(dst->flags & ~(IR3_REG_RELATIV | IR3_REG_EVEN |
+			IR3_REG_R | IR3_REG_POS_INF | IR3_REG_HALF)));
+
+	if (src->flags & IR3_REG_IMMED) {
+		v = PUT(CAT1_IIM_VAL, src->iim_val) |
+				PUT(CAT1_SRC_IM, 1);
+	} else if (src->flags & IR3_REG_RELATIV) {
+		v = PUT(CAT1_OFF, src->offset) |
+				PUT(CAT1_SRC_REL, 1) |
+				FLAG(CAT1_SRC_REL_C, src->flags, IR3_REG_CONST);
+	} else {
+		iassert(!(src->flags & ~(IR3_REG_R | IR3_REG_CONST | IR3_REG_HALF)));
+		v = PUT(CAT1_SRC, regval(src, info, instr->repeat)) |
+				FLAG(CAT1_SRC_C, src->flags, IR3_REG_CONST);
+	}
+
+	*bits = v |
+			PUT(CAT1_DST, regval(dst, info, instr->repeat)) |
+			PUT(CAT1_REPEAT, instr->repeat) |
+			FLAG(CAT1_SRC_R, src->flags, IR3_REG_R) |
+			FLAG(CAT1_SS, instr->flags, IR3_INSTR_SS) |
+			FLAG(CAT1_UL, instr->flags, IR3_INSTR_UL) |
+			PUT(CAT1_DST_TYPE, instr->cat1.dst_type) |
+			FLAG(CAT1_DST_REL, dst->flags, IR3_REG_RELATIV) |
+			PUT(CAT1_SRC_TYPE, instr->cat1.src_type) |
+			FLAG(CAT1_EVEN, dst->flags, IR3_REG_EVEN) |
+			FLAG(CAT1_POS_INF, dst->flags, IR3_REG_POS_INF) |
+			FLAG(CAT1_JMP_TGT, instr->flags, IR3_INSTR_JP) |
+			FLAG(CAT1_SYNC, instr->flags, IR3_INSTR_SY) |
+			PUT(CAT1_OPC_CAT, 1);
+
+	return 0;
+}
+
+static int encode_cat2(struct ir3_instruction *instr, uint64_t *bits,
+		struct ir3_shader_info *info)
+{
+	struct ir3_register *dst = instr->regs[0];
+	struct ir3_register *src1 = instr->regs[1];
+	struct ir3_register *src2 = instr->regs[2];
+	uint64_t v = 0;
+
+	iassert((instr->regs_count == 2) || (instr->regs_count == 3));
+	iassert(!(dst->flags & ~(IR3_REG_R | IR3_REG_EI | IR3_REG_HALF)));
+
+	if (src2) {
+		iassert((src2->flags & IR3_REG_IMMED) ||
+				!((src1->flags ^ src2->flags) & IR3_REG_HALF));
+	}
+
+	if (PLAIN(src1) && (!src2 || PLAIN(src2))) {
+		/* fast path, gpr/immed sources: */
+		iassert(src1->num < (1 << 11));
+		iassert(!(src1->flags & ~cat2_src1.valid));
+		v = PUT(CAT2_SRC1, regval(src1, info, instr->repeat)) |
+				FLAG(CAT2_SRC1_IM, src1->flags, IR3_REG_IMMED) |
+				FLAG(CAT2_SRC1_NEG, src1->flags, IR3_REG_NEGATE) |
+				FLAG(CAT2_SRC1_ABS, src1->flags, IR3_REG_ABS) |
+				FLAG(CAT2_SRC1_R, src1->flags, IR3_REG_R);
+		if (src2) {
+			iassert(src2->num < (1 << 11));
+			iassert(!(src2->flags & ~cat2_src2.valid));
+			v |= PUT(CAT2_SRC2, regval(src2, info, instr->repeat)) |
+					FLAG(CAT2_SRC2_IM, src2->flags, IR3_REG_IMMED) |
+					FLAG(CAT2_SRC2_NEG, src2->flags, IR3_REG_NEGATE) |
+					FLAG(CAT2_SRC2_ABS, src2->flags, IR3_REG_ABS) |
+					FLAG(CAT2_SRC2_R, src2->flags, IR3_REG_R);
+		}
+	} else {
+		if (encode_src(instr, &v, &cat2_src1, src1, info))
+			return -1;
+		if (src2 && encode_src(instr, &v, &cat2_src2, src2, info))
+			return -1;
+	}
+
+	*bits = v |
+			PUT(CAT2_DST, regval(dst, info, instr->repeat)) |
+			PUT(CAT2_REPEAT, instr->repeat) |
+			FLAG(CAT2_SS, instr->flags, IR3_INSTR_SS) |
+			FLAG(CAT2_UL, instr->flags, IR3_INSTR_UL) |
+			FLAG(CAT2_DST_HALF, src1->flags ^ dst->flags, IR3_REG_HALF) |
+			FLAG(CAT2_EI, dst->flags, IR3_REG_EI) |
+			PUT(CAT2_COND, instr->cat2.condition) |
+			PUT(CAT2_FULL, !(src1->flags & IR3_REG_HALF)) |
+			PUT(CAT2_OPC, instr->opc) |
+			FLAG(CAT2_JMP_TGT, instr->flags, IR3_INSTR_JP) |
+			FLAG(CAT2_SYNC, instr->flags, IR3_INSTR_SY) |
+			PUT(CAT2_OPC_CAT, 2);
+
+	return 0;
+}
+
+static int encode_cat3(struct ir3_instruction *instr, uint64_t *bits,
+		struct ir3_shader_info *info)
+{
+	struct ir3_register *dst = instr->regs[0];
+	struct ir3_register *src1 = instr->regs[1];
+	struct ir3_register *src2 = instr->regs[2];
+	struct ir3_register *src3 = instr->regs[3];
+	uint32_t src_flags = 0;
+	uint64_t v = 0;
+
+	if ((instr->opc < ARRAY_SIZE(cat3_half)) && cat3_half[instr->opc])
+		src_flags |= IR3_REG_HALF;
+
+	iassert(instr->regs_count == 4);
+	iassert(!((src1->flags ^ src_flags) & IR3_REG_HALF));
+	iassert(!((src2->flags ^ src_flags) & IR3_REG_HALF));
+	iassert(!((src3->flags ^ src_flags) & IR3_REG_HALF));
+	iassert(!(src2->flags & ~(IR3_REG_CONST | IR3_REG_NEGATE |
+			IR3_REG_R | IR3_REG_HALF)));
+	iassert(!(dst->flags & ~(IR3_REG_R | IR3_REG_HALF)));
+
+	if (PLAIN(src1) && PLAIN(src3)) {
+		/* fast path, gpr src1/src3 (immed is not valid for cat3): */
+		iassert(src1->num < (1 << 11));
+		iassert(src3->num < (1 << 11));
+		iassert(!(src1->flags & ~cat3_src1.valid));
+		iassert(!(src3->flags & ~cat3_src3.valid));
+		v = PUT(CAT3_SRC1, regval(src1, info, instr->repeat)) |
+				FLAG(CAT3_SRC1_NEG, src1->flags, IR3_REG_NEGATE) |
+				FLAG(CAT3_SRC1_R, src1->flags, IR3_REG_R) |
+				PUT(CAT3_SRC3, regval(src3, info, instr->repeat)) |
+				FLAG(CAT3_SRC3_NEG, src3->flags, IR3_REG_NEGATE) |
+				FLAG(CAT3_SRC3_R, src3->flags, IR3_REG_R);
+	} else {
+		if (encode_src(instr, &v, &cat3_src1, src1, info))
+			return -1;
+		if (encode_src(instr, &v, &cat3_src3, src3, info))
+			return -1;
+	}
+
+	*bits = v |
+			PUT(CAT3_SRC2, regval(src2, info, instr->repeat)) |
+			FLAG(CAT3_SRC2_C, src2->flags, IR3_REG_CONST) |
+			FLAG(CAT3_SRC2_NEG, src2->flags, IR3_REG_NEGATE) |
+			FLAG(CAT3_SRC2_R, src2->flags, IR3_REG_R) |
+			PUT(CAT3_DST, regval(dst, info, instr->repeat)) |
+			PUT(CAT3_REPEAT, instr->repeat) |
+			FLAG(CAT3_SS, instr->flags, IR3_INSTR_SS) |
+			FLAG(CAT3_UL, instr->flags, IR3_INSTR_UL) |
+			FLAG(CAT3_DST_HALF, src_flags ^ dst->flags, IR3_REG_HALF) |
+			PUT(CAT3_OPC, instr->opc) |
+			FLAG(CAT3_JMP_TGT, instr->flags, IR3_INSTR_JP) |
+			FLAG(CAT3_SYNC, instr->flags, IR3_INSTR_SY) |
+			PUT(CAT3_OPC_CAT, 3);
+
+	return 0;
+}
+
+static int encode_cat4(struct ir3_instruction *instr, uint64_t *bits,
+		struct ir3_shader_info *info)
+{
+	struct ir3_register *dst = instr->regs[0];
+	struct ir3_register *src = instr->regs[1];
+	uint64_t v = 0;
+
+	iassert(instr->regs_count == 2);
+	iassert(!(dst->flags & ~(IR3_REG_R | IR3_REG_HALF)));
+
+	if (encode_src(instr, &v, &cat4_src, src, info))
+		return -1;
+
+	*bits = v |
+			PUT(CAT4_DST, regval(dst, info, instr->repeat)) |
+			PUT(CAT4_REPEAT, instr->repeat) |
+			FLAG(CAT4_SS, instr->flags, IR3_INSTR_SS) |
+			FLAG(CAT4_UL, instr->flags, IR3_INSTR_UL) |
+			FLAG(CAT4_DST_HALF, src->flags ^ dst->flags, IR3_REG_HALF) |
+			PUT(CAT4_FULL, !(src->flags & IR3_REG_HALF)) |
+			PUT(CAT4_OPC, instr->opc) |
+			FLAG(CAT4_JMP_TGT, instr->flags, IR3_INSTR_JP) |
+			FLAG(CAT4_SYNC, instr->flags, IR3_INSTR_SY) |
+			PUT(CAT4_OPC_CAT, 4);
+
+	return 0;
+}
+
+static int encode_cat5(struct ir3_instruction *instr, uint64_t *bits,
+		struct ir3_shader_info *info)
+{
+	struct ir3_register *dst = instr->regs[0];
+	struct ir3_register *src1 = instr->regs[1];
+	struct ir3_register *src2 = instr->regs[2];
+	struct ir3_register *src3 = instr->regs[3];
+	uint64_t v = 0;
+
+	iassert(!((dst->flags ^ type_flags(instr->cat5.type)) & IR3_REG_HALF));
+	iassert(!(dst->flags & ~(IR3_REG_R | IR3_REG_HALF)));
+
+	if (src1) {
+		iassert(!(src1->flags & ~IR3_REG_HALF));
+		v |= PUT(CAT5_FULL, !(src1->flags & IR3_REG_HALF)) |
+				PUT(CAT5_SRC1, regval(src1, info, instr->repeat));
+	}
+
+	if (instr->flags & IR3_INSTR_S2EN) {
+		if (src2) {
+			iassert(!((src1->flags ^ src2->flags) & IR3_REG_HALF));
+			iassert(!(src2->flags & ~IR3_REG_HALF));
+			v |= PUT(CAT5_S2EN_SRC2, regval(src2, info, instr->repeat));
+		}
+		if (src3) {
+			iassert(src3->flags & IR3_REG_HALF);
+			iassert(!(src3->flags & ~IR3_REG_HALF));
+			v |= PUT(CAT5_S2EN_SRC3, regval(src3, info, instr->repeat));
+		}
+		iassert(!(instr->cat5.samp | instr->cat5.tex));
+	} else {
+		iassert(!src3);
+		if (src2) {
+			iassert(!((src1->flags ^ src2->flags) & IR3_REG_HALF));
+			iassert(!(src2->flags & ~IR3_REG_HALF));
+			v |= PUT(CAT5_NORM_SRC2, regval(src2, info, instr->repeat));
+		}
+		v |= PUT(CAT5_NORM_SAMP, instr->cat5.samp) |
+				PUT(CAT5_NORM_TEX, instr->cat5.tex);
+	}
+
+	*bits = v |
+			PUT(CAT5_DST, regval(dst, info, instr->repeat)) |
+			PUT(CAT5_WRMASK, dst->wrmask) |
+			PUT(CAT5_TYPE, instr->cat5.type) |
+			FLAG(CAT5_IS_3D, instr->flags, IR3_INSTR_3D) |
+			FLAG(CAT5_IS_A, instr->flags, IR3_INSTR_A) |
+			FLAG(CAT5_IS_S, instr->flags, IR3_INSTR_S) |
+			FLAG(CAT5_IS_S2EN, instr->flags, IR3_INSTR_S2EN) |
+			FLAG(CAT5_IS_O, instr->flags, IR3_INSTR_O) |
+			FLAG(CAT5_IS_P, instr->flags, IR3_INSTR_P) |
+			PUT(CAT5_OPC, instr->opc) |
+			FLAG(CAT5_JMP_TGT, instr->flags, IR3_INSTR_JP) |
+			FLAG(CAT5_SYNC, instr->flags, IR3_INSTR_SY) |
+			PUT(CAT5_OPC_CAT, 5);
+
+	return 0;
+}
+
+static int encode_cat6(struct ir3_instruction *instr, uint64_t *bits,
+		struct ir3_shader_info *info)
+{
+	struct ir3_register *dst  = instr->regs[0];
+	struct ir3_register *src1 = instr->regs[1];
+	struct ir3_register *src2 = (instr->regs_count >= 3) ? instr->regs[2] : NULL;
+	uint64_t v;
+
+	iassert(instr->regs_count >= 2);
+	iassert(!(src1->flags & ~IR3_REG_IMMED));
+	iassert(!src2 || !(src2->flags & ~IR3_REG_IMMED));
+	iassert(!(dst->flags & ~(IR3_REG_R | IR3_REG_HALF)));
+
+	/* see emit_cat6() about which encoding gets used: */
+	if (instr->cat6.src_offset || instr->opc == OPC_LDG) {
+		v = PUT(CAT6_SRC_OFF, 1) |
+				PUT(CAT6A_SRC1, regval(src1, info, instr->repeat)) |
+				FLAG(CAT6A_SRC1_IM, src1->flags, IR3_REG_IMMED) |
+				PUT(CAT6A_OFF, instr->cat6.src_offset);
+		if (src2) {
+			v |= PUT(CAT6A_SRC2, regval(src2, info, instr->repeat)) |
+					FLAG(CAT6A_SRC2_IM, src2->flags, IR3_REG_IMMED);
+		}
+	} else {
+		v = PUT(CAT6B_SRC1, regval(src1, info, instr->repeat)) |
+				FLAG(CAT6B_SRC1_IM, src1->flags, IR3_REG_IMMED);
+		if (src2) {
+			v |= PUT(CAT6B_SRC2, regval(src2, info, instr->repeat)) |
+					FLAG(CAT6B_SRC2_IM, src2->flags, IR3_REG_IMMED);
+		}
+	}
+
+	if (instr->cat6.dst_offset) {
+		v |= PUT(CAT6_DST_OFF, 1) |
+				PUT(CAT6C_DST, regval(dst, info, instr->repeat)) |
+				PUT(CAT6C_OFF, instr->cat6.dst_offset);
+	} else {
+		v |= PUT(CAT6D_DST, regval(dst, info, instr->repeat));
+	}
+
+	*bits = v |
+			PUT(CAT6_TYPE, instr->cat6.type) |
+			PUT(CAT6_OPC, instr->opc) |
+			FLAG(CAT6_JMP_TGT, instr->flags, IR3_INSTR_JP) |
+			FLAG(CAT6_SYNC, instr->flags, IR3_INSTR_SY) |
+			FLAG(CAT6_G, instr->flags, IR3_INSTR_G) |
+			PUT(CAT6_OPC_CAT, 6);
+
+	return 0;
+}
+
+/* encode shader->instrs_count instructions into dwords, which is expected
+ * to be already zero'd.  The register accounting is done on a local copy
+ * of info, which (unlike info, which could alias dwords as far as the
+ * compiler knows) can stay in registers:
+ */
+int ir3_shader_encode(struct ir3_shader *shader, uint32_t *dwords,
+		struct ir3_shader_info *info)
+{
+	struct ir3_shader_info i = *info;
+	uint32_t n;
+	int ret;
+
+	for (n = 0; n < shader->instrs_count; n++) {
+		struct ir3_instruction *instr = shader->instrs[n];
+		uint64_t bits = 0;
+
+		switch (instr->category) {
+		case 0:  ret = encode_cat0(instr, &bits, &i); break;
+		case 1:  ret = encode_cat1(instr, &bits, &i); break;
+		case 2:  ret = encode_cat2(instr, &bits, &i); break;
+		case 3:  ret = encode_cat3(instr, &bits, &i); break;
+		case 4:  ret = encode_cat4(instr, &bits, &i); break;
+		case 5:  ret = encode_cat5(instr, &bits, &i); break;
+		case 6:  ret = encode_cat6(instr, &bits, &i); break;
+		default:
+			ERROR_MSG("invalid instruction category: %d", instr->category);
+			ret = -1;
+			break;
+		}
+
+		if (ret)
+			return ret;
+
+		/* little endian, same as the bitfields: */
+		memcpy(&dwords[2 * n], &bits, sizeof(bits));
+	}
+
+	*info = i;
+
+	return 0;
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Helper which generates ir3-fields.h with the bit position and width of
+ * each instruction field used by the encoder, taken from the bitfield
+ * definitions in instr-a3xx.h.  For each field, a zeroed 64b instruction
+ * has all bits of the field set, and the resulting mask gives the layout.
+ *
+ * It is not run as part of the build (that would not work for cross
+ * builds), the output is committed.  Run "make update-ir3-fields" after
+ * changing instr-a3xx.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "instr-a3xx.h"
+
+static int errors;
+
+static void field(const char *name, const void *instr)
+{
+	uint64_t mask;
+	int shift, bits;
+
+	memcpy(&mask, instr, sizeof(mask));
+
+	if (!mask) {
+		fprintf(stderr, "%s: empty field\n", name);
+		errors++;
+		return;
+	}
+
+	shift = __builtin_ctzll(mask);
+	bits  = __builtin_popcountll(mask);
+
+	/* fields must be contiguous: */
+	if ((mask >> shift) != (~0ull >> (64 - bits))) {
+		fprintf(stderr, "%s: non-contiguous field: %016llx\n",
+				name, (unsigned long long)mask);
+		errors++;
+		return;
+	}
+
+	printf("#define %-24s %2d, %2d\n", name, shift, bits);
+}
+
+#define FIELD(name, type, member) do {               \
+		type __i;                                    \
+		memset(&__i, 0, sizeof(__i));                \
+		__i.member = ~0;                             \
+		field(#name, &__i);                          \
+	} while (0)
+
+int main(int argc, char **argv)
+{
+	printf("/* generated by gen-ir3-fields from instr-a3xx.h, do not edit! */\n\n");
+	printf("#ifndef IR3_FIELDS_H_\n#define IR3_FIELDS_H_\n\n");
+	printf("/* each field is: shift, bits */\n\n");
+
+	FIELD(CAT0_IMMED,           instr_cat0_t, immed);
+	FIELD(CAT0_REPEAT,          instr_cat0_t, repeat);
+	FIELD(CAT0_SS,              instr_cat0_t, ss);
+	FIELD(CAT0_INV,             instr_cat0_t, inv);
+	FIELD(CAT0_COMP,            instr_cat0_t, comp);
+	FIELD(CAT0_OPC,             instr_cat0_t, opc);
+	FIELD(CAT0_JMP_TGT,         instr_cat0_t, jmp_tgt);
+	FIELD(CAT0_SYNC,            instr_cat0_t, sync);
+	FIELD(CAT0_OPC_CAT,         instr_cat0_t, opc_cat);
+	printf("\n");
+
+	FIELD(CAT1_SRC,             instr_cat1_t, src);
+	FIELD(CAT1_OFF,             instr_cat1_t, off);
+	FIELD(CAT1_SRC_REL_C,       instr_cat1_t, src_rel_c);
+	FIELD(CAT1_SRC_REL,         instr_cat1_t, src_rel);
+	FIELD(CAT1_IIM_VAL,         instr_cat1_t, iim_val);
+	FIELD(CAT1_DST,             instr_cat1_t, dst);
+	FIELD(CAT1_REPEAT,          instr_cat1_t, repeat);
+	FIELD(CAT1_SRC_R,           instr_cat1_t, src_r);
+	FIELD(CAT1_SS,              instr_cat1_t, ss);
+	FIELD(CAT1_UL,              instr_cat1_t, ul);
+	FIELD(CAT1_DST_TYPE,        instr_cat1_t, dst_type);
+	FIELD(CAT1_DST_REL,         instr_cat1_t, dst_rel);
+	FIELD(CAT1_SRC_TYPE,        instr_cat1_t, src_type);
+	FIELD(CAT1_SRC_C,           instr_cat1_t, src_c);
+	FIELD(CAT1_SRC_IM,          instr_cat1_t, src_im);
+	FIELD(CAT1_EVEN,            instr_cat1_t, even);
+	FIELD(CAT1_POS_INF,         instr_cat1_t, pos_inf);
+	FIELD(CAT1_JMP_TGT,         instr_cat1_t, jmp_tgt);
+	FIELD(CAT1_SYNC,            instr_cat1_t, sync);
+	FIELD(CAT1_OPC_CAT,         instr_cat1_t, opc_cat);
+	printf("\n");
+
+	FIELD(CAT2_SRC1,            instr_cat2_t, src1);
+	FIELD(CAT2_SRC1_IM,         instr_cat2_t, src1_im);
+	FIELD(CAT2_SRC1_NEG,        instr_cat2_t, src1_neg);
+	FIELD(CAT2_SRC1_ABS,        instr_cat2_t, src1_abs);
+	FIELD(CAT2_REL1_SRC1,       instr_cat2_t, rel1.src1);
+	FIELD(CAT2_REL1_SRC1_C,     instr_cat2_t, rel1.src1_c);
+	FIELD(CAT2_REL1_SRC1_REL,   instr_cat2_t, rel1.src1_rel);
+	FIELD(CAT2_C1_SRC1,         instr_cat2_t, c1.src1);
+	FIELD(CAT2_C1_SRC1_C,       instr_cat2_t, c1.src1_c);
+	FIELD(CAT2_SRC2,            instr_cat2_t, src2);
+	FIELD(CAT2_SRC2_IM,         instr_cat2_t, src2_im);
+	FIELD(CAT2_SRC2_NEG,        instr_cat2_t, src2_neg);
+	FIELD(CAT2_SRC2_ABS,        instr_cat2_t, src2_abs);
+	FIELD(CAT2_REL2_SRC2,       instr_cat2_t, rel2.src2);
+	FIELD(CAT2_REL2_SRC2_C,     instr_cat2_t, rel2.src2_c);
+	FIELD(CAT2_REL2_SRC2_REL,   instr_cat2_t, rel2.src2_rel);
+	FIELD(CAT2_C2_SRC2,         instr_cat2_t, c2.src2);
+	FIELD(CAT2_C2_SRC2_C,       instr_cat2_t, c2.src2_c);
+	FIELD(CAT2_DST,             instr_cat2_t, dst);
+	FIELD(CAT2_REPEAT,          instr_cat2_t, repeat);
+	FIELD(CAT2_SRC1_R,          instr_cat2_t, src1_r);
+	FIELD(CAT2_SS,              instr_cat2_t, ss);
+	FIELD(CAT2_UL,              instr_cat2_t, ul);
+	FIELD(CAT2_DST_HALF,        instr_cat2_t, dst_half);
+	FIELD(CAT2_EI,              instr_cat2_t, ei);
+	FIELD(CAT2_COND,            instr_cat2_t, cond);
+	FIELD(CAT2_SRC2_R,          instr_cat2_t, src2_r);
+	FIELD(CAT2_FULL,            instr_cat2_t, full);
+	FIELD(CAT2_OPC,             instr_cat2_t, opc);
+	FIELD(CAT2_JMP_TGT,         instr_cat2_t, jmp_tgt);
+	FIELD(CAT2_SYNC,            instr_cat2_t, sync);
+	FIELD(CAT2_OPC_CAT,         instr_cat2_t, opc_cat);
+	printf("\n");
+
+	FIELD(CAT3_SRC1,            instr_cat3_t, src1);
+	FIELD(CAT3_SRC1_NEG,        instr_cat3_t, src1_neg);
+	FIELD(CAT3_REL1_SRC1,       instr_cat3_t, rel1.src1);
+	FIELD(CAT3_REL1_SRC1_C,     instr_cat3_t, rel1.src1_c);
+	FIELD(CAT3_REL1_SRC1_REL,   instr_cat3_t, rel1.src1_rel);
+	FIELD(CAT3_C1_SRC1,         instr_cat3_t, c1.src1);
+	FIELD(CAT3_C1_SRC1_C,       instr_cat3_t, c1.src1_c);
+	FIELD(CAT3_SRC2,            instr_cat3_t, src2);
+	FIELD(CAT3_SRC2_C,          instr_cat3_t, src2_c);
+	FIELD(CAT3_SRC2_NEG,        instr_cat3_t, src2_neg);
+	FIELD(CAT3_SRC2_R,          instr_cat3_t, src2_r);
+	FIELD(CAT3_SRC3,            instr_cat3_t, src3);
+	FIELD(CAT3_SRC3_NEG,        instr_cat3_t, src3_neg);
+	FIELD(CAT3_SRC3_R,          instr_cat3_t, src3_r);
+	FIELD(CAT3_REL2_SRC3,       instr_cat3_t, rel2.src3);
+	FIELD(CAT3_REL2_SRC3_C,     instr_cat3_t, rel2.src3_c);
+	FIELD(CAT3_REL2_SRC3_REL,   instr_cat3_t, rel2.src3_rel);
+	FIELD(CAT3_C2_SRC3,         instr_cat3_t, c2.src3);
+	FIELD(CAT3_C2_SRC3_C,       instr_cat3_t, c2.src3_c);
+	FIELD(CAT3_DST,             instr_cat3_t, dst);
+	FIELD(CAT3_REPEAT,          instr_cat3_t, repeat);
+	FIELD(CAT3_SRC1_R,          instr_cat3_t, src1_r);
+	FIELD(CAT3_SS,              instr_cat3_t, ss);
+	FIELD(CAT3_UL,              instr_cat3_t, ul);
+	FIELD(CAT3_DST_HALF,        instr_cat3_t, dst_half);
+	FIELD(CAT3_OPC,             instr_cat3_t, opc);
+	FIELD(CAT3_JMP_TGT,         instr_cat3_t, jmp_tgt);
+	FIELD(CAT3_SYNC,            instr_cat3_t, sync);
+	FIELD(CAT3_OPC_CAT,         instr_cat3_t, opc_cat);
+	printf("\n");
+
+	FIELD(CAT4_SRC,             instr_cat4_t, src);
+	FIELD(CAT4_SRC_IM,          instr_cat4_t, src_im);
+	FIELD(CAT4_SRC_NEG,         instr_cat4_t, src_neg);
+	FIELD(CAT4_SRC_ABS,         instr_cat4_t, src_abs);
+	FIELD(CAT4_REL_SRC,         instr_cat4_t, rel.src);
+	FIELD(CAT4_REL_SRC_C,       instr_cat4_t, rel.src_c);
+	FIELD(CAT4_REL_SRC_REL,     instr_cat4_t, rel.src_rel);
+	FIELD(CAT4_C_SRC,           instr_cat4_t, c.src);
+	FIELD(CAT4_C_SRC_C,         instr_cat4_t, c.src_c);
+	FIELD(CAT4_DST,             instr_cat4_t, dst);
+	FIELD(CAT4_REPEAT,          instr_cat4_t, repeat);
+	FIELD(CAT4_SRC_R,           instr_cat4_t, src_r);
+	FIELD(CAT4_SS,              instr_cat4_t, ss);
+	FIELD(CAT4_UL,              instr_cat4_t, ul);
+	FIELD(CAT4_DST_HALF,        instr_cat4_t, dst_half);
+	FIELD(CAT4_FULL,            instr_cat4_t, full);
+	FIELD(CAT4_OPC,             instr_cat4_t, opc);
+	FIELD(CAT4_JMP_TGT,         instr_cat4_t, jmp_tgt);
+	FIELD(CAT4_SYNC,            instr_cat4_t, sync);
+	FIELD(CAT4_OPC_CAT,         instr_cat4_t, opc_cat);
+	printf("\n");
+
+	FIELD(CAT5_FULL,            instr_cat5_t, full);
+	FIELD(CAT5_SRC1,            instr_cat5_t, src1);
+	FIELD(CAT5_NORM_SRC2,       instr_cat5_t, norm.src2);
+	FIELD(CAT5_NORM_SAMP,       instr_cat5_t, norm.samp);
+	FIELD(CAT5_NORM_TEX,        instr_cat5_t, norm.tex);
+	FIELD(CAT5_S2EN_SRC2,       instr_cat5_t, s2en.src2);
+	FIELD(CAT5_S2EN_SRC3,       instr_cat5_t, s2en.src3);
+	FIELD(CAT5_DST,             instr_cat5_t, dst);
+	FIELD(CAT5_WRMASK,          instr_cat5_t, wrmask);
+	FIELD(CAT5_TYPE,            instr_cat5_t, type);
+	FIELD(CAT5_IS_3D,           instr_cat5_t, is_3d);
+	FIELD(CAT5_IS_A,            instr_cat5_t, is_a);
+	FIELD(CAT5_IS_S,            instr_cat5_t, is_s);
+	FIELD(CAT5_IS_S2EN,         instr_cat5_t, is_s2en);
+	FIELD(CAT5_IS_O,            instr_cat5_t, is_o);
+	FIELD(CAT5_IS_P,            instr_cat5_t, is_p);
+	FIELD(CAT5_OPC,             instr_cat5_t, opc);
+	FIELD(CAT5_JMP_TGT,         instr_cat5_t, jmp_tgt);
+	FIELD(CAT5_SYNC,            instr_cat5_t, sync);
+	FIELD(CAT5_OPC_CAT,         instr_cat5_t, opc_cat);
+	printf("\n");
+
+	FIELD(CAT6_SRC_OFF,         instr_cat6_t, src_off);
+	FIELD(CAT6_DST_OFF,         instr_cat6_t, dst_off);
+	FIELD(CAT6_TYPE,            instr_cat6_t, type);
+	FIELD(CAT6_G,               instr_cat6_t, g);
+	FIELD(CAT6_OPC,             instr_cat6_t, opc);
+	FIELD(CAT6_JMP_TGT,         instr_cat6_t, jmp_tgt);
+	FIELD(CAT6_SYNC,            instr_cat6_t, sync);
+	FIELD(CAT6_OPC_CAT,         instr_cat6_t, opc_cat);
+	FIELD(CAT6A_OFF,            instr_cat6a_t, off);
+	FIELD(CAT6A_SRC1,           instr_cat6a_t, src1);
+	FIELD(CAT6A_SRC1_IM,        instr_cat6a_t, src1_im);
+	FIELD(CAT6A_SRC2_IM,        instr_cat6a_t, src2_im);
+	FIELD(CAT6A_SRC2,           instr_cat6a_t, src2);
+	FIELD(CAT6B_SRC1,           instr_cat6b_t, src1);
+	FIELD(CAT6B_SRC1_IM,        instr_cat6b_t, src1_im);
+	FIELD(CAT6B_SRC2_IM,        instr_cat6b_t, src2_im);
+	FIELD(CAT6B_SRC2,           instr_cat6b_t, src2);
+	FIELD(CAT6C_OFF,            instr_cat6c_t, off);
+	FIELD(CAT6C_DST,            instr_cat6c_t, dst);
+	FIELD(CAT6D_DST,            instr_cat6d_t, dst);
+
+	printf("\n#endif /* IR3_FIELDS_H_ */\n");
+
+	return errors ? 1 : 0;
+}
@@ -32,13 +32,48 @@
 #include "util.h"
 #include "instr-a3xx.h"
 
-/* simple allocator to carve allocations out of an up-front allocated heap,
- * so that we can free everything easily in one shot.
+/* simple allocator to carve allocations out of chunks of memory owned by
+ * the shader, so that we can free everything easily in one shot.  Chunks
+ * start small and double in size as needed, so small shaders stay small.
+ * Allocations are zero'd.
  */
+#define CHUNK_MIN_SIZE  (4 * 1024)
+#define CHUNK_MAX_SIZE  (1024 * 1024)
+
+struct ir3_heap_chunk {
+	struct ir3_heap_chunk *next;
+	size_t size, idx;
+	uint64_t data[];    /* keeps allocations 8 byte aligned */
+};
+
 static void * ir3_alloc(struct ir3_shader *shader, int sz)
 {
-	void *ptr = &shader->heap[shader->heap_idx];
-	shader->heap_idx += ALIGN(sz, 4);
+	struct ir3_heap_chunk *chunk = shader->heap;
+	size_t asz;
+	void *ptr;
+
+	assert(sz >= 0);
+	asz = ALIGN((size_t)sz, sizeof(chunk->data[0]));
+
+	if (!chunk || (asz > (chunk->size - chunk->idx))) {
+		size_t size = CHUNK_MIN_SIZE;
+		if (chunk)
+			size = min(2 * chunk->size, CHUNK_MAX_SIZE);
+		size = max(size, asz);
+
+		chunk = calloc(1, sizeof(*chunk) + size);
+		if (!chunk) {
+			ERROR_MSG("out of memory allocating %zu bytes", size);
+			abort();
+		}
+		chunk->size = size;
+		chunk->next = shader->heap;
+		shader->heap = chunk;
+	}
+
+	ptr = (uint8_t *)chunk->data + chunk->idx;
+	chunk->idx += asz;
+
 	return ptr;
 }
 
@@ -62,7 +97,14 @@ struct ir3_shader * ir3_shader_create(void)
 
 void ir3_shader_destroy(struct ir3_shader *shader)
 {
+	struct ir3_heap_chunk *chunk = shader->heap;
 	DEBUG_MSG("");
+	while (chunk) {
+		struct ir3_heap_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	free(shader->instrs);
 	free(shader);
 }
 
@@ -517,9 +559,9 @@ static int (*emit[])(struct ir3_instruction *instr, void *ptr,
 	emit_cat0, emit_cat1, emit_cat2, emit_cat3, emit_cat4, emit_cat5, emit_cat6,
 };
 
-int ir3_shader_assemble(struct ir3_shader *shader,
+static int assemble(struct ir3_shader *shader,
 		uint32_t *dwords, uint32_t sizedwords,
-		struct ir3_shader_info *info)
+		struct ir3_shader_info *info, bool ref)
 {
 	uint32_t i;
 
@@ -553,6 +595,13 @@ int ir3_shader_assemble(struct ir3_shader *shader,
 
 	memset(dwords, 0, 4 * 2 * shader->instrs_count);
 
+	if (!ref) {
+		int ret = ir3_shader_encode(shader, dwords, info);
+		if (ret)
+			return ret;
+		return 2 * shader->instrs_count;
+	}
+
 	for (i = 0; i < shader->instrs_count; i++) {
 		struct ir3_instruction *instr = shader->instrs[i];
 		int ret = emit[instr->category](instr, dwords, info);
@@ -565,6 +614,23 @@ int ir3_shader_assemble(struct ir3_shader *shader,
 	return 2 * shader->instrs_count;
 }
 
+int ir3_shader_assemble(struct ir3_shader *shader,
+		uint32_t *dwords, uint32_t sizedwords,
+		struct ir3_shader_info *info)
+{
+	return assemble(shader, dwords, sizedwords, info, false);
+}
+
+/* the original bitfield based encoder, which encbench checks the table
+ * driven one (encode-a3xx.c) against:
+ */
+int ir3_shader_assemble_ref(struct ir3_shader *shader,
+		uint32_t *dwords, uint32_t sizedwords,
+		struct ir3_shader_info *info)
+{
+	return assemble(shader, dwords, sizedwords, info, true);
+}
+
 static struct ir3_register * reg_create(struct ir3_shader *shader,
 		int num, int flags)
 {
@@ -681,7 +747,17 @@ struct ir3_instruction * ir3_instr_create(struct ir3_shader *shader,
 	instr->shader = shader;
 	instr->category = category;
 	instr->opc = opc;
-	assert(shader->instrs_count < ARRAY_SIZE(shader->instrs));
+	if (shader->instrs_count == shader->instrs_size) {
+		unsigned size = max(2 * shader->instrs_size, 64);
+		void *instrs = realloc(shader->instrs,
+				size * sizeof(shader->instrs[0]));
+		if (!instrs) {
+			ERROR_MSG("out of memory growing instrs to %u", size);
+			abort();
+		}
+		shader->instrs = instrs;
+		shader->instrs_size = size;
+	}
 	shader->instrs[shader->instrs_count++] = instr;
 	return instr;
 }
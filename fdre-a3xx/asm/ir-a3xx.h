@@ -174,14 +174,14 @@ struct ir3_out {
 	int num;                      /* number of registers */
 };
 
-/* this is just large to cope w/ the large test *.asm: */
-#define MAX_INSTRS 10240
+struct ir3_heap_chunk;
 
 struct ir3_shader {
-	unsigned instrs_count;
-	struct ir3_instruction *instrs[MAX_INSTRS];
-	uint32_t heap[128 * MAX_INSTRS];
-	unsigned heap_idx;
+	unsigned instrs_count, instrs_size;
+	struct ir3_instruction **instrs;
+
+	/* everything else is allocated from the heap, see ir3_alloc(): */
+	struct ir3_heap_chunk *heap;
 
 	/* @ headers: */
 	uint32_t attributes_count;
@@ -209,11 +209,80 @@ struct ir3_shader {
 	struct ir3_out *outs[MAX_OUTS];
 };
 
+/* Bump whenever a change to the encoder or to ir3_shader_compact() changes
+ * the binary produced for a given source.  It is part of the key for
+ * cached binaries (see program.c), so ones from an older assembler are
+ * not picked up:
+ */
+#define IR3_ASM_VERSION 1
+
 struct ir3_shader * ir3_shader_create(void);
 void ir3_shader_destroy(struct ir3_shader *shader);
 int ir3_shader_assemble(struct ir3_shader *shader,
 		uint32_t *dwords, uint32_t sizedwords,
 		struct ir3_shader_info *info);
+int ir3_shader_assemble_ref(struct ir3_shader *shader,
+		uint32_t *dwords, uint32_t sizedwords,
+		struct ir3_shader_info *info);
+int ir3_shader_encode(struct ir3_shader *shader, uint32_t *dwords,
+		struct ir3_shader_info *info);
+
+/* optional peephole pass (compact-a3xx.c), to run before assembling, which
+ * folds nop runs and drops redundant sync flags.  Returns the resulting
+ * instruction count:
+ */
+int ir3_shader_compact(struct ir3_shader *shader);
+
+/* static analysis report (stats-a3xx.c).  Register pressure is counted
+ * in scalar components, and the cycle counts are rough estimates:
+ */
+struct ir3_shader_stats {
+	uint32_t instrs;             /* not counting (rptN) */
+	uint32_t nops;               /* counting (rptN) */
+	uint32_t instrs_per_cat[7];
+	uint32_t cycles_per_cat[7];
+	uint32_t alu_cycles;         /* cat0-cat4 */
+	uint32_t mem_cycles;         /* cat5 (tex) and cat6 (mem) */
+	uint32_t tex_fetches;
+	uint32_t mem_accesses;
+	uint32_t sy, ss, jp;         /* sync points, and branch targets */
+	uint32_t max_live_full, max_live_half;
+	uint16_t *live_full;         /* per instruction */
+	uint16_t *live_half;
+};
+
+int ir3_shader_stats(struct ir3_shader *shader, struct ir3_shader_stats *stats);
+void ir3_shader_stats_fini(struct ir3_shader_stats *stats);
+
+/* CPU simulator (sim-a3xx.c), which runs invocations in batches of
+ * IR3_SIM_LANES.  Register numbers are as in ir3_register (ie. rN.c is
+ * (N << 2) | c), and the lane callbacks are called per lane before and
+ * after each batch runs, to set up the inputs and collect the outputs:
+ */
+#define IR3_SIM_LANES 16
+
+struct ir3_sim;
+
+typedef void (*ir3_sim_lane_t)(struct ir3_sim *sim, unsigned lane,
+		uint32_t invocation, void *priv);
+typedef void (*ir3_sim_sample_t)(void *priv, unsigned tex, unsigned samp,
+		opc_t opc, const float *coord, unsigned ncoord, float *texel);
+
+struct ir3_sim * ir3_sim_create(struct ir3_shader *shader);
+void ir3_sim_destroy(struct ir3_sim *sim);
+void ir3_sim_set_const(struct ir3_sim *sim, int num, uint32_t val);
+int ir3_sim_map_buf(struct ir3_sim *sim, const char *name,
+		void *ptr, uint32_t size);
+void ir3_sim_set_sampler(struct ir3_sim *sim, ir3_sim_sample_t sample,
+		void *priv);
+uint32_t ir3_sim_get_reg(struct ir3_sim *sim, unsigned lane, int num, bool half);
+void ir3_sim_set_reg(struct ir3_sim *sim, unsigned lane, int num, bool half,
+		uint32_t val);
+void ir3_sim_set_input(struct ir3_sim *sim, unsigned lane, int inloc,
+		uint32_t val);
+bool ir3_sim_killed(struct ir3_sim *sim, unsigned lane);
+int ir3_sim_run(struct ir3_sim *sim, uint32_t first, uint32_t count,
+		ir3_sim_lane_t setup, ir3_sim_lane_t finish, void *priv);
 
 struct ir3_attribute * ir3_attribute_create(struct ir3_shader *shader,
 		int rstart, int num, const char *name);
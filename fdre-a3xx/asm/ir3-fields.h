@@ -0,0 +1,165 @@
+/* generated by gen-ir3-fields from instr-a3xx.h, do not edit! */
+
+#ifndef IR3_FIELDS_H_
+#define IR3_FIELDS_H_
+
+/* each field is: shift, bits */
+
+#define CAT0_IMMED                0, 16
+#define CAT0_REPEAT              40,  3
+#define CAT0_SS                  44,  1
+#define CAT0_INV                 52,  1
+#define CAT0_COMP                53,  2
+#define CAT0_OPC                 55,  4
+#define CAT0_JMP_TGT             59,  1
+#define CAT0_SYNC                60,  1
+#define CAT0_OPC_CAT             61,  3
+
+#define CAT1_SRC                  0, 11
+#define CAT1_OFF                  0, 10
+#define CAT1_SRC_REL_C           10,  1
+#define CAT1_SRC_REL             11,  1
+#define CAT1_IIM_VAL              0, 32
+#define CAT1_DST                 32,  8
+#define CAT1_REPEAT              40,  3
+#define CAT1_SRC_R               43,  1
+#define CAT1_SS                  44,  1
+#define CAT1_UL                  45,  1
+#define CAT1_DST_TYPE            46,  3
+#define CAT1_DST_REL             49,  1
+#define CAT1_SRC_TYPE            50,  3
+#define CAT1_SRC_C               53,  1
+#define CAT1_SRC_IM              54,  1
+#define CAT1_EVEN                55,  1
+#define CAT1_POS_INF             56,  1
+#define CAT1_JMP_TGT             59,  1
+#define CAT1_SYNC                60,  1
+#define CAT1_OPC_CAT             61,  3
+
+#define CAT2_SRC1                 0, 11
+#define CAT2_SRC1_IM             13,  1
+#define CAT2_SRC1_NEG            14,  1
+#define CAT2_SRC1_ABS            15,  1
+#define CAT2_REL1_SRC1            0, 10
+#define CAT2_REL1_SRC1_C         10,  1
+#define CAT2_REL1_SRC1_REL       11,  1
+#define CAT2_C1_SRC1              0, 12
+#define CAT2_C1_SRC1_C           12,  1
+#define CAT2_SRC2                16, 11
+#define CAT2_SRC2_IM             29,  1
+#define CAT2_SRC2_NEG            30,  1
+#define CAT2_SRC2_ABS            31,  1
+#define CAT2_REL2_SRC2           16, 10
+#define CAT2_REL2_SRC2_C         26,  1
+#define CAT2_REL2_SRC2_REL       27,  1
+#define CAT2_C2_SRC2             16, 12
+#define CAT2_C2_SRC2_C           28,  1
+#define CAT2_DST                 32,  8
+#define CAT2_REPEAT              40,  2
+#define CAT2_SRC1_R              43,  1
+#define CAT2_SS                  44,  1
+#define CAT2_UL                  45,  1
+#define CAT2_DST_HALF            46,  1
+#define CAT2_EI                  47,  1
+#define CAT2_COND                48,  3
+#define CAT2_SRC2_R              51,  1
+#define CAT2_FULL                52,  1
+#define CAT2_OPC                 53,  6
+#define CAT2_JMP_TGT             59,  1
+#define CAT2_SYNC                60,  1
+#define CAT2_OPC_CAT             61,  3
+
+#define CAT3_SRC1                 0, 11
+#define CAT3_SRC1_NEG            14,  1
+#define CAT3_REL1_SRC1            0, 10
+#define CAT3_REL1_SRC1_C         10,  1
+#define CAT3_REL1_SRC1_REL       11,  1
+#define CAT3_C1_SRC1              0, 12
+#define CAT3_C1_SRC1_C           12,  1
+#define CAT3_SRC2                47,  8
+#define CAT3_SRC2_C              13,  1
+#define CAT3_SRC2_NEG            30,  1
+#define CAT3_SRC2_R              15,  1
+#define CAT3_SRC3                16, 11
+#define CAT3_SRC3_NEG            31,  1
+#define CAT3_SRC3_R              29,  1
+#define CAT3_REL2_SRC3           16, 10
+#define CAT3_REL2_SRC3_C         26,  1
+#define CAT3_REL2_SRC3_REL       27,  1
+#define CAT3_C2_SRC3             16, 12
+#define CAT3_C2_SRC3_C           28,  1
+#define CAT3_DST                 32,  8
+#define CAT3_REPEAT              40,  2
+#define CAT3_SRC1_R              43,  1
+#define CAT3_SS                  44,  1
+#define CAT3_UL                  45,  1
+#define CAT3_DST_HALF            46,  1
+#define CAT3_OPC                 55,  4
+#define CAT3_JMP_TGT             59,  1
+#define CAT3_SYNC                60,  1
+#define CAT3_OPC_CAT             61,  3
+
+#define CAT4_SRC                  0, 11
+#define CAT4_SRC_IM              13,  1
+#define CAT4_SRC_NEG             14,  1
+#define CAT4_SRC_ABS             15,  1
+#define CAT4_REL_SRC              0, 10
+#define CAT4_REL_SRC_C           10,  1
+#define CAT4_REL_SRC_REL         11,  1
+#define CAT4_C_SRC                0, 12
+#define CAT4_C_SRC_C             12,  1
+#define CAT4_DST                 32,  8
+#define CAT4_REPEAT              40,  2
+#define CAT4_SRC_R               43,  1
+#define CAT4_SS                  44,  1
+#define CAT4_UL                  45,  1
+#define CAT4_DST_HALF            46,  1
+#define CAT4_FULL                52,  1
+#define CAT4_OPC                 53,  6
+#define CAT4_JMP_TGT             59,  1
+#define CAT4_SYNC                60,  1
+#define CAT4_OPC_CAT             61,  3
+
+#define CAT5_FULL                 0,  1
+#define CAT5_SRC1                 1,  8
+#define CAT5_NORM_SRC2            9,  8
+#define CAT5_NORM_SAMP           21,  4
+#define CAT5_NORM_TEX            25,  7
+#define CAT5_S2EN_SRC2            9, 11
+#define CAT5_S2EN_SRC3           21,  8
+#define CAT5_DST                 32,  8
+#define CAT5_WRMASK              40,  4
+#define CAT5_TYPE                44,  3
+#define CAT5_IS_3D               48,  1
+#define CAT5_IS_A                49,  1
+#define CAT5_IS_S                50,  1
+#define CAT5_IS_S2EN             51,  1
+#define CAT5_IS_O                52,  1
+#define CAT5_IS_P                53,  1
+#define CAT5_OPC                 54,  5
+#define CAT5_JMP_TGT             59,  1
+#define CAT5_SYNC                60,  1
+#define CAT5_OPC_CAT             61,  3
+
+#define CAT6_SRC_OFF              0,  1
+#define CAT6_DST_OFF             40,  1
+#define CAT6_TYPE                49,  3
+#define CAT6_G                   52,  1
+#define CAT6_OPC                 54,  5
+#define CAT6_JMP_TGT             59,  1
+#define CAT6_SYNC                60,  1
+#define CAT6_OPC_CAT             61,  3
+#define CAT6A_OFF                 1, 13
+#define CAT6A_SRC1               14,  8
+#define CAT6A_SRC1_IM            22,  1
+#define CAT6A_SRC2_IM            23,  1
+#define CAT6A_SRC2               24,  8
+#define CAT6B_SRC1                1, 13
+#define CAT6B_SRC1_IM            22,  1
+#define CAT6B_SRC2_IM            23,  1
+#define CAT6B_SRC2               24,  8
+#define CAT6C_OFF                32,  8
+#define CAT6C_DST                41,  8
+#define CAT6D_DST                32,  8
+
+#endif /* IR3_FIELDS_H_ */
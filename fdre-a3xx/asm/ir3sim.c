@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "ir-a3xx.h"
+#include "util.h"
+#include "fnv.h"
+
+/*
+ * Runs a shader on the CPU simulator (sim-a3xx.c), and prints a checksum
+ * of the results, so the output of an assembler change can be compared
+ * against the output before the change (and with -v, the results
+ * themselves).  There are two modes:
+ *
+ *   ./ir3sim [-n count] shader.asm
+ *
+ * runs count invocations, with pseudo-random (but deterministic) values
+ * in the @attribute registers and the bary.f inputs.  The results are the
+ * @out's, plus the @varying's for a shader with attributes.
+ *
+ *   ./ir3sim -g x[,y[,z]] -l x[,y[,z]] -b name:count[:val] kernel.asm
+ *
+ * runs a compute kernel over a global grid, one workgroup at a time.  The
+ * kernel inputs follow what tests/compute-simple.c shows about them:
+ * r0.xyz is the local id, c2.yzw the offset of the workgroup in the grid,
+ * and c4.z the number of dimensions.  Each -b allocates count dwords for
+ * an @buf, filled with val, or with the dword index if no val.  The
+ * results are the contents of the bufs, and '-x a=b' checks that buf a
+ * ends up the same as buf b.
+ *
+ * Consts can be set with '-c c0.x=1.0' (a float) or '-c c0.x=0x10' (an
+ * integer), and '-r n' repeats the whole run, for timing.
+ */
+
+#define MAX_BUFS_ARG 16
+
+struct buf {
+	const char *name;
+	uint32_t *data;
+	uint32_t count;
+};
+
+static struct ir3_shader *shader;
+static struct buf bufs[MAX_BUFS_ARG];
+static int nbufs;
+static uint32_t local[3] = {1, 1, 1};
+static uint32_t global[3] = {1, 1, 1};
+static uint32_t workdim;
+static int verbose;
+static uint32_t checksum;
+
+static char * read_file(const char *infile)
+{
+	struct stat st;
+	char *src;
+	int fd, ret;
+
+	fd = open(infile, O_RDONLY);
+	if (fd < 0) {
+		ERROR_MSG("could not open '%s': %s", infile, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st)) {
+		ERROR_MSG("could not stat '%s': %s", infile, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	src = malloc(st.st_size + 1);
+	ret = read(fd, src, st.st_size);
+	close(fd);
+
+	if (ret != st.st_size) {
+		ERROR_MSG("could not read '%s': %s", infile, strerror(errno));
+		free(src);
+		return NULL;
+	}
+	src[ret] = '\0';
+
+	return src;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static float uif(uint32_t u)
+{
+	union { float f; uint32_t u; } x = { .u = u };
+	return x.f;
+}
+
+static void hash(uint32_t val)
+{
+	checksum = fnv32(checksum, &val, sizeof(val));
+}
+
+/* input values, in [0.0, 1.0): */
+static uint32_t input(uint32_t invocation, int n)
+{
+	return fui((float)(((invocation * 7) + (n * 13)) % 64) / 64.0);
+}
+
+/* "rN.c" or "cN.c", to a register number: */
+static int parse_reg(const char *s, char prefix, int *num)
+{
+	static const char comps[] = "xyzw";
+	char *end;
+	long n;
+
+	if (*s++ != prefix)
+		return -1;
+	n = strtol(s, &end, 10);
+	if ((end == s) || (end[0] != '.') || !end[1] || !strchr(comps, end[1]))
+		return -1;
+	*num = (n << 2) | (strchr(comps, end[1]) - comps);
+	return 0;
+}
+
+static uint32_t parse_val(const char *s)
+{
+	if (strchr(s, '.'))
+		return fui(strtof(s, NULL));
+	return strtoul(s, NULL, 0);
+}
+
+static int parse_size(const char *s, uint32_t *size)
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		char *end;
+		size[i] = strtoul(s, &end, 0);
+		if ((end == s) || !size[i])
+			return -1;
+		if (!*end)
+			return i + 1;
+		if (*end != ',')
+			return -1;
+		s = end + 1;
+	}
+
+	return -1;
+}
+
+static struct buf * find_buf(const char *name)
+{
+	int i;
+	for (i = 0; i < nbufs; i++)
+		if (!strcmp(bufs[i].name, name))
+			return &bufs[i];
+	return NULL;
+}
+
+/* default sampler, returns the coords, for something to look at: */
+static void sample(void *priv, unsigned tex, unsigned samp, opc_t opc,
+		const float *coord, unsigned ncoord, float *texel)
+{
+	texel[0] = (ncoord > 0) ? coord[0] : 0.0;
+	texel[1] = (ncoord > 1) ? coord[1] : 0.0;
+	texel[2] = 0.5;
+	texel[3] = 1.0;
+}
+
+static void setup_vertex(struct ir3_sim *sim, unsigned lane,
+		uint32_t invocation, void *priv)
+{
+	uint32_t i;
+	int j, n = 0;
+
+	for (i = 0; i < shader->attributes_count; i++) {
+		struct ir3_attribute *a = shader->attributes[i];
+		bool half = !!(a->rstart->flags & IR3_REG_HALF);
+		for (j = 0; j < a->num; j++) {
+			uint32_t val = input(invocation, n++);
+			if (half)
+				val = util_float_to_half(uif(val));
+			ir3_sim_set_reg(sim, lane, a->rstart->num + j, half, val);
+		}
+	}
+
+	for (j = 0; j < 4 * 32; j++)
+		ir3_sim_set_input(sim, lane, j, input(invocation, n++));
+}
+
+static void dump_regs(struct ir3_sim *sim, unsigned lane, uint32_t invocation,
+		const char *name, struct ir3_register *rstart, int num)
+{
+	bool half = !!(rstart->flags & IR3_REG_HALF);
+	int j;
+
+	if (verbose)
+		printf("%5u: %-16s", invocation, name);
+
+	for (j = 0; j < num; j++) {
+		uint32_t val = ir3_sim_get_reg(sim, lane, rstart->num + j, half);
+		hash(val);
+		if (verbose) {
+			if (half)
+				printf(" %04x", val);
+			else
+				printf(" %f", uif(val));
+		}
+	}
+
+	if (verbose)
+		printf("\n");
+}
+
+static void finish_vertex(struct ir3_sim *sim, unsigned lane,
+		uint32_t invocation, void *priv)
+{
+	uint32_t i;
+
+	if (ir3_sim_killed(sim, lane)) {
+		hash(~0);
+		if (verbose)
+			printf("%5u: killed\n", invocation);
+		return;
+	}
+
+	for (i = 0; i < shader->outs_count; i++) {
+		struct ir3_out *o = shader->outs[i];
+		dump_regs(sim, lane, invocation, o->name, o->rstart, max(o->num, 1));
+	}
+
+	if (shader->attributes_count) {
+		for (i = 0; i < shader->varyings_count; i++) {
+			struct ir3_varying *v = shader->varyings[i];
+			dump_regs(sim, lane, invocation, v->name, v->rstart, v->num);
+		}
+	}
+}
+
+static void setup_compute(struct ir3_sim *sim, unsigned lane,
+		uint32_t invocation, void *priv)
+{
+	ir3_sim_set_reg(sim, lane, 0, false, invocation % local[0]);
+	ir3_sim_set_reg(sim, lane, 1, false, (invocation / local[0]) % local[1]);
+	ir3_sim_set_reg(sim, lane, 2, false, invocation / (local[0] * local[1]));
+}
+
+static int run_compute(struct ir3_sim *sim)
+{
+	uint32_t g[3], n = local[0] * local[1] * local[2];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		if (global[i] % local[i]) {
+			ERROR_MSG("global size not a multiple of local size");
+			return -1;
+		}
+	}
+
+	for (g[2] = 0; g[2] < global[2]; g[2] += local[2]) {
+		for (g[1] = 0; g[1] < global[1]; g[1] += local[1]) {
+			for (g[0] = 0; g[0] < global[0]; g[0] += local[0]) {
+				for (i = 0; i < 3; i++)
+					ir3_sim_set_const(sim, (2 << 2) + 1 + i, g[i]);
+				if (ir3_sim_run(sim, 0, n, setup_compute, NULL, NULL))
+					return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	ERROR_MSG("usage: %s [-v] [-n count] [-r repeat] [-c cN.c=val]... "
+			"[-g x,y,z -l x,y,z] [-b name:count[:val]]... [-x buf=buf]... "
+			"infile", name);
+}
+
+int main(int argc, char **argv)
+{
+	const char *consts[64], *checks[16];
+	int nconsts = 0, nchecks = 0;
+	uint32_t count = 1024, repeat = 1, r;
+	int i, ret = 0;
+	struct ir3_sim *sim;
+	double start, t;
+	char *src;
+
+	while ((argc >= 2) && (argv[1][0] == '-')) {
+		if (!strcmp(argv[1], "-v")) {
+			verbose = 1;
+			argc -= 1;
+			argv += 1;
+			continue;
+		}
+
+		if (argc < 3)
+			break;
+
+		if (!strcmp(argv[1], "-n")) {
+			count = strtoul(argv[2], NULL, 0);
+		} else if (!strcmp(argv[1], "-r")) {
+			repeat = strtoul(argv[2], NULL, 0);
+		} else if (!strcmp(argv[1], "-c") && (nconsts < (int)ARRAY_SIZE(consts))) {
+			consts[nconsts++] = argv[2];
+		} else if (!strcmp(argv[1], "-x") && (nchecks < (int)ARRAY_SIZE(checks))) {
+			checks[nchecks++] = argv[2];
+		} else if (!strcmp(argv[1], "-g")) {
+			int n = parse_size(argv[2], global);
+			if (n < 0) {
+				ERROR_MSG("invalid size: %s", argv[2]);
+				return -1;
+			}
+			workdim = n;
+		} else if (!strcmp(argv[1], "-l")) {
+			if (parse_size(argv[2], local) < 0) {
+				ERROR_MSG("invalid size: %s", argv[2]);
+				return -1;
+			}
+		} else if (!strcmp(argv[1], "-b") && (nbufs < MAX_BUFS_ARG)) {
+			struct buf *b = &bufs[nbufs++];
+			char *s = strdup(argv[2]), *c = strchr(s, ':');
+			uint32_t j;
+
+			if (!c) {
+				ERROR_MSG("invalid buf: %s", argv[2]);
+				return -1;
+			}
+			*c++ = '\0';
+			b->name = s;
+			b->count = strtoul(c, &c, 0);
+			b->data = calloc(max(b->count, 1), 4);
+			for (j = 0; j < b->count; j++)
+				b->data[j] = (*c == ':') ? strtoul(c + 1, NULL, 0) : j;
+		} else {
+			break;
+		}
+
+		argc -= 2;
+		argv += 2;
+	}
+
+	if ((argc != 2) || (argv[1][0] == '-')) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	src = read_file(argv[1]);
+	if (!src)
+		return -1;
+
+	shader = fd_asm_parse(src);
+	free(src);
+	if (!shader) {
+		ERROR_MSG("parse failed");
+		return -1;
+	}
+
+	sim = ir3_sim_create(shader);
+	if (!sim) {
+		ERROR_MSG("could not create simulator");
+		return -1;
+	}
+
+	ir3_sim_set_sampler(sim, sample, NULL);
+
+	if (workdim)
+		ir3_sim_set_const(sim, (4 << 2) + 2, workdim);
+
+	for (i = 0; i < nconsts; i++) {
+		char *eq = strchr(consts[i], '=');
+		int num;
+
+		if (!eq || parse_reg(consts[i], 'c', &num)) {
+			ERROR_MSG("invalid const: %s", consts[i]);
+			return -1;
+		}
+		ir3_sim_set_const(sim, num, parse_val(eq + 1));
+	}
+
+	for (i = 0; i < nbufs; i++)
+		if (ir3_sim_map_buf(sim, bufs[i].name, bufs[i].data, bufs[i].count * 4))
+			return -1;
+
+	if (workdim)
+		count = global[0] * global[1] * global[2];
+
+	start = now();
+
+	for (r = 0; r < repeat; r++) {
+		/* only the last run is looked at: */
+		int v = verbose;
+
+		if (r != (repeat - 1))
+			verbose = 0;
+		checksum = FNV32_INIT;
+
+		if (workdim)
+			ret = run_compute(sim);
+		else
+			ret = ir3_sim_run(sim, 0, count, setup_vertex, finish_vertex, NULL);
+
+		verbose = v;
+
+		if (ret) {
+			ERROR_MSG("simulation failed");
+			return -1;
+		}
+	}
+
+	t = now() - start;
+
+	for (i = 0; i < nbufs; i++) {
+		uint32_t j;
+
+		for (j = 0; j < bufs[i].count; j++) {
+			hash(bufs[i].data[j]);
+			if (verbose)
+				printf("%s[%u]: %08x\n", bufs[i].name, j, bufs[i].data[j]);
+		}
+	}
+
+	printf("%u invocations x %u, %.3f ms (%.2f Minvocations/s)\n",
+			count, repeat, t * 1000.0,
+			(double)count * repeat / t / 1000000.0);
+	printf("checksum: %08x\n", checksum);
+
+	for (i = 0; i < nchecks; i++) {
+		char *a = strdup(checks[i]), *eq = strchr(a, '=');
+		struct buf *ba, *bb;
+
+		if (eq)
+			*eq++ = '\0';
+
+		ba = find_buf(a);
+		bb = eq ? find_buf(eq) : NULL;
+
+		if (!ba || !bb) {
+			ERROR_MSG("invalid check: %s", checks[i]);
+			ret = -1;
+		} else if ((ba->count != bb->count) ||
+				memcmp(ba->data, bb->data, ba->count * 4)) {
+			ERROR_MSG("%s does not match %s", ba->name, bb->name);
+			ret = -1;
+		}
+
+		free(a);
+	}
+
+	ir3_sim_destroy(sim);
+	ir3_shader_destroy(shader);
+
+	return ret;
+}
@@ -30,68 +30,403 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "ir-a3xx.h"
 #include "util.h"
+#include "read-file.h"
 
-int main(int argc, char **argv)
+/*
+ * In batch mode, many files are assembled by one process, and the output
+ * files are written by a pool of writer threads.  Parsing itself stays on
+ * the main thread, to keep the output order deterministic (the parser is
+ * reentrant, see stress.c).
+ */
+
+struct job {
+	struct job *next;
+	char *outfile;
+	uint32_t *dwords;
+	int sizedwords;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct job *head, **tail;
+	int nthreads, done, errors;
+	pthread_t threads[16];
+} writer = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.tail = &writer.head,
+};
+
+static int write_file(const char *outfile, uint32_t *dwords, int sizedwords)
 {
-	struct ir3_shader *shader;
-	struct ir3_shader_info info;
-	static char src[256 * 1024];
-	static uint32_t dwords[64 * 1024];
-	static int sizedwords;
-	char *infile, *outfile;
 	int fd, ret;
 
-	if (argc != 3) {
-		ERROR_MSG("usage: %s [infile] [outfile]", argv[0]);
+	fd = open(outfile, O_WRONLY| O_TRUNC | O_CREAT, 0644);
+	if (fd < 0) {
+		ERROR_MSG("could not open '%s': %s", outfile, strerror(errno));
 		return -1;
 	}
 
-	infile = argv[1];
-	outfile = argv[2];
-
-	fd = open(infile, O_RDONLY);
-	if (fd < 0) {
-		ERROR_MSG("could not open '%s': %s", infile, strerror(errno));
+	ret = write(fd, dwords, sizedwords * 4);
+	close(fd);
+	if (ret != (sizedwords * 4)) {
+		ERROR_MSG("could not write '%s': %s", outfile, strerror(errno));
 		return -1;
 	}
 
-	ret = read(fd, src, sizeof(src) - 1);
-	if (ret <= 0) {
-		ERROR_MSG("could not read '%s': %s", infile, strerror(errno));
-		return -1;
+	return 0;
+}
+
+static void * writer_thread(void *arg)
+{
+	pthread_mutex_lock(&writer.lock);
+	while (1) {
+		struct job *job = writer.head;
+
+		if (!job) {
+			if (writer.done)
+				break;
+			pthread_cond_wait(&writer.cond, &writer.lock);
+			continue;
+		}
+
+		writer.head = job->next;
+		if (!writer.head)
+			writer.tail = &writer.head;
+		pthread_mutex_unlock(&writer.lock);
+
+		if (write_file(job->outfile, job->dwords, job->sizedwords)) {
+			pthread_mutex_lock(&writer.lock);
+			writer.errors++;
+			pthread_mutex_unlock(&writer.lock);
+		}
+
+		free(job->outfile);
+		free(job->dwords);
+		free(job);
+
+		pthread_mutex_lock(&writer.lock);
 	}
-	printf("parsing:\n%s\n", src);
+	pthread_mutex_unlock(&writer.lock);
 
-	close(fd);
+	return NULL;
+}
+
+static void writer_init(int nthreads)
+{
+	int i;
+
+	if (nthreads > (int)ARRAY_SIZE(writer.threads)) {
+		WARN_MSG("only %d writer threads supported, not %d",
+				(int)ARRAY_SIZE(writer.threads), nthreads);
+		nthreads = ARRAY_SIZE(writer.threads);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&writer.threads[i], NULL, writer_thread, NULL))
+			break;
+		writer.nthreads++;
+	}
+}
+
+/* takes ownership of dwords: */
+static int writer_queue(const char *outfile, uint32_t *dwords, int sizedwords)
+{
+	struct job *job;
+
+	if (!writer.nthreads) {
+		int ret = write_file(outfile, dwords, sizedwords);
+		free(dwords);
+		return ret;
+	}
+
+	job = calloc(1, sizeof(*job));
+	job->outfile = strdup(outfile);
+	job->dwords = dwords;
+	job->sizedwords = sizedwords;
+
+	pthread_mutex_lock(&writer.lock);
+	*writer.tail = job;
+	writer.tail = &job->next;
+	pthread_cond_signal(&writer.cond);
+	pthread_mutex_unlock(&writer.lock);
+
+	return 0;
+}
+
+/* wait for all queued writes, returns number of failed writes: */
+static int writer_fini(void)
+{
+	int i;
+
+	pthread_mutex_lock(&writer.lock);
+	writer.done = 1;
+	pthread_cond_broadcast(&writer.cond);
+	pthread_mutex_unlock(&writer.lock);
+
+	for (i = 0; i < writer.nthreads; i++)
+		pthread_join(writer.threads[i], NULL);
+
+	return writer.errors;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* run the nop/sync-flag compaction pass (-c): */
+static int compact;
+
+/*
+ * Per-file output (compaction, timing, etc) is collected in a memstream
+ * and printed in one go under report_lock, so the lines for one file are
+ * never split up by output for another:
+ */
+struct report {
+	FILE *out;
+	char *buf;
+	size_t len;
+};
+
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void report_begin(struct report *r)
+{
+	r->buf = NULL;
+	r->len = 0;
+	r->out = open_memstream(&r->buf, &r->len);
+	if (!r->out)
+		r->out = stdout;
+}
+
+static void report_end(struct report *r)
+{
+	if (r->out == stdout)
+		return;
+
+	fclose(r->out);
+
+	pthread_mutex_lock(&report_lock);
+	fwrite(r->buf, 1, r->len, stdout);
+	fflush(stdout);
+	pthread_mutex_unlock(&report_lock);
+
+	free(r->buf);
+}
+
+/* print the static analysis report (--stats): */
+static int stats;
+
+/* max_reg and friends are -1 if no register of that kind is used: */
+static const char * reg_name(char *buf, size_t sz, const char *prefix, int n)
+{
+	if (n < 0)
+		return "none";
+	snprintf(buf, sz, "%s%d", prefix, n);
+	return buf;
+}
+
+static void print_stats(FILE *out, const char *name,
+		struct ir3_shader *shader, struct ir3_shader_info *info, int verbose)
+{
+	static const char *cat_names[] = {
+			"flow", "mov", "alu", "mad", "sfu", "tex", "mem",
+	};
+	struct ir3_shader_stats s;
+	char full[8], half[8], cnst[8];
+	uint32_t i;
+
+	if (ir3_shader_stats(shader, &s)) {
+		ERROR_MSG("stats failed: %s", name);
+		return;
+	}
+
+	fprintf(out, "%s: stats:\n", name);
+	fprintf(out, "  instrs:        %u (%u nop cycles)\n", s.instrs, s.nops);
+	for (i = 0; i < ARRAY_SIZE(s.instrs_per_cat); i++) {
+		fprintf(out, "  cat%u (%s):%*s %u instrs, ~%u cycles\n",
+				i, cat_names[i], (int)(4 - strlen(cat_names[i])), "",
+				s.instrs_per_cat[i], s.cycles_per_cat[i]);
+	}
+	fprintf(out, "  alu/mem:       ~%u / ~%u cycles\n",
+			s.alu_cycles, s.mem_cycles);
+	fprintf(out, "  fetches:       %u tex, %u mem\n",
+			s.tex_fetches, s.mem_accesses);
+	fprintf(out, "  sync points:   %u (sy), %u (ss), %u (jp)\n",
+			s.sy, s.ss, s.jp);
+	fprintf(out, "  peak live:     %u full, %u half components\n",
+			s.max_live_full, s.max_live_half);
+	fprintf(out, "  max reg:       full %s, half %s, const %s\n",
+			reg_name(full, sizeof(full), "r", info->max_reg),
+			reg_name(half, sizeof(half), "hr", info->max_half_reg),
+			reg_name(cnst, sizeof(cnst), "c", info->max_const));
+
+	if (verbose) {
+		fprintf(out, "  live components per instruction (full/half):\n");
+		for (i = 0; i < s.instrs; i++)
+			fprintf(out, "    %4u: %3u / %3u\n", i,
+					s.live_full[i], s.live_half[i]);
+	}
+
+	ir3_shader_stats_fini(&s);
+}
+
+static int assemble_file(const char *infile, const char *outfile, int verbose)
+{
+	struct ir3_shader *shader;
+	struct ir3_shader_info info = {0};
+	struct report r;
+	uint32_t *dwords;
+	int sizedwords;
+	double t = now();
+	char *src;
+
+	src = read_file(infile);
+	if (!src)
+		return -1;
+
+	if (verbose)
+		printf("parsing:\n%s\n", src);
 
 	shader = fd_asm_parse(src);
+	free(src);
 	if (!shader) {
-		ERROR_MSG("parse failed");
+		ERROR_MSG("parse failed: %s", infile);
 		return -1;
 	}
 
-	sizedwords = ir3_shader_assemble(shader, dwords, ARRAY_SIZE(dwords), &info);
+	report_begin(&r);
+
+	if (compact) {
+		int n = shader->instrs_count;
+		fprintf(r.out, "%s: compacted %d -> %d instrs\n", infile, n,
+				ir3_shader_compact(shader));
+	}
+
+	/* 64b per instruction, padded out to groups of four: */
+	sizedwords = 2 * ALIGN(shader->instrs_count, 4);
+	dwords = malloc(max(sizedwords, 1) * 4);
+
+	sizedwords = ir3_shader_assemble(shader, dwords, sizedwords, &info);
+	if ((sizedwords > 0) && stats)
+		print_stats(r.out, infile, shader, &info, verbose);
+	ir3_shader_destroy(shader);
 	if (sizedwords <= 0) {
-		ERROR_MSG("assembler failed");
+		report_end(&r);
+		ERROR_MSG("assembler failed: %s", infile);
+		free(dwords);
 		return -1;
 	}
 
-	fd = open(outfile, O_WRONLY| O_TRUNC | O_CREAT, 0644);
-	if (fd < 0) {
-		ERROR_MSG("could not open '%s': %s", outfile, strerror(errno));
-		return -1;
+	if (!verbose)
+		fprintf(r.out, "%s: %d instrs, %.3fms\n", infile, sizedwords / 2,
+				(now() - t) * 1000.0);
+
+	report_end(&r);
+
+	return writer_queue(outfile, dwords, sizedwords);
+}
+
+/* foo.asm -> foo.co3, same as run-tests.sh: */
+static char * outname(const char *infile)
+{
+	const char *ext = strrchr(infile, '.');
+	int len = (ext && !strcmp(ext, ".asm")) ? (ext - infile) : strlen(infile);
+	char *outfile = malloc(len + 5);
+	memcpy(outfile, infile, len);
+	strcpy(outfile + len, ".co3");
+	return outfile;
+}
+
+static void usage(const char *name)
+{
+	ERROR_MSG("usage: %s [-c] [--stats] [infile] [outfile]\n"
+			"       %s [-c] [--stats] -b [-j N] [infile...]\n"
+			"       %s [-c] [--stats] -b [-j N] -   (read 'infile [outfile]' lines from stdin)\n"
+			"  -c        fold nop runs and drop redundant (sy)/(ss) flags\n"
+			"  --stats   print register pressure, instruction counts, etc\n"
+			"  (-c and --stats can be given anywhere on the command line)",
+			name, name, name);
+}
+
+static int batch(int argc, char **argv)
+{
+	double t = now();
+	int i, n = 0, errors = 0, nthreads = 4;
+
+	if ((argc >= 2) && !strcmp(argv[0], "-j")) {
+		nthreads = strtol(argv[1], NULL, 0);
+		argc -= 2;
+		argv += 2;
 	}
 
-	ret = write(fd, dwords, sizedwords * 4);
-	if (ret <= 0) {
-		ERROR_MSG("could not write '%s': %s", outfile, strerror(errno));
-		return -1;
+	writer_init(nthreads);
+
+	if ((argc == 1) && !strcmp(argv[0], "-")) {
+		char line[1024];
+
+		while (fgets(line, sizeof(line), stdin)) {
+			char infile[512], outfile[512];
+			int ret = sscanf(line, "%511s %511s", infile, outfile);
+			if (ret < 1)
+				continue;
+			if (ret == 1) {
+				char *name = outname(infile);
+				errors += !!assemble_file(infile, name, 0);
+				free(name);
+			} else {
+				errors += !!assemble_file(infile, outfile, 0);
+			}
+			n++;
+		}
+	} else {
+		for (i = 0; i < argc; i++, n++) {
+			char *name = outname(argv[i]);
+			errors += !!assemble_file(argv[i], name, 0);
+			free(name);
+		}
 	}
 
-	ir3_shader_destroy(shader);
+	errors += writer_fini();
 
-	return 0;
+	printf("assembled %d files in %.3fms, %d errors\n", n,
+			(now() - t) * 1000.0, errors);
+
+	return errors ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int i, n = 1;
+
+	/* the flags which apply to every file can go anywhere: */
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c")) {
+			compact = 1;
+		} else if (!strcmp(argv[i], "--stats")) {
+			stats = 1;
+		} else {
+			argv[n++] = argv[i];
+		}
+	}
+	argc = n;
+
+	if ((argc >= 2) && !strcmp(argv[1], "-b"))
+		return batch(argc - 2, argv + 2);
+
+	if (argc != 3) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	return assemble_file(argv[1], argv[2], 1);
 }
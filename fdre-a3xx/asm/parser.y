@@ -32,28 +32,39 @@
 #include "ir-a3xx.h"
 #include "instr-a3xx.h"
 
-static struct ir3_shader      *shader;  /* current shader program */
-static struct ir3_instruction *instr;   /* current instruction */
+/* all parser state is kept in a parse_state, which is passed to the
+ * (pure) parser along with the (reentrant) scanner, so that multiple
+ * shaders can be assembled in parallel:
+ */
+struct parse_state {
+	struct ir3_shader      *shader;  /* current shader program */
+	struct ir3_instruction *instr;   /* current instruction */
+
+	struct {
+		unsigned flags;
+		unsigned repeat;
+	} iflags;
 
-static struct {
-	unsigned flags;
-	unsigned repeat;
-} iflags;
+	struct {
+		unsigned flags;
+		unsigned wrmask;
+	} rflags;
 
-static struct {
-	unsigned flags;
-	unsigned wrmask;
-} rflags;
+	void *scanner;
+};
 
-int asm_yyget_lineno(void);
+int asm_yyget_lineno(void *scanner);
 
-static struct ir3_instruction * new_instr(int cat, opc_t opc)
+static struct ir3_instruction * new_instr(struct parse_state *state,
+		int cat, opc_t opc)
 {
-	instr = ir3_instr_create(shader, cat, opc);
-	instr->flags = iflags.flags;
-	instr->repeat = iflags.repeat;
-	instr->line = asm_yyget_lineno();
-	iflags.flags = iflags.repeat = 0;
+	struct ir3_instruction *instr;
+	instr = ir3_instr_create(state->shader, cat, opc);
+	instr->flags = state->iflags.flags;
+	instr->repeat = state->iflags.repeat;
+	instr->line = asm_yyget_lineno(state->scanner);
+	state->iflags.flags = state->iflags.repeat = 0;
+	state->instr = instr;
 	return instr;
 }
 
@@ -97,46 +108,29 @@ static struct ir3_instruction * parse_type_type(struct ir3_instruction *instr,
 	return instr;
 }
 
-static struct ir3_register * new_reg(int num, unsigned flags)
+static struct ir3_register * new_reg(struct parse_state *state,
+		int num, unsigned flags)
 {
 	struct ir3_register *reg;
-	flags |= rflags.flags;
+	flags |= state->rflags.flags;
 	if (num & 0x1)
 		flags |= IR3_REG_HALF;
-	reg = ir3_reg_create(instr, num>>1, flags);
-	reg->wrmask = rflags.wrmask;
-	rflags.flags = rflags.wrmask = 0;
+	reg = ir3_reg_create(state->instr, num>>1, flags);
+	reg->wrmask = state->rflags.wrmask;
+	state->rflags.flags = state->rflags.wrmask = 0;
 	return reg;
 }
 
-#ifdef YYDEBUG
-int yydebug;
-#endif
-
-extern int yylex(void);
 typedef void *YY_BUFFER_STATE;
-extern YY_BUFFER_STATE asm_yy_scan_string(const char *);
-extern void asm_yy_delete_buffer(YY_BUFFER_STATE);
-
-int yyparse(void);
-
-void yyerror(const char *error)
-{
-	fprintf(stderr, "error at line %d: %s\n", asm_yyget_lineno(), error);
-}
+extern int asm_yylex_init(void **scanner);
+extern int asm_yylex_destroy(void *scanner);
+extern YY_BUFFER_STATE asm_yy_scan_string(const char *, void *scanner);
+extern void asm_yy_delete_buffer(YY_BUFFER_STATE, void *scanner);
+extern void asm_yyset_lineno(int, void *scanner);
 
-struct ir3_shader * fd_asm_parse(const char *src)
+void yyerror(void *scanner, struct parse_state *state, const char *error)
 {
-	YY_BUFFER_STATE buffer = asm_yy_scan_string(src);
-#ifdef YYDEBUG
-	yydebug = 1;
-#endif
-	if (yyparse()) {
-		ir3_shader_destroy(shader);
-		shader = NULL;
-	}
-	asm_yy_delete_buffer(buffer);
-	return shader;
+	fprintf(stderr, "error at line %d: %s\n", asm_yyget_lineno(scanner), error);
 }
 %}
 
@@ -161,8 +155,19 @@ static void print_token(FILE *file, int type, YYSTYPE value)
 }
 
 #define YYPRINT(file, type, value) print_token(file, type, value)
+
+extern int yylex(YYSTYPE *lval, void *scanner);
 %}
 
+%code requires {
+struct parse_state;
+}
+
+%define api.pure
+%lex-param   {void *scanner}
+%parse-param {void *scanner}
+%parse-param {struct parse_state *state}
+
 %token <num> T_INT
 %token <unum> T_HEX
 %token <flt> T_FLOAT
@@ -401,7 +406,7 @@ static void print_token(FILE *file, int type, YYSTYPE value)
 
 %%
 
-shader:            { shader = ir3_shader_create(); } headers instrs
+shader:            { state->shader = ir3_shader_create(); } headers instrs
 
 headers:           
 |                  header headers
@@ -415,7 +420,7 @@ header:            attribute_header
 |                  out_header
 
 attribute_header:  T_A_ATTRIBUTE '(' reg_range ')' T_IDENTIFIER {
-                       ir3_attribute_create(shader, $3.start, $3.num, $5);
+                       ir3_attribute_create(state->shader, $3.start, $3.num, $5);
 }
 
 const_val:         T_FLOAT   { $$ = fui($1); printf("%08x\n", $$); }
@@ -424,27 +429,27 @@ const_val:         T_FLOAT   { $$ = fui($1); printf("%08x\n", $$); }
 |                  T_HEX     { $$ = $1;      printf("%08x\n", $$); }
 
 const_header:      T_A_CONST '(' T_CONSTANT ')' const_val ',' const_val ',' const_val ',' const_val {
-                       ir3_const_create(shader, $3, $5, $7, $9, $11);
+                       ir3_const_create(state->shader, $3, $5, $7, $9, $11);
 }
 
 sampler_header:    T_A_SAMPLER '(' integer ')' T_IDENTIFIER {
-                       ir3_sampler_create(shader, $3, $5);
+                       ir3_sampler_create(state->shader, $3, $5);
 }
 
 uniform_header:    T_A_UNIFORM '(' const_range ')' T_IDENTIFIER {
-                       ir3_uniform_create(shader, $3.start, $3.num, $5);
+                       ir3_uniform_create(state->shader, $3.start, $3.num, $5);
 }
 
 varying_header:    T_A_VARYING '(' reg_range ')' T_IDENTIFIER {
-                       ir3_varying_create(shader, $3.start, $3.num, $5);
+                       ir3_varying_create(state->shader, $3.start, $3.num, $5);
 }
 
 out_header:        T_A_OUT '(' reg_range ')' T_IDENTIFIER {
-                       ir3_out_create(shader, $3.start, $3.num, $5);
+                       ir3_out_create(state->shader, $3.start, $3.num, $5);
 }
 
 buf_header:        T_A_BUF '(' T_CONSTANT ')' T_IDENTIFIER {
-                       ir3_buf_create(shader, $3, $5);
+                       ir3_buf_create(state->shader, $3, $5);
 }
 
                    /* NOTE: if just single register is specified (rather than a range) assume vec4 */
@@ -454,11 +459,11 @@ reg_range:         T_REGISTER                { $$.start = $1; $$.num = 4; }
 const_range:       T_CONSTANT                { $$.start = $1; $$.num = 4; }
 |                  T_CONSTANT '-' T_CONSTANT { $$.start = $1; $$.num = 1 + ($3 >> 1) - ($1 >> 1); }
 
-iflag:             T_SY   { iflags.flags |= IR3_INSTR_SY; }
-|                  T_SS   { iflags.flags |= IR3_INSTR_SS; }
-|                  T_JP   { iflags.flags |= IR3_INSTR_JP; }
-|                  T_RPT  { iflags.repeat = $1; }
-|                  T_UL   { iflags.flags |= IR3_INSTR_UL; }
+iflag:             T_SY   { state->iflags.flags |= IR3_INSTR_SY; }
+|                  T_SS   { state->iflags.flags |= IR3_INSTR_SS; }
+|                  T_JP   { state->iflags.flags |= IR3_INSTR_JP; }
+|                  T_RPT  { state->iflags.repeat = $1; }
+|                  T_UL   { state->iflags.flags |= IR3_INSTR_UL; }
 
 iflags:
 |                  iflag iflags
@@ -474,169 +479,169 @@ instr:             iflags cat0_instr
 |                  iflags cat5_instr
 |                  iflags cat6_instr
 
-cat0_src:          '!' T_P0        { instr->cat0.inv = true; instr->cat0.comp = $2 >> 1; }
-|                  T_P0            { instr->cat0.comp = $1 >> 1; }
+cat0_src:          '!' T_P0        { state->instr->cat0.inv = true; state->instr->cat0.comp = $2 >> 1; }
+|                  T_P0            { state->instr->cat0.comp = $1 >> 1; }
 
-cat0_immed:        '#' integer     { instr->cat0.immed = $2; }
+cat0_immed:        '#' integer     { state->instr->cat0.immed = $2; }
 
-cat0_instr:        T_OP_NOP        { new_instr(0, OPC_NOP); }
-|                  T_OP_BR         { new_instr(0, OPC_BR); }    cat0_src ',' cat0_immed
-|                  T_OP_JUMP       { new_instr(0, OPC_JUMP); }  cat0_immed
-|                  T_OP_CALL       { new_instr(0, OPC_CALL); }  cat0_immed
-|                  T_OP_RET        { new_instr(0, OPC_RET); }
-|                  T_OP_KILL       { new_instr(0, OPC_KILL); }  cat0_src
-|                  T_OP_END        { new_instr(0, OPC_END); }
-|                  T_OP_EMIT       { new_instr(0, OPC_EMIT); }
-|                  T_OP_CUT        { new_instr(0, OPC_CUT); }
-|                  T_OP_CHMASK     { new_instr(0, OPC_CHMASK); }
-|                  T_OP_CHSH       { new_instr(0, OPC_CHSH); }
-|                  T_OP_FLOW_REV   { new_instr(0, OPC_FLOW_REV); }
+cat0_instr:        T_OP_NOP        { new_instr(state, 0, OPC_NOP); }
+|                  T_OP_BR         { new_instr(state, 0, OPC_BR); }    cat0_src ',' cat0_immed
+|                  T_OP_JUMP       { new_instr(state, 0, OPC_JUMP); }  cat0_immed
+|                  T_OP_CALL       { new_instr(state, 0, OPC_CALL); }  cat0_immed
+|                  T_OP_RET        { new_instr(state, 0, OPC_RET); }
+|                  T_OP_KILL       { new_instr(state, 0, OPC_KILL); }  cat0_src
+|                  T_OP_END        { new_instr(state, 0, OPC_END); }
+|                  T_OP_EMIT       { new_instr(state, 0, OPC_EMIT); }
+|                  T_OP_CUT        { new_instr(state, 0, OPC_CUT); }
+|                  T_OP_CHMASK     { new_instr(state, 0, OPC_CHMASK); }
+|                  T_OP_CHSH       { new_instr(state, 0, OPC_CHSH); }
+|                  T_OP_FLOW_REV   { new_instr(state, 0, OPC_FLOW_REV); }
 
 cat1_opc:          T_OP_MOVA {
-                       new_instr(1, 0);
-                       instr->cat1.src_type = TYPE_S16;
-                       instr->cat1.dst_type = TYPE_S16;
+                       new_instr(state, 1, 0);
+                       state->instr->cat1.src_type = TYPE_S16;
+                       state->instr->cat1.dst_type = TYPE_S16;
 }
 |                  T_OP_MOV '.' T_CAT1_TYPE_TYPE {
-                       parse_type_type(new_instr(1, 0), $3);
+                       parse_type_type(new_instr(state, 1, 0), $3);
 }
 |                  T_OP_COV '.' T_CAT1_TYPE_TYPE {
-                       parse_type_type(new_instr(1, 0), $3);
+                       parse_type_type(new_instr(state, 1, 0), $3);
 }
 
 cat1_instr:        cat1_opc dst_reg ',' src_reg_or_const_or_rel_or_imm
 
-cat2_opc_1src:     T_OP_ABSNEG_F  { new_instr(2, OPC_ABSNEG_F); }
-|                  T_OP_ABSNEG_S  { new_instr(2, OPC_ABSNEG_S); }
-|                  T_OP_CLZ_B     { new_instr(2, OPC_CLZ_B); }
-|                  T_OP_CLZ_S     { new_instr(2, OPC_CLZ_S); }
-|                  T_OP_SIGN_F    { new_instr(2, OPC_SIGN_F); }
-|                  T_OP_FLOOR_F   { new_instr(2, OPC_FLOOR_F); }
-|                  T_OP_CEIL_F    { new_instr(2, OPC_CEIL_F); }
-|                  T_OP_RNDNE_F   { new_instr(2, OPC_RNDNE_F); }
-|                  T_OP_RNDAZ_F   { new_instr(2, OPC_RNDAZ_F); }
-|                  T_OP_TRUNC_F   { new_instr(2, OPC_TRUNC_F); }
-|                  T_OP_NOT_B     { new_instr(2, OPC_NOT_B); }
-|                  T_OP_BFREV_B   { new_instr(2, OPC_BFREV_B); }
-|                  T_OP_SETRM     { new_instr(2, OPC_SETRM); }
-|                  T_OP_CBITS_B   { new_instr(2, OPC_CBITS_B); }
-
-cat2_opc_2src_cnd: T_OP_CMPS_F    { new_instr(2, OPC_CMPS_F); }
-|                  T_OP_CMPS_U    { new_instr(2, OPC_CMPS_U); }
-|                  T_OP_CMPS_S    { new_instr(2, OPC_CMPS_S); }
-|                  T_OP_CMPV_F    { new_instr(2, OPC_CMPV_F); }
-|                  T_OP_CMPV_U    { new_instr(2, OPC_CMPV_U); }
-|                  T_OP_CMPV_S    { new_instr(2, OPC_CMPV_S); }
-
-cat2_opc_2src:     T_OP_ADD_F     { new_instr(2, OPC_ADD_F); }
-|                  T_OP_MIN_F     { new_instr(2, OPC_MIN_F); }
-|                  T_OP_MAX_F     { new_instr(2, OPC_MAX_F); }
-|                  T_OP_MUL_F     { new_instr(2, OPC_MUL_F); }
-|                  T_OP_ADD_U     { new_instr(2, OPC_ADD_U); }
-|                  T_OP_ADD_S     { new_instr(2, OPC_ADD_S); }
-|                  T_OP_SUB_U     { new_instr(2, OPC_SUB_U); }
-|                  T_OP_SUB_S     { new_instr(2, OPC_SUB_S); }
-|                  T_OP_MIN_U     { new_instr(2, OPC_MIN_U); }
-|                  T_OP_MIN_S     { new_instr(2, OPC_MIN_S); }
-|                  T_OP_MAX_U     { new_instr(2, OPC_MAX_U); }
-|                  T_OP_MAX_S     { new_instr(2, OPC_MAX_S); }
-|                  T_OP_AND_B     { new_instr(2, OPC_AND_B); }
-|                  T_OP_OR_B      { new_instr(2, OPC_OR_B); }
-|                  T_OP_XOR_B     { new_instr(2, OPC_XOR_B); }
-|                  T_OP_MUL_U     { new_instr(2, OPC_MUL_U); }
-|                  T_OP_MUL_S     { new_instr(2, OPC_MUL_S); }
-|                  T_OP_MULL_U    { new_instr(2, OPC_MULL_U); }
-|                  T_OP_SHL_B     { new_instr(2, OPC_SHL_B); }
-|                  T_OP_SHR_B     { new_instr(2, OPC_SHR_B); }
-|                  T_OP_ASHR_B    { new_instr(2, OPC_ASHR_B); }
-|                  T_OP_BARY_F    { new_instr(2, OPC_BARY_F); }
-|                  T_OP_MGEN_B    { new_instr(2, OPC_MGEN_B); }
-|                  T_OP_GETBIT_B  { new_instr(2, OPC_GETBIT_B); }
-|                  T_OP_SHB       { new_instr(2, OPC_SHB); }
-|                  T_OP_MSAD      { new_instr(2, OPC_MSAD); }
-
-cond:              T_LT           { instr->cat2.condition = IR3_COND_LT; }
-|                  T_LE           { instr->cat2.condition = IR3_COND_LE; }
-|                  T_GT           { instr->cat2.condition = IR3_COND_GT; }
-|                  T_GE           { instr->cat2.condition = IR3_COND_GE; }
-|                  T_EQ           { instr->cat2.condition = IR3_COND_EQ; }
-|                  T_NE           { instr->cat2.condition = IR3_COND_NE; }
+cat2_opc_1src:     T_OP_ABSNEG_F  { new_instr(state, 2, OPC_ABSNEG_F); }
+|                  T_OP_ABSNEG_S  { new_instr(state, 2, OPC_ABSNEG_S); }
+|                  T_OP_CLZ_B     { new_instr(state, 2, OPC_CLZ_B); }
+|                  T_OP_CLZ_S     { new_instr(state, 2, OPC_CLZ_S); }
+|                  T_OP_SIGN_F    { new_instr(state, 2, OPC_SIGN_F); }
+|                  T_OP_FLOOR_F   { new_instr(state, 2, OPC_FLOOR_F); }
+|                  T_OP_CEIL_F    { new_instr(state, 2, OPC_CEIL_F); }
+|                  T_OP_RNDNE_F   { new_instr(state, 2, OPC_RNDNE_F); }
+|                  T_OP_RNDAZ_F   { new_instr(state, 2, OPC_RNDAZ_F); }
+|                  T_OP_TRUNC_F   { new_instr(state, 2, OPC_TRUNC_F); }
+|                  T_OP_NOT_B     { new_instr(state, 2, OPC_NOT_B); }
+|                  T_OP_BFREV_B   { new_instr(state, 2, OPC_BFREV_B); }
+|                  T_OP_SETRM     { new_instr(state, 2, OPC_SETRM); }
+|                  T_OP_CBITS_B   { new_instr(state, 2, OPC_CBITS_B); }
+
+cat2_opc_2src_cnd: T_OP_CMPS_F    { new_instr(state, 2, OPC_CMPS_F); }
+|                  T_OP_CMPS_U    { new_instr(state, 2, OPC_CMPS_U); }
+|                  T_OP_CMPS_S    { new_instr(state, 2, OPC_CMPS_S); }
+|                  T_OP_CMPV_F    { new_instr(state, 2, OPC_CMPV_F); }
+|                  T_OP_CMPV_U    { new_instr(state, 2, OPC_CMPV_U); }
+|                  T_OP_CMPV_S    { new_instr(state, 2, OPC_CMPV_S); }
+
+cat2_opc_2src:     T_OP_ADD_F     { new_instr(state, 2, OPC_ADD_F); }
+|                  T_OP_MIN_F     { new_instr(state, 2, OPC_MIN_F); }
+|                  T_OP_MAX_F     { new_instr(state, 2, OPC_MAX_F); }
+|                  T_OP_MUL_F     { new_instr(state, 2, OPC_MUL_F); }
+|                  T_OP_ADD_U     { new_instr(state, 2, OPC_ADD_U); }
+|                  T_OP_ADD_S     { new_instr(state, 2, OPC_ADD_S); }
+|                  T_OP_SUB_U     { new_instr(state, 2, OPC_SUB_U); }
+|                  T_OP_SUB_S     { new_instr(state, 2, OPC_SUB_S); }
+|                  T_OP_MIN_U     { new_instr(state, 2, OPC_MIN_U); }
+|                  T_OP_MIN_S     { new_instr(state, 2, OPC_MIN_S); }
+|                  T_OP_MAX_U     { new_instr(state, 2, OPC_MAX_U); }
+|                  T_OP_MAX_S     { new_instr(state, 2, OPC_MAX_S); }
+|                  T_OP_AND_B     { new_instr(state, 2, OPC_AND_B); }
+|                  T_OP_OR_B      { new_instr(state, 2, OPC_OR_B); }
+|                  T_OP_XOR_B     { new_instr(state, 2, OPC_XOR_B); }
+|                  T_OP_MUL_U     { new_instr(state, 2, OPC_MUL_U); }
+|                  T_OP_MUL_S     { new_instr(state, 2, OPC_MUL_S); }
+|                  T_OP_MULL_U    { new_instr(state, 2, OPC_MULL_U); }
+|                  T_OP_SHL_B     { new_instr(state, 2, OPC_SHL_B); }
+|                  T_OP_SHR_B     { new_instr(state, 2, OPC_SHR_B); }
+|                  T_OP_ASHR_B    { new_instr(state, 2, OPC_ASHR_B); }
+|                  T_OP_BARY_F    { new_instr(state, 2, OPC_BARY_F); }
+|                  T_OP_MGEN_B    { new_instr(state, 2, OPC_MGEN_B); }
+|                  T_OP_GETBIT_B  { new_instr(state, 2, OPC_GETBIT_B); }
+|                  T_OP_SHB       { new_instr(state, 2, OPC_SHB); }
+|                  T_OP_MSAD      { new_instr(state, 2, OPC_MSAD); }
+
+cond:              T_LT           { state->instr->cat2.condition = IR3_COND_LT; }
+|                  T_LE           { state->instr->cat2.condition = IR3_COND_LE; }
+|                  T_GT           { state->instr->cat2.condition = IR3_COND_GT; }
+|                  T_GE           { state->instr->cat2.condition = IR3_COND_GE; }
+|                  T_EQ           { state->instr->cat2.condition = IR3_COND_EQ; }
+|                  T_NE           { state->instr->cat2.condition = IR3_COND_NE; }
 
 cat2_instr:        cat2_opc_1src dst_reg ',' src_reg_or_const_or_rel_or_imm
 |                  cat2_opc_2src_cnd '.' cond dst_reg ',' src_reg_or_const_or_rel_or_imm ',' src_reg_or_const_or_rel_or_imm
 |                  cat2_opc_2src dst_reg ',' src_reg_or_const_or_rel_or_imm ',' src_reg_or_const_or_rel_or_imm
 
-cat3_opc:          T_OP_MAD_U16   { new_instr(3, OPC_MAD_U16); }
-|                  T_OP_MADSH_U16 { new_instr(3, OPC_MADSH_U16); }
-|                  T_OP_MAD_S16   { new_instr(3, OPC_MAD_S16); }
-|                  T_OP_MADSH_M16 { new_instr(3, OPC_MADSH_M16); }
-|                  T_OP_MAD_U24   { new_instr(3, OPC_MAD_U24); }
-|                  T_OP_MAD_S24   { new_instr(3, OPC_MAD_S24); }
-|                  T_OP_MAD_F16   { new_instr(3, OPC_MAD_F16); }
-|                  T_OP_MAD_F32   { new_instr(3, OPC_MAD_F32); }
-|                  T_OP_SEL_B16   { new_instr(3, OPC_SEL_B16); }
-|                  T_OP_SEL_B32   { new_instr(3, OPC_SEL_B32); }
-|                  T_OP_SEL_S16   { new_instr(3, OPC_SEL_S16); }
-|                  T_OP_SEL_S32   { new_instr(3, OPC_SEL_S32); }
-|                  T_OP_SEL_F16   { new_instr(3, OPC_SEL_F16); }
-|                  T_OP_SEL_F32   { new_instr(3, OPC_SEL_F32); }
-|                  T_OP_SAD_S16   { new_instr(3, OPC_SAD_S16); }
-|                  T_OP_SAD_S32   { new_instr(3, OPC_SAD_S32); }
+cat3_opc:          T_OP_MAD_U16   { new_instr(state, 3, OPC_MAD_U16); }
+|                  T_OP_MADSH_U16 { new_instr(state, 3, OPC_MADSH_U16); }
+|                  T_OP_MAD_S16   { new_instr(state, 3, OPC_MAD_S16); }
+|                  T_OP_MADSH_M16 { new_instr(state, 3, OPC_MADSH_M16); }
+|                  T_OP_MAD_U24   { new_instr(state, 3, OPC_MAD_U24); }
+|                  T_OP_MAD_S24   { new_instr(state, 3, OPC_MAD_S24); }
+|                  T_OP_MAD_F16   { new_instr(state, 3, OPC_MAD_F16); }
+|                  T_OP_MAD_F32   { new_instr(state, 3, OPC_MAD_F32); }
+|                  T_OP_SEL_B16   { new_instr(state, 3, OPC_SEL_B16); }
+|                  T_OP_SEL_B32   { new_instr(state, 3, OPC_SEL_B32); }
+|                  T_OP_SEL_S16   { new_instr(state, 3, OPC_SEL_S16); }
+|                  T_OP_SEL_S32   { new_instr(state, 3, OPC_SEL_S32); }
+|                  T_OP_SEL_F16   { new_instr(state, 3, OPC_SEL_F16); }
+|                  T_OP_SEL_F32   { new_instr(state, 3, OPC_SEL_F32); }
+|                  T_OP_SAD_S16   { new_instr(state, 3, OPC_SAD_S16); }
+|                  T_OP_SAD_S32   { new_instr(state, 3, OPC_SAD_S32); }
 
 cat3_instr:        cat3_opc dst_reg ',' src_reg_or_const_or_rel ',' src_reg_or_const ',' src_reg_or_const_or_rel
 
-cat4_opc:          T_OP_RCP       { new_instr(4, OPC_RCP); }
-|                  T_OP_RSQ       { new_instr(4, OPC_RSQ); }
-|                  T_OP_LOG2      { new_instr(4, OPC_LOG2); }
-|                  T_OP_EXP2      { new_instr(4, OPC_EXP2); }
-|                  T_OP_SIN       { new_instr(4, OPC_SIN); }
-|                  T_OP_COS       { new_instr(4, OPC_COS); }
-|                  T_OP_SQRT      { new_instr(4, OPC_SQRT); }
+cat4_opc:          T_OP_RCP       { new_instr(state, 4, OPC_RCP); }
+|                  T_OP_RSQ       { new_instr(state, 4, OPC_RSQ); }
+|                  T_OP_LOG2      { new_instr(state, 4, OPC_LOG2); }
+|                  T_OP_EXP2      { new_instr(state, 4, OPC_EXP2); }
+|                  T_OP_SIN       { new_instr(state, 4, OPC_SIN); }
+|                  T_OP_COS       { new_instr(state, 4, OPC_COS); }
+|                  T_OP_SQRT      { new_instr(state, 4, OPC_SQRT); }
 
 cat4_instr:        cat4_opc dst_reg ',' src_reg_or_const_or_rel_or_imm
 
-cat5_opc_dsxypp:   T_OP_DSXPP_1   { new_instr(5, OPC_DSXPP_1); }
-|                  T_OP_DSYPP_1   { new_instr(5, OPC_DSYPP_1); }
-
-cat5_opc:          T_OP_ISAM      { new_instr(5, OPC_ISAM); }
-|                  T_OP_ISAML     { new_instr(5, OPC_ISAML); }
-|                  T_OP_ISAMM     { new_instr(5, OPC_ISAMM); }
-|                  T_OP_SAM       { new_instr(5, OPC_SAM); }
-|                  T_OP_SAMB      { new_instr(5, OPC_SAMB); }
-|                  T_OP_SAML      { new_instr(5, OPC_SAML); }
-|                  T_OP_SAMGQ     { new_instr(5, OPC_SAMGQ); }
-|                  T_OP_GETLOD    { new_instr(5, OPC_GETLOD); }
-|                  T_OP_CONV      { new_instr(5, OPC_CONV); }
-|                  T_OP_CONVM     { new_instr(5, OPC_CONVM); }
-|                  T_OP_GETSIZE   { new_instr(5, OPC_GETSIZE); }
-|                  T_OP_GETBUF    { new_instr(5, OPC_GETBUF); }
-|                  T_OP_GETPOS    { new_instr(5, OPC_GETPOS); }
-|                  T_OP_GETINFO   { new_instr(5, OPC_GETINFO); }
-|                  T_OP_DSX       { new_instr(5, OPC_DSX); }
-|                  T_OP_DSY       { new_instr(5, OPC_DSY); }
-|                  T_OP_GATHER4R  { new_instr(5, OPC_GATHER4R); }
-|                  T_OP_GATHER4G  { new_instr(5, OPC_GATHER4G); }
-|                  T_OP_GATHER4B  { new_instr(5, OPC_GATHER4B); }
-|                  T_OP_GATHER4A  { new_instr(5, OPC_GATHER4A); }
-|                  T_OP_SAMGP0    { new_instr(5, OPC_SAMGP0); }
-|                  T_OP_SAMGP1    { new_instr(5, OPC_SAMGP1); }
-|                  T_OP_SAMGP2    { new_instr(5, OPC_SAMGP2); }
-|                  T_OP_SAMGP3    { new_instr(5, OPC_SAMGP3); }
-|                  T_OP_RGETPOS   { new_instr(5, OPC_RGETPOS); }
-|                  T_OP_RGETINFO  { new_instr(5, OPC_RGETINFO); }
-
-cat5_flag:         '.' T_3D       { instr->flags |= IR3_INSTR_3D; }
-|                  '.' 'a'        { instr->flags |= IR3_INSTR_A; }
-|                  '.' 'o'        { instr->flags |= IR3_INSTR_O; }
-|                  '.' 'p'        { instr->flags |= IR3_INSTR_P; }
-|                  '.' 's'        { instr->flags |= IR3_INSTR_S; }
-|                  '.' T_S2EN     { instr->flags |= IR3_INSTR_S2EN; }
+cat5_opc_dsxypp:   T_OP_DSXPP_1   { new_instr(state, 5, OPC_DSXPP_1); }
+|                  T_OP_DSYPP_1   { new_instr(state, 5, OPC_DSYPP_1); }
+
+cat5_opc:          T_OP_ISAM      { new_instr(state, 5, OPC_ISAM); }
+|                  T_OP_ISAML     { new_instr(state, 5, OPC_ISAML); }
+|                  T_OP_ISAMM     { new_instr(state, 5, OPC_ISAMM); }
+|                  T_OP_SAM       { new_instr(state, 5, OPC_SAM); }
+|                  T_OP_SAMB      { new_instr(state, 5, OPC_SAMB); }
+|                  T_OP_SAML      { new_instr(state, 5, OPC_SAML); }
+|                  T_OP_SAMGQ     { new_instr(state, 5, OPC_SAMGQ); }
+|                  T_OP_GETLOD    { new_instr(state, 5, OPC_GETLOD); }
+|                  T_OP_CONV      { new_instr(state, 5, OPC_CONV); }
+|                  T_OP_CONVM     { new_instr(state, 5, OPC_CONVM); }
+|                  T_OP_GETSIZE   { new_instr(state, 5, OPC_GETSIZE); }
+|                  T_OP_GETBUF    { new_instr(state, 5, OPC_GETBUF); }
+|                  T_OP_GETPOS    { new_instr(state, 5, OPC_GETPOS); }
+|                  T_OP_GETINFO   { new_instr(state, 5, OPC_GETINFO); }
+|                  T_OP_DSX       { new_instr(state, 5, OPC_DSX); }
+|                  T_OP_DSY       { new_instr(state, 5, OPC_DSY); }
+|                  T_OP_GATHER4R  { new_instr(state, 5, OPC_GATHER4R); }
+|                  T_OP_GATHER4G  { new_instr(state, 5, OPC_GATHER4G); }
+|                  T_OP_GATHER4B  { new_instr(state, 5, OPC_GATHER4B); }
+|                  T_OP_GATHER4A  { new_instr(state, 5, OPC_GATHER4A); }
+|                  T_OP_SAMGP0    { new_instr(state, 5, OPC_SAMGP0); }
+|                  T_OP_SAMGP1    { new_instr(state, 5, OPC_SAMGP1); }
+|                  T_OP_SAMGP2    { new_instr(state, 5, OPC_SAMGP2); }
+|                  T_OP_SAMGP3    { new_instr(state, 5, OPC_SAMGP3); }
+|                  T_OP_RGETPOS   { new_instr(state, 5, OPC_RGETPOS); }
+|                  T_OP_RGETINFO  { new_instr(state, 5, OPC_RGETINFO); }
+
+cat5_flag:         '.' T_3D       { state->instr->flags |= IR3_INSTR_3D; }
+|                  '.' 'a'        { state->instr->flags |= IR3_INSTR_A; }
+|                  '.' 'o'        { state->instr->flags |= IR3_INSTR_O; }
+|                  '.' 'p'        { state->instr->flags |= IR3_INSTR_P; }
+|                  '.' 's'        { state->instr->flags |= IR3_INSTR_S; }
+|                  '.' T_S2EN     { state->instr->flags |= IR3_INSTR_S2EN; }
 cat5_flags:
 |                  cat5_flag cat5_flags
 
-cat5_samp:         T_SAMP         { instr->cat5.samp = $1; }
-cat5_tex:          T_TEX          { instr->cat5.tex = $1; }
-cat5_type:         '(' type ')'   { instr->cat5.type = $2; }
+cat5_samp:         T_SAMP         { state->instr->cat5.samp = $1; }
+cat5_tex:          T_TEX          { state->instr->cat5.tex = $1; }
+cat5_type:         '(' type ')'   { state->instr->cat5.type = $2; }
 
 cat5_instr:        cat5_opc_dsxypp cat5_flags dst_reg ',' src_reg
 |                  cat5_opc cat5_flags cat5_type dst_reg ',' src_reg ',' src_reg ',' cat5_samp ',' cat5_tex
@@ -652,49 +657,49 @@ cat5_instr:        cat5_opc_dsxypp cat5_flags dst_reg ',' src_reg
 |                  cat5_opc cat5_flags cat5_type dst_reg ',' cat5_tex
 |                  cat5_opc cat5_flags cat5_type dst_reg
 
-cat6_type:         '.' type  { instr->cat6.type = $2; }
-cat6_offset:       offset    { instr->cat6.src_offset = $1; }
-cat6_immed:        integer   { instr->cat6.iim_val = $1; }
+cat6_type:         '.' type  { state->instr->cat6.type = $2; }
+cat6_offset:       offset    { state->instr->cat6.src_offset = $1; }
+cat6_immed:        integer   { state->instr->cat6.iim_val = $1; }
 
-cat6_load:         T_OP_LDG  { new_instr(6, OPC_LDG); }  cat6_type dst_reg ',' 'g' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_LDP  { new_instr(6, OPC_LDP); }  cat6_type dst_reg ',' 'p' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_LDL  { new_instr(6, OPC_LDL); }  cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_LDLW { new_instr(6, OPC_LDLW); } cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_LDLV { new_instr(6, OPC_LDLV); } cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+cat6_load:         T_OP_LDG  { new_instr(state, 6, OPC_LDG); }  cat6_type dst_reg ',' 'g' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_LDP  { new_instr(state, 6, OPC_LDP); }  cat6_type dst_reg ',' 'p' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_LDL  { new_instr(state, 6, OPC_LDL); }  cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_LDLW { new_instr(state, 6, OPC_LDLW); } cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_LDLV { new_instr(state, 6, OPC_LDLV); } cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
 
-cat6_store:        T_OP_STG  { new_instr(6, OPC_STG); }  cat6_type 'g' '[' dst_reg cat6_offset ']' ',' reg ',' cat6_immed
-|                  T_OP_STP  { new_instr(6, OPC_STP); }  cat6_type 'p' '[' dst_reg cat6_offset ']' ',' reg ',' cat6_immed
-|                  T_OP_STL  { new_instr(6, OPC_STL); }  cat6_type 'l' '[' dst_reg cat6_offset ']' ',' reg ',' cat6_immed
-|                  T_OP_STLW { new_instr(6, OPC_STLW); } cat6_type 'l' '[' dst_reg cat6_offset ']' ',' reg ',' cat6_immed
+cat6_store:        T_OP_STG  { new_instr(state, 6, OPC_STG); }  cat6_type 'g' '[' dst_reg cat6_offset ']' ',' reg ',' cat6_immed
+|                  T_OP_STP  { new_instr(state, 6, OPC_STP); }  cat6_type 'p' '[' dst_reg cat6_offset ']' ',' reg ',' cat6_immed
+|                  T_OP_STL  { new_instr(state, 6, OPC_STL); }  cat6_type 'l' '[' dst_reg cat6_offset ']' ',' reg ',' cat6_immed
+|                  T_OP_STLW { new_instr(state, 6, OPC_STLW); } cat6_type 'l' '[' dst_reg cat6_offset ']' ',' reg ',' cat6_immed
 
-cat6_storei:       T_OP_STI  { new_instr(6, OPC_STI); }  cat6_type dst_reg cat6_offset ',' reg ',' cat6_immed
+cat6_storei:       T_OP_STI  { new_instr(state, 6, OPC_STI); }  cat6_type dst_reg cat6_offset ',' reg ',' cat6_immed
 
-cat6_storeib:      T_OP_STIB { new_instr(6, OPC_STIB); } cat6_type 'g' '[' dst_reg ']' ',' reg cat6_offset ',' cat6_immed
+cat6_storeib:      T_OP_STIB { new_instr(state, 6, OPC_STIB); } cat6_type 'g' '[' dst_reg ']' ',' reg cat6_offset ',' cat6_immed
 
-cat6_prefetch:     T_OP_PREFETCH { new_instr(6, OPC_PREFETCH); new_reg(0,0); /* dummy dst */ } 'g' '[' reg cat6_offset ']' ',' cat6_immed
+cat6_prefetch:     T_OP_PREFETCH { new_instr(state, 6, OPC_PREFETCH); new_reg(state, 0,0); /* dummy dst */ } 'g' '[' reg cat6_offset ']' ',' cat6_immed
 
-cat6_atomic_l_g:   '.' 'g'  { instr->flags |= IR3_INSTR_G; }
+cat6_atomic_l_g:   '.' 'g'  { state->instr->flags |= IR3_INSTR_G; }
 |                  '.' 'l'  {  }
 
-cat6_atomic:       T_OP_ATOMIC_ADD     { new_instr(6, OPC_ATOMIC_ADD); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_SUB     { new_instr(6, OPC_ATOMIC_SUB); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_XCHG    { new_instr(6, OPC_ATOMIC_XCHG); }   cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_INC     { new_instr(6, OPC_ATOMIC_INC); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_DEC     { new_instr(6, OPC_ATOMIC_DEC); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_CMPXCHG { new_instr(6, OPC_ATOMIC_CMPXCHG); }cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_MIN     { new_instr(6, OPC_ATOMIC_MIN); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_MAX     { new_instr(6, OPC_ATOMIC_MAX); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_AND     { new_instr(6, OPC_ATOMIC_AND); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_OR      { new_instr(6, OPC_ATOMIC_OR); }     cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-|                  T_OP_ATOMIC_XOR     { new_instr(6, OPC_ATOMIC_XOR); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
-
-cat6_todo:         T_OP_G2L                 { new_instr(6, OPC_G2L); }
-|                  T_OP_L2G                 { new_instr(6, OPC_L2G); }
-|                  T_OP_RESFMT              { new_instr(6, OPC_RESFMT); }
-|                  T_OP_RESINF              { new_instr(6, OPC_RESINFO); }
-|                  T_OP_LDGB_TYPED_4D       { new_instr(6, OPC_LDGB_TYPED_4D); }
-|                  T_OP_STGB_4D_4           { new_instr(6, OPC_STGB_4D_4); }
-|                  T_OP_LDC_4               { new_instr(6, OPC_LDC_4); }
+cat6_atomic:       T_OP_ATOMIC_ADD     { new_instr(state, 6, OPC_ATOMIC_ADD); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_SUB     { new_instr(state, 6, OPC_ATOMIC_SUB); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_XCHG    { new_instr(state, 6, OPC_ATOMIC_XCHG); }   cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_INC     { new_instr(state, 6, OPC_ATOMIC_INC); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_DEC     { new_instr(state, 6, OPC_ATOMIC_DEC); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_CMPXCHG { new_instr(state, 6, OPC_ATOMIC_CMPXCHG); }cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_MIN     { new_instr(state, 6, OPC_ATOMIC_MIN); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_MAX     { new_instr(state, 6, OPC_ATOMIC_MAX); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_AND     { new_instr(state, 6, OPC_ATOMIC_AND); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_OR      { new_instr(state, 6, OPC_ATOMIC_OR); }     cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+|                  T_OP_ATOMIC_XOR     { new_instr(state, 6, OPC_ATOMIC_XOR); }    cat6_atomic_l_g cat6_type dst_reg ',' 'l' '[' reg cat6_offset ']' ',' cat6_immed
+
+cat6_todo:         T_OP_G2L                 { new_instr(state, 6, OPC_G2L); }
+|                  T_OP_L2G                 { new_instr(state, 6, OPC_L2G); }
+|                  T_OP_RESFMT              { new_instr(state, 6, OPC_RESFMT); }
+|                  T_OP_RESINF              { new_instr(state, 6, OPC_RESINFO); }
+|                  T_OP_LDGB_TYPED_4D       { new_instr(state, 6, OPC_LDGB_TYPED_4D); }
+|                  T_OP_STGB_4D_4           { new_instr(state, 6, OPC_STGB_4D_4); }
+|                  T_OP_LDC_4               { new_instr(state, 6, OPC_LDC_4); }
 
 cat6_instr:        cat6_load
 |                  cat6_store
@@ -704,16 +709,16 @@ cat6_instr:        cat6_load
 |                  cat6_atomic
 |                  cat6_todo
 
-reg:               T_REGISTER     { $$ = new_reg($1, 0); }
-|                  T_A0           { $$ = new_reg((61 << 3) + $1, IR3_REG_HALF); }
-|                  T_P0           { $$ = new_reg((62 << 3) + $1, 0); }
+reg:               T_REGISTER     { $$ = new_reg(state, $1, 0); }
+|                  T_A0           { $$ = new_reg(state, (61 << 3) + $1, IR3_REG_HALF); }
+|                  T_P0           { $$ = new_reg(state, (62 << 3) + $1, 0); }
 
-const:             T_CONSTANT     { $$ = new_reg($1, IR3_REG_CONST); }
+const:             T_CONSTANT     { $$ = new_reg(state, $1, IR3_REG_CONST); }
 
-dst_reg_flag:      T_EVEN         { rflags.flags |= IR3_REG_EVEN; }
-|                  T_POS_INFINITY { rflags.flags |= IR3_REG_POS_INF; }
-|                  T_EI           { rflags.flags |= IR3_REG_EI; }
-|                  T_WRMASK       { rflags.wrmask = $1; }
+dst_reg_flag:      T_EVEN         { state->rflags.flags |= IR3_REG_EVEN; }
+|                  T_POS_INFINITY { state->rflags.flags |= IR3_REG_POS_INF; }
+|                  T_EI           { state->rflags.flags |= IR3_REG_EI; }
+|                  T_WRMASK       { state->rflags.wrmask = $1; }
 
 dst_reg_flags:     dst_reg_flag
 |                  dst_reg_flag dst_reg_flags
@@ -722,10 +727,10 @@ dst_reg_flags:     dst_reg_flag
 dst_reg:           reg                 { $1->flags |= IR3_REG_R; }
 |                  dst_reg_flags reg   { $2->flags |= IR3_REG_R; }
 
-src_reg_flag:      T_ABSNEG       { rflags.flags |= IR3_REG_ABS|IR3_REG_NEGATE; }
-|                  T_NEG          { rflags.flags |= IR3_REG_NEGATE; }
-|                  T_ABS          { rflags.flags |= IR3_REG_ABS; }
-|                  T_R            { rflags.flags |= IR3_REG_R; }
+src_reg_flag:      T_ABSNEG       { state->rflags.flags |= IR3_REG_ABS|IR3_REG_NEGATE; }
+|                  T_NEG          { state->rflags.flags |= IR3_REG_NEGATE; }
+|                  T_ABS          { state->rflags.flags |= IR3_REG_ABS; }
+|                  T_R            { state->rflags.flags |= IR3_REG_R; }
 
 src_reg_flags:     src_reg_flag
 |                  src_reg_flag src_reg_flags
@@ -750,14 +755,14 @@ offset:            { $$ = 0; }
 |                  '+' integer { $$ = $2; }
 |                  '-' integer { $$ = -$2; }
 
-relative:          'r' '<' T_A0 offset '>'  { new_reg(0, IR3_REG_RELATIV)->offset = $4; }
-|                  'c' '<' T_A0 offset '>'  { new_reg(0, IR3_REG_RELATIV | IR3_REG_CONST)->offset = $4; }
+relative:          'r' '<' T_A0 offset '>'  { new_reg(state, 0, IR3_REG_RELATIV)->offset = $4; }
+|                  'c' '<' T_A0 offset '>'  { new_reg(state, 0, IR3_REG_RELATIV | IR3_REG_CONST)->offset = $4; }
 
-immediate:         integer             { new_reg(0, IR3_REG_IMMED)->iim_val = $1; }
-|                  '(' integer ')'     { new_reg(0, IR3_REG_IMMED)->fim_val = $2; }
-|                  '(' float ')'       { new_reg(0, IR3_REG_IMMED)->fim_val = $2; }
-|                  '(' T_NAN ')'       { new_reg(0, IR3_REG_IMMED)->fim_val = NAN; }
-|                  '(' T_INF ')'       { new_reg(0, IR3_REG_IMMED)->fim_val = INFINITY; }
+immediate:         integer             { new_reg(state, 0, IR3_REG_IMMED)->iim_val = $1; }
+|                  '(' integer ')'     { new_reg(state, 0, IR3_REG_IMMED)->fim_val = $2; }
+|                  '(' float ')'       { new_reg(state, 0, IR3_REG_IMMED)->fim_val = $2; }
+|                  '(' T_NAN ')'       { new_reg(state, 0, IR3_REG_IMMED)->fim_val = NAN; }
+|                  '(' T_INF ')'       { new_reg(state, 0, IR3_REG_IMMED)->fim_val = INFINITY; }
 
 integer:           T_INT       { $$ = $1; }
 |                  '-' T_INT   { $$ = -$2; }
@@ -775,3 +780,27 @@ type:              T_TYPE_F16  { $$ = TYPE_F16; }
 |                  T_TYPE_S32  { $$ = TYPE_S32; }
 |                  T_TYPE_U8   { $$ = TYPE_U8;  }
 |                  T_TYPE_S8   { $$ = TYPE_S8;  }
+
+%%
+
+struct ir3_shader * fd_asm_parse(const char *src)
+{
+	struct parse_state state = {0};
+	YY_BUFFER_STATE buffer;
+
+	if (asm_yylex_init(&state.scanner))
+		return NULL;
+
+	buffer = asm_yy_scan_string(src, state.scanner);
+	asm_yyset_lineno(1, state.scanner);
+
+	if (yyparse(state.scanner, &state)) {
+		ir3_shader_destroy(state.shader);
+		state.shader = NULL;
+	}
+
+	asm_yy_delete_buffer(buffer, state.scanner);
+	asm_yylex_destroy(state.scanner);
+
+	return state.shader;
+}
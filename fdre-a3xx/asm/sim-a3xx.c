@@ -0,0 +1,1196 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ir-a3xx.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "util.h"
+#include "instr-a3xx.h"
+
+/*
+ * CPU interpreter for the ir3 instruction set, working directly on the
+ * parsed instructions (so no decoder needed, and what is simulated is
+ * what was written).  Invocations are run in batches of IR3_SIM_LANES
+ * lanes, with the registers stored lane-minor (ie. sim->full[reg][lane])
+ * so each instruction is a loop over the lanes of a batch.
+ *
+ * Flow control is handled by giving each lane its own pc, and always
+ * issuing the instruction at the lowest pc of any live lane, for all the
+ * lanes which are at that pc.  So divergent lanes are serialized, and
+ * reconverge when they meet up again, including for loops.
+ *
+ * Some simplifications, vs the real thing:
+ *
+ *  + results are visible immediately, so (sy)/(ss) and nop's just cost
+ *    time.  A shader which is missing a sync flag still works here.
+ *  + consts and immediates are 32 bit, and are converted when read as
+ *    half (ie. hc0.x is c0.x converted to f16).
+ *  + bary.f returns the (already interpolated) input at its inloc, which
+ *    the caller sets per lane with ir3_sim_set_input(), ignoring the ij
+ *    coordinates.
+ *  + texture fetches go thru a callback.
+ *  + local memory is shared by all the batches of a single ir3_sim_run(),
+ *    private memory is per lane.  There are no atomics.
+ */
+
+#define LANES     IR3_SIM_LANES
+#define NREGS     (4 * 64)       /* scalar components */
+#define NCONSTS   (4 * 1024)
+#define NINPUTS   (4 * 32)
+#define PVT_SIZE  1024           /* bytes, per lane */
+#define LOCAL_SIZE (32 * 1024)   /* bytes */
+#define MAX_MEMS  32
+#define MAX_CALL_DEPTH 8
+
+/* give up on a batch after this many instructions, probably a loop that
+ * does not terminate:
+ */
+#define MAX_STEPS (1 << 24)
+
+typedef union {
+	uint32_t u[LANES];
+	int32_t  i[LANES];
+	float    f[LANES];
+} lanes_t;
+
+/* how src values are read, and dst values written: */
+enum kind {
+	K_FLOAT,
+	K_UINT,
+	K_SINT,
+};
+
+struct sim_mem {
+	uint32_t addr, size;
+	void *ptr;
+};
+
+struct ir3_sim {
+	struct ir3_shader *shader;
+
+	uint32_t consts[NCONSTS];
+
+	/* per lane state: */
+	uint32_t full[NREGS][LANES];
+	uint16_t half[NREGS][LANES];
+	int32_t  a0[LANES];
+	uint32_t p0[4][LANES];
+	uint32_t inputs[NINPUTS][LANES];
+	uint32_t pc[LANES];
+	uint32_t stack[MAX_CALL_DEPTH][LANES];
+	uint32_t sp[LANES];
+	uint8_t  pvt[LANES][PVT_SIZE];
+
+	uint32_t live, killed;
+
+	uint8_t local[LOCAL_SIZE];
+
+	struct sim_mem mems[MAX_MEMS];
+	uint32_t mems_count;
+	uint32_t next_addr;
+
+	ir3_sim_sample_t sample;
+	void *sample_priv;
+
+	/* set on the first fault, to abort the run: */
+	bool fault;
+};
+
+/*
+ * Helpers:
+ */
+
+static inline float uif(uint32_t u)
+{
+	union { float f; uint32_t u; } x = { .u = u };
+	return x.f;
+}
+
+/* the other direction is util_float_to_half(): */
+static float f16_to_f32(uint16_t h)
+{
+	uint32_t sign = (h & 0x8000) << 16;
+	uint32_t exp  = (h >> 10) & 0x1f;
+	uint32_t mant = h & 0x3ff;
+
+	if (exp == 0x1f)
+		return uif(sign | 0x7f800000 | (mant << 13));
+	if (exp == 0)
+		return sign ? -ldexpf(mant, -24) : ldexpf(mant, -24);
+	return uif(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+static void fault(struct ir3_sim *sim, struct ir3_instruction *instr,
+		const char *msg, uint32_t val)
+{
+	if (!sim->fault)
+		ERROR_MSG("line %d: %s: %u (0x%x)", instr->line, msg, val, val);
+	sim->fault = true;
+}
+
+static bool is_special(int num)
+{
+	return ((num >> 2) == REG_A0) || ((num >> 2) == REG_P0);
+}
+
+/* a single lane of a gpr, or a0/p0, as 32 bits: */
+static uint32_t get_reg(struct ir3_sim *sim, struct ir3_instruction *instr,
+		int lane, int num, bool half, enum kind kind)
+{
+	uint16_t h;
+
+	if ((num >> 2) == REG_A0)
+		return sim->a0[lane];
+	if ((num >> 2) == REG_P0)
+		return sim->p0[num & 0x3][lane];
+
+	if ((num < 0) || (num >= NREGS)) {
+		fault(sim, instr, "invalid register", num);
+		return 0;
+	}
+
+	if (!half)
+		return sim->full[num][lane];
+
+	h = sim->half[num][lane];
+	switch (kind) {
+	case K_FLOAT: return fui(f16_to_f32(h));
+	case K_SINT:  return (int16_t)h;
+	default:      return h;
+	}
+}
+
+static uint32_t get_const(struct ir3_sim *sim, struct ir3_instruction *instr,
+		int num, bool half, enum kind kind)
+{
+	uint32_t val;
+
+	if ((num < 0) || (num >= NCONSTS)) {
+		fault(sim, instr, "invalid const", num);
+		return 0;
+	}
+
+	val = sim->consts[num];
+
+	if (half && (kind == K_SINT))
+		return (int16_t)val;
+	if (half && (kind == K_UINT))
+		return val & 0xffff;
+	return val;
+}
+
+/* read component n (for (rptN)) of a src, for all lanes: */
+static void read_src(struct ir3_sim *sim, struct ir3_instruction *instr,
+		struct ir3_register *reg, int n, enum kind kind, lanes_t *v)
+{
+	bool half = !!(reg->flags & IR3_REG_HALF);
+	int l, num;
+
+	if (!(reg->flags & IR3_REG_R))
+		n = 0;
+
+	if (reg->flags & IR3_REG_IMMED) {
+		for (l = 0; l < LANES; l++)
+			v->i[l] = reg->iim_val;
+	} else if (reg->flags & IR3_REG_RELATIV) {
+		for (l = 0; l < LANES; l++) {
+			num = sim->a0[l] + reg->offset + n;
+			if (reg->flags & IR3_REG_CONST)
+				v->u[l] = get_const(sim, instr, num, half, kind);
+			else
+				v->u[l] = get_reg(sim, instr, l, num, half, kind);
+		}
+	} else if (reg->flags & IR3_REG_CONST) {
+		uint32_t val = get_const(sim, instr, reg->num + n, half, kind);
+		for (l = 0; l < LANES; l++)
+			v->u[l] = val;
+	} else {
+		num = reg->num + n;
+		if (is_special(num) || (num < 0) || (num >= NREGS)) {
+			for (l = 0; l < LANES; l++)
+				v->u[l] = get_reg(sim, instr, l, num, half, kind);
+		} else if (!half) {
+			memcpy(v->u, sim->full[num], sizeof(v->u));
+		} else if (kind == K_FLOAT) {
+			for (l = 0; l < LANES; l++)
+				v->f[l] = f16_to_f32(sim->half[num][l]);
+		} else if (kind == K_SINT) {
+			for (l = 0; l < LANES; l++)
+				v->i[l] = (int16_t)sim->half[num][l];
+		} else {
+			for (l = 0; l < LANES; l++)
+				v->u[l] = sim->half[num][l];
+		}
+	}
+
+	if (reg->flags & IR3_REG_ABS) {
+		if (kind == K_FLOAT)
+			for (l = 0; l < LANES; l++)
+				v->f[l] = fabsf(v->f[l]);
+		else
+			for (l = 0; l < LANES; l++)
+				v->i[l] = (v->i[l] < 0) ? -v->i[l] : v->i[l];
+	}
+
+	if (reg->flags & IR3_REG_NEGATE) {
+		if (kind == K_FLOAT)
+			for (l = 0; l < LANES; l++)
+				v->f[l] = -v->f[l];
+		else
+			for (l = 0; l < LANES; l++)
+				v->i[l] = -v->i[l];
+	}
+}
+
+static void set_reg(struct ir3_sim *sim, struct ir3_instruction *instr,
+		int lane, int num, bool half, enum kind kind, uint32_t val)
+{
+	if ((num >> 2) == REG_A0) {
+		sim->a0[lane] = (kind == K_FLOAT) ? (int32_t)uif(val) : (int32_t)val;
+		return;
+	}
+	if ((num >> 2) == REG_P0) {
+		sim->p0[num & 0x3][lane] = val;
+		return;
+	}
+
+	if ((num < 0) || (num >= NREGS)) {
+		fault(sim, instr, "invalid register", num);
+		return;
+	}
+
+	if (!half)
+		sim->full[num][lane] = val;
+	else if (kind == K_FLOAT)
+		sim->half[num][lane] = util_float_to_half(uif(val));
+	else
+		sim->half[num][lane] = val;
+}
+
+/* write component n (for (rptN)) of the dst, for the lanes in mask: */
+static void write_dst(struct ir3_sim *sim, struct ir3_instruction *instr,
+		struct ir3_register *reg, int n, enum kind kind,
+		const lanes_t *v, uint32_t mask)
+{
+	bool half = !!(reg->flags & IR3_REG_HALF);
+	int l, num = reg->num + n;
+
+	if ((reg->flags & IR3_REG_RELATIV) || is_special(num) ||
+			(num < 0) || (num >= NREGS)) {
+		for (l = 0; l < LANES; l++) {
+			if (!(mask & (1 << l)))
+				continue;
+			if (reg->flags & IR3_REG_RELATIV)
+				num = sim->a0[l] + reg->offset + n;
+			set_reg(sim, instr, l, num, half, kind, v->u[l]);
+		}
+	} else if (!half) {
+		for (l = 0; l < LANES; l++)
+			if (mask & (1 << l))
+				sim->full[num][l] = v->u[l];
+	} else if (kind == K_FLOAT) {
+		for (l = 0; l < LANES; l++)
+			if (mask & (1 << l))
+				sim->half[num][l] = util_float_to_half(v->f[l]);
+	} else {
+		for (l = 0; l < LANES; l++)
+			if (mask & (1 << l))
+				sim->half[num][l] = v->u[l];
+	}
+}
+
+static enum kind type_kind(type_t type)
+{
+	if (type_float(type))
+		return K_FLOAT;
+	if (type_sint(type))
+		return K_SINT;
+	return K_UINT;
+}
+
+#define LANE_OP(expr) do {                 \
+		int l;                             \
+		for (l = 0; l < LANES; l++) {      \
+			expr;                          \
+		}                                  \
+	} while (0)
+
+/*
+ * Category 0: flow control
+ */
+
+static uint32_t p0_cond(struct ir3_sim *sim, struct ir3_instruction *instr,
+		int lane)
+{
+	return !!sim->p0[instr->cat0.comp & 0x3][lane] ^ !!instr->cat0.inv;
+}
+
+static int exec_cat0(struct ir3_sim *sim, struct ir3_instruction *instr,
+		uint32_t pc, uint32_t mask)
+{
+	uint32_t target = pc + instr->cat0.immed;
+	int l;
+
+	switch (instr->opc) {
+	case OPC_NOP:
+		break;
+	case OPC_BR:
+		for (l = 0; l < LANES; l++)
+			if ((mask & (1 << l)) && p0_cond(sim, instr, l))
+				sim->pc[l] = target;
+		break;
+	case OPC_JUMP:
+		for (l = 0; l < LANES; l++)
+			if (mask & (1 << l))
+				sim->pc[l] = target;
+		break;
+	case OPC_CALL:
+		for (l = 0; l < LANES; l++) {
+			if (!(mask & (1 << l)))
+				continue;
+			if (sim->sp[l] >= MAX_CALL_DEPTH) {
+				fault(sim, instr, "call stack overflow", sim->sp[l]);
+				return -1;
+			}
+			sim->stack[sim->sp[l]++][l] = pc + 1;
+			sim->pc[l] = target;
+		}
+		break;
+	case OPC_RET:
+		for (l = 0; l < LANES; l++) {
+			if (!(mask & (1 << l)))
+				continue;
+			if (sim->sp[l])
+				sim->pc[l] = sim->stack[--sim->sp[l]][l];
+			else
+				sim->live &= ~(1 << l);
+		}
+		break;
+	case OPC_KILL:
+		for (l = 0; l < LANES; l++) {
+			if ((mask & (1 << l)) && p0_cond(sim, instr, l)) {
+				sim->killed |= (1 << l);
+				sim->live &= ~(1 << l);
+			}
+		}
+		break;
+	case OPC_END:
+		sim->live &= ~mask;
+		break;
+	case OPC_EMIT:
+	case OPC_CUT:
+	case OPC_CHMASK:
+	case OPC_CHSH:
+	case OPC_FLOW_REV:
+		/* nothing to do for a single stage: */
+		break;
+	default:
+		fault(sim, instr, "unsupported cat0 opc", instr->opc);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Category 1: mov/cov
+ */
+
+/* truncate to the (8 or 16 bit) size of type, for integer types: */
+static void narrow(lanes_t *v, type_t type)
+{
+	switch (type) {
+	case TYPE_U16: LANE_OP(v->u[l] &= 0xffff); break;
+	case TYPE_S16: LANE_OP(v->i[l] = (int16_t)v->i[l]); break;
+	case TYPE_U8:  LANE_OP(v->u[l] &= 0xff); break;
+	case TYPE_S8:  LANE_OP(v->i[l] = (int8_t)v->i[l]); break;
+	default: break;
+	}
+}
+
+static int32_t f2i(float f, int32_t lo, int32_t hi)
+{
+	if (isnan(f))
+		return 0;
+	if (f <= (float)lo)
+		return lo;
+	if (f >= (float)hi)
+		return hi;
+	return (int32_t)f;
+}
+
+static uint32_t f2u(float f, uint32_t hi)
+{
+	if (isnan(f) || (f <= 0.0))
+		return 0;
+	if (f >= (float)hi)
+		return hi;
+	return (uint32_t)f;
+}
+
+static int exec_cat1(struct ir3_sim *sim, struct ir3_instruction *instr,
+		uint32_t mask)
+{
+	type_t st = instr->cat1.src_type, dt = instr->cat1.dst_type;
+	enum kind sk = type_kind(st), dk = type_kind(dt);
+	lanes_t v;
+	int i;
+
+	for (i = 0; i <= instr->repeat; i++) {
+		read_src(sim, instr, instr->regs[1], i, sk, &v);
+		if (sk != K_FLOAT)
+			narrow(&v, st);
+
+		if ((sk == K_FLOAT) && (dk != K_FLOAT)) {
+			switch (dt) {
+			case TYPE_U32: LANE_OP(v.u[l] = f2u(v.f[l], 0xffffffff)); break;
+			case TYPE_U16: LANE_OP(v.u[l] = f2u(v.f[l], 0xffff)); break;
+			case TYPE_U8:  LANE_OP(v.u[l] = f2u(v.f[l], 0xff)); break;
+			case TYPE_S32: LANE_OP(v.i[l] = f2i(v.f[l], INT32_MIN, INT32_MAX)); break;
+			case TYPE_S16: LANE_OP(v.i[l] = f2i(v.f[l], INT16_MIN, INT16_MAX)); break;
+			case TYPE_S8:  LANE_OP(v.i[l] = f2i(v.f[l], INT8_MIN, INT8_MAX)); break;
+			default: break;
+			}
+		} else if ((sk != K_FLOAT) && (dk == K_FLOAT)) {
+			if (sk == K_SINT)
+				LANE_OP(v.f[l] = (float)v.i[l]);
+			else
+				LANE_OP(v.f[l] = (float)v.u[l]);
+		} else if (dk != K_FLOAT) {
+			narrow(&v, dt);
+		}
+
+		write_dst(sim, instr, instr->regs[0], i, dk, &v, mask);
+	}
+
+	return 0;
+}
+
+/*
+ * Category 2: alu
+ */
+
+static enum kind cat2_kind(opc_t opc)
+{
+	switch (opc) {
+	case OPC_ADD_F:
+	case OPC_MIN_F:
+	case OPC_MAX_F:
+	case OPC_MUL_F:
+	case OPC_SIGN_F:
+	case OPC_CMPS_F:
+	case OPC_ABSNEG_F:
+	case OPC_CMPV_F:
+	case OPC_FLOOR_F:
+	case OPC_CEIL_F:
+	case OPC_RNDNE_F:
+	case OPC_RNDAZ_F:
+	case OPC_TRUNC_F:
+	case OPC_BARY_F:
+		return K_FLOAT;
+	case OPC_ADD_S:
+	case OPC_SUB_S:
+	case OPC_CMPS_S:
+	case OPC_MIN_S:
+	case OPC_MAX_S:
+	case OPC_ABSNEG_S:
+	case OPC_CMPV_S:
+	case OPC_MUL_S:
+	case OPC_CLZ_S:
+	case OPC_ASHR_B:
+		return K_SINT;
+	default:
+		return K_UINT;
+	}
+}
+
+/* cmps gives 1/0, cmpv a ~0/0 mask: */
+#define CMP(cond, a, b, t) do {                                  \
+		switch (cond) {                                          \
+		case IR3_COND_LT: LANE_OP(d.u[l] = (a[l] <  b[l]) ? t : 0); break; \
+		case IR3_COND_LE: LANE_OP(d.u[l] = (a[l] <= b[l]) ? t : 0); break; \
+		case IR3_COND_GT: LANE_OP(d.u[l] = (a[l] >  b[l]) ? t : 0); break; \
+		case IR3_COND_GE: LANE_OP(d.u[l] = (a[l] >= b[l]) ? t : 0); break; \
+		case IR3_COND_EQ: LANE_OP(d.u[l] = (a[l] == b[l]) ? t : 0); break; \
+		case IR3_COND_NE: LANE_OP(d.u[l] = (a[l] != b[l]) ? t : 0); break; \
+		}                                                        \
+	} while (0)
+
+static uint32_t bfrev(uint32_t v)
+{
+	v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+	v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+	v = ((v >> 4) & 0x0f0f0f0f) | ((v & 0x0f0f0f0f) << 4);
+	v = ((v >> 8) & 0x00ff00ff) | ((v & 0x00ff00ff) << 8);
+	return (v >> 16) | (v << 16);
+}
+
+static int32_t sext24(uint32_t v)
+{
+	return ((int32_t)(v << 8)) >> 8;
+}
+
+static int exec_cat2(struct ir3_sim *sim, struct ir3_instruction *instr,
+		uint32_t mask)
+{
+	struct ir3_register *dst  = instr->regs[0];
+	struct ir3_register *src1 = instr->regs[1];
+	struct ir3_register *src2 = (instr->regs_count > 2) ? instr->regs[2] : NULL;
+	int cond = instr->cat2.condition;
+	enum kind sk = cat2_kind(instr->opc), dk;
+	lanes_t a, b, d;
+	int i;
+
+	for (i = 0; i <= instr->repeat; i++) {
+		if (instr->opc == OPC_BARY_F) {
+			/* src1 is the inloc, which advances with (r): */
+			int inloc = src1->iim_val + ((src1->flags & IR3_REG_R) ? i : 0);
+			if ((inloc < 0) || (inloc >= NINPUTS)) {
+				fault(sim, instr, "invalid inloc", inloc);
+				return -1;
+			}
+			memcpy(d.u, sim->inputs[inloc], sizeof(d.u));
+			write_dst(sim, instr, dst, i, K_FLOAT, &d, mask);
+			continue;
+		}
+
+		read_src(sim, instr, src1, i, sk, &a);
+		if (src2)
+			read_src(sim, instr, src2, i, sk, &b);
+		else
+			memset(&b, 0, sizeof(b));
+
+		dk = sk;
+
+		switch (instr->opc) {
+		case OPC_ADD_F:   LANE_OP(d.f[l] = a.f[l] + b.f[l]); break;
+		case OPC_MIN_F:   LANE_OP(d.f[l] = fminf(a.f[l], b.f[l])); break;
+		case OPC_MAX_F:   LANE_OP(d.f[l] = fmaxf(a.f[l], b.f[l])); break;
+		case OPC_MUL_F:   LANE_OP(d.f[l] = a.f[l] * b.f[l]); break;
+		case OPC_SIGN_F:
+			LANE_OP(d.f[l] = (a.f[l] > 0.0) ? 1.0 : (a.f[l] < 0.0) ? -1.0 : 0.0);
+			break;
+		case OPC_CMPS_F:  CMP(cond, a.f, b.f, 1); dk = K_UINT; break;
+		case OPC_CMPV_F:  CMP(cond, a.f, b.f, ~0); dk = K_UINT; break;
+		case OPC_ABSNEG_F:
+		case OPC_ABSNEG_S:
+			d = a;
+			break;
+		case OPC_FLOOR_F: LANE_OP(d.f[l] = floorf(a.f[l])); break;
+		case OPC_CEIL_F:  LANE_OP(d.f[l] = ceilf(a.f[l])); break;
+		case OPC_RNDNE_F: LANE_OP(d.f[l] = rintf(a.f[l])); break;
+		case OPC_RNDAZ_F: LANE_OP(d.f[l] = roundf(a.f[l])); break;
+		case OPC_TRUNC_F: LANE_OP(d.f[l] = truncf(a.f[l])); break;
+		case OPC_ADD_U:
+		case OPC_ADD_S:   LANE_OP(d.u[l] = a.u[l] + b.u[l]); break;
+		case OPC_SUB_U:
+		case OPC_SUB_S:   LANE_OP(d.u[l] = a.u[l] - b.u[l]); break;
+		case OPC_CMPS_U:  CMP(cond, a.u, b.u, 1); break;
+		case OPC_CMPS_S:  CMP(cond, a.i, b.i, 1); dk = K_UINT; break;
+		case OPC_CMPV_U:  CMP(cond, a.u, b.u, ~0); break;
+		case OPC_CMPV_S:  CMP(cond, a.i, b.i, ~0); dk = K_UINT; break;
+		case OPC_MIN_U:   LANE_OP(d.u[l] = min(a.u[l], b.u[l])); break;
+		case OPC_MIN_S:   LANE_OP(d.i[l] = min(a.i[l], b.i[l])); break;
+		case OPC_MAX_U:   LANE_OP(d.u[l] = max(a.u[l], b.u[l])); break;
+		case OPC_MAX_S:   LANE_OP(d.i[l] = max(a.i[l], b.i[l])); break;
+		case OPC_AND_B:   LANE_OP(d.u[l] = a.u[l] & b.u[l]); break;
+		case OPC_OR_B:    LANE_OP(d.u[l] = a.u[l] | b.u[l]); break;
+		case OPC_NOT_B:   LANE_OP(d.u[l] = ~a.u[l]); break;
+		case OPC_XOR_B:   LANE_OP(d.u[l] = a.u[l] ^ b.u[l]); break;
+		/* 24 bit multiplies, and 16x16 for mull.u (see madsh.m16): */
+		case OPC_MUL_U:
+			LANE_OP(d.u[l] = (a.u[l] & 0xffffff) * (b.u[l] & 0xffffff));
+			break;
+		case OPC_MUL_S:
+			LANE_OP(d.i[l] = sext24(a.u[l]) * sext24(b.u[l]));
+			break;
+		case OPC_MULL_U:
+			LANE_OP(d.u[l] = (a.u[l] & 0xffff) * (b.u[l] & 0xffff));
+			break;
+		case OPC_BFREV_B: LANE_OP(d.u[l] = bfrev(a.u[l])); break;
+		case OPC_CLZ_B:
+			LANE_OP(d.u[l] = a.u[l] ? __builtin_clz(a.u[l]) : 32);
+			break;
+		case OPC_CLZ_S:
+			/* leading bits which are the same as the sign bit: */
+			LANE_OP(d.u[l] = (a.i[l] < 0) ?
+					(~a.u[l] ? __builtin_clz(~a.u[l]) : 32) :
+					(a.u[l] ? __builtin_clz(a.u[l]) : 32));
+			dk = K_UINT;
+			break;
+		case OPC_SHL_B:   LANE_OP(d.u[l] = a.u[l] << (b.u[l] & 31)); break;
+		case OPC_SHR_B:   LANE_OP(d.u[l] = a.u[l] >> (b.u[l] & 31)); break;
+		case OPC_ASHR_B:  LANE_OP(d.i[l] = a.i[l] >> (b.u[l] & 31)); break;
+		case OPC_GETBIT_B:
+			LANE_OP(d.u[l] = (a.u[l] >> (b.u[l] & 31)) & 1);
+			break;
+		case OPC_CBITS_B: LANE_OP(d.u[l] = __builtin_popcount(a.u[l])); break;
+		default:
+			fault(sim, instr, "unsupported cat2 opc", instr->opc);
+			return -1;
+		}
+
+		write_dst(sim, instr, dst, i, dk, &d, mask);
+	}
+
+	return 0;
+}
+
+/*
+ * Category 3: mad/sel/sad
+ */
+
+static enum kind cat3_kind(opc_t opc)
+{
+	switch (opc) {
+	case OPC_MAD_F16:
+	case OPC_MAD_F32:
+	case OPC_SEL_F16:
+	case OPC_SEL_F32:
+		return K_FLOAT;
+	case OPC_MAD_S16:
+	case OPC_MADSH_M16:
+	case OPC_MAD_S24:
+	case OPC_SEL_S16:
+	case OPC_SEL_S32:
+	case OPC_SAD_S16:
+	case OPC_SAD_S32:
+		return K_SINT;
+	default:
+		return K_UINT;
+	}
+}
+
+static int exec_cat3(struct ir3_sim *sim, struct ir3_instruction *instr,
+		uint32_t mask)
+{
+	enum kind sk = cat3_kind(instr->opc);
+	lanes_t a, b, c, d;
+	int i;
+
+	for (i = 0; i <= instr->repeat; i++) {
+		read_src(sim, instr, instr->regs[1], i, sk, &a);
+		read_src(sim, instr, instr->regs[2], i, sk, &b);
+		read_src(sim, instr, instr->regs[3], i, sk, &c);
+
+		switch (instr->opc) {
+		case OPC_MAD_U16:
+			LANE_OP(d.u[l] = (a.u[l] & 0xffff) * (b.u[l] & 0xffff) + c.u[l]);
+			break;
+		case OPC_MAD_S16:
+			LANE_OP(d.i[l] = (int16_t)a.i[l] * (int16_t)b.i[l] + c.i[l]);
+			break;
+		/* (a.lo * b.hi) << 16, for building a 32x32 multiply out of
+		 * mull.u + 2x madsh.m16:
+		 */
+		case OPC_MADSH_U16:
+		case OPC_MADSH_M16:
+			LANE_OP(d.u[l] = (((a.u[l] & 0xffff) * (b.u[l] >> 16)) << 16) + c.u[l]);
+			break;
+		case OPC_MAD_U24:
+			LANE_OP(d.u[l] = (a.u[l] & 0xffffff) * (b.u[l] & 0xffffff) + c.u[l]);
+			break;
+		case OPC_MAD_S24:
+			LANE_OP(d.i[l] = sext24(a.u[l]) * sext24(b.u[l]) + c.i[l]);
+			break;
+		case OPC_MAD_F16:
+		case OPC_MAD_F32:
+			LANE_OP(d.f[l] = a.f[l] * b.f[l] + c.f[l]);
+			break;
+		case OPC_SEL_B16:
+		case OPC_SEL_B32:
+		case OPC_SEL_S16:
+		case OPC_SEL_S32:
+			LANE_OP(d.u[l] = b.u[l] ? a.u[l] : c.u[l]);
+			break;
+		case OPC_SEL_F16:
+		case OPC_SEL_F32:
+			LANE_OP(d.u[l] = (b.f[l] != 0.0) ? a.u[l] : c.u[l]);
+			break;
+		case OPC_SAD_S16:
+		case OPC_SAD_S32:
+			LANE_OP(d.i[l] = abs(a.i[l] - b.i[l]) + c.i[l]);
+			break;
+		default:
+			fault(sim, instr, "unsupported cat3 opc", instr->opc);
+			return -1;
+		}
+
+		write_dst(sim, instr, instr->regs[0], i, sk, &d, mask);
+	}
+
+	return 0;
+}
+
+/*
+ * Category 4: sfu
+ */
+
+static int exec_cat4(struct ir3_sim *sim, struct ir3_instruction *instr,
+		uint32_t mask)
+{
+	lanes_t a, d;
+	int i;
+
+	for (i = 0; i <= instr->repeat; i++) {
+		read_src(sim, instr, instr->regs[1], i, K_FLOAT, &a);
+
+		switch (instr->opc) {
+		case OPC_RCP:  LANE_OP(d.f[l] = 1.0 / a.f[l]); break;
+		case OPC_RSQ:  LANE_OP(d.f[l] = 1.0 / sqrtf(a.f[l])); break;
+		case OPC_LOG2: LANE_OP(d.f[l] = log2f(a.f[l])); break;
+		case OPC_EXP2: LANE_OP(d.f[l] = exp2f(a.f[l])); break;
+		case OPC_SIN:  LANE_OP(d.f[l] = sinf(a.f[l])); break;
+		case OPC_COS:  LANE_OP(d.f[l] = cosf(a.f[l])); break;
+		case OPC_SQRT: LANE_OP(d.f[l] = sqrtf(a.f[l])); break;
+		default:
+			fault(sim, instr, "unsupported cat4 opc", instr->opc);
+			return -1;
+		}
+
+		write_dst(sim, instr, instr->regs[0], i, K_FLOAT, &d, mask);
+	}
+
+	return 0;
+}
+
+/*
+ * Category 5: texture
+ */
+
+static int exec_cat5(struct ir3_sim *sim, struct ir3_instruction *instr,
+		uint32_t mask)
+{
+	struct ir3_register *dst = instr->regs[0];
+	enum kind ck, dk = type_kind(instr->cat5.type);
+	lanes_t coord[5], texel[4];
+	int i, l, ncoord = 0;
+
+	switch (instr->opc) {
+	case OPC_ISAM:
+	case OPC_ISAML:
+	case OPC_ISAMM:
+		ck = K_SINT;
+		break;
+	case OPC_SAM:
+	case OPC_SAMB:
+	case OPC_SAML:
+		ck = K_FLOAT;
+		break;
+	default:
+		fault(sim, instr, "unsupported cat5 opc", instr->opc);
+		return -1;
+	}
+
+	if (!sim->sample) {
+		fault(sim, instr, "no sampler for tex", instr->cat5.tex);
+		return -1;
+	}
+
+	/* src1 holds the coords, src2 the bias/lod (if any): */
+	if (instr->regs_count > 1) {
+		struct ir3_register *src = instr->regs[1];
+		int n = 2 + !!(instr->flags & IR3_INSTR_3D) +
+				!!(instr->flags & IR3_INSTR_A);
+		for (i = 0; i < n; i++) {
+			/* the coords are consecutive, regardless of (r): */
+			struct ir3_register tmp = *src;
+			tmp.flags |= IR3_REG_R;
+			read_src(sim, instr, &tmp, i, ck, &coord[ncoord++]);
+		}
+	}
+	if (instr->regs_count > 2)
+		read_src(sim, instr, instr->regs[2], 0, ck, &coord[ncoord++]);
+
+	if (ck == K_SINT)
+		for (i = 0; i < ncoord; i++)
+			LANE_OP(coord[i].f[l] = (float)coord[i].i[l]);
+
+	for (l = 0; l < LANES; l++) {
+		float c[5], t[4];
+
+		if (!(mask & (1 << l)))
+			continue;
+
+		for (i = 0; i < ncoord; i++)
+			c[i] = coord[i].f[l];
+
+		sim->sample(sim->sample_priv, instr->cat5.tex, instr->cat5.samp,
+				instr->opc, c, ncoord, t);
+
+		for (i = 0; i < 4; i++) {
+			if (dk == K_FLOAT)
+				texel[i].f[l] = t[i];
+			else if (dk == K_SINT)
+				texel[i].i[l] = f2i(t[i], INT32_MIN, INT32_MAX);
+			else
+				texel[i].u[l] = f2u(t[i], 0xffffffff);
+		}
+	}
+
+	for (i = 0; i < 4; i++)
+		if (dst->wrmask & (1 << i))
+			write_dst(sim, instr, dst, i, dk, &texel[i], mask);
+
+	return 0;
+}
+
+/*
+ * Category 6: memory
+ */
+
+static void * global_ptr(struct ir3_sim *sim, uint32_t addr, uint32_t size)
+{
+	uint32_t i;
+
+	for (i = 0; i < sim->mems_count; i++) {
+		struct sim_mem *m = &sim->mems[i];
+		if ((addr >= m->addr) && ((addr - m->addr) + size <= m->size))
+			return (uint8_t *)m->ptr + (addr - m->addr);
+	}
+
+	return NULL;
+}
+
+static void * mem_ptr(struct ir3_sim *sim, struct ir3_instruction *instr,
+		int lane, uint32_t addr, uint32_t size)
+{
+	void *ptr = NULL;
+
+	switch (instr->opc) {
+	case OPC_LDG:
+	case OPC_STG:
+		ptr = global_ptr(sim, addr, size);
+		break;
+	case OPC_LDP:
+	case OPC_STP:
+		if ((addr < PVT_SIZE) && (addr + size <= PVT_SIZE))
+			ptr = &sim->pvt[lane][addr];
+		break;
+	default:   /* local: */
+		if ((addr < LOCAL_SIZE) && (addr + size <= LOCAL_SIZE))
+			ptr = &sim->local[addr];
+		break;
+	}
+
+	if (!ptr)
+		fault(sim, instr, "invalid address", addr);
+
+	return ptr;
+}
+
+static int exec_cat6(struct ir3_sim *sim, struct ir3_instruction *instr,
+		uint32_t mask)
+{
+	uint32_t size = type_size(instr->cat6.type) / 8;
+	int i, l, n = max(instr->cat6.iim_val, 1);
+	struct ir3_register *addr_reg, *val_reg;
+	lanes_t addr, v;
+	bool store;
+
+	switch (instr->opc) {
+	case OPC_PREFETCH:
+		return 0;
+	case OPC_LDG:
+	case OPC_LDP:
+	case OPC_LDL:
+	case OPC_LDLW:
+		store = false;
+		addr_reg = instr->regs[1];
+		val_reg = instr->regs[0];
+		break;
+	case OPC_STG:
+	case OPC_STP:
+	case OPC_STL:
+	case OPC_STLW:
+		store = true;
+		addr_reg = instr->regs[0];
+		val_reg = instr->regs[1];
+		break;
+	default:
+		fault(sim, instr, "unsupported cat6 opc", instr->opc);
+		return -1;
+	}
+
+	read_src(sim, instr, addr_reg, 0, K_UINT, &addr);
+
+	for (i = 0; i < n; i++) {
+		/* the value components are consecutive: */
+		struct ir3_register tmp = *val_reg;
+		tmp.flags |= IR3_REG_R;
+		tmp.flags &= ~(IR3_REG_ABS | IR3_REG_NEGATE);
+
+		if (store)
+			read_src(sim, instr, &tmp, i, K_UINT, &v);
+
+		for (l = 0; l < LANES; l++) {
+			uint32_t a = addr.u[l] + instr->cat6.src_offset + (i * size);
+			void *ptr;
+
+			if (!(mask & (1 << l)))
+				continue;
+
+			ptr = mem_ptr(sim, instr, l, a, size);
+			if (!ptr)
+				return -1;
+
+			if (store) {
+				if (size == 4)
+					memcpy(ptr, &v.u[l], 4);
+				else if (size == 2)
+					*(uint16_t *)ptr = v.u[l];
+				else
+					*(uint8_t *)ptr = v.u[l];
+			} else {
+				if (size == 4)
+					memcpy(&v.u[l], ptr, 4);
+				else if (size == 2)
+					v.u[l] = *(uint16_t *)ptr;
+				else
+					v.u[l] = *(uint8_t *)ptr;
+			}
+		}
+
+		if (!store) {
+			if (size < 4)
+				narrow(&v, instr->cat6.type);
+			write_dst(sim, instr, &tmp, i, K_UINT, &v, mask);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Execution:
+ */
+
+static int exec_instr(struct ir3_sim *sim, struct ir3_instruction *instr,
+		uint32_t pc, uint32_t mask)
+{
+	switch (instr->category) {
+	case 0: return exec_cat0(sim, instr, pc, mask);
+	case 1: return exec_cat1(sim, instr, mask);
+	case 2: return exec_cat2(sim, instr, mask);
+	case 3: return exec_cat3(sim, instr, mask);
+	case 4: return exec_cat4(sim, instr, mask);
+	case 5: return exec_cat5(sim, instr, mask);
+	case 6: return exec_cat6(sim, instr, mask);
+	default:
+		fault(sim, instr, "invalid instruction category", instr->category);
+		return -1;
+	}
+}
+
+static int exec_batch(struct ir3_sim *sim, uint32_t lanes)
+{
+	struct ir3_shader *shader = sim->shader;
+	uint32_t steps = 0;
+	int l;
+
+	sim->live = lanes;
+	sim->killed = 0;
+	memset(sim->pc, 0, sizeof(sim->pc));
+	memset(sim->sp, 0, sizeof(sim->sp));
+
+	while (sim->live) {
+		uint32_t pc = ~0, mask = 0;
+
+		/* issue the lowest pc, for all the lanes that are there: */
+		for (l = 0; l < LANES; l++)
+			if (sim->live & (1 << l))
+				pc = min(pc, sim->pc[l]);
+		for (l = 0; l < LANES; l++)
+			if ((sim->live & (1 << l)) && (sim->pc[l] == pc))
+				mask |= (1 << l);
+
+		/* falling off the end is the same as end: */
+		if (pc >= shader->instrs_count) {
+			sim->live &= ~mask;
+			continue;
+		}
+
+		if (++steps > MAX_STEPS) {
+			ERROR_MSG("gave up after %u instructions, endless loop?", steps);
+			return -1;
+		}
+
+		for (l = 0; l < LANES; l++)
+			if (mask & (1 << l))
+				sim->pc[l] = pc + 1;
+
+		if (exec_instr(sim, shader->instrs[pc], pc, mask) || sim->fault)
+			return -1;
+	}
+
+	return 0;
+}
+
+struct ir3_sim * ir3_sim_create(struct ir3_shader *shader)
+{
+	struct ir3_sim *sim = calloc(1, sizeof(*sim));
+	uint32_t i, j;
+
+	if (!sim)
+		return NULL;
+
+	sim->shader = shader;
+	sim->next_addr = 0x10000000;
+
+	/* immediate consts from the @const headers: */
+	for (i = 0; i < shader->consts_count; i++) {
+		struct ir3_const *c = shader->consts[i];
+		for (j = 0; j < 4; j++)
+			ir3_sim_set_const(sim, c->cstart->num + j, c->val[j]);
+	}
+
+	return sim;
+}
+
+void ir3_sim_destroy(struct ir3_sim *sim)
+{
+	free(sim);
+}
+
+void ir3_sim_set_const(struct ir3_sim *sim, int num, uint32_t val)
+{
+	if ((num >= 0) && (num < NCONSTS))
+		sim->consts[num] = val;
+}
+
+int ir3_sim_map_buf(struct ir3_sim *sim, const char *name,
+		void *ptr, uint32_t size)
+{
+	struct ir3_shader *shader = sim->shader;
+	struct sim_mem *m;
+	uint32_t i;
+
+	for (i = 0; i < shader->bufs_count; i++)
+		if (!strcmp(shader->bufs[i]->name, name))
+			break;
+
+	if (i == shader->bufs_count) {
+		ERROR_MSG("invalid buf: %s", name);
+		return -1;
+	}
+
+	if (sim->mems_count >= ARRAY_SIZE(sim->mems)) {
+		ERROR_MSG("too many bufs");
+		return -1;
+	}
+
+	/* pretend gpu address, which the shader sees in the buf's const: */
+	m = &sim->mems[sim->mems_count++];
+	m->addr = sim->next_addr;
+	m->size = size;
+	m->ptr  = ptr;
+
+	sim->next_addr = ALIGN(m->addr + size + 1, 0x1000);
+
+	ir3_sim_set_const(sim, shader->bufs[i]->cstart->num, m->addr);
+
+	return 0;
+}
+
+void ir3_sim_set_sampler(struct ir3_sim *sim, ir3_sim_sample_t sample,
+		void *priv)
+{
+	sim->sample = sample;
+	sim->sample_priv = priv;
+}
+
+uint32_t ir3_sim_get_reg(struct ir3_sim *sim, unsigned lane, int num, bool half)
+{
+	if ((lane >= LANES) || (num < 0) || (num >= NREGS))
+		return 0;
+	if ((num >> 2) == REG_A0)
+		return sim->a0[lane];
+	if ((num >> 2) == REG_P0)
+		return sim->p0[num & 0x3][lane];
+	return half ? sim->half[num][lane] : sim->full[num][lane];
+}
+
+void ir3_sim_set_reg(struct ir3_sim *sim, unsigned lane, int num, bool half,
+		uint32_t val)
+{
+	if ((lane >= LANES) || (num < 0) || (num >= NREGS))
+		return;
+	if ((num >> 2) == REG_A0)
+		sim->a0[lane] = val;
+	else if ((num >> 2) == REG_P0)
+		sim->p0[num & 0x3][lane] = val;
+	else if (half)
+		sim->half[num][lane] = val;
+	else
+		sim->full[num][lane] = val;
+}
+
+void ir3_sim_set_input(struct ir3_sim *sim, unsigned lane, int inloc,
+		uint32_t val)
+{
+	if ((lane < LANES) && (inloc >= 0) && (inloc < NINPUTS))
+		sim->inputs[inloc][lane] = val;
+}
+
+bool ir3_sim_killed(struct ir3_sim *sim, unsigned lane)
+{
+	return (lane < LANES) && (sim->killed & (1 << lane));
+}
+
+int ir3_sim_run(struct ir3_sim *sim, uint32_t first, uint32_t count,
+		ir3_sim_lane_t setup, ir3_sim_lane_t finish, void *priv)
+{
+	uint32_t base, end = first + count;
+
+	sim->fault = false;
+	memset(sim->local, 0, sizeof(sim->local));
+
+	for (base = first; base < end; base += LANES) {
+		uint32_t l, n = min(LANES, end - base);
+
+		memset(sim->full, 0, sizeof(sim->full));
+		memset(sim->half, 0, sizeof(sim->half));
+		memset(sim->a0, 0, sizeof(sim->a0));
+		memset(sim->p0, 0, sizeof(sim->p0));
+		memset(sim->inputs, 0, sizeof(sim->inputs));
+		memset(sim->pvt, 0, sizeof(sim->pvt));
+
+		if (setup)
+			for (l = 0; l < n; l++)
+				setup(sim, l, base + l, priv);
+
+		if (exec_batch(sim, (uint32_t)((1ull << n) - 1)))
+			return -1;
+
+		if (finish)
+			for (l = 0; l < n; l++)
+				finish(sim, l, base + l, priv);
+	}
+
+	return 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "ir-a3xx.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "util.h"
+#include "instr-a3xx.h"
+
+/*
+ * Static analysis of a shader, for tuning occupancy: register pressure
+ * from the live ranges of each register component, plus instruction,
+ * fetch and sync-point counts and a (very) rough cycle estimate.
+ *
+ * The liveness is for straight line code, branches are treated as falling
+ * through.  Attributes are live-in, and @out's (plus @varying's, for a
+ * vertex shader, which is taken to be a shader with attributes) are live
+ * out.  Relative (a0.x indexed) accesses are not tracked.
+ */
+
+/* scalar components, full and then half registers: */
+#define NCOMP     (4 * 64)
+#define LIVE_SIZE ((2 * NCOMP) / 32)
+
+struct live {
+	uint32_t bits[LIVE_SIZE];
+};
+
+/* rough per-instruction costs, for comparing shaders against each
+ * other rather than for absolute numbers.  ALU cost is per repeat:
+ */
+static const uint32_t cat_cycles[7] = {
+	[0] = 1,    /* flow control, nop */
+	[1] = 1,    /* mov/cov */
+	[2] = 1,
+	[3] = 1,
+	[4] = 4,    /* sfu */
+	[5] = 20,   /* tex fetch */
+	[6] = 20,   /* mem load/store */
+};
+
+static bool is_store(struct ir3_instruction *instr)
+{
+	if (instr->category != 6)
+		return false;
+	switch (instr->opc) {
+	case OPC_STG:
+	case OPC_STL:
+	case OPC_STP:
+	case OPC_STI:
+	case OPC_STLW:
+	case OPC_STGB:
+	case OPC_STIB:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* set n components of reg, starting at num: */
+static void set_comps(struct live *l, int num, int n, bool half)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		int c = num + i;
+
+		/* skip a0/p0, and anything out of range: */
+		if ((c < 0) || (c >= NCOMP) || ((c >> 2) == REG_A0) ||
+				((c >> 2) == REG_P0))
+			continue;
+
+		if (half)
+			c += NCOMP;
+
+		l->bits[c / 32] |= 1u << (c % 32);
+	}
+}
+
+static void add_reg(struct live *l, struct ir3_register *reg, int n)
+{
+	if (reg->flags & (IR3_REG_CONST | IR3_REG_IMMED | IR3_REG_RELATIV))
+		return;
+	set_comps(l, reg->num, n, !!(reg->flags & IR3_REG_HALF));
+}
+
+/* components read by a src, with (rptN) a src with (r) advances: */
+static int src_comps(struct ir3_instruction *instr, struct ir3_register *reg)
+{
+	return (reg->flags & IR3_REG_R) ? instr->repeat + 1 : 1;
+}
+
+static void instr_regs(struct ir3_instruction *instr,
+		struct live *def, struct live *use)
+{
+	struct ir3_register *dst = instr->regs[0];
+	unsigned i;
+
+	memset(def, 0, sizeof(*def));
+	memset(use, 0, sizeof(*use));
+
+	switch (instr->category) {
+	case 0:
+		break;
+	case 5:
+		/* dst written according to wrmask, src1 holds the coords: */
+		for (i = 0; i < 4; i++)
+			if (dst->wrmask & (1 << i))
+				set_comps(def, dst->num + i, 1, !!(dst->flags & IR3_REG_HALF));
+		if (instr->regs_count > 1) {
+			add_reg(use, instr->regs[1], 2 +
+					!!(instr->flags & IR3_INSTR_3D) +
+					!!(instr->flags & IR3_INSTR_A));
+		}
+		for (i = 2; i < instr->regs_count; i++)
+			add_reg(use, instr->regs[i], 1);
+		break;
+	case 6:
+		/* cat6.iim_val is the number of components loaded/stored: */
+		if (is_store(instr)) {
+			add_reg(use, dst, 1);
+			if (instr->regs_count > 1)
+				add_reg(use, instr->regs[1], max(instr->cat6.iim_val, 1));
+		} else {
+			if (instr->opc != OPC_PREFETCH)
+				add_reg(def, dst, max(instr->cat6.iim_val, 1));
+			if (instr->regs_count > 1)
+				add_reg(use, instr->regs[1], 1);
+		}
+		for (i = 2; i < instr->regs_count; i++)
+			add_reg(use, instr->regs[i], 1);
+		break;
+	default:
+		/* dst advances with each repeat: */
+		add_reg(def, dst, instr->repeat + 1);
+		for (i = 1; i < instr->regs_count; i++)
+			add_reg(use, instr->regs[i], src_comps(instr, instr->regs[i]));
+		break;
+	}
+}
+
+static void count_live(const struct live *l, uint32_t *full, uint32_t *half)
+{
+	int i;
+
+	*full = *half = 0;
+	for (i = 0; i < LIVE_SIZE; i++) {
+		if (i < (LIVE_SIZE / 2))
+			*full += __builtin_popcount(l->bits[i]);
+		else
+			*half += __builtin_popcount(l->bits[i]);
+	}
+}
+
+int ir3_shader_stats(struct ir3_shader *shader, struct ir3_shader_stats *stats)
+{
+	uint32_t i, j, n = shader->instrs_count;
+	struct live live, def, use;
+
+	memset(stats, 0, sizeof(*stats));
+
+	stats->live_full = calloc(max(n, 1), sizeof(stats->live_full[0]));
+	stats->live_half = calloc(max(n, 1), sizeof(stats->live_half[0]));
+	if (!stats->live_full || !stats->live_half) {
+		ir3_shader_stats_fini(stats);
+		return -1;
+	}
+
+	/* counts and cycle estimate: */
+	for (i = 0; i < n; i++) {
+		struct ir3_instruction *instr = shader->instrs[i];
+		int cat = instr->category;
+		uint32_t cycles;
+
+		if ((cat < 0) || (cat >= ARRAY_SIZE(cat_cycles))) {
+			ERROR_MSG("invalid instruction category: %d", cat);
+			ir3_shader_stats_fini(stats);
+			return -1;
+		}
+
+		if (cat >= 5)
+			cycles = cat_cycles[cat];
+		else
+			cycles = cat_cycles[cat] * (instr->repeat + 1);
+
+		stats->instrs++;
+		stats->instrs_per_cat[cat]++;
+		stats->cycles_per_cat[cat] += cycles;
+
+		if (cat >= 5)
+			stats->mem_cycles += cycles;
+		else
+			stats->alu_cycles += cycles;
+
+		if ((cat == 0) && (instr->opc == OPC_NOP))
+			stats->nops += instr->repeat + 1;
+		if (cat == 5)
+			stats->tex_fetches++;
+		if ((cat == 6) && (instr->opc != OPC_PREFETCH))
+			stats->mem_accesses++;
+
+		if (instr->flags & IR3_INSTR_SY)
+			stats->sy++;
+		if (instr->flags & IR3_INSTR_SS)
+			stats->ss++;
+		if (instr->flags & IR3_INSTR_JP)
+			stats->jp++;
+	}
+
+	/* live-out: */
+	memset(&live, 0, sizeof(live));
+	for (i = 0; i < shader->outs_count; i++) {
+		struct ir3_out *o = shader->outs[i];
+		set_comps(&live, o->rstart->num, max(o->num, 1),
+				!!(o->rstart->flags & IR3_REG_HALF));
+	}
+	if (shader->attributes_count) {
+		for (i = 0; i < shader->varyings_count; i++) {
+			struct ir3_varying *v = shader->varyings[i];
+			set_comps(&live, v->rstart->num, v->num,
+					!!(v->rstart->flags & IR3_REG_HALF));
+		}
+	}
+
+	/* and walk backwards.  The pressure at each instruction is its
+	 * live-out, minus the srcs it kills (last use, so the dst can reuse
+	 * them), plus anything it writes (even if never read).  The kills
+	 * are never in the live-out, so that is just live-out | def:
+	 */
+	for (i = n; i-- > 0; ) {
+		struct live across;
+		uint32_t full, half;
+
+		instr_regs(shader->instrs[i], &def, &use);
+
+		for (j = 0; j < LIVE_SIZE; j++) {
+			across.bits[j] = live.bits[j] | def.bits[j];
+			live.bits[j] = (live.bits[j] & ~def.bits[j]) | use.bits[j];
+		}
+
+		count_live(&across, &full, &half);
+
+		stats->live_full[i] = full;
+		stats->live_half[i] = half;
+		stats->max_live_full = max(stats->max_live_full, full);
+		stats->max_live_half = max(stats->max_live_half, half);
+	}
+
+	return 0;
+}
+
+void ir3_shader_stats_fini(struct ir3_shader_stats *stats)
+{
+	free(stats->live_full);
+	free(stats->live_half);
+	stats->live_full = stats->live_half = NULL;
+}
@@ -0,0 +1,11 @@
+(sy)(ss)nop
+nop
+nop
+br p0.x, #5
+nop
+nop
+nop
+add.f r0.x, r0.y, r0.z
+mov.f32f32 r0.w, r0.x
+jump #-6
+end
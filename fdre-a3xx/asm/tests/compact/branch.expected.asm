@@ -0,0 +1,7 @@
+(sy)(ss)(rpt2)nop
+br p0.x, #3
+(rpt2)nop
+add.f r0.x, r0.y, r0.z
+mov.f32f32 r0.w, r0.x
+jump #-4
+end
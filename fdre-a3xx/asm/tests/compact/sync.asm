@@ -0,0 +1,11 @@
+(sy)(ss)mov.f32f32 r0.x, c0.x
+(sy)add.f r0.y, r0.x, r0.x
+(ss)add.f r0.z, r0.x, r0.x
+sqrt r1.x, r0.y
+(sy)mov.f32f32 r1.y, r0.z
+(ss)add.f r1.z, r1.x, r0.x
+isam (f32)(xyzw)r2.x, r0.x, s#0, t#0
+(ss)mov.f32f32 r1.w, r1.z
+(sy)add.f r3.x, r2.x, r2.y
+(sy)add.f r3.y, r2.z, r2.w
+end
@@ -0,0 +1,12 @@
+(rpt1)nop
+nop
+br !p0.x, #4
+nop
+nop
+nop
+nop
+(rpt5)nop
+(rpt2)nop
+mov.f32f32 r0.x, r0.y
+jump #-7
+end
@@ -0,0 +1,8 @@
+(rpt2)nop
+br !p0.x, #2
+(rpt2)nop
+(rpt6)nop
+(rpt2)nop
+mov.f32f32 r0.x, r0.y
+jump #-4
+end
@@ -0,0 +1,28 @@
+@buf(c5.z) inbuf
+@buf(c5.x) outbuf
+(sy)(rpt4)nop
+(sy)(ss)mov.s32s32 r0.w, 0
+mov.f32f32 r1.y, c5.z
+mov.f32f32 r1.z, c5.x
+mov.s32s32 r1.w, 0
+add.s r2.x, c2.y, r0.x
+(rpt2)nop
+shl.b r2.x, r2.x, 5
+add.s r2.y, c2.z, r0.y
+mov.f32f32 r2.z, c4.z
+(rpt2)nop
+cmps.u.lt r2.z, r2.z, 2
+(rpt2)nop
+sel.b32 r1.w, r1.w, r2.z, r2.y
+(rpt2)nop
+add.s r1.w, r1.w, r2.x
+(rpt2)nop
+shl.b r1.w, r1.w, 2
+(rpt2)nop
+add.s r1.y, r1.y, r1.w
+(rpt5)nop
+ldg.f32 r1.y,g[r1.y], 1
+add.s r1.z, r1.z, r1.w
+(rpt5)nop
+(sy)stg.f32 g[r1.z],r1.y, 1
+end
@@ -0,0 +1,8 @@
+@out(r2.x-r2.x) gl_FragColor
+mov.f32f32 r0.x, c0.x
+mov.f32f32 r0.y, c0.y
+add.f r1.x, r0.x, r0.y
+mul.f r1.y, r1.x, r1.x
+(rpt1)nop
+add.f r2.x, r1.x, r1.y
+end
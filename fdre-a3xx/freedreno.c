@@ -29,6 +29,8 @@
 #include "msm_kgsl.h"
 #include "freedreno.h"
 #include "program.h"
+#include "stateobj.h"
+#include "upload.h"
 #include "ring.h"
 #include "ir-a3xx.h"
 #include "ws.h"
@@ -42,6 +44,62 @@ emit_marker(struct fd_ringbuffer *ring, int scratch_idx)
 	OUT_RING(ring, ++marker_cnt);
 }
 
+/* groups of state emitted for a draw, each of which is a state object
+ * (see stateobj.h), in the order they are emitted:
+ */
+enum fd_group {
+	FD_GROUP_PROGRAM,       /* shader state, PC_PRIM_VTX_CNTL */
+	FD_GROUP_RASTERIZER,    /* GRAS_SU_MODE_CONTROL, RB_RENDER_CONTROL, etc */
+	FD_GROUP_ZSA,           /* depth/stencil */
+	FD_GROUP_VIEWPORT,
+	FD_GROUP_TEXTURES,
+	FD_GROUP_BLEND,         /* RB_MRT_CONTROL / RB_MRT_BLEND_CONTROL */
+	FD_GROUP_MAX,
+};
+
+/* groups whose state object needs to be looked up again on the next draw: */
+enum fd_dirty {
+	FD_DIRTY_PROGRAM    = (1 << FD_GROUP_PROGRAM),
+	FD_DIRTY_RASTERIZER = (1 << FD_GROUP_RASTERIZER),
+	FD_DIRTY_ZSA        = (1 << FD_GROUP_ZSA),
+	FD_DIRTY_VIEWPORT   = (1 << FD_GROUP_VIEWPORT),
+	FD_DIRTY_TEXTURES   = (1 << FD_GROUP_TEXTURES),
+	FD_DIRTY_BLEND      = (1 << FD_GROUP_BLEND),
+	FD_DIRTY_ALL        = (1 << FD_GROUP_MAX) - 1,
+};
+
+/* the keys for the program and texture state objects, which are built
+ * at draw time.  The other groups are hashed directly from fd_state.
+ * They are memset() first, so padding doesn't matter:
+ */
+struct fd_program_key {
+	struct fd_program *program;
+	uint32_t seqno;
+	bool resolve;
+	/* zero for the clear/gmem2mem programs, which set it themselves: */
+	uint32_t pc_prim_vtx_cntl;
+};
+
+struct fd_textures_key {
+	enum a3xx_tex_filter min_filter, mag_filter;
+	enum a3xx_tex_clamp clamp_s, clamp_t;
+	uint32_t count;
+	struct fd_surface *tex[MAX_SAMPLERS];
+};
+
+/* a queued draw/clear/query.  The cmds themselves are back to back in
+ * the ring, up until draw_end, and at flush time they are replayed with
+ * the state objects they need emitted in front of them, whenever that
+ * differs from the previous cmd:
+ */
+struct fd_cmd {
+	struct fd_ringmarker *start;
+	/* NULL for groups which the cmd doesn't depend on: */
+	struct fd_stateobj *stateobjs[FD_GROUP_MAX];
+	/* the cmd trashes state, so it must all be emitted again after: */
+	bool clobber;
+};
+
 struct fd_state {
 
 	struct fd_winsys *ws;
@@ -54,7 +112,24 @@ struct fd_state {
 
 	/* cmdstream buffer with render commands: */
 	struct fd_ringbuffer *ring;
-	struct fd_ringmarker *draw_start, *draw_end;
+	struct fd_ringmarker *draw_end;
+
+	/* queued cmds since last flush: */
+	struct fd_cmd *cmds;
+	uint32_t ncmds, maxcmds;
+
+	/* state objects for the current state, plus the solid program
+	 * for clear and gmem2mem:
+	 */
+	struct fd_stateobj_cache *stateobj_cache;
+	struct fd_stateobj *stateobjs[FD_GROUP_MAX];
+	struct fd_stateobj *clear_program, *resolve_program;
+
+	/* streaming buffer for client vertex arrays and indices, plus the
+	 * current fence (anything uploaded before that can be recycled):
+	 */
+	struct fd_upload *upload;
+	uint32_t upload_fence;
 
 	struct {
 		struct fd_bo *bo;
@@ -108,7 +183,10 @@ struct fd_state {
 	/* have there been any render cmds since last flush? */
 	bool dirty;
 
-	struct {
+	/* state which has changed since the last draw: */
+	enum fd_dirty dirty_state;
+
+	struct fd_viewport_state {
 		struct {
 			float x, y, z;
 		} scale, offset;
@@ -124,15 +202,23 @@ struct fd_state {
 	} query;
 
 	uint32_t pc_prim_vtx_cntl;
-	uint32_t gras_su_mode_control;
-	struct {
-		uint32_t control;
-		uint32_t blendcontrol;
-	} rb_mrt[4];
-	uint32_t rb_render_control;
-	uint32_t rb_stencil_control;
-	uint32_t rb_depth_control;
-	uint32_t rb_stencilrefmask;
+
+	/* these double as the keys for their state objects: */
+	struct fd_raster_state {
+		uint32_t gras_su_mode_control;
+		uint32_t rb_render_control;
+	} raster;
+	struct fd_zsa_state {
+		uint32_t rb_depth_control;
+		uint32_t rb_stencil_control;
+		uint32_t rb_stencilrefmask;
+	} zsa;
+	struct fd_blend_state {
+		struct {
+			uint32_t control;
+			uint32_t blendcontrol;
+		} rb_mrt[4];
+	} blend;
 };
 
 struct fd_shader_const {
@@ -181,6 +267,50 @@ static void emit_mem_write(struct fd_state *state, struct fd_bo *bo,
 		OUT_RING(ring, *(dwords++));
 }
 
+/* start a new cmd in the queue, everything emitted up until the next
+ * cmd (or the flush) belongs to it:
+ */
+static struct fd_cmd * cmd_begin(struct fd_state *state)
+{
+	struct fd_cmd *cmd;
+
+	if (state->ncmds == state->maxcmds) {
+		uint32_t n = max(2 * state->maxcmds, 16);
+		state->cmds = realloc(state->cmds, n * sizeof(state->cmds[0]));
+		assert(state->cmds);
+		memset(&state->cmds[state->maxcmds], 0,
+				(n - state->maxcmds) * sizeof(state->cmds[0]));
+		state->maxcmds = n;
+	}
+
+	cmd = &state->cmds[state->ncmds++];
+	if (!cmd->start)
+		cmd->start = fd_ringmarker_new(state->ring);
+	fd_ringmarker_mark(cmd->start);
+
+	return cmd;
+}
+
+static struct fd_stateobj * get_program_stateobj(struct fd_state *state,
+		struct fd_program *program, bool resolve, uint32_t pc_prim_vtx_cntl);
+
+/* drop the queued cmds, and their references to state objects: */
+static void release_cmds(struct fd_state *state)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < state->ncmds; i++) {
+		struct fd_cmd *cmd = &state->cmds[i];
+		for (j = 0; j < FD_GROUP_MAX; j++) {
+			fd_stateobj_unref(cmd->stateobjs[j]);
+			cmd->stateobjs[j] = NULL;
+		}
+		cmd->clobber = false;
+	}
+
+	state->ncmds = 0;
+}
+
 const char *solid_vertex_shader_asm =
 		"@attribute(r0.x)  aPosition                             \n"
 		"(sy)(ss)end                                             \n"
@@ -223,22 +353,18 @@ struct fd_state * fd_init(void)
 #endif
 	if (!state->ws)
 		state->ws = fd_winsys_fbdev_open();
-
-	if (state->ws) {
-		state->dev  = state->ws->dev;
-		state->pipe = state->ws->pipe;
-	} else {
-		/* well, we can still do compute.. */
-		int fd = drmOpen("msm", NULL);
-		if (fd < 0) {
-			ERROR_MSG("could not open msm device: %d (%s)",
-					fd, strerror(errno));
-			goto fail;
-		}
-
-		state->dev = fd_device_new(fd);
-		state->pipe = fd_pipe_new(state->dev, FD_PIPE_3D);
+	if (!state->ws) {
+		/* no display, but we can still render offscreen (or do
+		 * compute):
+		 */
+		ERROR_MSG("failed to open fbdev, rendering offscreen");
+		state->ws = fd_winsys_null_open();
 	}
+	if (!state->ws)
+		goto fail;
+
+	state->dev  = state->ws->dev;
+	state->pipe = state->ws->pipe;
 
 	fd_pipe_get_param(state->pipe, FD_GMEM_SIZE, &val);
 	state->gmemsize_bytes = val;
@@ -247,9 +373,12 @@ struct fd_state * fd_init(void)
 	state->device_id = val;
 
 	state->ring = fd_ringbuffer_new(state->pipe, 0x10000);
-	state->draw_start = fd_ringmarker_new(state->ring);
 	state->draw_end = fd_ringmarker_new(state->ring);
 
+	state->stateobj_cache = fd_stateobj_cache_new();
+
+	state->upload = fd_upload_new(state->dev, state->pipe, 0x10000);
+
 	state->solid_const = fd_bo_new(state->dev, 0x1000,
 			DRM_FREEDRENO_GEM_TYPE_KMEM);
 
@@ -288,32 +417,38 @@ struct fd_state * fd_init(void)
 	p->count = 1;
 	p->data  = &state->clear.color[0];
 
+	state->clear_program = get_program_stateobj(state,
+			state->solid_program, false, 0);
+	state->resolve_program = get_program_stateobj(state,
+			state->solid_program, true, 0);
+
 	/* setup initial GL state: */
+	state->dirty_state = FD_DIRTY_ALL;
 	state->cull_mode = GL_BACK;
 
 	state->pc_prim_vtx_cntl =
 			A3XX_PC_PRIM_VTX_CNTL_PROVOKING_VTX_LAST |
 			A3XX_PC_PRIM_VTX_CNTL_POLYMODE_FRONT_PTYPE(PC_DRAW_TRIANGLES) |
 			A3XX_PC_PRIM_VTX_CNTL_POLYMODE_BACK_PTYPE(PC_DRAW_TRIANGLES);
-	state->gras_su_mode_control =
+	state->raster.gras_su_mode_control =
 			A3XX_GRAS_SU_MODE_CONTROL_LINEHALFWIDTH(4);
-	state->rb_render_control =
+	state->raster.rb_render_control =
 			A3XX_RB_RENDER_CONTROL_ALPHA_TEST_FUNC(g2a(GL_ALWAYS));
-	state->rb_depth_control =
+	state->zsa.rb_depth_control =
 			A3XX_RB_DEPTH_CONTROL_Z_WRITE_ENABLE |
 			A3XX_RB_DEPTH_CONTROL_EARLY_Z_DISABLE |
 			A3XX_RB_DEPTH_CONTROL_ZFUNC(g2a(GL_LESS));
-	state->rb_stencil_control =
+	state->zsa.rb_stencil_control =
 			A3XX_RB_STENCIL_CONTROL_FUNC(g2a(GL_ALWAYS)) |
 			A3XX_RB_STENCIL_CONTROL_FUNC_BF(g2a(GL_ALWAYS));
-	state->rb_stencilrefmask = 0xff000000 |
+	state->zsa.rb_stencilrefmask = 0xff000000 |
 			A3XX_RB_STENCILREFMASK_STENCILWRITEMASK(0xff);
 
 	state->clear.depth = 1;
 	state->clear.stencil = 0;
 
-	for (i = 0; i < ARRAY_SIZE(state->rb_mrt); i++) {
-		state->rb_mrt[i].blendcontrol =
+	for (i = 0; i < ARRAY_SIZE(state->blend.rb_mrt); i++) {
+		state->blend.rb_mrt[i].blendcontrol =
 				A3XX_RB_MRT_BLEND_CONTROL_RGB_SRC_FACTOR(FACTOR_ONE) |
 				A3XX_RB_MRT_BLEND_CONTROL_RGB_BLEND_OPCODE(BLEND_DST_PLUS_SRC) |
 				A3XX_RB_MRT_BLEND_CONTROL_RGB_DEST_FACTOR(FACTOR_ZERO) |
@@ -321,7 +456,7 @@ struct fd_state * fd_init(void)
 				A3XX_RB_MRT_BLEND_CONTROL_ALPHA_BLEND_OPCODE(BLEND_DST_PLUS_SRC) |
 				A3XX_RB_MRT_BLEND_CONTROL_ALPHA_DEST_FACTOR(FACTOR_ZERO) |
 				A3XX_RB_MRT_BLEND_CONTROL_CLAMP_ENABLE;
-		state->rb_mrt[i].control =
+		state->blend.rb_mrt[i].control =
 				A3XX_RB_MRT_CONTROL_READ_DEST_ENABLE |
 				A3XX_RB_MRT_CONTROL_ROP_CODE(ROP_COPY) |
 				A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS) |
@@ -337,8 +472,25 @@ fail:
 
 void fd_fini(struct fd_state *state)
 {
+	uint32_t i;
+
 	fd_surface_del(state, state->render_target.surface);
-	fd_ringbuffer_del(state->ring);
+
+	release_cmds(state);
+	for (i = 0; i < state->maxcmds; i++)
+		fd_ringmarker_del(state->cmds[i].start);
+	free(state->cmds);
+	for (i = 0; i < FD_GROUP_MAX; i++)
+		fd_stateobj_unref(state->stateobjs[i]);
+	fd_stateobj_unref(state->clear_program);
+	fd_stateobj_unref(state->resolve_program);
+	fd_stateobj_cache_del(state->stateobj_cache);
+
+	fd_upload_del(state->upload);
+
+	if (state->ring)
+		fd_ringbuffer_del(state->ring);
+	fd_program_cache_release(state);
 	if (state->ws)
 		state->ws->destroy(state->ws);
 	free(state);
@@ -348,11 +500,13 @@ void fd_fini(struct fd_state *state)
 
 int fd_vertex_shader_attach_asm(struct fd_state *state, const char *src)
 {
+	state->dirty_state |= FD_DIRTY_PROGRAM | FD_DIRTY_TEXTURES;
 	return fd_program_attach_asm(state->program, FD_SHADER_VERTEX, src);
 }
 
 int fd_fragment_shader_attach_asm(struct fd_state *state, const char *src)
 {
+	state->dirty_state |= FD_DIRTY_PROGRAM | FD_DIRTY_TEXTURES;
 	return fd_program_attach_asm(state->program, FD_SHADER_FRAGMENT, src);
 }
 
@@ -365,6 +519,7 @@ int fd_link(struct fd_state *state)
 int fd_set_program(struct fd_state *state, struct fd_program *program)
 {
 	state->program = program;
+	state->dirty_state |= FD_DIRTY_PROGRAM | FD_DIRTY_TEXTURES;
 	return fd_link(state);
 }
 
@@ -385,19 +540,28 @@ int fd_attribute_bo(struct fd_state *state, const char *name,
 	struct fd_param *p = find_param(&state->attributes, name);
 	if (!p)
 		return -1;
-	p->fmt  = fmt;
-	p->bo   = bo;
+	p->fmt    = fmt;
+	p->bo     = bo;
+	p->offset = 0;
+	p->ptr    = NULL;
 	return 0;
 }
 
+/* like client vertex arrays, the data is read at each draw, see
+ * upload_attributes(), so it must stay valid until the last draw
+ * using it:
+ */
 int fd_attribute_pointer(struct fd_state *state, const char *name,
 		enum a3xx_vtx_fmt fmt, uint32_t count, const void *data)
 {
-	uint32_t size = fmt2size(fmt) * count;
-	struct fd_bo *bo = fd_bo_new(state->dev, size,
-			DRM_FREEDRENO_GEM_TYPE_KMEM);
-	memcpy(fd_bo_map(bo), data, size);
-	return fd_attribute_bo(state, name, fmt, bo);
+	struct fd_param *p = find_param(&state->attributes, name);
+	if (!p)
+		return -1;
+	p->fmt     = fmt;
+	p->bo      = NULL;
+	p->ptr     = data;
+	p->ptrsize = fmt2size(fmt) * count;
+	return 0;
 }
 
 int fd_uniform_attach(struct fd_state *state, const char *name,
@@ -421,6 +585,7 @@ int fd_set_texture(struct fd_state *state, const char *name,
 	if (!p)
 		return -1;
 	p->tex = tex;
+	state->dirty_state |= FD_DIRTY_TEXTURES;
 	return 0;
 }
 
@@ -463,16 +628,16 @@ static void emit_draw_indx(struct fd_ringbuffer *ring, enum pc_di_primtype primt
 	}
 }
 
-static void emit_mrt(struct fd_state *state,
-		struct fd_ringbuffer *ring, struct fd_surface *surface)
+static void emit_mrt(struct fd_ringbuffer *ring,
+		const struct fd_blend_state *blend)
 {
 	int i;
 
 	for (i = 0; i < 4; i++) {
 		OUT_PKT0(ring, REG_A3XX_RB_MRT_CONTROL(i), 1);
-		OUT_RING(ring, state->rb_mrt[i].control);
+		OUT_RING(ring, blend->rb_mrt[i].control);
 		OUT_PKT0(ring, REG_A3XX_RB_MRT_BLEND_CONTROL(i), 1);
-		OUT_RING(ring, state->rb_mrt[i].blendcontrol);
+		OUT_RING(ring, blend->rb_mrt[i].blendcontrol);
 	}
 }
 
@@ -481,7 +646,9 @@ static void emit_gmem2mem(struct fd_state *state,
 		struct fd_ringbuffer *ring, struct fd_surface *surface,
 		uint32_t xoff, uint32_t yoff)
 {
-	fd_program_emit_state(state->solid_program, 0,
+	OUT_IB  (ring, state->resolve_program->start,
+			state->resolve_program->end);
+	fd_program_emit_draw_state(state->solid_program, 0,
 			NULL, &state->solid_attributes, NULL, ring);
 
 	OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
@@ -548,19 +715,19 @@ static void emit_gmem2mem(struct fd_state *state,
 			A3XX_GRAS_SC_CONTROL_RASTER_MODE(0));
 
 	OUT_PKT0(ring, REG_A3XX_GRAS_SU_MODE_CONTROL, 1);
-	OUT_RING(ring, state->gras_su_mode_control);
+	OUT_RING(ring, state->raster.gras_su_mode_control);
 
-	emit_mrt(state, ring, surface);
+	emit_mrt(ring, &state->blend);
 
 	OUT_PKT0(ring, REG_A3XX_RB_STENCIL_CONTROL, 1);
-	OUT_RING(ring, state->rb_stencil_control);
+	OUT_RING(ring, state->zsa.rb_stencil_control);
 
 	OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
-	OUT_RING(ring, state->rb_depth_control);
+	OUT_RING(ring, state->zsa.rb_depth_control);
 
 	OUT_PKT0(ring, REG_A3XX_RB_STENCILREFMASK, 2);
-	OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK */
-	OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK_BF */
+	OUT_RING(ring, state->zsa.rb_stencilrefmask);    /* RB_STENCILREFMASK */
+	OUT_RING(ring, state->zsa.rb_stencilrefmask);    /* RB_STENCILREFMASK_BF */
 
 	OUT_PKT0(ring, REG_A3XX_GRAS_CL_CLIP_CNTL, 1);
 	OUT_RING(ring, A3XX_GRAS_CL_CLIP_CNTL_IJ_PERSP_CENTER);
@@ -588,10 +755,18 @@ void fd_clear_depth(struct fd_state *state, float depth)
 int fd_clear(struct fd_state *state, GLbitfield mask)
 {
 	struct fd_ringbuffer *ring = state->ring;
+	struct fd_cmd *cmd;
 	int i;
 
 	state->dirty = true;
 
+	/* the solid program and clear state need to be replaced before
+	 * the next draw:
+	 */
+	cmd = cmd_begin(state);
+	cmd->stateobjs[FD_GROUP_PROGRAM] = fd_stateobj_ref(state->clear_program);
+	cmd->clobber = true;
+
 	OUT_PKT3(ring, CP_REG_RMW, 3);
 	OUT_RING(ring, REG_A3XX_RB_RENDER_CONTROL);
 	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_BIN_WIDTH__MASK);
@@ -643,7 +818,7 @@ int fd_clear(struct fd_state *state, GLbitfield mask)
 				A3XX_RB_MRT_BLEND_CONTROL_CLAMP_ENABLE);
 	}
 
-	fd_program_emit_state(state->solid_program, 0,
+	fd_program_emit_draw_state(state->solid_program, 0,
 			&state->solid_uniforms, &state->solid_attributes,
 			NULL, ring);
 
@@ -660,8 +835,9 @@ int fd_cull(struct fd_state *state, GLenum mode)
 
 int fd_depth_func(struct fd_state *state, GLenum depth_func)
 {
-	state->rb_depth_control &= ~A3XX_RB_DEPTH_CONTROL_ZFUNC__MASK;
-	state->rb_depth_control |= A3XX_RB_DEPTH_CONTROL_ZFUNC(g2a(depth_func));
+	state->zsa.rb_depth_control &= ~A3XX_RB_DEPTH_CONTROL_ZFUNC__MASK;
+	state->zsa.rb_depth_control |= A3XX_RB_DEPTH_CONTROL_ZFUNC(g2a(depth_func));
+	state->dirty_state |= FD_DIRTY_ZSA;
 	return 0;
 }
 
@@ -677,29 +853,35 @@ int fd_enable(struct fd_state *state, GLenum cap)
 	case GL_CULL_FACE:
 		if ((state->cull_mode == GL_FRONT) ||
 				(state->cull_mode == GL_FRONT_AND_BACK)) {
-			state->gras_su_mode_control |= A3XX_GRAS_SU_MODE_CONTROL_CULL_FRONT;
+			state->raster.gras_su_mode_control |= A3XX_GRAS_SU_MODE_CONTROL_CULL_FRONT;
 		}
 		if ((state->cull_mode == GL_BACK) ||
 				(state->cull_mode == GL_FRONT_AND_BACK)) {
-			state->gras_su_mode_control |= A3XX_GRAS_SU_MODE_CONTROL_CULL_BACK;
+			state->raster.gras_su_mode_control |= A3XX_GRAS_SU_MODE_CONTROL_CULL_BACK;
 		}
+		state->dirty_state |= FD_DIRTY_RASTERIZER;
 		return 0;
 	case GL_POLYGON_OFFSET_FILL:
-		state->gras_su_mode_control |= A3XX_GRAS_SU_MODE_CONTROL_POLY_OFFSET;
+		state->raster.gras_su_mode_control |= A3XX_GRAS_SU_MODE_CONTROL_POLY_OFFSET;
+		state->dirty_state |= FD_DIRTY_RASTERIZER;
 		return 0;
 	case GL_BLEND:
-		state->rb_mrt[0].control |= (A3XX_RB_MRT_CONTROL_BLEND | A3XX_RB_MRT_CONTROL_BLEND2);
+		state->blend.rb_mrt[0].control |= (A3XX_RB_MRT_CONTROL_BLEND | A3XX_RB_MRT_CONTROL_BLEND2);
+		state->dirty_state |= FD_DIRTY_BLEND;
 		return 0;
 	case GL_DEPTH_TEST:
-		state->rb_depth_control |= (A3XX_RB_DEPTH_CONTROL_Z_ENABLE |
+		state->zsa.rb_depth_control |= (A3XX_RB_DEPTH_CONTROL_Z_ENABLE |
 				A3XX_RB_DEPTH_CONTROL_Z_TEST_ENABLE);
+		state->dirty_state |= FD_DIRTY_ZSA;
 		return 0;
 	case GL_STENCIL_TEST:
-		state->rb_stencil_control |= (A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE |
+		state->zsa.rb_stencil_control |= (A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE |
 				A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE_BF);
+		state->dirty_state |= FD_DIRTY_ZSA;
 		return 0;
 	case GL_DITHER:
-		state->rb_mrt[0].control |= A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS);
+		state->blend.rb_mrt[0].control |= A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS);
+		state->dirty_state |= FD_DIRTY_BLEND;
 		return 0;
 	default:
 		ERROR_MSG("unsupported cap: 0x%04x", cap);
@@ -711,25 +893,31 @@ int fd_disable(struct fd_state *state, GLenum cap)
 {
 	switch (cap) {
 	case GL_CULL_FACE:
-		state->gras_su_mode_control &=
+		state->raster.gras_su_mode_control &=
 			~(A3XX_GRAS_SU_MODE_CONTROL_CULL_FRONT | A3XX_GRAS_SU_MODE_CONTROL_CULL_BACK);
+		state->dirty_state |= FD_DIRTY_RASTERIZER;
 		return 0;
 	case GL_POLYGON_OFFSET_FILL:
-		state->gras_su_mode_control &= ~A3XX_GRAS_SU_MODE_CONTROL_POLY_OFFSET;
+		state->raster.gras_su_mode_control &= ~A3XX_GRAS_SU_MODE_CONTROL_POLY_OFFSET;
+		state->dirty_state |= FD_DIRTY_RASTERIZER;
 		return 0;
 	case GL_BLEND:
-		state->rb_mrt[0].control &= ~(A3XX_RB_MRT_CONTROL_BLEND | A3XX_RB_MRT_CONTROL_BLEND2);
+		state->blend.rb_mrt[0].control &= ~(A3XX_RB_MRT_CONTROL_BLEND | A3XX_RB_MRT_CONTROL_BLEND2);
+		state->dirty_state |= FD_DIRTY_BLEND;
 		return 0;
 	case GL_DEPTH_TEST:
-		state->rb_depth_control &= ~(A3XX_RB_DEPTH_CONTROL_Z_ENABLE |
+		state->zsa.rb_depth_control &= ~(A3XX_RB_DEPTH_CONTROL_Z_ENABLE |
 				A3XX_RB_DEPTH_CONTROL_Z_TEST_ENABLE);
+		state->dirty_state |= FD_DIRTY_ZSA;
 		return 0;
 	case GL_STENCIL_TEST:
-		state->rb_stencil_control &= ~(A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE |
+		state->zsa.rb_stencil_control &= ~(A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE |
 				A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE_BF);
+		state->dirty_state |= FD_DIRTY_ZSA;
 		return 0;
 	case GL_DITHER:
-		state->rb_mrt[0].control &= ~A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS);
+		state->blend.rb_mrt[0].control &= ~A3XX_RB_MRT_CONTROL_DITHER_MODE(DITHER_ALWAYS);
+		state->dirty_state |= FD_DIRTY_BLEND;
 		return 0;
 	default:
 		ERROR_MSG("unsupported cap: 0x%04x", cap);
@@ -833,7 +1021,8 @@ int fd_blend_func(struct fd_state *state, GLenum sfactor, GLenum dfactor)
 		return -1;
 	}
 
-	state->rb_mrt[0].blendcontrol = bc;
+	state->blend.rb_mrt[0].blendcontrol = bc;
+	state->dirty_state |= FD_DIRTY_BLEND;
 
 	return 0;
 }
@@ -841,18 +1030,19 @@ int fd_blend_func(struct fd_state *state, GLenum sfactor, GLenum dfactor)
 int fd_stencil_func(struct fd_state *state, GLenum func,
 		GLint ref, GLuint mask)
 {
-	state->rb_stencilrefmask &= ~(
+	state->zsa.rb_stencilrefmask &= ~(
 			A3XX_RB_STENCILREFMASK_STENCILREF__MASK |
 			A3XX_RB_STENCILREFMASK_STENCILMASK__MASK);
-	state->rb_stencilrefmask |=
+	state->zsa.rb_stencilrefmask |=
 			A3XX_RB_STENCILREFMASK_STENCILREF(ref) |
 			A3XX_RB_STENCILREFMASK_STENCILMASK(mask);
-	state->rb_stencil_control &= ~(
+	state->zsa.rb_stencil_control &= ~(
 			A3XX_RB_STENCIL_CONTROL_FUNC__MASK |
 			A3XX_RB_STENCIL_CONTROL_FUNC_BF__MASK );
-	state->rb_stencil_control |=
+	state->zsa.rb_stencil_control |=
 			A3XX_RB_STENCIL_CONTROL_FUNC(g2a(func)) |
 			A3XX_RB_STENCIL_CONTROL_FUNC_BF(g2a(func));
+	state->dirty_state |= FD_DIRTY_ZSA;
 	return 0;
 }
 
@@ -896,7 +1086,7 @@ int fd_stencil_op(struct fd_state *state, GLenum sfail,
 			set_stencil_op(&rbzpass, zpass))
 		return -1;
 
-	state->rb_stencil_control &= ~(
+	state->zsa.rb_stencil_control &= ~(
 			A3XX_RB_STENCIL_CONTROL_FAIL__MASK |
 			A3XX_RB_STENCIL_CONTROL_ZPASS__MASK |
 			A3XX_RB_STENCIL_CONTROL_ZFAIL__MASK |
@@ -904,20 +1094,22 @@ int fd_stencil_op(struct fd_state *state, GLenum sfail,
 			A3XX_RB_STENCIL_CONTROL_ZPASS_BF__MASK |
 			A3XX_RB_STENCIL_CONTROL_ZFAIL_BF__MASK);
 
-	state->rb_stencil_control |=
+	state->zsa.rb_stencil_control |=
 			A3XX_RB_STENCIL_CONTROL_FAIL(rbsfail) |
 			A3XX_RB_STENCIL_CONTROL_ZPASS(rbzpass) |
 			A3XX_RB_STENCIL_CONTROL_ZFAIL(rbzfail) |
 			A3XX_RB_STENCIL_CONTROL_FAIL_BF(rbsfail) |
 			A3XX_RB_STENCIL_CONTROL_ZPASS_BF(rbzpass) |
 			A3XX_RB_STENCIL_CONTROL_ZFAIL_BF(rbzfail);
+	state->dirty_state |= FD_DIRTY_ZSA;
 	return 0;
 }
 
 int fd_stencil_mask(struct fd_state *state, GLuint mask)
 {
-	state->rb_stencilrefmask &= ~A3XX_RB_STENCILREFMASK_STENCILWRITEMASK__MASK;
-	state->rb_stencilrefmask |= A3XX_RB_STENCILREFMASK_STENCILWRITEMASK(mask);
+	state->zsa.rb_stencilrefmask &= ~A3XX_RB_STENCILREFMASK_STENCILWRITEMASK__MASK;
+	state->zsa.rb_stencilrefmask |= A3XX_RB_STENCILREFMASK_STENCILWRITEMASK(mask);
+	state->dirty_state |= FD_DIRTY_ZSA;
 	return 0;
 }
 
@@ -956,6 +1148,8 @@ static int set_clamp(enum a3xx_tex_clamp *clamp, GLint param)
 
 int fd_tex_param(struct fd_state *state, GLenum name, GLint param)
 {
+	state->dirty_state |= FD_DIRTY_TEXTURES;
+
 	switch (name) {
 	default:
 	case GL_TEXTURE_MAG_FILTER:
@@ -971,19 +1165,15 @@ int fd_tex_param(struct fd_state *state, GLenum name, GLint param)
 	}
 }
 
-static void emit_textures(struct fd_state *state)
+static void emit_textures(struct fd_ringbuffer *ring,
+		const struct fd_textures_key *key)
 {
-	struct fd_ringbuffer *ring = state->ring;
-	struct ir3_sampler **samplers;
-	int n, samplers_count;
+	int n, samplers_count = key->count;
 
 	/* this dst_off should align w/ values in TPL1_TP_FS_TEX_OFFSET:
 	 */
 	int dst_off = 16;
 
-	samplers = fd_program_samplers(state->program,
-			FD_SHADER_FRAGMENT, &samplers_count);
-
 	if (!samplers_count)
 		return;
 
@@ -996,10 +1186,10 @@ static void emit_textures(struct fd_state *state)
 	OUT_RING(ring, CP_LOAD_STATE_1_STATE_TYPE(ST_SHADER) |
 			CP_LOAD_STATE_1_EXT_SRC_ADDR(0));
 	for (n = 0; n < samplers_count; n++) {
-		OUT_RING(ring, A3XX_TEX_SAMP_0_XY_MAG(state->textures.mag_filter) |
-				A3XX_TEX_SAMP_0_XY_MIN(state->textures.min_filter) |
-				A3XX_TEX_SAMP_0_WRAP_S(state->textures.clamp_s) |
-				A3XX_TEX_SAMP_0_WRAP_T(state->textures.clamp_t) |
+		OUT_RING(ring, A3XX_TEX_SAMP_0_XY_MAG(key->mag_filter) |
+				A3XX_TEX_SAMP_0_XY_MIN(key->min_filter) |
+				A3XX_TEX_SAMP_0_WRAP_S(key->clamp_s) |
+				A3XX_TEX_SAMP_0_WRAP_T(key->clamp_t) |
 				A3XX_TEX_SAMP_0_WRAP_R(A3XX_TEX_REPEAT));
 		OUT_RING(ring, 0x00000000);
 	}
@@ -1013,9 +1203,7 @@ static void emit_textures(struct fd_state *state)
 	OUT_RING(ring, CP_LOAD_STATE_1_STATE_TYPE(ST_CONSTANTS) |
 			CP_LOAD_STATE_1_EXT_SRC_ADDR(0));
 	for (n = 0; n < samplers_count; n++) {
-		struct fd_param *p = find_param(&state->textures.params,
-				samplers[n]->name);
-		struct fd_surface *tex = p->tex;
+		struct fd_surface *tex = key->tex[n];
 		OUT_RING(ring, 0x00c00000 | // XXX
 				A3XX_TEX_CONST_0_SWIZ_X(A3XX_TEX_X) |
 				A3XX_TEX_CONST_0_SWIZ_Y(A3XX_TEX_Y) |
@@ -1039,9 +1227,7 @@ static void emit_textures(struct fd_state *state)
 	OUT_RING(ring, CP_LOAD_STATE_1_STATE_TYPE(ST_CONSTANTS) |
 			CP_LOAD_STATE_1_EXT_SRC_ADDR(0));
 	for (n = 0; n < samplers_count; n++) {
-		struct fd_param *p = find_param(&state->textures.params,
-				samplers[n]->name);
-		OUT_RELOC(ring, p->tex->bo, 0, 0);
+		OUT_RELOC(ring, key->tex[n]->bo, 0, 0);
 		OUT_RING(ring, 0x00000000);
 		OUT_RING(ring, 0x00000000);
 		OUT_RING(ring, 0x00000000);
@@ -1139,46 +1325,124 @@ static void emit_query(struct fd_state *state, bool flush)
 	}
 }
 
-static int draw_impl(struct fd_state *state, GLenum mode,
-		GLint first, GLsizei count, GLenum type, const GLvoid *indices)
+/* emit the cmdstream for a state object, from its key: */
+static void emit_stateobj_key(struct fd_ringbuffer *ring,
+		struct fd_stateobj *so)
 {
-	struct fd_ringbuffer *ring = state->ring;
-	enum pc_di_index_size idx_type = INDEX_SIZE_IGN;
-	struct fd_bo *indx_bo = NULL;
-	uint32_t idx_size, stride_in_vpc;
-
-	if (indices) {
-		switch (type) {
-		case GL_UNSIGNED_BYTE:
-			idx_type = INDEX_SIZE_8_BIT;
-			idx_size = count;
-			break;
-		case GL_UNSIGNED_SHORT:
-			idx_type = INDEX_SIZE_16_BIT;
-			idx_size = 2 * count;
-			break;
-		case GL_UNSIGNED_INT:
-			idx_type = INDEX_SIZE_32_BIT;
-			idx_size = 4 * count;
-			break;
-		default:
-			ERROR_MSG("invalid type");
-			return -1;
+	switch (so->type) {
+	case FD_GROUP_PROGRAM: {
+		const struct fd_program_key *key = (void *)so->key;
+		fd_program_emit_shader_state(key->program, key->resolve, ring);
+		if (key->pc_prim_vtx_cntl) {
+			OUT_PKT0(ring, REG_A3XX_PC_PRIM_VTX_CNTL, 1);
+			OUT_RING(ring, key->pc_prim_vtx_cntl);
 		}
+		break;
+	}
+	case FD_GROUP_RASTERIZER: {
+		const struct fd_raster_state *raster = (void *)so->key;
+		OUT_PKT0(ring, REG_A3XX_GRAS_SU_MODE_CONTROL, 1);
+		OUT_RING(ring, raster->gras_su_mode_control);
+
+		OUT_PKT3(ring, CP_REG_RMW, 3);
+		OUT_RING(ring, REG_A3XX_RB_RENDER_CONTROL);
+		OUT_RING(ring, A3XX_RB_RENDER_CONTROL_BIN_WIDTH__MASK);
+		OUT_RING(ring, A3XX_RB_RENDER_CONTROL_ENABLE_GMEM |
+				A3XX_RB_RENDER_CONTROL_FACENESS |
+				A3XX_RB_RENDER_CONTROL_XCOORD |
+				A3XX_RB_RENDER_CONTROL_YCOORD |
+				A3XX_RB_RENDER_CONTROL_ZCOORD |
+				A3XX_RB_RENDER_CONTROL_WCOORD |
+				raster->rb_render_control);
+
+		OUT_PKT0(ring, REG_A3XX_GRAS_CL_CLIP_CNTL, 1);
+		OUT_RING(ring, A3XX_GRAS_CL_CLIP_CNTL_IJ_PERSP_CENTER |
+				A3XX_GRAS_CL_CLIP_CNTL_ZCOORD |
+				A3XX_GRAS_CL_CLIP_CNTL_WCOORD);
+		break;
+	}
+	case FD_GROUP_ZSA: {
+		const struct fd_zsa_state *zsa = (void *)so->key;
+		OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
+		OUT_RING(ring, zsa->rb_depth_control);
 
-		indx_bo = fd_bo_new(state->dev, idx_size,
-				DRM_FREEDRENO_GEM_TYPE_KMEM);
-		memcpy(fd_bo_map(indx_bo), indices, idx_size);
+		OUT_PKT0(ring, REG_A3XX_RB_STENCILREFMASK, 2);
+		OUT_RING(ring, zsa->rb_stencilrefmask);    /* RB_STENCILREFMASK */
+		OUT_RING(ring, zsa->rb_stencilrefmask);    /* RB_STENCILREFMASK_BF */
 
-	} else {
-		idx_type = INDEX_SIZE_IGN;
-		idx_size = 0;
+		OUT_PKT0(ring, REG_A3XX_RB_STENCIL_CONTROL, 1);
+		OUT_RING(ring, zsa->rb_stencil_control);
+		break;
+	}
+	case FD_GROUP_VIEWPORT: {
+		const struct fd_viewport_state *viewport = (void *)so->key;
+		OUT_PKT0(ring, REG_A3XX_GRAS_CL_VPORT_XOFFSET, 6);
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_XOFFSET(viewport->offset.x));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_XSCALE(viewport->scale.x));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_YOFFSET(viewport->offset.y));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_YSCALE(viewport->scale.y));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZOFFSET(viewport->offset.z));
+		OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZSCALE(viewport->scale.z));
+		break;
 	}
+	case FD_GROUP_TEXTURES:
+		emit_textures(ring, (void *)so->key);
+		break;
+	case FD_GROUP_BLEND:
+		emit_mrt(ring, (void *)so->key);
+		break;
+	}
+}
 
-	state->dirty = true;
+/* returns a new reference.  The cmdstream for new objects is built
+ * right away, since it can depend on things which aren't immutable
+ * (like the program):
+ */
+static struct fd_stateobj * get_stateobj(struct fd_state *state,
+		enum fd_group group, const void *key, uint32_t keysize)
+{
+	struct fd_stateobj *so = fd_stateobj_get(state->stateobj_cache,
+			group, key, keysize);
+
+	if (!so->ring) {
+		/* the program state includes the shaders, inline: */
+		uint32_t size = (group == FD_GROUP_PROGRAM) ? 0x2000 : 0x1000;
+		emit_stateobj_key(fd_stateobj_begin(so, state->pipe, size), so);
+		fd_stateobj_end(so);
+	}
 
-	fd_program_emit_state(state->program, first, &state->uniforms,
-			&state->attributes, &state->bufs, ring);
+	return so;
+}
+
+static void set_stateobj(struct fd_state *state, enum fd_group group,
+		const void *key, uint32_t keysize)
+{
+	struct fd_stateobj *so = get_stateobj(state, group, key, keysize);
+	fd_stateobj_unref(state->stateobjs[group]);
+	state->stateobjs[group] = so;
+}
+
+static struct fd_stateobj * get_program_stateobj(struct fd_state *state,
+		struct fd_program *program, bool resolve, uint32_t pc_prim_vtx_cntl)
+{
+	struct fd_program_key key;
+
+	memset(&key, 0, sizeof(key));
+	key.program = program;
+	key.seqno = fd_program_seqno(program);
+	key.resolve = resolve;
+	key.pc_prim_vtx_cntl = pc_prim_vtx_cntl;
+
+	return get_stateobj(state, FD_GROUP_PROGRAM, &key, sizeof(key));
+}
+
+/* look up new state objects for the state which has changed: */
+static void update_stateobjs(struct fd_state *state)
+{
+	enum fd_dirty dirty = state->dirty_state;
+
+	if (dirty & FD_DIRTY_PROGRAM) {
+		uint32_t stride_in_vpc;
 
 	/*
 	 * +----------- max outloc
@@ -1223,64 +1487,162 @@ static int draw_impl(struct fd_state *state, GLenum mode,
 	 * driver never uses value of 1, so possibly 0 (no varying), or minimum
 	 * of 2..
 	 */
-	stride_in_vpc = ALIGN(fd_program_outloc(state->program) - 8, 4) / 4;
-	if (stride_in_vpc > 0)
-		stride_in_vpc = max(stride_in_vpc, 2);
-	OUT_PKT0(ring, REG_A3XX_PC_PRIM_VTX_CNTL, 1);
-	OUT_RING(ring, A3XX_PC_PRIM_VTX_CNTL_STRIDE_IN_VPC(stride_in_vpc) |
-			state->pc_prim_vtx_cntl);
+		stride_in_vpc = ALIGN(fd_program_outloc(state->program) - 8, 4) / 4;
+		if (stride_in_vpc > 0)
+			stride_in_vpc = max(stride_in_vpc, 2);
+
+		fd_stateobj_unref(state->stateobjs[FD_GROUP_PROGRAM]);
+		state->stateobjs[FD_GROUP_PROGRAM] = get_program_stateobj(state,
+				state->program, false, state->pc_prim_vtx_cntl |
+				A3XX_PC_PRIM_VTX_CNTL_STRIDE_IN_VPC(stride_in_vpc));
+	}
 
-	OUT_PKT0(ring, REG_A3XX_GRAS_SU_MODE_CONTROL, 1);
-	OUT_RING(ring, state->gras_su_mode_control);
+	if (dirty & FD_DIRTY_RASTERIZER) {
+		set_stateobj(state, FD_GROUP_RASTERIZER,
+				&state->raster, sizeof(state->raster));
+	}
 
-	OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
-	OUT_RING(ring, state->rb_depth_control);
+	if (dirty & FD_DIRTY_ZSA) {
+		set_stateobj(state, FD_GROUP_ZSA,
+				&state->zsa, sizeof(state->zsa));
+	}
 
-	OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
-	OUT_RING(ring, 0x00000000);
+	if (dirty & FD_DIRTY_VIEWPORT) {
+		set_stateobj(state, FD_GROUP_VIEWPORT,
+				&state->viewport, sizeof(state->viewport));
+	}
 
-	OUT_PKT3(ring, CP_REG_RMW, 3);
-	OUT_RING(ring, REG_A3XX_RB_RENDER_CONTROL);
-	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_BIN_WIDTH__MASK);
-	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_ENABLE_GMEM |
-			A3XX_RB_RENDER_CONTROL_FACENESS |
-			A3XX_RB_RENDER_CONTROL_XCOORD |
-			A3XX_RB_RENDER_CONTROL_YCOORD |
-			A3XX_RB_RENDER_CONTROL_ZCOORD |
-			A3XX_RB_RENDER_CONTROL_WCOORD |
-			state->rb_render_control);
+	if (dirty & FD_DIRTY_TEXTURES) {
+		struct fd_textures_key key;
+		struct ir3_sampler **samplers;
+		int n, samplers_count;
+
+		samplers = fd_program_samplers(state->program,
+				FD_SHADER_FRAGMENT, &samplers_count);
+
+		memset(&key, 0, sizeof(key));
+		key.min_filter = state->textures.min_filter;
+		key.mag_filter = state->textures.mag_filter;
+		key.clamp_s = state->textures.clamp_s;
+		key.clamp_t = state->textures.clamp_t;
+		key.count = samplers_count;
+		for (n = 0; n < samplers_count; n++) {
+			struct fd_param *p = find_param(&state->textures.params,
+					samplers[n]->name);
+			key.tex[n] = p->tex;
+		}
 
-	OUT_PKT0(ring, REG_A3XX_GRAS_CL_CLIP_CNTL, 1);
-	OUT_RING(ring, A3XX_GRAS_CL_CLIP_CNTL_IJ_PERSP_CENTER |
-			A3XX_GRAS_CL_CLIP_CNTL_ZCOORD |
-			A3XX_GRAS_CL_CLIP_CNTL_WCOORD);
+		set_stateobj(state, FD_GROUP_TEXTURES, &key, sizeof(key));
+	}
 
-	OUT_PKT0(ring, REG_A3XX_GRAS_CL_VPORT_XOFFSET, 6);
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_XOFFSET(state->viewport.offset.x));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_XSCALE(state->viewport.scale.x));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_YOFFSET(state->viewport.offset.y));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_YSCALE(state->viewport.scale.y));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZOFFSET(state->viewport.offset.z));
-	OUT_RING(ring, A3XX_GRAS_CL_VPORT_ZSCALE(state->viewport.scale.z));
+	if (dirty & FD_DIRTY_BLEND) {
+		set_stateobj(state, FD_GROUP_BLEND,
+				&state->blend, sizeof(state->blend));
+	}
 
-	OUT_PKT0(ring, REG_A3XX_RB_STENCILREFMASK, 2);
-	OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK */
-	OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK_BF */
+	state->dirty_state = 0;
+}
 
-	OUT_PKT0(ring, REG_A3XX_RB_STENCIL_CONTROL, 1);
-	OUT_RING(ring, state->rb_stencil_control);
+/* copy client vertex arrays into the upload buffer.  The client can
+ * change the contents between draws without calling
+ * fd_attribute_pointer() again, so the previous copy is only re-used
+ * if it is from the current upload fence and still matches:
+ */
+static void upload_attributes(struct fd_state *state)
+{
+	uint32_t i;
+
+	for (i = 0; i < state->attributes.nparams; i++) {
+		struct fd_param *p = &state->attributes.params[i];
+
+		if (!p->ptr)
+			continue;
+
+		if (p->bo && (p->fence == state->upload_fence) &&
+				!memcmp((uint8_t *)fd_bo_map(p->bo) + p->offset,
+						p->ptr, p->ptrsize))
+			continue;
+
+		fd_upload_data(state->upload, p->ptr, p->ptrsize, 32,
+				&p->bo, &p->offset);
+		p->fence = state->upload_fence;
+	}
+}
+
+static int draw_impl(struct fd_state *state, GLenum mode,
+		GLint first, GLsizei count, GLenum type, const GLvoid *indices)
+{
+	struct fd_ringbuffer *ring = state->ring;
+	enum pc_di_index_size idx_type = INDEX_SIZE_IGN;
+	struct fd_bo *indx_bo = NULL;
+	struct fd_cmd *cmd;
+	uint32_t *start;
+	uint32_t i, idx_size, idx_offset = 0;
+
+	if (indices) {
+		switch (type) {
+		case GL_UNSIGNED_BYTE:
+			idx_type = INDEX_SIZE_8_BIT;
+			idx_size = count;
+			break;
+		case GL_UNSIGNED_SHORT:
+			idx_type = INDEX_SIZE_16_BIT;
+			idx_size = 2 * count;
+			break;
+		case GL_UNSIGNED_INT:
+			idx_type = INDEX_SIZE_32_BIT;
+			idx_size = 4 * count;
+			break;
+		default:
+			ERROR_MSG("invalid type");
+			return -1;
+		}
+	} else {
+		idx_type = INDEX_SIZE_IGN;
+		idx_size = 0;
+	}
 
-	emit_textures(state);
+	/* cull draws which can't produce any fragments, since the only
+	 * primitives supported are triangles, that includes culling both
+	 * faces:
+	 */
+	if ((count <= 0) || ((state->raster.gras_su_mode_control &
+			A3XX_GRAS_SU_MODE_CONTROL_CULL_FRONT) &&
+			(state->raster.gras_su_mode_control &
+			A3XX_GRAS_SU_MODE_CONTROL_CULL_BACK))) {
+		DEBUG_MSG("draw: culled");
+		return 0;
+	}
+
+	if (indices) {
+		fd_upload_data(state->upload, indices, idx_size, 32,
+				&indx_bo, &idx_offset);
+	}
+
+	upload_attributes(state);
+
+	state->dirty = true;
+
+	update_stateobjs(state);
+
+	/* the state objects are emitted when the cmds are replayed, so
+	 * the draw cmd itself is just the per-draw state:
+	 */
+	cmd = cmd_begin(state);
+	for (i = 0; i < FD_GROUP_MAX; i++)
+		cmd->stateobjs[i] = fd_stateobj_ref(state->stateobjs[i]);
 
-	emit_mrt(state, ring, state->render_target.surface);
+	start = ring->cur;
+
+	fd_program_emit_draw_state(state->program, first, &state->uniforms,
+			&state->attributes, &state->bufs, ring);
 
 	emit_draw_indx(ring, mode2prim(mode), idx_type, count,
-			indx_bo, 0, idx_size);
+			indx_bo, idx_offset, idx_size);
 	if (state->query.active)
 		emit_query(state, false);
 
-	if (indx_bo)
-		fd_bo_del(indx_bo);
+	DEBUG_MSG("draw: %u dwords", (uint32_t)(ring->cur - start));
 
 	return 0;
 }
@@ -1439,9 +1801,11 @@ int fd_run_compute(struct fd_state *state, uint32_t workdim,
 	// reset..
 
 	fd_pipe_wait(state->pipe, fd_ringbuffer_timestamp(ring));
+	state->upload_fence = fd_upload_fence(state->upload,
+			fd_ringbuffer_timestamp(ring));
 	fd_ringbuffer_reset(state->ring);
 
-	fd_ringmarker_mark(state->draw_start);
+	release_cmds(state);
 
 	return 0;
 }
@@ -1482,6 +1846,73 @@ static void flush_setup(struct fd_state *state, struct fd_ringbuffer *ring)
 	}
 }
 
+static bool needs_state(struct fd_cmd *cmd, struct fd_stateobj **cur)
+{
+	uint32_t i;
+	for (i = 0; i < FD_GROUP_MAX; i++)
+		if (cmd->stateobjs[i] && (cmd->stateobjs[i] != cur[i]))
+			return true;
+	return false;
+}
+
+/* replay the queued cmds, emitting the state objects which differ from
+ * the previous cmd.  Since the state objects are hash-consed, that is
+ * just a pointer compare.  Runs of cmds which don't need any state in
+ * between are merged into a single IB.  Both the state objects and the
+ * cmds are reached by IB, so this has to emit into the submitted ring
+ * itself, not into something which is IB'd to:
+ */
+static void emit_cmds(struct fd_state *state, struct fd_ringbuffer *ring)
+{
+	struct fd_stateobj *cur[FD_GROUP_MAX] = {0};
+	uint32_t *start = ring->cur;
+	uint32_t i, j, g, nib = 0, nstate = 0;
+
+	for (i = 0; i < state->ncmds; i = j) {
+		struct fd_cmd *cmd = &state->cmds[i];
+		uint32_t changed = 0;
+
+		for (g = 0; g < FD_GROUP_MAX; g++) {
+			if (cmd->stateobjs[g] && (cmd->stateobjs[g] != cur[g])) {
+				changed |= (1 << g);
+				cur[g] = cmd->stateobjs[g];
+			}
+		}
+
+		if (changed & FD_DIRTY_PROGRAM)
+			OUT_IB(ring, cur[FD_GROUP_PROGRAM]->start,
+					cur[FD_GROUP_PROGRAM]->end);
+
+		/* only need to idle when the shader or render control changes: */
+		if (changed & (FD_DIRTY_PROGRAM | FD_DIRTY_RASTERIZER)) {
+			OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
+			OUT_RING(ring, 0x00000000);
+		}
+
+		for (g = FD_GROUP_PROGRAM + 1; g < FD_GROUP_MAX; g++)
+			if (changed & (1 << g))
+				OUT_IB(ring, cur[g]->start, cur[g]->end);
+
+		nstate += __builtin_popcount(changed);
+
+		for (j = i + 1; j < state->ncmds; j++) {
+			if (state->cmds[j - 1].clobber ||
+					needs_state(&state->cmds[j], cur))
+				break;
+		}
+
+		OUT_IB(ring, cmd->start, (j < state->ncmds) ?
+				state->cmds[j].start : state->draw_end);
+		nib++;
+
+		if (state->cmds[j - 1].clobber)
+			memset(cur, 0, sizeof(cur));
+	}
+
+	DEBUG_MSG("replay: %u cmds, %u IBs, %u state objects, %u dwords",
+			state->ncmds, nib, nstate, (uint32_t)(ring->cur - start));
+}
+
 int fd_flush(struct fd_state *state)
 {
 	struct fd_surface *surface = state->render_target.surface;
@@ -1545,8 +1976,12 @@ int fd_flush(struct fd_state *state)
 			OUT_RING(ring, A3XX_GRAS_SC_SCREEN_SCISSOR_BR_X(x2) |
 					A3XX_GRAS_SC_SCREEN_SCISSOR_BR_Y(y2));
 
-			/* emit IB to drawcmds: */
-			OUT_IB  (ring, state->draw_start, state->draw_end);
+			/* replay the cmds for this tile.  This has to be done
+			 * in the submitted ring, rather than built once and
+			 * IB'd to, since the cmds are IBs themselves and the
+			 * CP only goes two levels deep:
+			 */
+			emit_cmds(state, ring);
 
 			/* emit gmem2mem to transfer tile back to system memory: */
 			emit_gmem2mem(state, ring, surface, xoff, yoff);
@@ -1563,9 +1998,11 @@ int fd_flush(struct fd_state *state)
 	fd_ringmarker_flush(state->draw_end);
 	fd_ringbuffer_flush(ring);
 	fd_pipe_wait(state->pipe, fd_ringbuffer_timestamp(ring));
+	state->upload_fence = fd_upload_fence(state->upload,
+			fd_ringbuffer_timestamp(ring));
 	fd_ringbuffer_reset(state->ring);
 
-	fd_ringmarker_mark(state->draw_start);
+	release_cmds(state);
 
 	state->dirty = false;
 
@@ -1612,10 +2049,34 @@ struct fd_surface * fd_surface_screen(struct fd_state *state,
 	return state->ws->get_surface(state->ws, width, height);
 }
 
+/* a new surface could end up at the same address, so texture state
+ * objects pointing at this one must not be found by lookups anymore:
+ */
+static void evict_surface(struct fd_state *state, struct fd_surface *surface)
+{
+	struct fd_stateobj *so;
+	uint32_t i, n;
+
+	for (i = 0; i <= state->ncmds; i++) {
+		if (i < state->ncmds)
+			so = state->cmds[i].stateobjs[FD_GROUP_TEXTURES];
+		else
+			so = state->stateobjs[FD_GROUP_TEXTURES];
+		if (!so)
+			continue;
+		for (n = 0; n < MAX_SAMPLERS; n++) {
+			const struct fd_textures_key *key = (void *)so->key;
+			if (key->tex[n] == surface)
+				fd_stateobj_evict(so);
+		}
+	}
+}
+
 void fd_surface_del(struct fd_state *state, struct fd_surface *surface)
 {
 	if (!surface)
 		return;
+	evict_surface(state, surface);
 	if (state->render_target.surface == surface)
 		state->render_target.surface = NULL;
 	fd_bo_del(surface->bo);
@@ -1644,8 +2105,8 @@ static void attach_render_target(struct fd_state *state,
 	uint32_t gmem_size = state->gmemsize_bytes;
 	uint32_t max_width = 256;
 
-	if ((state->rb_depth_control & A3XX_RB_DEPTH_CONTROL_Z_ENABLE) |
-			(state->rb_stencil_control & A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE)) {
+	if ((state->zsa.rb_depth_control & A3XX_RB_DEPTH_CONTROL_Z_ENABLE) |
+			(state->zsa.rb_stencil_control & A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE)) {
 		gmem_size /= 2;
 	}
 
@@ -1695,6 +2156,7 @@ static void set_viewport(struct fd_state *state, uint32_t x, uint32_t y,
 	state->viewport.offset.x = half_width + x;
 	state->viewport.offset.y = half_height + y;
 	state->viewport.offset.z = 0.5;
+	state->dirty_state |= FD_DIRTY_VIEWPORT;
 }
 
 void fd_make_current(struct fd_state *state,
@@ -1748,7 +2210,7 @@ void fd_make_current(struct fd_state *state,
 	OUT_RING(ring, A3XX_RB_MODE_CONTROL_RENDER_MODE(RB_RENDERING_PASS) |
 			A3XX_RB_MODE_CONTROL_MARB_CACHE_SPLIT_MODE);
 
-	emit_mrt(state, ring, surface);
+	emit_mrt(ring, &state->blend);
 
 	OUT_PKT0(ring, REG_A3XX_GRAS_SC_CONTROL, 1);
 	OUT_RING(ring, A3XX_GRAS_SC_CONTROL_RENDER_MODE(RB_RENDERING_PASS) |
@@ -1769,7 +2231,7 @@ void fd_make_current(struct fd_state *state,
 	OUT_RING(ring, 0x00000001);        /* GRAS_TSE_DEBUG_ECO */
 
 	OUT_PKT0(ring, REG_A3XX_GRAS_SU_MODE_CONTROL, 1);
-	OUT_RING(ring, state->gras_su_mode_control);
+	OUT_RING(ring, state->raster.gras_su_mode_control);
 
 	OUT_PKT0(ring, REG_A3XX_GRAS_SU_POINT_MINMAX, 2);
 	OUT_RING(ring, 0xffc00010);        /* GRAS_SU_POINT_MINMAX */
@@ -1853,7 +2315,7 @@ void fd_make_current(struct fd_state *state,
 	}
 
 	OUT_PKT0(ring, REG_A3XX_RB_DEPTH_INFO, 2);
-	if (state->rb_stencil_control & A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE) {
+	if (state->zsa.rb_stencil_control & A3XX_RB_STENCIL_CONTROL_STENCIL_ENABLE) {
 		OUT_RING(ring, A3XX_RB_DEPTH_INFO_DEPTH_FORMAT(DEPTHX_24_8) |
 				A3XX_RB_DEPTH_INFO_DEPTH_BASE(bw * bh));
 		OUT_RING(ring, A3XX_RB_DEPTH_PITCH(bw * 4));
@@ -1868,11 +2330,11 @@ void fd_make_current(struct fd_state *state,
 			A3XX_RB_WINDOW_OFFSET_Y(0));
 
 	OUT_PKT0(ring, REG_A3XX_RB_DEPTH_CONTROL, 1);
-	OUT_RING(ring, state->rb_depth_control);
+	OUT_RING(ring, state->zsa.rb_depth_control);
 
 	OUT_PKT0(ring, REG_A3XX_RB_STENCILREFMASK, 2);
-	OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK */
-	OUT_RING(ring, state->rb_stencilrefmask);    /* RB_STENCILREFMASK_BF */
+	OUT_RING(ring, state->zsa.rb_stencilrefmask);    /* RB_STENCILREFMASK */
+	OUT_RING(ring, state->zsa.rb_stencilrefmask);    /* RB_STENCILREFMASK_BF */
 
 	OUT_PKT0(ring, REG_A3XX_RB_BLEND_RED, 4);
 	OUT_RING(ring, 0x00000000);        /* RB_BLEND_RED */
@@ -1881,7 +2343,7 @@ void fd_make_current(struct fd_state *state,
 	OUT_RING(ring, 0x3c0000ff);        /* RB_BLEND_ALPHA */
 
 	OUT_PKT0(ring, REG_A3XX_RB_STENCIL_CONTROL, 1);
-	OUT_RING(ring, state->rb_stencil_control);
+	OUT_RING(ring, state->zsa.rb_stencil_control);
 
 	OUT_PKT3(ring, CP_WAIT_FOR_IDLE, 1);
 	OUT_RING(ring, 0x00000000);
@@ -1890,7 +2352,7 @@ void fd_make_current(struct fd_state *state,
 	OUT_RING(ring, REG_A3XX_RB_RENDER_CONTROL);
 	OUT_RING(ring, A3XX_RB_RENDER_CONTROL_BIN_WIDTH__MASK);
 	OUT_RING(ring, 0x2000 | /* XXX */
-			state->rb_render_control);
+			state->raster.rb_render_control);
 
 	OUT_PKT0(ring, REG_A3XX_GRAS_CL_VPORT_XOFFSET, 6);
 	OUT_RING(ring, A3XX_GRAS_CL_VPORT_XOFFSET(state->viewport.offset.x));
@@ -1908,8 +2370,6 @@ void fd_make_current(struct fd_state *state,
 	OUT_RING(ring, A3XX_GRAS_CL_CLIP_CNTL_IJ_PERSP_CENTER);
 
 	fd_ringbuffer_flush(ring);
-
-	fd_ringmarker_mark(state->draw_start);
 }
 
 static int dump_hex(void *buf, uint32_t w, uint32_t h, uint32_t p, bool flt)
@@ -1967,6 +2427,7 @@ int fd_query_start(struct fd_state *state)
 		return -1;
 
 	state->query.active = true;
+	cmd_begin(state);
 	emit_query(state, true);
 
 	return 0;
@@ -45,6 +45,9 @@ struct fd_bo * fd_attribute_bo_new(struct fd_state *state,
 		uint32_t size, const void *data);
 int fd_attribute_bo(struct fd_state *state, const char *name,
 		enum a3xx_vtx_fmt fmt, struct fd_bo * bo);
+/* data is not copied until the draw, so it must stay valid (and hold
+ * the contents to draw with) until the last fd_draw_*() using it:
+ */
 int fd_attribute_pointer(struct fd_state *state, const char *name,
 		enum a3xx_vtx_fmt fmt, uint32_t count, const void *data);
 int fd_uniform_attach(struct fd_state *state, const char *name,
@@ -25,26 +25,395 @@
 #include "config.h"
 #endif
 
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <sys/stat.h>
+
 #include "program.h"
 #include "freedreno.h"
 #include "ir-a3xx.h"
 #include "ring.h"
 #include "util.h"
+#include "fnv.h"
 
 
 struct fd_shader {
-	uint32_t bin[512];
+	const uint32_t *bin;
 	uint32_t sizedwords;
 	struct fd_bo *bo;
 	struct ir3_shader_info info;
-	struct ir3_shader *ir;
+	struct ir3_shader *ir;    /* owned by the shader cache */
 };
 
 struct fd_program {
 	struct fd_state *state;
 	struct fd_shader vertex_shader, fragment_shader, compute_shader;
+	uint32_t seqno;   /* changes whenever a shader is attached */
+};
+
+/*
+ * Assembled shaders are cached, keyed by a hash of the asm source, so
+ * attaching the same shader again (such as the solid program, on every
+ * fd_init()) is just a lookup.  Each entry holds the parsed metadata
+ * (attributes, uniforms, etc), the binary, and a bo with the binary for
+ * the most recent fd_state to use it.  Entries are never evicted, so
+ * the cache grows by one entry per distinct shader source; the tests
+ * each build a fixed set of programs up front, so that is bounded.
+ *
+ * If FD_SHADER_CACHE is set to a directory, entries are also saved to
+ * and loaded from there, so the assembler is skipped across runs too.
+ *
+ * If FD_SHADER_COMPACT is set, shaders go through ir3_shader_compact()
+ * before being assembled, which folds nop runs and drops redundant sync
+ * flags.  It is part of the hash, so the two don't share cache entries.
+ * So is IR3_ASM_VERSION, so binaries from an older assembler are not
+ * loaded from FD_SHADER_CACHE.
+ */
+
+struct shader_cache_entry {
+	struct shader_cache_entry *next;
+	uint64_t hash;
+	char *src;
+	struct ir3_shader *ir;
+	uint32_t bin[512];
+	uint32_t sizedwords;
+	struct ir3_shader_info info;
+	struct fd_state *state;   /* the state bo was allocated for */
+	struct fd_bo *bo;
+};
+
+static struct shader_cache_entry *shader_cache[64];
+
+static bool compact_enabled(void)
+{
+	static int compact = -1;
+	if (compact < 0)
+		compact = !!getenv("FD_SHADER_COMPACT");
+	return compact;
+}
+
+static uint64_t hash_src(const char *src)
+{
+	uint32_t version = IR3_ASM_VERSION;
+	uint64_t hash = fnv64(FNV64_INIT, src, strlen(src));
+	if (compact_enabled()) {
+		/* not a byte which can appear in the source: */
+		hash = fnv64(hash, "\xff", 1);
+	}
+	return fnv64(hash, &version, sizeof(version));
+}
+
+/* on-disk format is a header, followed by the source (to rule out hash
+ * collisions), the binary, and then one record per @ header:
+ */
+#define CACHE_MAGIC    0x63736466   /* "fdsc" */
+#define CACHE_VERSION  2
+
+struct cache_file_header {
+	uint32_t magic, version;
+	uint32_t asm_version;   /* IR3_ASM_VERSION */
+	uint64_t hash;
+	uint32_t srclen, sizedwords, nrecords;
+	struct ir3_shader_info info;
+};
+
+struct cache_record {
+	enum {
+		REC_ATTRIBUTE,
+		REC_CONST,
+		REC_SAMPLER,
+		REC_UNIFORM,
+		REC_VARYING,
+		REC_BUF,
+		REC_OUT,
+	} type;
+	int32_t start;   /* register #, in the form the parser uses */
+	int32_t num;
+	uint32_t val[4];
+	char name[32];
 };
 
+static bool cache_path(uint64_t hash, char *path, size_t len)
+{
+	const char *dir = getenv("FD_SHADER_CACHE");
+	if (!dir)
+		return false;
+	return snprintf(path, len, "%s/%016"PRIx64".shader", dir, hash) < len;
+}
+
+/* undo reg_create_from_num(): */
+static int32_t reg_start(struct ir3_register *reg)
+{
+	return (reg->num << 1) | !!(reg->flags & IR3_REG_HALF);
+}
+
+static int add_record(struct cache_record *recs, uint32_t *n, int type,
+		struct ir3_register *reg, int num, const char *name)
+{
+	struct cache_record *rec = &recs[(*n)++];
+	rec->type  = type;
+	rec->start = reg ? reg_start(reg) : 0;
+	rec->num   = num;
+	if (name) {
+		if (strlen(name) >= sizeof(rec->name))
+			return -1;
+		strcpy(rec->name, name);
+	}
+	return 0;
+}
+
+static void cache_save(struct shader_cache_entry *entry)
+{
+	struct ir3_shader *ir = entry->ir;
+	struct cache_file_header hdr = {
+			.magic      = CACHE_MAGIC,
+			.version    = CACHE_VERSION,
+			.asm_version = IR3_ASM_VERSION,
+			.hash       = entry->hash,
+			.srclen     = strlen(entry->src),
+			.sizedwords = entry->sizedwords,
+			.info       = entry->info,
+	};
+	struct cache_record *recs;
+	char path[PATH_MAX], tmp[PATH_MAX + 16];
+	uint32_t i;
+	int fd, ret = 0;
+
+	if (!cache_path(entry->hash, path, sizeof(path)))
+		return;
+
+	recs = calloc(ir->attributes_count + ir->consts_count +
+			ir->samplers_count + ir->uniforms_count + ir->varyings_count +
+			ir->bufs_count + ir->outs_count, sizeof(*recs));
+
+	for (i = 0; i < ir->attributes_count; i++) {
+		struct ir3_attribute *a = ir->attributes[i];
+		ret |= add_record(recs, &hdr.nrecords, REC_ATTRIBUTE,
+				a->rstart, a->num, a->name);
+	}
+	for (i = 0; i < ir->consts_count; i++) {
+		struct ir3_const *c = ir->consts[i];
+		add_record(recs, &hdr.nrecords, REC_CONST, c->cstart, 0, NULL);
+		memcpy(recs[hdr.nrecords - 1].val, c->val, sizeof(c->val));
+	}
+	for (i = 0; i < ir->samplers_count; i++) {
+		struct ir3_sampler *s = ir->samplers[i];
+		ret |= add_record(recs, &hdr.nrecords, REC_SAMPLER,
+				NULL, s->idx, s->name);
+	}
+	for (i = 0; i < ir->uniforms_count; i++) {
+		struct ir3_uniform *u = ir->uniforms[i];
+		ret |= add_record(recs, &hdr.nrecords, REC_UNIFORM,
+				u->cstart, u->num, u->name);
+	}
+	for (i = 0; i < ir->varyings_count; i++) {
+		struct ir3_varying *v = ir->varyings[i];
+		ret |= add_record(recs, &hdr.nrecords, REC_VARYING,
+				v->rstart, v->num, v->name);
+	}
+	for (i = 0; i < ir->bufs_count; i++) {
+		struct ir3_buf *b = ir->bufs[i];
+		ret |= add_record(recs, &hdr.nrecords, REC_BUF,
+				b->cstart, 0, b->name);
+	}
+	for (i = 0; i < ir->outs_count; i++) {
+		struct ir3_out *o = ir->outs[i];
+		ret |= add_record(recs, &hdr.nrecords, REC_OUT,
+				o->rstart, o->num, o->name);
+	}
+
+	/* names too long for a record, just don't cache it on disk: */
+	if (ret)
+		goto out;
+
+	/* write to a temporary and rename, so concurrent runs never see a
+	 * partially written file:
+	 */
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		goto out;
+
+	if ((write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) ||
+			(write(fd, entry->src, hdr.srclen) != hdr.srclen) ||
+			(write(fd, entry->bin, hdr.sizedwords * 4) != hdr.sizedwords * 4) ||
+			(write(fd, recs, hdr.nrecords * sizeof(*recs)) !=
+					hdr.nrecords * sizeof(*recs))) {
+		close(fd);
+		unlink(tmp);
+		goto out;
+	}
+
+	close(fd);
+
+	if (rename(tmp, path))
+		unlink(tmp);
+
+out:
+	free(recs);
+}
+
+static struct shader_cache_entry * cache_load(const char *src, uint64_t hash)
+{
+	struct shader_cache_entry *entry = NULL;
+	struct cache_file_header hdr;
+	struct cache_record *recs = NULL;
+	char path[PATH_MAX], *buf = NULL;
+	uint32_t i, srclen = strlen(src);
+	int fd;
+
+	if (!cache_path(hash, path, sizeof(path)))
+		return NULL;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if ((read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) ||
+			(hdr.magic != CACHE_MAGIC) ||
+			(hdr.version != CACHE_VERSION) ||
+			(hdr.asm_version != IR3_ASM_VERSION) ||
+			(hdr.hash != hash) || (hdr.srclen != srclen) ||
+			(hdr.sizedwords > ARRAY_SIZE(entry->bin)) ||
+			(hdr.nrecords > 256))
+		goto out;
+
+	buf = malloc(srclen);
+	if ((read(fd, buf, srclen) != srclen) || memcmp(buf, src, srclen))
+		goto out;
+
+	entry = calloc(1, sizeof(*entry));
+	recs = calloc(max(hdr.nrecords, 1), sizeof(*recs));
+
+	if ((read(fd, entry->bin, hdr.sizedwords * 4) != hdr.sizedwords * 4) ||
+			(read(fd, recs, hdr.nrecords * sizeof(*recs)) !=
+					hdr.nrecords * sizeof(*recs))) {
+		free(entry);
+		entry = NULL;
+		goto out;
+	}
+
+	entry->hash = hash;
+	entry->src = strdup(src);
+	entry->sizedwords = hdr.sizedwords;
+	entry->info = hdr.info;
+	entry->ir = ir3_shader_create();
+
+	for (i = 0; i < hdr.nrecords; i++) {
+		struct cache_record *rec = &recs[i];
+		rec->name[sizeof(rec->name) - 1] = '\0';
+		switch (rec->type) {
+		case REC_ATTRIBUTE:
+			ir3_attribute_create(entry->ir, rec->start, rec->num, rec->name);
+			break;
+		case REC_CONST:
+			ir3_const_create(entry->ir, rec->start, rec->val[0],
+					rec->val[1], rec->val[2], rec->val[3]);
+			break;
+		case REC_SAMPLER:
+			ir3_sampler_create(entry->ir, rec->num, rec->name);
+			break;
+		case REC_UNIFORM:
+			ir3_uniform_create(entry->ir, rec->start, rec->num, rec->name);
+			break;
+		case REC_VARYING:
+			ir3_varying_create(entry->ir, rec->start, rec->num, rec->name);
+			break;
+		case REC_BUF:
+			ir3_buf_create(entry->ir, rec->start, rec->name);
+			break;
+		case REC_OUT:
+			ir3_out_create(entry->ir, rec->start, rec->num, rec->name);
+			break;
+		}
+	}
+
+out:
+	close(fd);
+	free(recs);
+	free(buf);
+	return entry;
+}
+
+static struct shader_cache_entry * cache_assemble(const char *src,
+		uint64_t hash)
+{
+	struct shader_cache_entry *entry = calloc(1, sizeof(*entry));
+	int sizedwords;
+
+	entry->ir = fd_asm_parse(src);
+	if (!entry->ir) {
+		ERROR_MSG("parse failed");
+		free(entry);
+		return NULL;
+	}
+
+	if (compact_enabled()) {
+		int n = entry->ir->instrs_count;
+		int compacted = ir3_shader_compact(entry->ir);
+		DEBUG_MSG("compacted %d -> %d instrs", n, compacted);
+	}
+
+	sizedwords = ir3_shader_assemble(entry->ir, entry->bin,
+			ARRAY_SIZE(entry->bin), &entry->info);
+	if (sizedwords <= 0) {
+		ERROR_MSG("assembler failed");
+		ir3_shader_destroy(entry->ir);
+		free(entry);
+		return NULL;
+	}
+
+	entry->hash = hash;
+	entry->src = strdup(src);
+	entry->sizedwords = sizedwords;
+
+	cache_save(entry);
+
+	return entry;
+}
+
+static struct shader_cache_entry * cache_get(const char *src)
+{
+	uint64_t hash = hash_src(src);
+	struct shader_cache_entry **bucket =
+			&shader_cache[hash % ARRAY_SIZE(shader_cache)];
+	struct shader_cache_entry *entry;
+
+	for (entry = *bucket; entry; entry = entry->next)
+		if ((entry->hash == hash) && !strcmp(entry->src, src))
+			return entry;
+
+	entry = cache_load(src, hash);
+	if (!entry)
+		entry = cache_assemble(src, hash);
+	if (!entry)
+		return NULL;
+
+	entry->next = *bucket;
+	*bucket = entry;
+
+	return entry;
+}
+
+/* drop the bo's allocated for a state which is going away: */
+void fd_program_cache_release(struct fd_state *state)
+{
+	uint32_t i;
+
+	for (i = 0; i < ARRAY_SIZE(shader_cache); i++) {
+		struct shader_cache_entry *entry;
+		for (entry = shader_cache[i]; entry; entry = entry->next) {
+			if (entry->state != state)
+				continue;
+			fd_bo_del(entry->bo);
+			entry->bo = NULL;
+			entry->state = NULL;
+		}
+	}
+}
+
 static struct fd_shader *get_shader(struct fd_program *program,
 		enum fd_shader_type type)
 {
@@ -67,29 +436,34 @@ struct fd_program * fd_program_new(struct fd_state *state)
 int fd_program_attach_asm(struct fd_program *program,
 		enum fd_shader_type type, const char *src)
 {
+	static uint32_t seqno = 0;
 	struct fd_shader *shader = get_shader(program, type);
-	int sizedwords;
+	struct shader_cache_entry *entry;
+
+	if (shader->bo)
+		fd_bo_del(shader->bo);
 
-	if (shader->ir)
-		ir3_shader_destroy(shader->ir);
+	program->seqno = ++seqno;
 
 	memset(shader, 0, sizeof(*shader));
 
-	shader->ir = fd_asm_parse(src);
-	if (!shader->ir) {
-		ERROR_MSG("parse failed");
-		return -1;
-	}
-	sizedwords = ir3_shader_assemble(shader->ir, shader->bin,
-			ARRAY_SIZE(shader->bin), &shader->info);
-	if (sizedwords <= 0) {
-		ERROR_MSG("assembler failed");
+	entry = cache_get(src);
+	if (!entry)
 		return -1;
+
+	if (entry->state != program->state) {
+		if (entry->bo)
+			fd_bo_del(entry->bo);
+		entry->bo = fd_attribute_bo_new(program->state,
+				entry->sizedwords * 4, entry->bin);
+		entry->state = program->state;
 	}
-	shader->sizedwords = sizedwords;
 
-	shader->bo = fd_attribute_bo_new(program->state,
-			sizedwords * 4, shader->bin);
+	shader->bin = entry->bin;
+	shader->sizedwords = entry->sizedwords;
+	shader->info = entry->info;
+	shader->ir = entry->ir;
+	shader->bo = fd_bo_ref(entry->bo);
 
 	return 0;
 }
@@ -102,6 +476,11 @@ struct ir3_sampler ** fd_program_samplers(struct fd_program *program,
 	return shader->ir->samplers;
 }
 
+uint32_t fd_program_seqno(struct fd_program *program)
+{
+	return program->seqno;
+}
+
 uint32_t fd_program_outloc(struct fd_program *program)
 {
 	struct fd_shader *vs = get_shader(program, FD_SHADER_VERTEX);
@@ -195,7 +574,7 @@ static void emit_vtx_fetch(struct fd_ringbuffer *ring,
 				COND(switchnext, A3XX_VFD_FETCH_INSTR_0_SWITCHNEXT) |
 				A3XX_VFD_FETCH_INSTR_0_INDEXCODE(i) |
 				A3XX_VFD_FETCH_INSTR_0_STEPRATE(1));
-		OUT_RELOC(ring, p->bo, s * first, 0);    /* VFD_FETCH[i].INSTR_1 */
+		OUT_RELOC(ring, p->bo, p->offset + (s * first), 0); /* VFD_FETCH[i].INSTR_1 */
 
 		OUT_PKT0(ring, REG_A3XX_VFD_DECODE_INSTR(i), 1);
 		OUT_RING(ring, A3XX_VFD_DECODE_INSTR_WRITEMASK(regmask(a->num)) |
@@ -316,9 +695,11 @@ static void emit_global_mem(struct fd_ringbuffer *ring,
 	}
 }
 
-void fd_program_emit_state(struct fd_program *program, uint32_t first,
-		struct fd_parameters *uniforms, struct fd_parameters *attr,
-		struct fd_parameters *bufs, struct fd_ringbuffer *ring)
+/* state which only depends on the program, for resolve (gmem2mem) the
+ * program runs in RB_RESOLVE_PASS:
+ */
+void fd_program_emit_shader_state(struct fd_program *program, bool resolve,
+		struct fd_ringbuffer *ring)
 {
 	struct fd_shader *vs = get_shader(program, FD_SHADER_VERTEX);
 	struct fd_shader *fs = get_shader(program, FD_SHADER_FRAGMENT);
@@ -356,7 +737,7 @@ void fd_program_emit_state(struct fd_program *program, uint32_t first,
 	OUT_RING(ring, A3XX_SP_SP_CTRL_REG_CONSTMODE(0) |
 			A3XX_SP_SP_CTRL_REG_SLEEPMODE(1) |
 			// XXX "resolve" (?) bit set on gmem->mem pass..
-			COND(!uniforms, A3XX_SP_SP_CTRL_REG_RESOLVE) |
+			COND(resolve, A3XX_SP_SP_CTRL_REG_RESOLVE) |
 			// XXX sometimes 0, sometimes 1:
 			A3XX_SP_SP_CTRL_REG_L0MODE(1));
 
@@ -528,6 +909,15 @@ void fd_program_emit_state(struct fd_program *program, uint32_t first,
 	OUT_RING(ring, A3XX_VFD_CONTROL_1_MAXSTORAGE(1) | // XXX
 			A3XX_VFD_CONTROL_1_REGID4VTX(63 << 2) |
 			A3XX_VFD_CONTROL_1_REGID4INST(63 << 2));
+}
+
+/* per-draw state, vertex fetch and consts: */
+void fd_program_emit_draw_state(struct fd_program *program, uint32_t first,
+		struct fd_parameters *uniforms, struct fd_parameters *attr,
+		struct fd_parameters *bufs, struct fd_ringbuffer *ring)
+{
+	struct fd_shader *vs = get_shader(program, FD_SHADER_VERTEX);
+	struct fd_shader *fs = get_shader(program, FD_SHADER_FRAGMENT);
 
 	emit_vtx_fetch(ring, vs, attr, first);
 
@@ -547,6 +937,14 @@ void fd_program_emit_state(struct fd_program *program, uint32_t first,
 	}
 }
 
+void fd_program_emit_state(struct fd_program *program, uint32_t first,
+		struct fd_parameters *uniforms, struct fd_parameters *attr,
+		struct fd_parameters *bufs, struct fd_ringbuffer *ring)
+{
+	fd_program_emit_shader_state(program, !uniforms, ring);
+	fd_program_emit_draw_state(program, first, uniforms, attr, bufs, ring);
+}
+
 void fd_program_emit_compute_state(struct fd_program *program,
 		struct fd_parameters *uniforms, struct fd_parameters *attr,
 		struct fd_parameters *bufs, struct fd_ringbuffer *ring)
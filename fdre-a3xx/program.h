@@ -40,12 +40,19 @@ struct fd_program * fd_program_new(struct fd_state *state);
 
 int fd_program_attach_asm(struct fd_program *program,
 		enum fd_shader_type type, const char *src);
+void fd_program_cache_release(struct fd_state *state);
 
 struct ir3_sampler;
 
 struct ir3_sampler ** fd_program_samplers(struct fd_program *program,
 		enum fd_shader_type type, int *cnt);
+uint32_t fd_program_seqno(struct fd_program *program);
 uint32_t fd_program_outloc(struct fd_program *program);
+void fd_program_emit_shader_state(struct fd_program *program, bool resolve,
+		struct fd_ringbuffer *ring);
+void fd_program_emit_draw_state(struct fd_program *program, uint32_t first,
+		struct fd_parameters *uniforms, struct fd_parameters *attr,
+		struct fd_parameters *bufs, struct fd_ringbuffer *ring);
 void fd_program_emit_state(struct fd_program *program, uint32_t first,
 		struct fd_parameters *uniforms, struct fd_parameters *attr,
 		struct fd_parameters *bufs, struct fd_ringbuffer *ring);
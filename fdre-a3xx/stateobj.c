@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "stateobj.h"
+#include "ring.h"
+#include "util.h"
+#include "fnv.h"
+
+/* objects leave the cache when their last ref (held by the fd_state or
+ * a queued cmd) goes away, so it only holds the state in use by the
+ * current frame, a few objects per group; collisions just chain:
+ */
+#define NBUCKETS 64
+
+struct fd_stateobj_cache {
+	struct fd_stateobj *buckets[NBUCKETS];
+};
+
+static uint32_t hash_key(uint32_t type, const void *key, uint32_t keysize)
+{
+	return fnv32(FNV32_INIT ^ type, key, keysize);
+}
+
+struct fd_stateobj_cache * fd_stateobj_cache_new(void)
+{
+	return calloc(1, sizeof(struct fd_stateobj_cache));
+}
+
+void fd_stateobj_cache_del(struct fd_stateobj_cache *cache)
+{
+	unsigned i;
+
+	if (!cache)
+		return;
+
+	/* anything left over is leaked by whoever holds the ref, but
+	 * don't leave them pointing at a freed cache:
+	 */
+	for (i = 0; i < NBUCKETS; i++) {
+		struct fd_stateobj *so;
+		for (so = cache->buckets[i]; so; so = so->next)
+			so->cache = NULL;
+	}
+
+	free(cache);
+}
+
+struct fd_stateobj * fd_stateobj_get(struct fd_stateobj_cache *cache,
+		uint32_t type, const void *key, uint32_t keysize)
+{
+	uint32_t hash = hash_key(type, key, keysize);
+	struct fd_stateobj **bucket = &cache->buckets[hash % NBUCKETS];
+	struct fd_stateobj *so;
+
+	for (so = *bucket; so; so = so->next) {
+		if ((so->hash == hash) && (so->type == type) &&
+				(so->keysize == keysize) &&
+				!memcmp(so->key, key, keysize)) {
+			return fd_stateobj_ref(so);
+		}
+	}
+
+	so = calloc(1, sizeof(*so) + ALIGN(keysize, sizeof(so->key[0])));
+	assert(so);
+
+	so->cache   = cache;
+	so->type    = type;
+	so->hash    = hash;
+	so->refcnt  = 1;
+	so->keysize = keysize;
+	memcpy(so->key, key, keysize);
+
+	so->next = *bucket;
+	*bucket = so;
+
+	return so;
+}
+
+struct fd_stateobj * fd_stateobj_ref(struct fd_stateobj *so)
+{
+	so->refcnt++;
+	return so;
+}
+
+void fd_stateobj_evict(struct fd_stateobj *so)
+{
+	struct fd_stateobj **p;
+
+	if (!so->cache)
+		return;
+
+	p = &so->cache->buckets[so->hash % NBUCKETS];
+	while (*p != so)
+		p = &(*p)->next;
+	*p = so->next;
+
+	so->cache = NULL;
+	so->next = NULL;
+}
+
+void fd_stateobj_unref(struct fd_stateobj *so)
+{
+	if (!so || --so->refcnt)
+		return;
+
+	fd_stateobj_evict(so);
+
+	if (so->ring) {
+		fd_ringmarker_del(so->start);
+		fd_ringmarker_del(so->end);
+		fd_ringbuffer_del(so->ring);
+	}
+
+	free(so);
+}
+
+struct fd_ringbuffer * fd_stateobj_begin(struct fd_stateobj *so,
+		struct fd_pipe *pipe, uint32_t size)
+{
+	assert(!so->ring);
+	so->ring  = fd_ringbuffer_new(pipe, size);
+	so->start = fd_ringmarker_new(so->ring);
+	so->end   = fd_ringmarker_new(so->ring);
+	fd_ringmarker_mark(so->start);
+	return so->ring;
+}
+
+void fd_stateobj_end(struct fd_stateobj *so)
+{
+	fd_ringmarker_mark(so->end);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef STATEOBJ_H_
+#define STATEOBJ_H_
+
+#include <stdint.h>
+
+/*
+ * Immutable, refcounted state objects (see NOTES).  Objects are hash-
+ * consed on their contents (the key), so identical state is always the
+ * same object, and can be compared by pointer.  The cmdstream to emit
+ * an object's state is built once, into its own ring, and every draw
+ * which uses the object just emits an IB to it.
+ *
+ * Objects are never modified, changing state means looking up (or
+ * creating) the object for the new contents.
+ */
+
+struct fd_stateobj_cache;
+struct fd_pipe;
+struct fd_ringbuffer;
+struct fd_ringmarker;
+
+struct fd_stateobj {
+	struct fd_stateobj_cache *cache;
+	struct fd_stateobj *next;       /* hash chain */
+	uint32_t type, hash, refcnt;
+
+	/* pre-built cmdstream, NULL if not built (yet): */
+	struct fd_ringbuffer *ring;
+	struct fd_ringmarker *start, *end;
+
+	uint32_t keysize;
+	uint64_t key[];
+};
+
+struct fd_stateobj_cache * fd_stateobj_cache_new(void);
+void fd_stateobj_cache_del(struct fd_stateobj_cache *cache);
+
+/* returns a new reference to the object with the given type/contents: */
+struct fd_stateobj * fd_stateobj_get(struct fd_stateobj_cache *cache,
+		uint32_t type, const void *key, uint32_t keysize);
+struct fd_stateobj * fd_stateobj_ref(struct fd_stateobj *so);
+void fd_stateobj_unref(struct fd_stateobj *so);
+
+/* the cmdstream is built in the ring returned by fd_stateobj_begin(),
+ * up until fd_stateobj_end():
+ */
+struct fd_ringbuffer * fd_stateobj_begin(struct fd_stateobj *so,
+		struct fd_pipe *pipe, uint32_t size);
+void fd_stateobj_end(struct fd_stateobj *so);
+
+/* remove from the cache, for when something the key points to is
+ * going away.  Existing references stay valid:
+ */
+void fd_stateobj_evict(struct fd_stateobj *so);
+
+#endif /* STATEOBJ_H_ */
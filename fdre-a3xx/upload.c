@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "upload.h"
+#include "ring.h"
+#include "util.h"
+
+struct fd_upload_buf {
+	struct fd_upload_buf *next;
+	struct fd_bo *bo;
+	uint8_t *map;
+	uint32_t size;
+	/* timestamp of last submit which used the buf, 0 if idle: */
+	uint32_t timestamp;
+	/* used by cmds which are not submitted yet: */
+	bool pending;
+};
+
+struct fd_upload {
+	struct fd_device *dev;
+	struct fd_pipe *pipe;
+	uint32_t size;
+
+	/* current buf being allocated from, the ring is circular: */
+	struct fd_upload_buf *cur;
+	uint32_t off;
+
+	uint32_t fence;
+
+	/* stats since last fence: */
+	struct {
+		uint32_t allocs, bytes, bufs, stalls;
+	} stats;
+	uint32_t nbufs;
+};
+
+struct fd_upload * fd_upload_new(struct fd_device *dev,
+		struct fd_pipe *pipe, uint32_t size)
+{
+	struct fd_upload *up = calloc(1, sizeof(*up));
+	up->dev  = dev;
+	up->pipe = pipe;
+	up->size = size;
+	return up;
+}
+
+void fd_upload_del(struct fd_upload *up)
+{
+	struct fd_upload_buf *buf, *next;
+
+	if (!up)
+		return;
+
+	buf = up->cur;
+	while (buf) {
+		if (buf->timestamp)
+			fd_pipe_wait(up->pipe, buf->timestamp);
+		next = buf->next;
+		fd_bo_del(buf->bo);
+		free(buf);
+		buf = (next == up->cur) ? NULL : next;
+	}
+
+	free(up);
+}
+
+/* insert a new buf after the current one: */
+static struct fd_upload_buf * buf_new(struct fd_upload *up, uint32_t size)
+{
+	struct fd_upload_buf *buf = calloc(1, sizeof(*buf));
+
+	buf->size = ALIGN(max(size, up->size), 0x1000);
+	buf->bo   = fd_bo_new(up->dev, buf->size, DRM_FREEDRENO_GEM_TYPE_KMEM);
+	buf->map  = fd_bo_map(buf->bo);
+
+	if (up->cur) {
+		buf->next = up->cur->next;
+		up->cur->next = buf;
+	} else {
+		buf->next = buf;
+	}
+
+	up->stats.bufs++;
+	up->nbufs++;
+
+	return buf;
+}
+
+void * fd_upload_alloc(struct fd_upload *up, uint32_t size,
+		uint32_t align, struct fd_bo **bo, uint32_t *offset)
+{
+	struct fd_upload_buf *buf = up->cur;
+	uint32_t off = ALIGN(up->off, align);
+
+	if (!buf || ((off + size) > buf->size)) {
+		struct fd_upload_buf *next = buf ? buf->next : NULL;
+
+		if (!next || next->pending || (next->size < size)) {
+			/* wrapped around within a single submit, grow: */
+			next = buf_new(up, size);
+		} else if (next->timestamp) {
+			/* oldest buf in the ring, so if it is still busy then
+			 * so is everything else:
+			 */
+			fd_pipe_wait(up->pipe, next->timestamp);
+			next->timestamp = 0;
+			up->stats.stalls++;
+		}
+
+		buf = up->cur = next;
+		off = 0;
+	}
+
+	buf->pending = true;
+	up->off = off + size;
+
+	up->stats.allocs++;
+	up->stats.bytes += size;
+
+	*bo = buf->bo;
+	*offset = off;
+
+	return buf->map + off;
+}
+
+void fd_upload_data(struct fd_upload *up, const void *data,
+		uint32_t size, uint32_t align,
+		struct fd_bo **bo, uint32_t *offset)
+{
+	memcpy(fd_upload_alloc(up, size, align, bo, offset), data, size);
+}
+
+uint32_t fd_upload_fence(struct fd_upload *up, uint32_t timestamp)
+{
+	struct fd_upload_buf *buf = up->cur;
+
+	if (buf) {
+		do {
+			if (buf->pending) {
+				buf->timestamp = timestamp;
+				buf->pending = false;
+			}
+			buf = buf->next;
+		} while (buf != up->cur);
+	}
+
+	DEBUG_MSG("upload: %u allocs, %u bytes, %u bufs (%u new), %u stalls",
+			up->stats.allocs, up->stats.bytes, up->nbufs,
+			up->stats.bufs, up->stats.stalls);
+	memset(&up->stats, 0, sizeof(up->stats));
+
+	return ++up->fence;
+}
@@ -165,7 +165,14 @@ struct fd_param {
 	union {
 		struct {                  /* attributes */
 			struct fd_bo     *bo;
+			uint32_t          offset;
 			enum a3xx_vtx_fmt fmt;
+			/* client ptr, uploaded at draw time, unless bo/offset
+			 * is from the current upload fence and still holds
+			 * the same contents:
+			 */
+			const void       *ptr;
+			uint32_t          ptrsize, fence;
 		};
 		struct fd_surface *tex;   /* textures */
 		struct {                  /* uniforms */
@@ -51,6 +51,7 @@ struct fd_winsys {
 };
 
 struct fd_winsys * fd_winsys_fbdev_open(void);
+struct fd_winsys * fd_winsys_null_open(void);
 #ifdef HAVE_X11
 struct fd_winsys * fd_winsys_dri2_open(void);
 #endif
@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Null libdrm_freedreno backend, for running fdre (and profiling it, or
+ * diffing its cmdstream) on a host without a gpu:
+ *
+ *  + bo's are anonymous mmap's, with synthetic gpuaddr's which are never
+ *    re-used, so a stale reloc can be told apart from a live one
+ *  + ringbuffers live in a bo, relocs are resolved into the cmdstream as
+ *    they would be by the kernel, and each flush is written to the .rd
+ *    file named by $NULL_DRM_RD (if set) along with the contents of the
+ *    bo's it references, so it can be fed to cffdump/redump
+ *  + fences complete immediately, so waits never block
+ *
+ * $NULL_DRM_GPU_ID picks the gpu (default 320), which determines the
+ * gmem size reported.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include "freedreno_drmif.h"
+#include "freedreno_ringbuffer.h"
+#include "redump.h"
+
+#define GPUADDR_BASE 0x10000000
+#define PAGE_SIZE    4096
+
+struct fd_device {
+	int fd;
+	int refcnt;
+	uint32_t gpu_id;
+	uint32_t next_name;
+	struct fd_bo *bos;          /* list of live bo's */
+};
+
+struct fd_pipe {
+	struct fd_device *dev;
+	enum fd_pipe_id id;
+	uint32_t timestamp;
+};
+
+struct fd_bo {
+	struct fd_device *dev;
+	struct fd_bo *next;
+	int refcnt;
+	void *map;
+	uint32_t size;
+	uint32_t gpuaddr;
+	uint32_t name;
+	uint32_t submit;            /* last submit it was dumped in */
+};
+
+struct fd_ringbuffer_null {
+	struct fd_ringbuffer base;
+	struct fd_bo *bo;
+
+	/* bo's referenced since the last reset, holding a reference: */
+	struct fd_bo **bos;
+	uint32_t nr_bos, max_bos;
+};
+
+struct fd_ringmarker {
+	struct fd_ringbuffer *ring;
+	uint32_t *cur;
+};
+
+static inline struct fd_ringbuffer_null * to_null_ring(struct fd_ringbuffer *ring)
+{
+	return (struct fd_ringbuffer_null *)ring;
+}
+
+/* gpuaddr space is shared by all devices, like it is for kgsl: */
+static uint32_t next_gpuaddr = GPUADDR_BASE;
+
+/*
+ * .rd output:
+ */
+
+static FILE *rd;
+static uint32_t submit;
+
+static void rd_section(enum rd_sect_type type, const void *buf, uint32_t sz)
+{
+	static const uint32_t zero = 0;
+	uint32_t hdr[4] = { ~0, ~0, type, ALIGN(sz, 4) };
+
+	fwrite(hdr, sizeof(hdr), 1, rd);
+	fwrite(buf, 1, sz, rd);
+	fwrite(&zero, 1, ALIGN(sz, 4) - sz, rd);
+}
+
+static void rd_open(struct fd_device *dev)
+{
+	const char *name;
+
+	if (rd)
+		return;
+
+	name = getenv("NULL_DRM_RD");
+	if (!name)
+		return;
+
+	rd = fopen(name, "w");
+	if (!rd) {
+		fprintf(stderr, "null-drm: could not open %s\n", name);
+		return;
+	}
+
+	rd_section(RD_GPU_ID, &dev->gpu_id, sizeof(dev->gpu_id));
+}
+
+static void rd_bo(struct fd_bo *bo)
+{
+	uint32_t sect[3] = { bo->gpuaddr, bo->size, 0 };
+
+	if (bo->submit == submit)
+		return;
+	bo->submit = submit;
+
+	rd_section(RD_GPUADDR, sect, sizeof(sect));
+	rd_section(RD_BUFFER_CONTENTS, bo->map, bo->size);
+}
+
+/*
+ * device:
+ */
+
+int drmOpen(const char *name, const char *busid)
+{
+	/* not a real fd, but fd_device_new() doesn't care: */
+	return 1000;
+}
+
+int drmClose(int fd)
+{
+	return 0;
+}
+
+struct fd_device * fd_device_new(int fd)
+{
+	struct fd_device *dev = calloc(1, sizeof(*dev));
+	const char *gpu_id = getenv("NULL_DRM_GPU_ID");
+
+	if (!dev)
+		return NULL;
+
+	dev->fd = fd;
+	dev->refcnt = 1;
+	dev->gpu_id = gpu_id ? strtoul(gpu_id, NULL, 0) : 320;
+	dev->next_name = 1;
+
+	return dev;
+}
+
+struct fd_device * fd_device_ref(struct fd_device *dev)
+{
+	dev->refcnt++;
+	return dev;
+}
+
+void fd_device_del(struct fd_device *dev)
+{
+	if (--dev->refcnt > 0)
+		return;
+	free(dev);
+}
+
+/*
+ * pipe:
+ */
+
+struct fd_pipe * fd_pipe_new(struct fd_device *dev, enum fd_pipe_id id)
+{
+	struct fd_pipe *pipe = calloc(1, sizeof(*pipe));
+
+	if (!pipe)
+		return NULL;
+
+	pipe->dev = dev;
+	pipe->id = id;
+
+	return pipe;
+}
+
+void fd_pipe_del(struct fd_pipe *pipe)
+{
+	free(pipe);
+}
+
+int fd_pipe_get_param(struct fd_pipe *pipe, enum fd_param_id param,
+		uint64_t *value)
+{
+	uint32_t gpu_id = pipe->dev->gpu_id;
+
+	switch (param) {
+	case FD_DEVICE_ID:
+	case FD_GPU_ID:
+		*value = gpu_id;
+		return 0;
+	case FD_GMEM_SIZE:
+		if (gpu_id < 300)
+			*value = 0x40000;     /* a2xx: 256K */
+		else if (gpu_id < 320)
+			*value = 0x20000;     /* a305: 128K */
+		else if (gpu_id < 330)
+			*value = 0x80000;     /* a320: 512K */
+		else
+			*value = 0x100000;    /* a330: 1M */
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+int fd_pipe_wait(struct fd_pipe *pipe, uint32_t timestamp)
+{
+	/* everything completes as soon as it is flushed */
+	return 0;
+}
+
+/*
+ * bo:
+ */
+
+struct fd_bo * fd_bo_new(struct fd_device *dev,
+		uint32_t size, uint32_t flags)
+{
+	struct fd_bo *bo;
+	uint32_t alloc_size = ALIGN(size, PAGE_SIZE);
+
+	if (!size || (alloc_size < size) ||
+			(next_gpuaddr + (uint64_t)alloc_size) > 0xffffffff) {
+		fprintf(stderr, "null-drm: cannot allocate %u bytes\n", size);
+		return NULL;
+	}
+
+	bo = calloc(1, sizeof(*bo));
+	if (!bo)
+		return NULL;
+
+	bo->map = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (bo->map == MAP_FAILED) {
+		free(bo);
+		return NULL;
+	}
+
+	bo->dev = fd_device_ref(dev);
+	bo->refcnt = 1;
+	bo->size = size;
+	bo->gpuaddr = next_gpuaddr;
+	next_gpuaddr += alloc_size;
+
+	bo->next = dev->bos;
+	dev->bos = bo;
+
+	return bo;
+}
+
+struct fd_bo * fd_bo_from_fbdev(struct fd_pipe *pipe,
+		int fbfd, uint32_t size)
+{
+	return fd_bo_new(pipe->dev, size, 0);
+}
+
+struct fd_bo * fd_bo_from_name(struct fd_device *dev, uint32_t name)
+{
+	struct fd_bo *bo;
+
+	for (bo = dev->bos; bo; bo = bo->next)
+		if (bo->name == name)
+			return fd_bo_ref(bo);
+
+	return NULL;
+}
+
+struct fd_bo * fd_bo_ref(struct fd_bo *bo)
+{
+	bo->refcnt++;
+	return bo;
+}
+
+void fd_bo_del(struct fd_bo *bo)
+{
+	struct fd_device *dev = bo->dev;
+	struct fd_bo **p;
+
+	if (--bo->refcnt > 0)
+		return;
+
+	for (p = &dev->bos; *p; p = &(*p)->next) {
+		if (*p == bo) {
+			*p = bo->next;
+			break;
+		}
+	}
+
+	munmap(bo->map, ALIGN(bo->size, PAGE_SIZE));
+	free(bo);
+	fd_device_del(dev);
+}
+
+int fd_bo_get_name(struct fd_bo *bo, uint32_t *name)
+{
+	if (!bo->name)
+		bo->name = bo->dev->next_name++;
+	*name = bo->name;
+	return 0;
+}
+
+uint32_t fd_bo_handle(struct fd_bo *bo)
+{
+	/* no real handle, but the gpuaddr is unique: */
+	return bo->gpuaddr;
+}
+
+uint32_t fd_bo_size(struct fd_bo *bo)
+{
+	return bo->size;
+}
+
+void * fd_bo_map(struct fd_bo *bo)
+{
+	return bo->map;
+}
+
+int fd_bo_cpu_prep(struct fd_bo *bo, struct fd_pipe *pipe, uint32_t op)
+{
+	return 0;
+}
+
+void fd_bo_cpu_fini(struct fd_bo *bo)
+{
+}
+
+/*
+ * ringbuffer:
+ */
+
+static void ring_add_bo(struct fd_ringbuffer *ring, struct fd_bo *bo)
+{
+	struct fd_ringbuffer_null *nring = to_null_ring(ring);
+	uint32_t i;
+
+	for (i = 0; i < nring->nr_bos; i++)
+		if (nring->bos[i] == bo)
+			return;
+
+	if (nring->nr_bos == nring->max_bos) {
+		nring->max_bos = max(2 * nring->max_bos, 64);
+		nring->bos = realloc(nring->bos,
+				nring->max_bos * sizeof(nring->bos[0]));
+		assert(nring->bos);
+	}
+
+	nring->bos[nring->nr_bos++] = fd_bo_ref(bo);
+}
+
+static void ring_put_bos(struct fd_ringbuffer *ring)
+{
+	struct fd_ringbuffer_null *nring = to_null_ring(ring);
+	uint32_t i;
+
+	for (i = 0; i < nring->nr_bos; i++)
+		fd_bo_del(nring->bos[i]);
+	nring->nr_bos = 0;
+}
+
+static uint32_t ring_gpuaddr(struct fd_ringbuffer *ring, uint32_t *ptr)
+{
+	return to_null_ring(ring)->bo->gpuaddr +
+			((ptr - ring->start) * sizeof(uint32_t));
+}
+
+struct fd_ringbuffer * fd_ringbuffer_new(struct fd_pipe *pipe,
+		uint32_t size)
+{
+	struct fd_ringbuffer_null *nring = calloc(1, sizeof(*nring));
+	struct fd_ringbuffer *ring = &nring->base;
+
+	if (!nring)
+		return NULL;
+
+	nring->bo = fd_bo_new(pipe->dev, size, 0);
+	if (!nring->bo) {
+		free(nring);
+		return NULL;
+	}
+
+	ring->size = size;
+	ring->pipe = pipe;
+	ring->start = fd_bo_map(nring->bo);
+	ring->end = &ring->start[size / 4];
+	ring->cur = ring->last_start = ring->start;
+
+	return ring;
+}
+
+void fd_ringbuffer_del(struct fd_ringbuffer *ring)
+{
+	struct fd_ringbuffer_null *nring = to_null_ring(ring);
+
+	ring_put_bos(ring);
+	free(nring->bos);
+	fd_bo_del(nring->bo);
+	free(nring);
+}
+
+void fd_ringbuffer_reset(struct fd_ringbuffer *ring)
+{
+	ring->cur = ring->last_start = ring->start;
+	ring_put_bos(ring);
+}
+
+/* submits the cmds from 'start' up to the current position, like the
+ * kgsl backend does:
+ */
+static int flush(struct fd_ringbuffer *ring, uint32_t *start)
+{
+	struct fd_ringbuffer_null *nring = to_null_ring(ring);
+	uint32_t i;
+
+	if (ring->cur > ring->end) {
+		fprintf(stderr, "null-drm: ringbuffer overflow\n");
+		return -1;
+	}
+
+	ring->last_timestamp = ++ring->pipe->timestamp;
+
+	rd_open(ring->pipe->dev);
+
+	if (rd && (ring->cur > start)) {
+		uint32_t sect[3] = {
+				ring_gpuaddr(ring, start), ring->cur - start, 0,
+		};
+
+		submit++;
+
+		rd_bo(nring->bo);
+		for (i = 0; i < nring->nr_bos; i++)
+			rd_bo(nring->bos[i]);
+
+		rd_section(RD_CMDSTREAM_ADDR, sect, sizeof(sect));
+		fflush(rd);
+	}
+
+	ring->last_start = ring->cur;
+
+	return 0;
+}
+
+int fd_ringbuffer_flush(struct fd_ringbuffer *ring)
+{
+	return flush(ring, ring->last_start);
+}
+
+uint32_t fd_ringbuffer_timestamp(struct fd_ringbuffer *ring)
+{
+	return ring->last_timestamp;
+}
+
+void fd_ringbuffer_reloc(struct fd_ringbuffer *ring,
+		const struct fd_reloc *reloc)
+{
+	uint32_t addr = reloc->bo->gpuaddr + reloc->offset;
+
+	if (reloc->shift < 0)
+		addr >>= -reloc->shift;
+	else
+		addr <<= reloc->shift;
+
+	ring_add_bo(ring, reloc->bo);
+	fd_ringbuffer_emit(ring, addr | reloc->or);
+}
+
+/* the IB is only dumped along with the parent, so the parent also needs
+ * everything the target references.  The target's list already includes
+ * the bo's of any rings it references in turn, so this covers nested IBs
+ * (as long as the target is complete by the time it is referenced):
+ */
+void fd_ringbuffer_emit_reloc_ring(struct fd_ringbuffer *ring,
+		struct fd_ringmarker *target, struct fd_ringmarker *end)
+{
+	struct fd_ringbuffer_null *tring = to_null_ring(target->ring);
+	uint32_t i;
+
+	ring_add_bo(ring, tring->bo);
+	for (i = 0; i < tring->nr_bos; i++)
+		ring_add_bo(ring, tring->bos[i]);
+
+	fd_ringbuffer_emit(ring, ring_gpuaddr(target->ring, target->cur));
+}
+
+/*
+ * ringmarker:
+ */
+
+struct fd_ringmarker * fd_ringmarker_new(struct fd_ringbuffer *ring)
+{
+	struct fd_ringmarker *marker = calloc(1, sizeof(*marker));
+
+	if (!marker)
+		return NULL;
+
+	marker->ring = ring;
+	marker->cur = ring->cur;
+
+	return marker;
+}
+
+void fd_ringmarker_del(struct fd_ringmarker *marker)
+{
+	free(marker);
+}
+
+void fd_ringmarker_mark(struct fd_ringmarker *marker)
+{
+	marker->cur = marker->ring->cur;
+}
+
+uint32_t fd_ringmarker_dwords(struct fd_ringmarker *start,
+		struct fd_ringmarker *end)
+{
+	return end->cur - start->cur;
+}
+
+int fd_ringmarker_flush(struct fd_ringmarker *marker)
+{
+	/* skip over anything before the marker, which is only reached by
+	 * IB's from the cmds after it:
+	 */
+	return flush(marker->ring, marker->cur);
+}
@@ -1,14 +1,16 @@
 #!/bin/sh
 
-found=""
-
-for f in *.rd; do
-	test=${f%%-[0-9]*};
-	echo $found | grep $test > /dev/null
-	if [ $? = 1 ]; then
-		echo "found: $test";
-		./redump $test-*.rd > $test.html
-		found="$found $test"
-	fi
-done
+# redump each test (ie. all the foo-NNNN.rd or foo-NNNN.rd.gz files for
+# test foo) to foo.html, running one redump per cpu.  Each redump is then
+# kept single threaded, as there is more to gain running tests in parallel:
 
+jobs=`nproc 2>/dev/null || echo 1`
+
+export REDUMP_THREADS=1
+
+for f in *.rd *.rd.gz; do
+	[ -e "$f" ] || continue
+	f=${f%.gz}
+	f=${f%.rd}
+	echo ${f%-[0-9]*}
+done | sort -u | xargs -P $jobs -I{} sh -c 'echo "found: {}"; ./redump `ls {}-*.rd {}-*.rd.gz 2>/dev/null` > {}.html'
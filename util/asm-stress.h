@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef ASM_STRESS_H_
+#define ASM_STRESS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "read-file.h"
+
+/*
+ * Stress test for the reentrant parsers, shared by the a2xx and a3xx
+ * assemblers.  Everything is first assembled serially, to get the
+ * reference output, and then assembled again from multiple threads at
+ * once, each thread starting at a different file so that different
+ * shaders are parsed concurrently.  The output must be bit-identical to
+ * the serial run:
+ *
+ *   ./stress [-j nthreads] [-n iterations] infile...
+ *
+ * Note this only tests whichever scanner the build generated from
+ * lexer.l, so it needs to be run against the real flex output.
+ */
+
+/* returns sizedwords, with the malloc'd result in *dwords, or -1: */
+typedef int (*asm_stress_assemble_t)(const char *src, uint32_t **dwords);
+
+struct asm_stress_test {
+	const char *name;
+	char *src;
+	uint32_t *dwords;
+	int sizedwords;
+};
+
+struct asm_stress {
+	asm_stress_assemble_t assemble;
+	struct asm_stress_test *tests;
+	int ntests, niters;
+	pthread_mutex_t lock;
+	int failures;
+};
+
+struct asm_stress_thread {
+	struct asm_stress *s;
+	pthread_t thread;
+	int n;
+};
+
+static inline void * asm_stress_thread(void *arg)
+{
+	struct asm_stress_thread *thr = arg;
+	struct asm_stress *s = thr->s;
+	int i, j;
+
+	for (i = 0; i < s->niters; i++) {
+		for (j = 0; j < s->ntests; j++) {
+			struct asm_stress_test *t = &s->tests[(thr->n + j) % s->ntests];
+			uint32_t *dwords;
+			int sizedwords = s->assemble(t->src, &dwords);
+
+			if ((sizedwords == t->sizedwords) &&
+					!memcmp(dwords, t->dwords, sizedwords * 4)) {
+				free(dwords);
+				continue;
+			}
+
+			if (sizedwords > 0)
+				free(dwords);
+
+			pthread_mutex_lock(&s->lock);
+			ERROR_MSG("thread %d: mismatch on %s (%d vs %d dwords)",
+					thr->n, t->name, sizedwords, t->sizedwords);
+			s->failures++;
+			pthread_mutex_unlock(&s->lock);
+		}
+	}
+
+	return NULL;
+}
+
+static inline int asm_stress_main(int argc, char **argv,
+		asm_stress_assemble_t assemble)
+{
+	struct asm_stress s = {
+			.assemble = assemble,
+			.niters = 10,
+			.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	struct asm_stress_thread *threads;
+	int i, nthreads = 8;
+
+	while ((argc >= 3) && (argv[1][0] == '-')) {
+		if (!strcmp(argv[1], "-j")) {
+			nthreads = strtol(argv[2], NULL, 0);
+		} else if (!strcmp(argv[1], "-n")) {
+			s.niters = strtol(argv[2], NULL, 0);
+		} else {
+			break;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if ((argc < 2) || (nthreads < 1)) {
+		ERROR_MSG("usage: %s [-j nthreads] [-n iterations] infile...", argv[0]);
+		return -1;
+	}
+
+	s.tests = calloc(argc - 1, sizeof(*s.tests));
+
+	/* serial pass, for the reference output: */
+	for (i = 1; i < argc; i++) {
+		struct asm_stress_test *t = &s.tests[s.ntests];
+
+		t->name = argv[i];
+		t->src = read_file(argv[i]);
+		if (!t->src) {
+			ERROR_MSG("could not read %s, skipping", argv[i]);
+			continue;
+		}
+
+		t->sizedwords = assemble(t->src, &t->dwords);
+		if (t->sizedwords < 0) {
+			/* expected to fail every time, so just skip it: */
+			ERROR_MSG("could not assemble %s, skipping", argv[i]);
+			free(t->src);
+			continue;
+		}
+
+		s.ntests++;
+	}
+
+	if (!s.ntests) {
+		ERROR_MSG("nothing to test");
+		return -1;
+	}
+
+	threads = calloc(nthreads, sizeof(*threads));
+
+	for (i = 0; i < nthreads; i++) {
+		threads[i].s = &s;
+		threads[i].n = i;
+		if (pthread_create(&threads[i].thread, NULL, asm_stress_thread,
+				&threads[i])) {
+			ERROR_MSG("could not create thread %d", i);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i].thread, NULL);
+
+	printf("%d files, %d threads x %d iterations: %d mismatches\n",
+			s.ntests, nthreads, s.niters, s.failures);
+
+	return s.failures ? -1 : 0;
+}
+
+#endif /* ASM_STRESS_H_ */
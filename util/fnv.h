@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FNV_H_
+#define FNV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* FNV-1a, for cache keys and checksums (not for anything which needs
+ * to resist collisions on purpose).  Start with the _INIT value, and
+ * feed bytes in with fnv32()/fnv64():
+ */
+
+#define FNV32_INIT  2166136261u
+#define FNV64_INIT  0xcbf29ce484222325ull
+
+static inline uint32_t fnv32(uint32_t hash, const void *buf, size_t sz)
+{
+	const uint8_t *p = buf;
+	while (sz--) {
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static inline uint64_t fnv64(uint64_t hash, const void *buf, size_t sz)
+{
+	const uint8_t *p = buf;
+	while (sz--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+#endif /* FNV_H_ */
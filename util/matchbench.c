@@ -0,0 +1,180 @@
+/*
+ * Copyright © 2012 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Benchmark for redump's pattern matching kernel.  Takes the cmdstreams
+ * of two or more captures, lines them up row by row (without aligning
+ * them, which doesn't matter for timing the match), and compares the
+ * naive loop over patterns[], the scalar table lookup, and the SIMD
+ * kernel:
+ *
+ *   ./matchbench foo-0000.rd foo-0001.rd ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "redump.h"
+#include "rd-reader.h"
+#include "redump-match.h"
+
+#define MAX_SRCS 64
+
+struct row {
+	const uint32_t *src[MAX_SRCS];
+	int n;
+};
+
+static struct row *rows;
+static int nrows, nsrcs;
+static int8_t *result, *expected;
+static long total;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void match_naive(const uint32_t * const *src, int nsrc, int n,
+		int8_t *result)
+{
+	int i, j, k;
+
+	for (i = 0; i < n; i++) {
+		result[i] = -1;
+		for (j = 0; j < ARRAY_SIZE(patterns); j++) {
+			int found = 1;
+			for (k = 1; k < nsrc; k++) {
+				if ((src[0][i] & patterns[j]) != (src[k][i] & patterns[j])) {
+					found = 0;
+					break;
+				}
+			}
+			if (found) {
+				result[i] = j;
+				break;
+			}
+		}
+	}
+}
+
+static void bench(const char *name, void (*fxn)(const uint32_t * const *src,
+		int nsrc, int n, int8_t *result), int iters)
+{
+	double t = now();
+	int i, r;
+
+	for (i = 0; i < iters; i++) {
+		int8_t *res = result;
+		for (r = 0; r < nrows; r++) {
+			fxn(rows[r].src, nsrcs, rows[r].n, res);
+			res += rows[r].n;
+		}
+	}
+
+	t = now() - t;
+
+	if (expected && memcmp(result, expected, total)) {
+		fprintf(stderr, "%s: mismatch!\n", name);
+		exit(-1);
+	}
+
+	printf("%-8s: %8.3fms (%.2f Mdwords/s)\n", name, t * 1000.0 / iters,
+			(double)total * iters / t / 1000000.0);
+}
+
+int main(int argc, char **argv)
+{
+	struct rd_reader *rd[MAX_SRCS];
+	int iters = 100;
+	int i;
+
+	if ((argc < 3) || (argc > (MAX_SRCS + 1))) {
+		fprintf(stderr, "usage: %s file1.rd file2.rd [...]\n", argv[0]);
+		return -1;
+	}
+
+	nsrcs = argc - 1;
+
+	for (i = 0; i < nsrcs; i++) {
+		rd[i] = rd_reader_open(argv[i + 1]);
+		if (!rd[i] || !rd_reader_mapped(rd[i])) {
+			fprintf(stderr, "could not map: %s\n", argv[i + 1]);
+			return -1;
+		}
+	}
+
+	/* the n'th cmdstream of each file makes up a row: */
+	while (1) {
+		struct row row = { .n = 0x7fffffff };
+
+		for (i = 0; i < nsrcs; i++) {
+			struct rd_section sect;
+			int ret;
+
+			while (((ret = rd_reader_next(rd[i], &sect)) > 0) &&
+					(sect.type != RD_CMDSTREAM))
+				;
+			if (ret <= 0)
+				break;
+
+			row.src[i] = sect.buf;
+			row.n = min(row.n, sect.sz / 4);
+		}
+
+		if (i < nsrcs)
+			break;
+
+		rows = realloc(rows, (nrows + 1) * sizeof(rows[0]));
+		rows[nrows++] = row;
+		total += row.n;
+	}
+
+	if (!total) {
+		fprintf(stderr, "no cmdstreams found\n");
+		return -1;
+	}
+
+	printf("%d rows, %ld dwords x %d captures\n", nrows, total, nsrcs);
+
+	result = malloc(total);
+	expected = NULL;
+
+	match_init(patterns, ARRAY_SIZE(patterns));
+
+	bench("naive", match_naive, iters);
+	expected = malloc(total);
+	memcpy(expected, result, total);
+
+	bench("scalar", match_patterns_scalar, iters);
+	bench("simd", match_patterns, iters);
+
+	for (i = 0; i < nsrcs; i++)
+		rd_reader_close(rd[i]);
+
+	return 0;
+}
@@ -0,0 +1,631 @@
+/*
+ * Copyright © 2012 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include "rd-reader.h"
+
+/* sanity limit, anything bigger is a corrupt file: */
+#define MAX_SECTION_SIZE  (1 << 30)
+
+/* buffer contents written with an RD_BUFFER_HASH, so later RD_BUFFER_REF
+ * sections can be resolved, or the latest contents of a gpuaddr, so later
+ * RD_BUFFER_PARTIAL sections can be applied:
+ */
+struct rd_blob {
+	uint64_t key;
+	uint32_t sz;
+	uint32_t copied;     /* buf is malloc'd rather than in the mapping */
+	const void *buf;
+};
+
+struct rd_blob_table {
+	struct rd_blob *entries;
+	unsigned int size, count;   /* size is power of two, or zero */
+};
+
+struct rd_reader {
+	/* uncompressed files are mapped, and sections point directly into
+	 * the mapping:
+	 */
+	const uint8_t *map;
+	uint64_t filesz;
+
+	/* otherwise fall back to decompressing into buf: */
+	gzFile fd;
+	void *buf;
+	uint32_t bufsz;
+
+	uint64_t offset;     /* current (uncompressed) offset */
+
+	struct rd_index_entry *index;
+	int nindex;
+	int index_loaded;
+	int index_resolve;   /* has RD_BUFFER_HASH/RD_BUFFER_PARTIAL entries */
+
+	struct rd_blob_table blobs;
+	uint64_t hash;       /* from RD_BUFFER_HASH, for the next contents */
+	int have_hash;
+
+	struct rd_blob_table bufs;
+	uint64_t gpuaddr;    /* from RD_GPUADDR, for the next contents */
+	int have_gpuaddr;
+
+	/* an RD_BUFFER_PARTIAL is returned as an RD_GPUADDR followed by
+	 * the patched RD_BUFFER_CONTENTS:
+	 */
+	uint32_t gpuaddr_sect[3];
+	struct rd_section queued;
+	int have_queued;
+
+	/* copies that were replaced, but which the caller may still be
+	 * looking at (see rd_reader_mapped()):
+	 */
+	void **retired;
+	unsigned int nretired, retiredsz;
+};
+
+static int is_gzip(int fd)
+{
+	uint8_t magic[2];
+	if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic))
+		return 0;
+	return (magic[0] == 0x1f) && (magic[1] == 0x8b);
+}
+
+struct rd_reader * rd_reader_open(const char *filename)
+{
+	struct rd_reader *r;
+	struct stat st;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	r = calloc(1, sizeof(*r));
+
+	if (!is_gzip(fd) && !fstat(fd, &st) && (st.st_size > 0)) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			r->map = map;
+			r->filesz = st.st_size;
+			close(fd);
+			return r;
+		}
+	}
+
+	/* note: gzdopen() also handles uncompressed files, in case mmap
+	 * fails (ie. reading from a pipe):
+	 */
+	r->fd = gzdopen(fd, "rb");
+	if (!r->fd) {
+		close(fd);
+		free(r);
+		return NULL;
+	}
+
+	return r;
+}
+
+/* returns the entry for key, or the empty slot to add it in: */
+static struct rd_blob * blob_slot(struct rd_blob_table *t, uint64_t key)
+{
+	unsigned int i;
+
+	for (i = key & (t->size - 1); t->entries[i].buf; i = (i + 1) & (t->size - 1))
+		if (t->entries[i].key == key)
+			break;
+
+	return &t->entries[i];
+}
+
+static struct rd_blob * blob_lookup(struct rd_blob_table *t, uint64_t key)
+{
+	struct rd_blob *b;
+
+	if (!t->size)
+		return NULL;
+
+	b = blob_slot(t, key);
+
+	return b->buf ? b : NULL;
+}
+
+static void retire(struct rd_reader *r, const void *buf)
+{
+	if (!r->map) {
+		free((void *)buf);
+		return;
+	}
+	if (r->nretired == r->retiredsz) {
+		r->retiredsz = max(2 * r->retiredsz, 64);
+		r->retired = realloc(r->retired, r->retiredsz * sizeof(r->retired[0]));
+	}
+	r->retired[r->nretired++] = (void *)buf;
+}
+
+/* add, or replace, the contents for key: */
+static void blob_insert(struct rd_reader *r, struct rd_blob_table *t,
+		uint64_t key, const void *buf, uint32_t sz)
+{
+	struct rd_blob *b;
+	unsigned int i;
+
+	if ((t->count + 1) * 2 > t->size) {
+		struct rd_blob_table old = *t;
+
+		t->size = old.size ? old.size * 2 : 256;
+		t->entries = calloc(t->size, sizeof(t->entries[0]));
+
+		for (i = 0; i < old.size; i++)
+			if (old.entries[i].buf)
+				*blob_slot(t, old.entries[i].key) = old.entries[i];
+
+		free(old.entries);
+	}
+
+	b = blob_slot(t, key);
+	if (!b->buf)
+		t->count++;
+	else if (b->copied)
+		retire(r, b->buf);
+
+	/* contents of compressed files don't stick around, so keep a copy: */
+	if (!r->map) {
+		void *copy = malloc(max(sz, 1));
+		memcpy(copy, buf, sz);
+		buf = copy;
+	}
+
+	b->key = key;
+	b->sz  = sz;
+	b->copied = !r->map;
+	b->buf = buf;
+}
+
+static void blob_table_fini(struct rd_reader *r, struct rd_blob_table *t)
+{
+	unsigned int i;
+
+	for (i = 0; i < t->size; i++)
+		if (t->entries[i].copied)
+			retire(r, t->entries[i].buf);
+	free(t->entries);
+	memset(t, 0, sizeof(*t));
+}
+
+void rd_reader_close(struct rd_reader *r)
+{
+	blob_table_fini(r, &r->blobs);
+	blob_table_fini(r, &r->bufs);
+	while (r->nretired)
+		free(r->retired[--r->nretired]);
+	free(r->retired);
+	if (r->map)
+		munmap((void *)r->map, r->filesz);
+	else
+		gzclose(r->fd);
+	free(r->index);
+	free(r->buf);
+	free(r);
+}
+
+/* returns pointer to the next sz bytes, or NULL if there are not that
+ * many left:
+ */
+static const void * read_bytes(struct rd_reader *r, uint32_t sz)
+{
+	const void *ptr;
+
+	if (r->map) {
+		if ((r->offset + sz) > r->filesz)
+			return NULL;
+		ptr = r->map + r->offset;
+	} else {
+		if (!r->buf || (sz > r->bufsz)) {
+			r->bufsz = ALIGN(sz + 1, 0x1000);
+			free(r->buf);
+			r->buf = malloc(r->bufsz);
+		}
+		if (gzread(r->fd, r->buf, sz) != sz)
+			return NULL;
+		ptr = r->buf;
+	}
+
+	r->offset += sz;
+
+	return ptr;
+}
+
+/* read the next raw section from the file: */
+static int read_section(struct rd_reader *r, struct rd_section *sect)
+{
+	const uint32_t *hdr;
+
+	sect->offset = r->offset;
+
+	do {
+		if (r->map && (r->offset == r->filesz))
+			return 0;
+		hdr = read_bytes(r, 2 * sizeof(uint32_t));
+		if (!hdr) {
+			if (!r->map && gzeof(r->fd) && (r->offset == sect->offset))
+				return 0;
+			fprintf(stderr, "truncated section header at 0x%llx\n",
+					(unsigned long long)r->offset);
+			return -1;
+		}
+		/* sections start with a pair of 0xffffffff markers: */
+	} while ((hdr[0] == 0xffffffff) && (hdr[1] == 0xffffffff));
+
+	sect->type = hdr[0];
+	sect->sz   = hdr[1];
+
+	if (sect->sz > MAX_SECTION_SIZE) {
+		fprintf(stderr, "invalid section size 0x%x at 0x%llx\n",
+				sect->sz, (unsigned long long)sect->offset);
+		return -1;
+	}
+
+	sect->buf = read_bytes(r, sect->sz);
+	if (!sect->buf) {
+		fprintf(stderr, "truncated section at 0x%llx\n",
+				(unsigned long long)sect->offset);
+		return -1;
+	}
+
+	return 1;
+}
+
+static inline uint64_t sect_u64(const struct rd_section *sect)
+{
+	const uint32_t *dwords = sect->buf;
+	return ((uint64_t)dwords[1] << 32) | dwords[0];
+}
+
+static inline uint32_t get_u32(const void *ptr)
+{
+	uint32_t v;
+	memcpy(&v, ptr, sizeof(v));   /* runs are not necessarily aligned */
+	return v;
+}
+
+/* patch a copy of the latest contents of the buffer with the dirty runs,
+ * and turn the section into the RD_GPUADDR for it, with the contents
+ * queued to be returned next:
+ */
+static int apply_partial(struct rd_reader *r, struct rd_section *sect)
+{
+	const uint8_t *p = sect->buf, *end = p + sect->sz;
+	struct rd_blob *b;
+	uint64_t gpuaddr;
+	void *buf;
+
+	if (sect->sz < 8)
+		return -1;
+
+	gpuaddr = sect_u64(sect);
+	b = blob_lookup(&r->bufs, gpuaddr);
+	if (!b) {
+		fprintf(stderr, "partial contents of unknown buffer at 0x%llx\n",
+				(unsigned long long)sect->offset);
+		return -1;
+	}
+
+	/* previously returned contents must not change under the caller: */
+	buf = malloc(max(b->sz, 1));
+	memcpy(buf, b->buf, b->sz);
+
+	for (p += 8; (end - p) >= 8; ) {
+		uint32_t off = get_u32(p), len = get_u32(p + 4);
+		p += 8;
+		if ((len > (end - p)) || (off > b->sz) || (len > (b->sz - off))) {
+			fprintf(stderr, "invalid partial contents at 0x%llx\n",
+					(unsigned long long)sect->offset);
+			free(buf);
+			return -1;
+		}
+		memcpy((uint8_t *)buf + off, p, len);
+		p += len;
+	}
+
+	if (b->copied)
+		retire(r, b->buf);
+	b->buf = buf;
+	b->copied = 1;
+
+	r->queued.type   = RD_BUFFER_CONTENTS;
+	r->queued.sz     = b->sz;
+	r->queued.offset = sect->offset;
+	r->queued.buf    = b->buf;
+	r->have_queued   = 1;
+
+	r->gpuaddr_sect[0] = gpuaddr;
+	r->gpuaddr_sect[1] = b->sz;
+	r->gpuaddr_sect[2] = gpuaddr >> 32;
+
+	sect->type = RD_GPUADDR;
+	sect->sz   = sizeof(r->gpuaddr_sect);
+	sect->buf  = r->gpuaddr_sect;
+
+	return 0;
+}
+
+int rd_reader_next(struct rd_reader *r, struct rd_section *sect)
+{
+	const uint32_t *dwords;
+	struct rd_blob *b;
+	int ret;
+
+	if (r->have_queued) {
+		*sect = r->queued;
+		r->have_queued = 0;
+		return 1;
+	}
+
+	while ((ret = read_section(r, sect)) == 1) {
+		switch (sect->type) {
+		case RD_GPUADDR:
+			if (sect->sz < 4)
+				break;
+			/* upper 32b of gpuaddr comes after the size, if present: */
+			dwords = sect->buf;
+			r->gpuaddr = dwords[0];
+			if (sect->sz >= 12)
+				r->gpuaddr |= (uint64_t)dwords[2] << 32;
+			r->have_gpuaddr = 1;
+			break;
+		case RD_BUFFER_PARTIAL:
+			apply_partial(r, sect);
+			break;
+		case RD_BUFFER_HASH:
+			if (sect->sz < 8)
+				break;
+			/* names the RD_BUFFER_CONTENTS which follows it: */
+			r->hash = sect_u64(sect);
+			r->have_hash = 1;
+			continue;
+		case RD_BUFFER_CONTENTS:
+			if (r->have_hash)
+				blob_insert(r, &r->blobs, r->hash, sect->buf, sect->sz);
+			r->have_hash = 0;
+			break;
+		case RD_BUFFER_REF:
+			if (sect->sz < 8)
+				break;
+			b = blob_lookup(&r->blobs, sect_u64(sect));
+			if (!b) {
+				fprintf(stderr, "unresolved buffer ref at 0x%llx\n",
+						(unsigned long long)sect->offset);
+				break;
+			}
+			sect->type = RD_BUFFER_CONTENTS;
+			sect->sz   = b->sz;
+			sect->buf  = b->buf;
+			break;
+		default:
+			break;
+		}
+
+		if ((sect->type == RD_BUFFER_CONTENTS) && r->have_gpuaddr) {
+			blob_insert(r, &r->bufs, r->gpuaddr, sect->buf, sect->sz);
+			r->have_gpuaddr = 0;
+		}
+
+		break;
+	}
+
+	return ret;
+}
+
+int rd_reader_seek(struct rd_reader *r, uint64_t offset)
+{
+	if (r->map) {
+		if (offset > r->filesz)
+			return -1;
+	} else if (gzseek(r->fd, offset, SEEK_SET) < 0) {
+		return -1;
+	}
+	r->offset = offset;
+	r->have_queued = 0;
+	return 0;
+}
+
+int rd_reader_mapped(struct rd_reader *r)
+{
+	return !!r->map;
+}
+
+/* try to find the index written by libwrap at the end of the file: */
+static int load_index(struct rd_reader *r)
+{
+	struct rd_section sect;
+	const uint32_t *off;
+
+	/* finding the end of a compressed file means decompressing all of
+	 * it, at which point we may as well scan:
+	 */
+	if (!r->map || (r->filesz < 24))
+		return -1;
+
+	/* RD_INDEX_OFFSET section is 2 markers + type + size + 2 dwords: */
+	if (rd_reader_seek(r, r->filesz - 24) || (read_section(r, &sect) != 1))
+		return -1;
+
+	if ((sect.type != RD_INDEX_OFFSET) || (sect.sz != 8))
+		return -1;
+
+	off = (const uint32_t *)sect.buf;
+	if (rd_reader_seek(r, ((uint64_t)off[1] << 32) | off[0]) ||
+			(read_section(r, &sect) != 1) || (sect.type != RD_INDEX))
+		return -1;
+
+	r->nindex = sect.sz / sizeof(r->index[0]);
+	r->index = malloc(sect.sz);
+	memcpy(r->index, sect.buf, sect.sz);
+
+	return 0;
+}
+
+/* no index in the file, so build it by scanning.  Each submit starts
+ * with dumping the buffers (RD_GPUADDR, or RD_BUFFER_PARTIAL for the ones
+ * only partially dumped), followed by the cmdstream address(es), so a new
+ * submit starts at the first buffer after an RD_CMDSTREAM_ADDR.  Unlike
+ * in a written index, there is no way to tell buffers logged before the
+ * first submit apart, so they are counted as part of submit 1 rather
+ * than submit 0:
+ */
+static int build_index(struct rd_reader *r)
+{
+	struct rd_section sect;
+	enum rd_sect_type last = RD_NONE;
+	unsigned int submit = 0;
+	int size = 0, ret;
+
+	if (rd_reader_seek(r, 0))
+		return -1;
+
+	while ((ret = read_section(r, &sect)) == 1) {
+		struct rd_index_entry *e;
+
+		/* compressed file written with an index, use that instead: */
+		if (sect.type == RD_INDEX) {
+			r->nindex = sect.sz / sizeof(r->index[0]);
+			r->index = realloc(r->index, max(sect.sz, 1));
+			memcpy(r->index, sect.buf, sect.sz);
+			return 0;
+		}
+
+		if ((sect.type != RD_GPUADDR) && (sect.type != RD_BUFFER_PARTIAL) &&
+				(sect.type != RD_CMDSTREAM_ADDR) &&
+				(sect.type != RD_BUFFER_HASH))
+			continue;
+
+		if (((sect.type != RD_CMDSTREAM_ADDR) || (submit == 0)) &&
+				(last == RD_CMDSTREAM_ADDR || last == RD_NONE))
+			submit++;
+		last = sect.type;
+
+		if (r->nindex == size) {
+			size = max(2 * size, 1024);
+			r->index = realloc(r->index, size * sizeof(r->index[0]));
+		}
+
+		e = &r->index[r->nindex++];
+		e->type = sect.type;
+		e->submit = submit;
+		e->offset_lo = sect.offset;
+		e->offset_hi = sect.offset >> 32;
+	}
+
+	return ret;
+}
+
+const struct rd_index_entry * rd_reader_index(struct rd_reader *r, int *n)
+{
+	if (!r->index_loaded) {
+		uint64_t saved = r->offset;
+		int i;
+
+		if (load_index(r)) {
+			free(r->index);
+			r->index = NULL;
+			r->nindex = 0;
+			if (build_index(r))
+				fprintf(stderr, "could not build index\n");
+		}
+
+		for (i = 0; i < r->nindex; i++)
+			if ((r->index[i].type == RD_BUFFER_HASH) ||
+					(r->index[i].type == RD_BUFFER_PARTIAL))
+				r->index_resolve = 1;
+
+		r->index_loaded = 1;
+		rd_reader_seek(r, saved);
+	}
+
+	*n = r->nindex;
+	return r->index;
+}
+
+/* buffer refs and partial contents can only be resolved if everything
+ * in between has been read, so if the file has any, rather than jumping
+ * directly, read up to the offset (which for mapped files is just walking
+ * the section headers):
+ */
+static int seek_resolved(struct rd_reader *r, uint64_t offset)
+{
+	struct rd_section sect;
+
+	if (!r->index_resolve)
+		return rd_reader_seek(r, offset);
+
+	if (offset < r->offset) {
+		blob_table_fini(r, &r->blobs);
+		blob_table_fini(r, &r->bufs);
+		r->have_hash = 0;
+		r->have_gpuaddr = 0;
+		if (rd_reader_seek(r, 0))
+			return -1;
+	}
+
+	while (r->have_queued || (r->offset < offset))
+		if (rd_reader_next(r, &sect) != 1)
+			return -1;
+
+	return (r->offset == offset) ? 0 : -1;
+}
+
+int rd_reader_seek_submit(struct rd_reader *r, unsigned int submit)
+{
+	const struct rd_index_entry *index;
+	int n, lo = 0, hi;
+
+	index = rd_reader_index(r, &n);
+
+	/* entries are in file order, so submit numbers are sorted too: */
+	hi = n;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (index[mid].submit < submit)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if ((lo == n) || (index[lo].submit != submit))
+		return -1;
+
+	return seek_resolved(r, rd_index_offset(&index[lo]));
+}
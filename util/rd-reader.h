@@ -0,0 +1,83 @@
+/*
+ * Copyright © 2012 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef RD_READER_H_
+#define RD_READER_H_
+
+#include <stdint.h>
+
+#include "redump.h"
+
+/* Helper for reading .rd files (compressed or not), section by section.
+ * Uncompressed files are mmap'd, and the returned sections point directly
+ * into the mapping.  Compressed files are decompressed into a buffer that
+ * is reused for each section.  Either way, section contents are only
+ * valid until the next call, and are not nul terminated.
+ *
+ * If the file has an RD_INDEX, it is used to seek directly to a given
+ * submit, otherwise the index is built by scanning the file the first
+ * time it is needed.
+ *
+ * Buffers written deduplicated or dirty-tracked by libwrap are resolved
+ * transparently: RD_BUFFER_HASH sections are consumed, an RD_BUFFER_REF
+ * is returned as an RD_BUFFER_CONTENTS with the contents it refers to,
+ * and an RD_BUFFER_PARTIAL is returned as an RD_GPUADDR followed by an
+ * RD_BUFFER_CONTENTS with the full, patched, contents.  That relies on
+ * having read the earlier contents, so after rd_reader_seek() to an
+ * arbitrary offset they may not resolve, and are returned as is
+ * (rd_reader_seek_submit() takes care of that, by reading up to the
+ * submit in files which have them, and jumping directly otherwise).
+ */
+
+struct rd_reader;
+
+struct rd_section {
+	enum rd_sect_type type;
+	uint32_t sz;
+	uint64_t offset;     /* file offset of the section */
+	const void *buf;     /* payload, valid until next read */
+};
+
+struct rd_reader * rd_reader_open(const char *filename);
+void rd_reader_close(struct rd_reader *r);
+
+/* returns 1 if a section was read, 0 at end of file, -1 on error: */
+int rd_reader_next(struct rd_reader *r, struct rd_section *sect);
+
+int rd_reader_seek(struct rd_reader *r, uint64_t offset);
+
+/* if true, section contents stay valid until rd_reader_close(): */
+int rd_reader_mapped(struct rd_reader *r);
+
+/* returns the index entries (sorted by offset), and the count in *n: */
+const struct rd_index_entry * rd_reader_index(struct rd_reader *r, int *n);
+
+/* seek to the start of the given submit, returns -1 if not found: */
+int rd_reader_seek_submit(struct rd_reader *r, unsigned int submit);
+
+static inline uint64_t rd_index_offset(const struct rd_index_entry *e)
+{
+	return ((uint64_t)e->offset_hi << 32) | e->offset_lo;
+}
+
+#endif /* RD_READER_H_ */
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2013 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef READ_FILE_H_
+#define READ_FILE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+
+/* Read a whole (text) file into a nul terminated, malloc'd buffer, for
+ * the assemblers and their tests.  Include after the util.h with
+ * ERROR_MSG().
+ */
+static inline char * read_file(const char *infile)
+{
+	struct stat st;
+	char *src;
+	int fd, ret;
+
+	fd = open(infile, O_RDONLY);
+	if (fd < 0) {
+		ERROR_MSG("could not open '%s': %s", infile, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st)) {
+		ERROR_MSG("could not stat '%s': %s", infile, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	src = malloc(st.st_size + 1);
+	ret = read(fd, src, st.st_size);
+	close(fd);
+
+	if (ret != st.st_size) {
+		ERROR_MSG("could not read '%s': %s", infile, strerror(errno));
+		free(src);
+		return NULL;
+	}
+	src[ret] = '\0';
+
+	return src;
+}
+
+#endif /* READ_FILE_H_ */
@@ -0,0 +1,172 @@
+/*
+ * Copyright © 2012 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define HAVE_X86_SIMD 1
+#endif
+
+#include "redump-match.h"
+
+int8_t match_lut[16];
+
+const uint32_t patterns[NUM_PATTERNS] = {
+		/* these should be ordered by most inclusive pattern, ie. most 'f's */
+		0xffffffff,
+		0xffffff00,
+		0xffff00ff,
+		0xff00ffff,
+		0x00ffffff,
+		0xffff0000,
+		0x0000ffff,
+		0xff000000,
+		0x00ff0000,
+		0x0000ff00,
+		0x000000ff,
+};
+
+static void match_scalar(const uint32_t * const *src, int nsrc, int i, int n,
+		int8_t *result)
+{
+	int k;
+
+	for (; i < n; i++) {
+		uint32_t ref = src[0][i], diff = 0;
+		for (k = 1; k < nsrc; k++)
+			diff |= ref ^ src[k][i];
+		result[i] = match_lut[match_zero_bytes(diff)];
+	}
+}
+
+static void (*match_fxn)(const uint32_t * const *src, int nsrc, int i, int n,
+		int8_t *result) = match_scalar;
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static void match_sse2(const uint32_t * const *src, int nsrc, int i, int n,
+		int8_t *result)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int k;
+
+	for (; (i + 4) <= n; i += 4) {
+		__m128i ref = _mm_loadu_si128((const __m128i *)&src[0][i]);
+		__m128i diff = zero;
+		unsigned mask;
+
+		for (k = 1; k < nsrc; k++) {
+			__m128i v = _mm_loadu_si128((const __m128i *)&src[k][i]);
+			diff = _mm_or_si128(diff, _mm_xor_si128(ref, v));
+		}
+
+		/* one bit per zero byte, so 4 bits per dword: */
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero));
+
+		result[i + 0] = match_lut[(mask >>  0) & 0xf];
+		result[i + 1] = match_lut[(mask >>  4) & 0xf];
+		result[i + 2] = match_lut[(mask >>  8) & 0xf];
+		result[i + 3] = match_lut[(mask >> 12) & 0xf];
+	}
+
+	match_scalar(src, nsrc, i, n, result);
+}
+
+__attribute__((target("avx2")))
+static void match_avx2(const uint32_t * const *src, int nsrc, int i, int n,
+		int8_t *result)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	int j, k;
+
+	for (; (i + 8) <= n; i += 8) {
+		__m256i ref = _mm256_loadu_si256((const __m256i *)&src[0][i]);
+		__m256i diff = zero;
+		uint32_t mask;
+
+		for (k = 1; k < nsrc; k++) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)&src[k][i]);
+			diff = _mm256_or_si256(diff, _mm256_xor_si256(ref, v));
+		}
+
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(diff, zero));
+
+		for (j = 0; j < 8; j++, mask >>= 4)
+			result[i + j] = match_lut[mask & 0xf];
+	}
+
+	match_sse2(src, nsrc, i, n, result);
+}
+#endif
+
+void match_init(const uint32_t *patterns, int npatterns)
+{
+	unsigned zero;
+	int j, b;
+
+	for (j = 0; j < npatterns; j++) {
+		for (b = 0; b < 32; b += 8) {
+			uint32_t byte = (patterns[j] >> b) & 0xff;
+			if ((byte != 0x00) && (byte != 0xff)) {
+				fprintf(stderr, "not a byte mask: %08x\n", patterns[j]);
+				abort();
+			}
+		}
+	}
+
+	/* for each set of zero bytes in a ^ b, first pattern covered by it: */
+	for (zero = 0; zero < 16; zero++) {
+		match_lut[zero] = -1;
+		for (j = 0; j < npatterns; j++) {
+			unsigned bytes = ~match_zero_bytes(patterns[j]) & 0xf;
+			if ((bytes & zero) == bytes) {
+				match_lut[zero] = j;
+				break;
+			}
+		}
+	}
+
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (getenv("REDUMP_NO_SIMD"))
+		match_fxn = match_scalar;
+	else if (__builtin_cpu_supports("avx2"))
+		match_fxn = match_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		match_fxn = match_sse2;
+#endif
+}
+
+void match_patterns(const uint32_t * const *src, int nsrc, int n, int8_t *result)
+{
+	match_fxn(src, nsrc, 0, n, result);
+}
+
+void match_patterns_scalar(const uint32_t * const *src, int nsrc, int n,
+		int8_t *result)
+{
+	match_scalar(src, nsrc, 0, n, result);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright © 2012 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef REDUMP_MATCH_H_
+#define REDUMP_MATCH_H_
+
+#include <stdint.h>
+
+/* Matching dwords against redump's table of byte masks.  Each pattern
+ * selects some of the bytes of a dword, so which of them match is only
+ * a function of which bytes of (a ^ b) are zero.  That is looked up in
+ * a 16 entry table, rather than trying each pattern in turn.
+ */
+
+extern int8_t match_lut[16];
+
+/* redump's table, shared with matchbench: */
+#define NUM_PATTERNS 11
+extern const uint32_t patterns[NUM_PATTERNS];
+
+/* patterns must be byte masks, ordered from most to least inclusive: */
+void match_init(const uint32_t *patterns, int npatterns);
+
+/* bit N set if byte N of the dword is zero: */
+static inline unsigned match_zero_bytes(uint32_t v)
+{
+	return (!(v & 0x000000ff) << 0) |
+	       (!(v & 0x0000ff00) << 1) |
+	       (!(v & 0x00ff0000) << 2) |
+	       (!(v & 0xff000000) << 3);
+}
+
+/* index of the most inclusive pattern for which a and b match, or -1: */
+static inline int match_dwords(uint32_t a, uint32_t b)
+{
+	return match_lut[match_zero_bytes(a ^ b)];
+}
+
+/* for each of n positions, find the most inclusive pattern for which the
+ * dwords of all the nsrc sources match.  Uses SSE2/AVX2 if available:
+ */
+void match_patterns(const uint32_t * const *src, int nsrc, int n, int8_t *result);
+void match_patterns_scalar(const uint32_t * const *src, int nsrc, int n, int8_t *result);
+
+#endif /* REDUMP_MATCH_H_ */
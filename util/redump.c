@@ -29,23 +29,12 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "redump.h"
-
-static const uint32_t patterns[] = {
-		/* these should be ordered by most inclusive pattern, ie. most 'f's */
-		0xffffffff,
-		0xffffff00,
-		0xffff00ff,
-		0xff00ffff,
-		0x00ffffff,
-		0xffff0000,
-		0x0000ffff,
-		0xff000000,
-		0x00ff0000,
-		0x0000ff00,
-		0x000000ff,
-};
+#include "rd-reader.h"
+#include "redump-match.h"
 
 static const struct {
 	uint32_t val, mask, color;
@@ -124,9 +113,15 @@ struct param {
 };
 
 struct context {
-	int       fd;
-	uint32_t *buf;           /* current row buffer */
+	struct rd_reader *rd;
+	struct rd_section sect;  /* next section we can handle */
+	int       have_sect;
+	FILE     *out;
+	char     *outbuf;        /* rendered column, if done in parallel */
+	size_t    outlen;
+	const uint32_t *buf;     /* current row buffer */
 	int       sz;            /* current row buffer size */
+	int8_t   *gpuidx;        /* find_gpuaddr() for each dword of buf */
 	uint32_t  gpuaddrs[32];
 	int       ngpuaddrs;
 	struct param params[32];
@@ -135,19 +130,28 @@ struct context {
 
 struct context ctxts[64];
 int nctxts;
-typedef int offsets_t[ARRAY_SIZE(ctxts)];
+
+/* the cmdstreams might not all be the same size (optional words, etc),
+ * so treat anything past the end as zero:
+ */
+static inline uint32_t ctx_dword(struct context *ctx, int i)
+{
+	if ((i < 0) || (i >= (ctx->sz / 4)))
+		return 0;
+	return ctx->buf[i];
+}
 
 static void handle_string(struct context *ctx)
 {
-	printf("%s", (char *)ctx->buf);
+	fprintf(ctx->out, "%.*s", ctx->sz, (const char *)ctx->buf);
 }
 
 static void handle_gpuaddr(struct context *ctx)
 {
-	uint32_t gpuaddr = ctx->buf[0];
-	printf("<font color=\"#%06x\"><b>%08x</b></font><br>",
+	uint32_t gpuaddr = ctx_dword(ctx, 0);
+	fprintf(ctx->out, "<font color=\"#%06x\"><b>%08x</b></font><br>",
 			gpuaddr_colors[ctx->ngpuaddrs], gpuaddr);
-	printf("(len: %x)", ctx->buf[1]);
+	fprintf(ctx->out, "(len: %x)", ctx_dword(ctx, 1));
 	ctx->gpuaddrs[ctx->ngpuaddrs++] = gpuaddr;
 }
 
@@ -160,116 +164,253 @@ static int find_gpuaddr(struct context *ctx, uint32_t dword)
 	return -1;
 }
 
-static int find_pattern(uint32_t dword, int i, offsets_t offsets)
+/*
+ * Alignment of the cmdstreams of the current row, computed once per row
+ * before rendering.  Each column of the alignment has the index of a
+ * dword in each context, or -1 for a gap.
+ *
+ * The contexts are aligned progressively: the first cmdstream is the
+ * initial profile, and each following one is aligned against the columns
+ * so far with a banded Needleman-Wunsch.  A dword scores against a column
+ * by the sum of how well it matches each dword already in the column:
+ * highest if they are the same gpuaddr, otherwise by the most inclusive
+ * of patterns[] that matches.
+ */
+#define GAP_SCORE   (-(int)ARRAY_SIZE(patterns) / 2)
+#define BAND        32
+#define MAX_CELLS   (16 * 1024 * 1024)
+
+typedef int column_t[ARRAY_SIZE(ctxts)];
+
+static struct {
+	column_t *cols, *tmp;
+	int ncols, size;
+	int8_t *pattern;     /* most inclusive matching pattern per column */
+	uint32_t *gather;    /* dwords of each column, for match_patterns() */
+
+	/* dp matrix, only the cells within the band: */
+	int *score;
+	uint8_t *trace;
+	size_t ncells;
+} aln;
+
+enum { DIAG, UP, LEFT };
+
+static int dword_score(uint32_t a, int ga, uint32_t b, int gb)
 {
-	int j, k;
-	for (j = 0; j < ARRAY_SIZE(patterns); j++) {
-		int found = 1;
-		uint32_t pattern = patterns[j];
-		for (k = 0; k < nctxts; k++) {
-			uint32_t other_dword = ctxts[k].buf[i - offsets[k]];
-			if ((dword & pattern) != (other_dword & pattern)) {
-				found = 0;
-				break;
-			}
-		}
-		if (found)
-			return j;
-	}
-	return -1;
+	int j;
+
+	if ((ga >= 0) || (gb >= 0))
+		return (ga == gb) ? ARRAY_SIZE(patterns) : 0;
+
+	j = match_dwords(a, b);
+	if (j >= 0)
+		return ARRAY_SIZE(patterns) - 1 - j;
+
+	return 0;
 }
 
-static int find_rank(int i, offsets_t offsets)
+/* score of dword j of ctxts[k] against the contexts before it in col: */
+static int column_score(const int *col, int k, int j)
 {
-	int j, k, rank = 0;
-	uint32_t dword;
-
-	/* check if we are past the end: */
-	for (k = 0; k < nctxts; k++)
-		if (i >= (ctxts[k].sz/ 4 + offsets[k]))
-			return 0;
-
-	dword = ctxts[0].buf[i - offsets[0]];
-
-	j = find_gpuaddr(&ctxts[0], dword);
-	if (j >= 0) {
-		/* highest rank, if all are gpuaddr: */
-		rank = ARRAY_SIZE(patterns);
-		for (k = 0; k < nctxts; k++) {
-			struct context *ctx = &ctxts[k];
-			if (j != find_gpuaddr(ctx, ctx->buf[i - offsets[k]])) {
-				rank = 0;
-				break;
-			}
-		}
-	} else {
-		/* followed by pattern match.. in order of priority */
-		/* TODO we need some fuzziness for partial match here.. */
-		j = find_pattern(dword, i, offsets);
-		if (j >= 0)
-			rank = ARRAY_SIZE(patterns) - 1 - j;
+	struct context *ctx = &ctxts[k];
+	int m, score = 0;
+
+	for (m = 0; m < k; m++) {
+		int i = col[m];
+		if (i >= 0)
+			score += dword_score(ctxts[m].buf[i], ctxts[m].gpuidx[i],
+					ctx->buf[j], ctx->gpuidx[j]);
 	}
 
-	return rank + find_rank(i + 1, offsets) / 2;
+	return score;
 }
 
-static int adjust_offsets_recursive(struct context *ctx, int i,
-		offsets_t offsets, int n, int max_sz)
+static void aln_reserve(int n)
 {
-	int rank;
+	if (n > aln.size) {
+		aln.size = max(n, 2 * aln.size);
+		aln.cols = realloc(aln.cols, aln.size * sizeof(aln.cols[0]));
+		aln.tmp = realloc(aln.tmp, aln.size * sizeof(aln.tmp[0]));
+		aln.pattern = realloc(aln.pattern, aln.size * sizeof(aln.pattern[0]));
+		aln.gather = realloc(aln.gather,
+				(nctxts + 1) * aln.size * sizeof(aln.gather[0]));
+	}
+}
 
-	rank = find_rank(i, offsets);
+/* align ctxts[k] against the columns so far: */
+static void align_context(int k)
+{
+	struct context *ctx = &ctxts[k];
+	int m = aln.ncols, n = ctx->sz / 4;
+	/* cells (i, j) with lo <= j - i <= hi, which includes (m, n): */
+	int lo = min(0, n - m) - BAND;
+	int hi = max(0, n - m) + BAND;
+	int w = hi - lo + 1;
+	int i, j, ncols;
+
+#define CELL(i, j) ((size_t)(i) * w + ((j) - (i) - lo))
+
+	aln_reserve(m + n);
+
+	if (((size_t)(m + 1) * w) > MAX_CELLS) {
+		/* too different to be worth aligning, just line them up: */
+		for (i = m; i < n; i++) {
+			memset(aln.cols[i], 0xff, sizeof(aln.cols[i]));
+		}
+		for (j = 0; j < n; j++)
+			aln.cols[j][k] = j;
+		aln.ncols = max(m, n);
+		return;
+	}
 
-	if (n < nctxts) {
-		int new_rank;
-		offsets_t new_offsets;
-		memcpy(new_offsets, offsets, sizeof(offsets_t));
+	if (((size_t)(m + 1) * w) > aln.ncells) {
+		aln.ncells = (size_t)(m + 1) * w;
+		aln.score = realloc(aln.score, aln.ncells * sizeof(aln.score[0]));
+		aln.trace = realloc(aln.trace, aln.ncells * sizeof(aln.trace[0]));
+	}
 
-		if ((ctxts[n].sz/4 + offsets[n]) < max_sz)
-			new_offsets[n] += 1;
-		new_rank = adjust_offsets_recursive(ctx, i, new_offsets, n+1, max_sz);
-		if (new_rank > rank) {
-			rank = new_rank;
-			memcpy(offsets, new_offsets, sizeof(offsets_t));
+	for (i = 0; i <= m; i++) {
+		int jmin = max(0, i + lo), jmax = min(n, i + hi);
+		for (j = jmin; j <= jmax; j++) {
+			int best, dir;
+
+			if ((i == 0) && (j == 0)) {
+				aln.score[CELL(i, j)] = 0;
+				continue;
+			}
+
+			best = INT_MIN;
+			dir = DIAG;
+
+			if ((i > 0) && (j > 0)) {
+				best = aln.score[CELL(i - 1, j - 1)] +
+						column_score(aln.cols[i - 1], k, j - 1);
+			}
+			/* column i-1 with a gap for ctxts[k]: */
+			if ((i > 0) && ((j - i + 1) <= hi)) {
+				int s = aln.score[CELL(i - 1, j)] + GAP_SCORE;
+				if (s > best) {
+					best = s;
+					dir = UP;
+				}
+			}
+			/* dword j-1 in a new column of its own: */
+			if ((j > 0) && ((j - 1 - i) >= lo)) {
+				int s = aln.score[CELL(i, j - 1)] + GAP_SCORE;
+				if (s > best) {
+					best = s;
+					dir = LEFT;
+				}
+			}
+
+			aln.score[CELL(i, j)] = best;
+			aln.trace[CELL(i, j)] = dir;
 		}
 	}
 
-	return rank;
+	/* trace back, building the new columns in reverse order: */
+	ncols = 0;
+	i = m;
+	j = n;
+	while ((i > 0) || (j > 0)) {
+		int *col = aln.tmp[ncols++];
+
+		switch (aln.trace[CELL(i, j)]) {
+		case DIAG:
+			memcpy(col, aln.cols[--i], sizeof(column_t));
+			col[k] = --j;
+			break;
+		case UP:
+			memcpy(col, aln.cols[--i], sizeof(column_t));
+			col[k] = -1;
+			break;
+		case LEFT:
+			memset(col, 0xff, sizeof(column_t));
+			col[k] = --j;
+			break;
+		}
+	}
+
+#undef CELL
+
+	for (i = 0; i < ncols; i++)
+		memcpy(aln.cols[i], aln.tmp[ncols - 1 - i], sizeof(column_t));
+	aln.ncols = ncols;
 }
 
-static void adjust_offsets(struct context *ctx, int i, offsets_t offsets)
+/* most inclusive pattern matching all the dwords of each column.  Gaps
+ * are filled in with the first dword of the column, so they always match:
+ */
+static void match_columns(void)
 {
-	int k;
-	int max_sz = 0;
+	const uint32_t *src[ARRAY_SIZE(ctxts) + 1];
+	uint32_t *ref = aln.gather;
+	int i, k, nsrc = 0;
+
+	for (i = 0; i < aln.ncols; i++) {
+		for (k = 0; aln.cols[i][k] < 0; k++)
+			;
+		ref[i] = ctxts[k].buf[aln.cols[i][k]];
+	}
+	src[nsrc++] = ref;
+
+	for (k = 0; k < nctxts; k++) {
+		uint32_t *dst = &aln.gather[nsrc * aln.ncols];
 
-	for (k = 0; k < nctxts; k++)
-		if (ctxts[k].sz > max_sz)
-			max_sz = ctxts[k].sz;
+		if (!ctxts[k].sz)
+			continue;
 
-	/* convert to dwords: */
-	max_sz /= 4;
+		for (i = 0; i < aln.ncols; i++) {
+			int j = aln.cols[i][k];
+			dst[i] = (j >= 0) ? ctxts[k].buf[j] : ref[i];
+		}
+		src[nsrc++] = dst;
+	}
 
-	adjust_offsets_recursive(ctx, i, offsets, 0, max_sz);
+	match_patterns(src, nsrc, aln.ncols, aln.pattern);
 }
 
-static void handle_hexdump(struct context *ctx)
+static void align_row(void)
 {
-	uint32_t *dwords = ctx->buf;
-	int i, j, k;
-	offsets_t offsets = {0};
-	int offset = 0;
-	int idx = -1;
+	int i, k, first = 1;
+
+	aln.ncols = 0;
 
-	/* figure out idx: */
 	for (k = 0; k < nctxts; k++) {
-		if (&ctxts[k] == ctx) {
-			idx = k;
-			break;
+		struct context *ctx = &ctxts[k];
+		int n = ctx->sz / 4;
+
+		ctx->gpuidx = realloc(ctx->gpuidx, max(n, 1));
+		for (i = 0; i < n; i++)
+			ctx->gpuidx[i] = find_gpuaddr(ctx, ctx->buf[i]);
+
+		if (!n)
+			continue;
+
+		if (first) {
+			aln_reserve(n);
+			for (i = 0; i < n; i++) {
+				memset(aln.cols[i], 0xff, sizeof(aln.cols[i]));
+				aln.cols[i][k] = i;
+			}
+			aln.ncols = n;
+			first = 0;
+		} else {
+			align_context(k);
 		}
 	}
 
-	for (i = 0; i < ctx->sz/4; i++) {
-		int found = 0;
+	match_columns();
+}
+
+static void handle_hexdump(struct context *ctx)
+{
+	const uint32_t *dwords = ctx->buf;
+	int idx = ctx - ctxts;
+	int r, i, j, k;
+
+	for (r = 0; r < aln.ncols; r++) {
 		uint32_t dword;
 		uint32_t pattern = 0;
 		uint32_t known_pattern = 0;
@@ -279,25 +420,25 @@ static void handle_hexdump(struct context *ctx)
 		const char *pnames[32];
 		int nparams = 0;
 
-		/* adjust offsets for fuzzy matching: */
-		adjust_offsets(ctx, i + offset, offsets);
-		j = offsets[idx] - offset;
-		while (j--)
-			printf("<font face=\"monospace\" color=\"#000000\">........</font><br>");
-		offset = offsets[idx];
+		/* gap, to line up with the other ctxts: */
+		i = aln.cols[r][idx];
+		if (i < 0) {
+			fprintf(ctx->out, "<font face=\"monospace\" color=\"#000000\">........</font><br>");
+			continue;
+		}
 
 		dword = dwords[i];
 
 		/* check for gpu address: */
-		j = find_gpuaddr(ctx, dword);
+		j = ctx->gpuidx[i];
 		if (j >= 0) {
-			printf("<font face=\"monospace\">%04x: <font color=\"#%06x\"><b>%08x</b></font> (gpuaddr)</font><br>",
+			fprintf(ctx->out, "<font face=\"monospace\">%04x: <font color=\"#%06x\"><b>%08x</b></font> (gpuaddr)</font><br>",
 					i, gpuaddr_colors[j], dword);
 			continue;
 		}
 
 		/* check for similarity with other ctxts: */
-		j = find_pattern(dword, i + offset, offsets);
+		j = aln.pattern[r];
 		if (j >= 0)
 			pattern = patterns[j];
 
@@ -338,7 +479,7 @@ static void handle_hexdump(struct context *ctx)
 			uint32_t mask = 0xff000000;
 			uint32_t shift = 24;
 
-			printf("<font face=\"monospace\">%04x: ", i);
+			fprintf(ctx->out, "<font face=\"monospace\">%04x: ", i);
 
 			for (k = 0; k < 4; k++, mask >>= 8, shift -= 8) {
 				uint32_t color = 0;
@@ -352,35 +493,35 @@ static void handle_hexdump(struct context *ctx)
 				for (j = 0; j < nparams; j++) {
 					if (mask & pmasks[j]) {
 						color = pcolors[j];
-						printf("<b>");
+						fprintf(ctx->out, "<b>");
 						break;
 					}
 				}
 
-				printf("<font color=\"#%06x\">%02x</font>",
+				fprintf(ctx->out, "<font color=\"#%06x\">%02x</font>",
 						color, (dword & mask) >> shift);
 
 				for (j = 0; j < nparams; j++) {
 					if (mask & pmasks[j]) {
-						printf("</b>");
+						fprintf(ctx->out, "</b>");
 						break;
 					}
 				}
 			}
 			if (nparams > 0) {
-				printf(" (");
+				fprintf(ctx->out, " (");
 				for (j = 0; j < nparams; j++) {
 					if (j != 0)
-						printf(", ");
-					printf("%s", pnames[j]);
+						fprintf(ctx->out, ", ");
+					fprintf(ctx->out, "%s", pnames[j]);
 				}
-				printf("?)");
+				fprintf(ctx->out, "?)");
 			}
-			printf("</font><br>");
+			fprintf(ctx->out, "</font><br>");
 			continue;
 		}
 
-		printf("<font face=\"monospace\" color=\"#000000\">%04x: %08x</font><br>", i, dword);
+		fprintf(ctx->out, "<font face=\"monospace\" color=\"#000000\">%04x: %08x</font><br>", i, dword);
 	}
 }
 
@@ -397,13 +538,13 @@ static void handle_cmdstream(struct context *ctx)
 static void handle_param(struct context *ctx)
 {
 	struct param *param = &ctx->params[ctx->nparams++];
-	param->type   = ctx->buf[0];
-	param->val    = ctx->buf[1];
-	param->bitlen = ctx->buf[2];
-	printf("%s<br>", param_names[param->type]);
-	printf("<font color=\"#%06x\"><b>%08x</b></font><br>",
+	param->type   = ctx_dword(ctx, 0);
+	param->val    = ctx_dword(ctx, 1);
+	param->bitlen = ctx_dword(ctx, 2);
+	fprintf(ctx->out, "%s<br>", param_names[param->type]);
+	fprintf(ctx->out, "<font color=\"#%06x\"><b>%08x</b></font><br>",
 			param_colors[param->type], param->val);
-	printf("(bitlen: %d)", param->bitlen);
+	fprintf(ctx->out, "(bitlen: %d)", param->bitlen);
 	if (param->val >= (1 << param->bitlen)) {
 		fprintf(stderr, "invalid param: %08x (name: %s, bitlen: %d)\n",
 				param->val, param_names[param->type], param->bitlen);
@@ -435,46 +576,172 @@ static const char *sect_names[] = {
 	[RD_FLUSH]     = "flush",
 };
 
+/*
+ * Simple thread pool, used to read the next section of each input in
+ * parallel, and to render the columns of each cmdstream row in parallel
+ * (each column only reads the other contexts, so they are independent):
+ */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t  cond, done;
+	pthread_t threads[ARRAY_SIZE(ctxts)];
+	int nthreads, quit;
+	void (*fxn)(int i);
+	int n, next, pending;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+static void * pool_worker(void *arg)
+{
+	pthread_mutex_lock(&pool.lock);
+	while (1) {
+		while (pool.next < pool.n) {
+			int i = pool.next++;
+			pthread_mutex_unlock(&pool.lock);
+			pool.fxn(i);
+			pthread_mutex_lock(&pool.lock);
+			if (--pool.pending == 0)
+				pthread_cond_signal(&pool.done);
+		}
+		if (pool.quit)
+			break;
+		pthread_cond_wait(&pool.cond, &pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+	return NULL;
+}
+
+static void pool_init(int n)
+{
+	int i;
+
+	/* REDUMP_THREADS=1 to disable: */
+	if (getenv("REDUMP_THREADS"))
+		pool.nthreads = strtol(getenv("REDUMP_THREADS"), NULL, 0);
+	else
+		pool.nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	pool.nthreads = min(pool.nthreads, n);
+
+	for (i = 0; i < pool.nthreads; i++) {
+		if (pthread_create(&pool.threads[i], NULL, pool_worker, NULL)) {
+			pool.nthreads = i;
+			break;
+		}
+	}
+}
+
+static void pool_fini(void)
+{
+	int i;
+
+	pthread_mutex_lock(&pool.lock);
+	pool.quit = 1;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (i = 0; i < pool.nthreads; i++)
+		pthread_join(pool.threads[i], NULL);
+}
+
+/* call fxn(0)..fxn(n-1) from the pool, and wait for all to finish: */
+static void pool_run(void (*fxn)(int i), int n)
+{
+	int i;
+
+	if ((pool.nthreads <= 1) || (n <= 1)) {
+		for (i = 0; i < n; i++)
+			fxn(i);
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.fxn = fxn;
+	pool.n = n;
+	pool.next = 0;
+	pool.pending = n;
+	pthread_cond_broadcast(&pool.cond);
+	while (pool.pending > 0)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/* read the next section we know how to handle.  Only the current row is
+ * ever looked at, so the inputs are streamed, and (for compressed files)
+ * decompressed in parallel one row at a time:
+ */
+static void next_section(int i)
+{
+	struct context *ctx = &ctxts[i];
+
+	ctx->have_sect = 0;
+
+	while (rd_reader_next(ctx->rd, &ctx->sect) > 0) {
+		if ((ctx->sect.type < ARRAY_SIZE(sect_handlers)) &&
+				sect_handlers[ctx->sect.type]) {
+			ctx->have_sect = 1;
+			break;
+		}
+	}
+}
+
+static void render_column(int i)
+{
+	struct context *ctx = &ctxts[i];
+
+	if (ctx->sz > 0) {
+		ctx->out = open_memstream(&ctx->outbuf, &ctx->outlen);
+		handle_hexdump(ctx);
+		fclose(ctx->out);
+		ctx->out = stdout;
+	}
+}
+
 int main(int argc, char **argv)
 {
 	int i, n;
 
 	for (i = 1; i < argc; i++) {
 		struct context *ctx = &ctxts[nctxts++];
-		ctx->fd = open(argv[i], O_RDONLY);
-		if (ctx->fd < 0) {
+		ctx->rd = rd_reader_open(argv[i]);
+		if (!ctx->rd) {
 			fprintf(stderr, "could not open: %s\n", argv[i]);
 			return -1;
 		}
+		ctx->out = stdout;
 	}
 
+	match_init(patterns, ARRAY_SIZE(patterns));
+
+	pool_init(nctxts);
+
 	printf("<html><body><table border=\"1\">\n");
 	do {
 		enum rd_sect_type row_type = RD_NONE;
 
+		pool_run(next_section, nctxts);
+
 		for (i = 0; i < nctxts; i++) {
 			struct context *ctx = &ctxts[i];
-			enum rd_sect_type type = RD_NONE;
 
 			ctx->sz = 0;
-			free(ctx->buf);
 			ctx->buf = NULL;
 
-			if ((read(ctx->fd, &type, sizeof(type)) > 0) &&
-					(read(ctx->fd, &ctx->sz, 4) > 0)) {
+			if (ctx->have_sect) {
+				struct rd_section *sect = &ctx->sect;
+
 				if (row_type == RD_NONE)
-					row_type = type;
-
-				if (type == row_type) {
-					/* allocate  bit extra, because there could be some optional
-					 * words in the cmdstreams, and they might not all be the
-					 * same size..
-					 */
-					ctx->buf = calloc(1, ctx->sz + 1 + 20);
-					read(ctx->fd, ctx->buf, ctx->sz);
-					((char *)ctx->buf)[ctx->sz] = '\0';
+					row_type = sect->type;
+
+				if (sect->type == row_type) {
+					ctx->buf = sect->buf;
+					ctx->sz  = sect->sz;
 				} else {
-					fprintf(stderr, "unexpected type '%d', expected '%d'\n", type, row_type);
+					fprintf(stderr, "unexpected type '%d', expected '%d'\n",
+							sect->type, row_type);
 					return -1;
 				}
 			}
@@ -486,13 +753,23 @@ int main(int argc, char **argv)
 			break;
 		}
 
+		if (row_type == RD_CMDSTREAM) {
+			align_row();
+			pool_run(render_column, nctxts);
+		}
+
 		printf("<tr><th>%s</th>", sect_names[row_type]);
 
 		for (i = 0, n = 0; i < nctxts; i++) {
 			struct context *ctx = &ctxts[i];
 
 			printf("<td>");
-			if (ctx->sz > 0) {
+			if (ctx->outbuf) {
+				fwrite(ctx->outbuf, 1, ctx->outlen, stdout);
+				free(ctx->outbuf);
+				ctx->outbuf = NULL;
+				n++;
+			} else if (ctx->sz > 0) {
 				sect_handlers[row_type](ctx);
 				n++;
 			}
@@ -503,6 +780,10 @@ int main(int argc, char **argv)
 	} while(n > 0);
 	printf("</table></body></html>\n");
 
+	pool_fini();
+
+	for (i = 0; i < nctxts; i++)
+		rd_reader_close(ctxts[i].rd);
+
 	return 0;
 }
-
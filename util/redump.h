@@ -24,6 +24,8 @@
 #ifndef REDUMP_H_
 #define REDUMP_H_
 
+#include <stdint.h>
+
 enum rd_sect_type {
 	RD_NONE,
 	RD_TEST,       /* ascii text */
@@ -39,6 +41,21 @@ enum rd_sect_type {
 	RD_FRAG_SHADER,
 	RD_BUFFER_CONTENTS,
 	RD_GPU_ID,
+	RD_BUFFER_HASH,  /* u32 hash_lo, u32 hash_hi: names the following RD_BUFFER_CONTENTS */
+	RD_BUFFER_REF,   /* u32 hash_lo, u32 hash_hi: contents same as earlier RD_BUFFER_HASH */
+	RD_BUFFER_PARTIAL, /* u32 gpuaddr_lo, u32 gpuaddr_hi, then runs of: u32 offset, u32 len, raw dump */
+	RD_INDEX,        /* array of struct rd_index_entry */
+	RD_INDEX_OFFSET, /* u32 offset_lo, u32 offset_hi: of the RD_INDEX, always last */
+};
+
+/* RD_INDEX entries, for RD_GPUADDR, RD_BUFFER_PARTIAL and RD_CMDSTREAM_ADDR
+ * sections, plus RD_BUFFER_HASH so readers can tell the file has buffer
+ * refs to resolve:
+ */
+struct rd_index_entry {
+	uint32_t type;
+	uint32_t submit;                /* 0 for sections before the 1st submit */
+	uint32_t offset_lo, offset_hi;  /* file offset of the section */
 };
 
 /* RD_PARAM types: */
@@ -58,6 +75,7 @@ enum rd_param_type {
 void rd_start(const char *name, const char *fmt, ...) __attribute__((weak));
 void rd_end(void) __attribute__((weak));
 void rd_write_section(enum rd_sect_type type, const void *buf, int sz) __attribute__((weak));
+void rd_write_buffer(const void *buf, int sz) __attribute__((weak));
 
 /* for code that should run with and without libwrap, use the following
  * macros which check if the fxns are present before calling
@@ -0,0 +1,236 @@
+/*
+ * Copyright © 2012 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Micro-benchmark for libwrap's buffer tracking.  Replays a synthetic
+ * sequence of gpuobj alloc/info/mmap, submits and frees, with lots of
+ * buffers.  Meant to be run against the fake wrapper, ie:
+ *
+ *   LD_PRELOAD=`pwd`/libwrapfake.so WRAP_GPU_ID=530 WRAP_GMEM_SIZE=0x100000 \
+ *       TESTNUM=0 ./wrapbench 10000 > /dev/null
+ *
+ * Timings for each phase are printed on stderr (since libwrap logs to
+ * stdout).  Every submit dumps the contents of all the (mostly zero)
+ * buffers, so the submit phase also gives the rd write throughput, ie.
+ * compare with WRAP_COMPRESS=1.
+ *
+ * With a 3rd argument, that many threads write to the same pages of a
+ * subset of the buffers before each submit, which with WRAP_DIRTY makes
+ * them fault concurrently.  The writes are deterministic, so buffer
+ * contents read back from the rd file should not depend on WRAP_DIRTY.
+ *
+ * Before that, the interval tree used by find_buffer() is checked against
+ * a brute force search, with overlapping intervals, since which buffer is
+ * found when several contain the address (the one with the lowest start)
+ * can't be observed through the fake kgsl.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#define __user
+#include "msm_kgsl.h"
+#include "itree.h"
+
+#define BUFSZ 0x1000
+
+static struct wrbuf {
+	unsigned int id;
+	uint64_t gpuaddr;
+	void *ptr;
+} *bufs;
+static int nbufs, nwriters, submit;
+
+static void * writer(void *arg)
+{
+	int k = (intptr_t)arg, i;
+
+	for (i = submit % 7; i < nbufs; i += 7) {
+		uint32_t *dwords = bufs[i].ptr;
+		dwords[k] = (submit << 8) | k;
+	}
+
+	return NULL;
+}
+
+static void write_bufs(void)
+{
+	pthread_t threads[64];
+	int k;
+
+	for (k = 0; k < nwriters; k++)
+		pthread_create(&threads[k], NULL, writer, (void *)(intptr_t)k);
+	for (k = 0; k < nwriters; k++)
+		pthread_join(threads[k], NULL);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void report(const char *phase, int n, double t)
+{
+	fprintf(stderr, "%-8s: %6d in %8.3fms (%.2fus each)\n",
+			phase, n, t * 1000.0, t * 1000000.0 / n);
+}
+
+static int check_itree(void)
+{
+	static struct itree_node nodes[512];
+	struct itree tree = ITREE_INIT;
+	int inserted[512] = {0};
+	int i, j;
+
+	for (i = 0; i < 20000; i++) {
+		int n = rand() % 512;
+		uint64_t addr = rand() % 0x10000;
+		struct itree_node *found, *expected = NULL;
+
+		if (inserted[n]) {
+			itree_remove(&tree, &nodes[n]);
+		} else {
+			uint64_t start = rand() % 0x10000;
+			itree_insert(&tree, &nodes[n], start,
+					start + 1 + rand() % 0x800);
+		}
+		inserted[n] = !inserted[n];
+
+		for (j = 0; j < 512; j++) {
+			if (!inserted[j] || (addr < nodes[j].start) ||
+					(addr >= nodes[j].end))
+				continue;
+			if (!expected || (nodes[j].start < expected->start))
+				expected = &nodes[j];
+		}
+
+		found = itree_find(&tree, addr);
+		if ((!found != !expected) ||
+				(found && (found->start != expected->start))) {
+			fprintf(stderr, "itree: wrong interval for %"PRIx64"\n", addr);
+			return -1;
+		}
+	}
+
+	fprintf(stderr, "itree: ok\n");
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int nsubmits = (argc > 2) ? strtol(argv[2], NULL, 0) : 100;
+	struct kgsl_drawctxt_create ctx = {0};
+	double t;
+	int fd, i;
+
+	nbufs = (argc > 1) ? strtol(argv[1], NULL, 0) : 10000;
+	nwriters = (argc > 3) ? strtol(argv[3], NULL, 0) : 0;
+	if (nwriters > 64)
+		nwriters = 64;
+
+	if (check_itree())
+		return -1;
+
+	fd = open("/dev/kgsl-3d0", O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "could not open kgsl\n");
+		return -1;
+	}
+
+	ioctl(fd, IOCTL_KGSL_DRAWCTXT_CREATE, &ctx);
+
+	bufs = calloc(nbufs, sizeof(*bufs));
+
+	t = now();
+	for (i = 0; i < nbufs; i++) {
+		struct kgsl_gpuobj_alloc req = {
+				.size = BUFSZ,
+		};
+		ioctl(fd, IOCTL_KGSL_GPUOBJ_ALLOC, &req);
+		bufs[i].id = req.id;
+	}
+	report("alloc", nbufs, now() - t);
+
+	t = now();
+	for (i = 0; i < nbufs; i++) {
+		struct kgsl_gpuobj_info req = {
+				.id = bufs[i].id,
+		};
+		ioctl(fd, IOCTL_KGSL_GPUOBJ_INFO, &req);
+		bufs[i].gpuaddr = req.gpuaddr;
+	}
+	report("info", nbufs, now() - t);
+
+	t = now();
+	for (i = 0; i < nbufs; i++) {
+		bufs[i].ptr = mmap(NULL, BUFSZ, PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, (off_t)bufs[i].id << 12);
+		memset(bufs[i].ptr, 0, 4 * sizeof(uint32_t));
+	}
+	report("mmap", nbufs, now() - t);
+
+	t = now();
+	for (i = 0; i < nsubmits; i++) {
+		int n = rand() % nbufs;
+		submit = i;
+		write_bufs();
+		struct kgsl_command_object cmd = {
+				.gpuaddr = bufs[n].gpuaddr,
+				.size = 4 * sizeof(uint32_t),
+				.id = bufs[n].id,
+		};
+		struct kgsl_gpu_command req = {
+				.cmdlist = (uintptr_t)&cmd,
+				.cmdsize = sizeof(cmd),
+				.numcmds = 1,
+				.context_id = ctx.drawctxt_id,
+		};
+		ioctl(fd, IOCTL_KGSL_GPU_COMMAND, &req);
+	}
+	report("submit", nsubmits, now() - t);
+
+	t = now();
+	for (i = 0; i < nbufs; i++) {
+		struct kgsl_gpuobj_free req = {
+				.id = bufs[i].id,
+		};
+		munmap(bufs[i].ptr, BUFSZ);
+		ioctl(fd, IOCTL_KGSL_GPUOBJ_FREE, &req);
+	}
+	report("free", nbufs, now() - t);
+
+	close(fd);
+
+	return 0;
+}
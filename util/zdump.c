@@ -31,6 +31,7 @@
 #include <string.h>
 
 #include "redump.h"
+#include "rd-reader.h"
 
 #include "freedreno_z1xx.h"
 
@@ -130,7 +131,7 @@ static void dump_register(uint32_t reg, uint32_t dword)
 		printf("\tunknown(%02x): %08x (%d)\n", reg, dword, dword);
 }
 
-static void dump_cmdstream(uint32_t *dwords, uint32_t sizedwords)
+static void dump_cmdstream(const uint32_t *dwords, uint32_t sizedwords)
 {
 	int i, j;
 	for (i = 0; i < sizedwords; i++) {
@@ -139,7 +140,7 @@ static void dump_cmdstream(uint32_t *dwords, uint32_t sizedwords)
 		if (reg == VGV3_WRITERAW) {
 			uint32_t count = (dword >> 8) & 0xffff;
 			reg = dword & 0xff;
-			for (j = 0; (j < count) && (i < sizedwords); j++) {
+			for (j = 0; (j < count) && ((i + 1) < sizedwords); j++) {
 				dump_register(reg, dwords[++i]);
 				reg++;
 			}
@@ -175,32 +176,42 @@ static const char *param_names[] = {
 		"",
 };
 
-static void dump_file(int fd)
+/* file offset where the submit following the given one starts, or the
+ * end of the file if it is the last one:
+ */
+static uint64_t submit_end(struct rd_reader *rd, unsigned int submit)
 {
-	enum rd_sect_type type = RD_NONE;
-	void *buf = NULL;
-	int sz;
+	const struct rd_index_entry *index;
+	int i, n;
+
+	index = rd_reader_index(rd, &n);
+	for (i = 0; i < n; i++)
+		if (index[i].submit > submit)
+			return rd_index_offset(&index[i]);
+
+	return ~0ULL;
+}
 
-	while ((read(fd, &type, sizeof(type)) > 0) && (read(fd, &sz, 4) > 0)) {
-		free(buf);
+static void dump_file(struct rd_reader *rd, uint64_t end)
+{
+	struct rd_section sect;
 
-		buf = malloc(sz + 1);
-		((char *)buf)[sz] = '\0';
-		read(fd, buf, sz);
+	while ((rd_reader_next(rd, &sect) > 0) && (sect.offset < end)) {
+		const uint32_t *dwords = sect.buf;
 
-		switch(type) {
+		switch(sect.type) {
 		case RD_TEST:
-			printf("test: %s\n", (char *)buf);
+			printf("test: %.*s\n", sect.sz, (const char *)sect.buf);
 			break;
 		case RD_CMD:
-			printf("cmd: %s\n", (char *)buf);
+			printf("cmd: %.*s\n", sect.sz, (const char *)sect.buf);
 			break;
 		case RD_CMDSTREAM:
-			dump_cmdstream(buf, sz/4);
+			dump_cmdstream(dwords, sect.sz/4);
 			break;
 		case RD_PARAM:
-			printf("param: %s: %u\n", param_names[((uint32_t *)buf)[0]],
-					((uint32_t *)buf)[1]);
+			if ((sect.sz >= 8) && (dwords[0] < ARRAY_SIZE(param_names)))
+				printf("param: %s: %u\n", param_names[dwords[0]], dwords[1]);
 			break;
 		default:
 			break;
@@ -210,15 +221,35 @@ static void dump_file(int fd)
 
 int main(int argc, char **argv)
 {
-	int i;
+	int i, submit = -1;
+
+	/* with --submit N, only dump the N'th submit of each file: */
+	if ((argc >= 3) && !strcmp(argv[1], "--submit")) {
+		submit = strtol(argv[2], NULL, 0);
+		argc -= 2;
+		argv += 2;
+	}
 
 	for (i = 1; i < argc; i++) {
-		int fd = open(argv[i], O_RDONLY);
-		if (fd < 0) {
-			fprintf(stderr, "could not open: %s\n", argv[1]);
+		struct rd_reader *rd = rd_reader_open(argv[i]);
+		uint64_t end = ~0ULL;
+
+		if (!rd) {
+			fprintf(stderr, "could not open: %s\n", argv[i]);
 			return -1;
 		}
-		dump_file(fd);
+
+		if (submit >= 0) {
+			if (rd_reader_seek_submit(rd, submit)) {
+				fprintf(stderr, "%s: no submit %d\n", argv[i], submit);
+				rd_reader_close(rd);
+				continue;
+			}
+			end = submit_end(rd, submit);
+		}
+
+		dump_file(rd, end);
+		rd_reader_close(rd);
 	}
 
 	return 0;
@@ -0,0 +1,178 @@
+/*
+ * Copyright © 2012 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _ITREE_H_
+#define _ITREE_H_
+
+#include <stdint.h>
+
+/* interval tree, as a treap augmented with the max end address of each
+ * subtree.  Nodes are embedded in the containing object, like struct
+ * list.  Intervals are [start, end), and may overlap.
+ */
+struct itree_node {
+    struct itree_node *left, *right;
+    uint64_t start, end, max_end;
+    uint32_t prio;
+};
+
+struct itree {
+    struct itree_node *root;
+    uint32_t seed;
+};
+
+#define ITREE_INIT { NULL, 0x9e3779b9 }
+
+static inline uint64_t
+__itree_max_end(struct itree_node *node)
+{
+    return node ? node->max_end : 0;
+}
+
+static inline void
+__itree_update(struct itree_node *node)
+{
+    uint64_t m = node->end;
+    if (__itree_max_end(node->left) > m)
+        m = __itree_max_end(node->left);
+    if (__itree_max_end(node->right) > m)
+        m = __itree_max_end(node->right);
+    node->max_end = m;
+}
+
+/* ordered by start address, ties broken by node address: */
+static inline int
+__itree_less(struct itree_node *a, struct itree_node *b)
+{
+    if (a->start != b->start)
+        return a->start < b->start;
+    return a < b;
+}
+
+static inline struct itree_node *
+__itree_merge(struct itree_node *a, struct itree_node *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    if (a->prio > b->prio) {
+        a->right = __itree_merge(a->right, b);
+        __itree_update(a);
+        return a;
+    } else {
+        b->left = __itree_merge(a, b->left);
+        __itree_update(b);
+        return b;
+    }
+}
+
+/* split into nodes ordered before 'key' and the rest: */
+static inline void
+__itree_split(struct itree_node *t, struct itree_node *key,
+        struct itree_node **a, struct itree_node **b)
+{
+    if (!t) {
+        *a = *b = NULL;
+    } else if (__itree_less(t, key)) {
+        __itree_split(t->right, key, &t->right, b);
+        __itree_update(t);
+        *a = t;
+    } else {
+        __itree_split(t->left, key, a, &t->left);
+        __itree_update(t);
+        *b = t;
+    }
+}
+
+static inline void
+itree_insert(struct itree *tree, struct itree_node *node,
+        uint64_t start, uint64_t end)
+{
+    struct itree_node *a, *b;
+
+    /* xorshift, we just need the priorities to be well mixed: */
+    tree->seed ^= tree->seed << 13;
+    tree->seed ^= tree->seed >> 17;
+    tree->seed ^= tree->seed << 5;
+
+    node->left = node->right = NULL;
+    node->start = start;
+    node->end = end;
+    node->max_end = end;
+    node->prio = tree->seed;
+
+    __itree_split(tree->root, node, &a, &b);
+    tree->root = __itree_merge(__itree_merge(a, node), b);
+}
+
+static inline struct itree_node *
+__itree_remove(struct itree_node *t, struct itree_node *node)
+{
+    if (!t)
+        return NULL;
+    if (t == node)
+        return __itree_merge(t->left, t->right);
+    if (__itree_less(node, t))
+        t->left = __itree_remove(t->left, node);
+    else
+        t->right = __itree_remove(t->right, node);
+    __itree_update(t);
+    return t;
+}
+
+static inline void
+itree_remove(struct itree *tree, struct itree_node *node)
+{
+    tree->root = __itree_remove(tree->root, node);
+    node->left = node->right = NULL;
+}
+
+/* find the lowest interval containing addr: */
+static inline struct itree_node *
+__itree_find(struct itree_node *t, uint64_t addr)
+{
+    struct itree_node *n;
+
+    if (!t || (t->max_end <= addr))
+        return NULL;
+    n = __itree_find(t->left, addr);
+    if (n)
+        return n;
+    if (t->start > addr)
+        return NULL;
+    if (addr < t->end)
+        return t;
+    return __itree_find(t->right, addr);
+}
+
+static inline struct itree_node *
+itree_find(struct itree *tree, uint64_t addr)
+{
+    return __itree_find(tree->root, addr);
+}
+
+#define itree_entry(ptr, type, member) \
+    ((ptr) ? container_of(ptr, type, member) : NULL)
+
+#endif
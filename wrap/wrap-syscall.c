@@ -25,10 +25,11 @@
  * various syscalls and log what happens
  */
 
-#include <ctype.h>
-
 #include "wrap.h"
 
+#include <ctype.h>
+#include <signal.h>
+
 #ifdef USE_PTHREADS
 static pthread_mutex_t l = PTHREAD_RECURSIVE_MUTEX_INITIALIZER;
 #define LOCK()   pthread_mutex_lock(&l)
@@ -240,40 +241,141 @@ struct buffer {
 	struct list node;
 	int munmap;
 	int dumped;
+	/* for dirty tracking: */
+	struct tracked *track;   /* NULL if not tracked */
+	unsigned int serial;     /* rd file that the full contents went to */
+	/* for lookup by address range: */
+	struct itree_node hostptr_node, gpuaddr_node, offset_node;
+	/* for lookup by handle/id: */
+	struct list handle_node, id_node;
 };
 
 static LIST_HEAD(buffers_of_interest);
 
+/*
+ * Indexes for find_buffer(), which is called for every mmap, submit and
+ * alloc/free ioctl.  The address ranges are kept in interval trees and
+ * handles/id's in hash tables.  Use the buffer_set_xyz() helpers rather
+ * than updating the fields directly, so the indexes are kept in sync.
+ * A zero/NULL value is not indexed.
+ */
+#define BUFFER_HASH_SIZE 4096
+
+static struct itree hostptr_tree = ITREE_INIT;
+static struct itree gpuaddr_tree = ITREE_INIT;
+static struct itree offset_tree  = ITREE_INIT;
+static struct list handle_hash[BUFFER_HASH_SIZE];
+static struct list id_hash[BUFFER_HASH_SIZE];
+
+static struct list * hash_bucket(struct list *hash, unsigned int key)
+{
+	struct list *bucket = &hash[(key * 0x9e3779b1) >> 20];
+	/* lazily init empty buckets: */
+	if (!bucket->next)
+		list_init(bucket);
+	return bucket;
+}
+
+static void untrack_buffer(struct buffer *buf);
+
+static void buffer_set_hostptr(struct buffer *buf, void *hostptr)
+{
+	if (buf->hostptr) {
+		if (buf->track && (buf->hostptr != hostptr))
+			untrack_buffer(buf);
+		itree_remove(&hostptr_tree, &buf->hostptr_node);
+	}
+	buf->hostptr = hostptr;
+	if (buf->hostptr)
+		itree_insert(&hostptr_tree, &buf->hostptr_node,
+				(uintptr_t)hostptr, (uintptr_t)hostptr + buf->len);
+}
+
+static void buffer_set_gpuaddr(struct buffer *buf, uint64_t gpuaddr)
+{
+	if (buf->gpuaddr)
+		itree_remove(&gpuaddr_tree, &buf->gpuaddr_node);
+	buf->gpuaddr = gpuaddr;
+	if (buf->gpuaddr)
+		itree_insert(&gpuaddr_tree, &buf->gpuaddr_node,
+				gpuaddr, gpuaddr + buf->len);
+}
+
+static void buffer_set_offset(struct buffer *buf, uint64_t offset)
+{
+	if (buf->offset)
+		itree_remove(&offset_tree, &buf->offset_node);
+	buf->offset = offset;
+	if (buf->offset)
+		itree_insert(&offset_tree, &buf->offset_node,
+				offset, offset + buf->len);
+}
+
+static void buffer_set_handle(struct buffer *buf, unsigned int handle)
+{
+	if (buf->handle)
+		list_del(&buf->handle_node);
+	buf->handle = handle;
+	if (buf->handle)
+		list_add(&buf->handle_node, hash_bucket(handle_hash, handle));
+}
+
+static void buffer_set_id(struct buffer *buf, unsigned int id)
+{
+	if (buf->id)
+		list_del(&buf->id_node);
+	buf->id = id;
+	if (buf->id)
+		list_add(&buf->id_node, hash_bucket(id_hash, id));
+}
+
 static struct buffer * register_buffer(void *hostptr, uint64_t flags,
 		unsigned int len, unsigned int handle)
 {
 	struct buffer *buf = calloc(1, sizeof *buf);
-	buf->hostptr = hostptr;
 	buf->flags = flags;
 	buf->len = len;
-	buf->handle = handle;
+	buffer_set_hostptr(buf, hostptr);
+	buffer_set_handle(buf, handle);
 	list_add(&buf->node, &buffers_of_interest);
 	return buf;
 }
 
+/* Note that if more than one buffer contains the address, the one with
+ * the lowest start address wins.  Back when this walked the list, it was
+ * the most recently registered one instead.  Overlap should only happen
+ * with stale buffers which were never unregistered, where neither answer
+ * is more right than the other.
+ */
 static struct buffer * find_buffer(void *hostptr, uint64_t gpuaddr,
 		uint64_t offset, unsigned int handle, unsigned id)
 {
 	struct buffer *buf = NULL;
-	list_for_each_entry(buf, &buffers_of_interest, node) {
-		if (hostptr)
-			if ((buf->hostptr <= hostptr) && (hostptr < (buf->hostptr + buf->len)))
-				return buf;
-		if (gpuaddr)
-			if ((buf->gpuaddr <= gpuaddr) && (gpuaddr < (buf->gpuaddr + buf->len)))
-				return buf;
-		if (offset)
-			if ((buf->offset <= offset) && (offset < (buf->offset + buf->len)))
-				return buf;
-		if (handle)
+	if (hostptr) {
+		buf = itree_entry(itree_find(&hostptr_tree, (uintptr_t)hostptr),
+				struct buffer, hostptr_node);
+		if (buf)
+			return buf;
+	}
+	if (gpuaddr) {
+		buf = itree_entry(itree_find(&gpuaddr_tree, gpuaddr),
+				struct buffer, gpuaddr_node);
+		if (buf)
+			return buf;
+	}
+	if (offset) {
+		buf = itree_entry(itree_find(&offset_tree, offset),
+				struct buffer, offset_node);
+		if (buf)
+			return buf;
+	}
+	if (handle) {
+		list_for_each_entry(buf, hash_bucket(handle_hash, handle), handle_node)
 			if (buf->handle == handle)
 				return buf;
-		if (id)
+	}
+	if (id) {
+		list_for_each_entry(buf, hash_bucket(id_hash, id), id_node)
 			if (buf->id == id)
 				return buf;
 	}
@@ -283,9 +385,17 @@ static struct buffer * find_buffer(void *hostptr, uint64_t gpuaddr,
 static void unregister_buffer(struct buffer *buf)
 {
 	if (buf) {
+		void *hostptr = buf->hostptr;
 		list_del(&buf->node);
+		untrack_buffer(buf);
+		/* remove from indexes before munmap, so it is not found again: */
+		buffer_set_hostptr(buf, NULL);
+		buffer_set_gpuaddr(buf, 0);
+		buffer_set_offset(buf, 0);
+		buffer_set_handle(buf, 0);
+		buffer_set_id(buf, 0);
 		if (buf->munmap)
-			munmap(buf->hostptr, buf->len);
+			munmap(hostptr, buf->len);
 		free(buf);
 	}
 }
@@ -437,16 +547,263 @@ static void dump_ib_prep(void)
 {
 	struct buffer *other_buf;
 
+	rd_begin_submit();
+
 	list_for_each_entry(other_buf, &buffers_of_interest, node) {
 		other_buf->dumped = 0;
 	}
 }
 
+/*
+ * Dirty tracking: once the full contents of a buffer are dumped, the
+ * mapping is made read-only.  The first CPU write to each page then
+ * faults, and the SIGSEGV handler marks the page dirty and makes it
+ * writable again.  On the next submit only the dirty pages are dumped
+ * (as RD_BUFFER_PARTIAL sections) and protected again.
+ *
+ * Only whole pages are protected, a partial page at the end of the
+ * buffer is always dumped.  Note that writes by the GPU are not seen,
+ * and syscalls writing into a protected buffer fail with EFAULT rather
+ * than faulting, which is why this is opt-in.
+ */
+static unsigned int page_size;
+static struct sigaction old_segv_action;
+
+/*
+ * The SIGSEGV handler can't take the lock (not async-signal-safe), and
+ * may run on any thread, so the protected ranges live in a fixed table
+ * that it scans without locking, and the dirty flags are a bitmap that
+ * is only updated with atomic ops.  A slot's base is published last
+ * when tracking starts, and cleared only after the range is writable
+ * again when it stops.  Bitmaps are kept with the slot and reused, so
+ * a handler racing with untrack never touches freed memory.
+ */
+#define MAX_TRACKED 1024
+
+struct tracked {
+	void * volatile base;    /* NULL if slot unused */
+	unsigned int npages;
+	unsigned int nwords;     /* size of bits[] */
+	uint32_t *bits;
+};
+
+static struct tracked tracked[MAX_TRACKED];
+
+static struct tracked * find_tracked(void *addr)
+{
+	unsigned int i;
+	for (i = 0; i < MAX_TRACKED; i++) {
+		void *base = tracked[i].base;
+		if (base && (addr >= base) &&
+				(addr < base + tracked[i].npages * page_size))
+			return &tracked[i];
+	}
+	return NULL;
+}
+
+static void set_dirty(struct tracked *t, unsigned int page)
+{
+	__sync_fetch_and_or(&t->bits[page / 32], 1u << (page % 32));
+}
+
+static int test_and_clear_dirty(struct tracked *t, unsigned int page)
+{
+	uint32_t bit = 1u << (page % 32);
+	return !!(__sync_fetch_and_and(&t->bits[page / 32], ~bit) & bit);
+}
+
+static void segv_handler(int sig, siginfo_t *info, void *context)
+{
+	struct tracked *t = find_tracked(info->si_addr);
+
+	if (t) {
+		unsigned int page = (info->si_addr - t->base) / page_size;
+		/* if the page is already dirty, another thread got here first
+		 * and the access just raced with its mprotect(), so either way
+		 * the page should be writable and the access retried:
+		 */
+		set_dirty(t, page);
+		mprotect(t->base + page * page_size, page_size,
+				PROT_READ | PROT_WRITE);
+		return;
+	}
+
+	/* not one of ours, pass it on: */
+	if (old_segv_action.sa_flags & SA_SIGINFO) {
+		old_segv_action.sa_sigaction(sig, info, context);
+	} else if ((old_segv_action.sa_handler == SIG_DFL) ||
+			(old_segv_action.sa_handler == SIG_IGN)) {
+		/* restore original action, and let the access fault again: */
+		sigaction(SIGSEGV, &old_segv_action, NULL);
+	} else {
+		old_segv_action.sa_handler(sig);
+	}
+}
+
+/* write protect (all the whole pages of) the buffer, and mark it clean: */
+static void track_buffer(struct buffer *buf)
+{
+	struct tracked *t = buf->track;
+	unsigned int npages, nwords;
+
+	if (!page_size) {
+		struct sigaction sa;
+
+		page_size = sysconf(_SC_PAGESIZE);
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = segv_handler;
+		sa.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGSEGV, &sa, &old_segv_action);
+	}
+
+	npages = buf->len / page_size;
+	if (!npages || ((uintptr_t)buf->hostptr & (page_size - 1)))
+		return;
+
+	nwords = (npages + 31) / 32;
+
+	if (!t) {
+		unsigned int i;
+		for (i = 0; i < MAX_TRACKED; i++)
+			if (!tracked[i].base)
+				break;
+		if (i == MAX_TRACKED) {
+			printf("\t\ttoo many tracked buffers\n");
+			return;
+		}
+		t = &tracked[i];
+		if (t->nwords < nwords) {
+			/* the old bitmap is leaked rather than freed, in case
+			 * a handler on another thread is still looking at it:
+			 */
+			t->bits = calloc(nwords, sizeof(t->bits[0]));
+			t->nwords = nwords;
+		}
+		t->npages = npages;
+	}
+
+	memset(t->bits, 0, nwords * sizeof(t->bits[0]));
+
+	if (mprotect(buf->hostptr, npages * page_size, PROT_READ)) {
+		printf("\t\tcould not protect buffer: %s\n", strerror(errno));
+		t->base = NULL;
+		buf->track = NULL;
+		return;
+	}
+
+	/* publish the slot once bitmap and size are set up: */
+	__sync_synchronize();
+	t->base = buf->hostptr;
+	buf->track = t;
+	buf->serial = rd_serial();
+}
+
+static void untrack_buffer(struct buffer *buf)
+{
+	struct tracked *t = buf->track;
+	if (t) {
+		mprotect(buf->hostptr, t->npages * page_size,
+				PROT_READ | PROT_WRITE);
+		__sync_synchronize();
+		t->base = NULL;
+		buf->track = NULL;
+	}
+}
+
+/* all the dirty runs of a buffer go in a single RD_BUFFER_PARTIAL, so
+ * the reader can patch the previous contents in one go:
+ */
+struct partial {
+	uint32_t hdr[2];
+	uint32_t (*runs)[2];
+	struct iovec *iov;
+	unsigned int nruns;
+};
+
+static void partial_add(struct partial *p, struct buffer *buf,
+		uint32_t off, uint32_t len)
+{
+	p->runs[p->nruns][0] = off;
+	p->runs[p->nruns][1] = len;
+	p->iov[1 + 2 * p->nruns].iov_base = p->runs[p->nruns];
+	p->iov[1 + 2 * p->nruns].iov_len  = sizeof(p->runs[0]);
+	p->iov[2 + 2 * p->nruns].iov_base = buf->hostptr + off;
+	p->iov[2 + 2 * p->nruns].iov_len  = len;
+	p->nruns++;
+}
+
+static void dump_dirty_pages(struct buffer *buf)
+{
+	struct tracked *t = buf->track;
+	unsigned int npages = t->npages;
+	/* at most every other page starts a run, plus the tail: */
+	unsigned int maxruns = (npages + 1) / 2 + 1;
+	struct partial p = {
+			.hdr  = { buf->gpuaddr, buf->gpuaddr >> 32 },
+			.runs = malloc(maxruns * sizeof(p.runs[0])),
+			.iov  = malloc((1 + 2 * maxruns) * sizeof(p.iov[0])),
+	};
+	unsigned int i = 0;
+
+	p.iov[0].iov_base = p.hdr;
+	p.iov[0].iov_len  = sizeof(p.hdr);
+
+	while (i < npages) {
+		unsigned int start = i;
+
+		if (!test_and_clear_dirty(t, i)) {
+			i++;
+			continue;
+		}
+
+		while ((++i < npages) && test_and_clear_dirty(t, i))
+			;
+
+		/* protect before dumping, so a write racing with the dump just
+		 * marks the page dirty again:
+		 */
+		mprotect(buf->hostptr + start * page_size,
+				(i - start) * page_size, PROT_READ);
+		partial_add(&p, buf, start * page_size, (i - start) * page_size);
+	}
+
+	if (buf->len > (npages * page_size))
+		partial_add(&p, buf, npages * page_size,
+				buf->len - (npages * page_size));
+
+	if (p.nruns)
+		rd_write_sectionv(RD_BUFFER_PARTIAL, p.iov, 1 + 2 * p.nruns);
+
+	free(p.runs);
+	free(p.iov);
+}
+
+/* dump contents of all buffers not already dumped for the current submit: */
+static void dump_buffers(void)
+{
+	struct buffer *buf;
+
+	list_for_each_entry(buf, &buffers_of_interest, node) {
+		if (buf->hostptr && !buf->dumped) {
+			if (buf->track && (buf->serial == rd_serial())) {
+				dump_dirty_pages(buf);
+			} else {
+				log_gpuaddr(buf->gpuaddr, buf->len);
+				rd_write_buffer(buf->hostptr, buf->len);
+				if (wrap_dirty())
+					track_buffer(buf);
+			}
+			buf->dumped = 1;
+		}
+	}
+}
+
 static void dump_ib(struct kgsl_ibdesc *ibdesc)
 {
 	struct buffer *buf = find_buffer(NULL, ibdesc->gpuaddr, 0, 0, 0);
 	if (buf && buf->hostptr) {
-		struct buffer *other_buf;
 		uint32_t off = ibdesc->gpuaddr - buf->gpuaddr;
 		uint32_t *ptr = buf->hostptr + off;
 
@@ -454,15 +811,7 @@ static void dump_ib(struct kgsl_ibdesc *ibdesc)
 
 		hexdump_dwords(ptr, ibdesc->sizedwords);
 
-		list_for_each_entry(other_buf, &buffers_of_interest, node) {
-			if (other_buf && other_buf->hostptr && !other_buf->dumped) {
-				uint32_t len = other_buf->len;
-				log_gpuaddr(other_buf->gpuaddr, len);
-				rd_write_section(RD_BUFFER_CONTENTS,
-						other_buf->hostptr, len);
-				other_buf->dumped = 1;
-			}
-		}
+		dump_buffers();
 
 		/* we already dump all the buffer contents, so just need
 		 * to dump the address/size of the cmdstream:
@@ -476,7 +825,6 @@ static void dump_cmd(struct kgsl_command_object *cmd)
 	/* note: kgsl seems to ignore cmd->offset.. which may be a bug.. */
 	struct buffer *buf = find_buffer(NULL, cmd->gpuaddr, 0, 0, 0);
 	if (buf && buf->hostptr) {
-		struct buffer *other_buf;
 		uint32_t sizedwords = cmd->size / 4;
 		uint32_t off = cmd->gpuaddr - buf->gpuaddr;
 		uint32_t *ptr = buf->hostptr + off;
@@ -485,15 +833,7 @@ static void dump_cmd(struct kgsl_command_object *cmd)
 
 		hexdump_dwords(ptr, sizedwords);
 
-		list_for_each_entry(other_buf, &buffers_of_interest, node) {
-			if (other_buf && other_buf->hostptr && !other_buf->dumped) {
-				uint32_t len = other_buf->len;
-				log_gpuaddr(other_buf->gpuaddr, len);
-				rd_write_section(RD_BUFFER_CONTENTS,
-						other_buf->hostptr, len);
-				other_buf->dumped = 1;
-			}
-		}
+		dump_buffers();
 
 		/* we already dump all the buffer contents, so just need
 		 * to dump the address/size of the cmdstream:
@@ -898,7 +1238,7 @@ static void kgsl_ioctl_sharedmem_from_vmalloc_post(int fd,
 	struct buffer *buf = find_buffer((void *)param->hostptr, 0, 0, 0, 0);
 	log_gpuaddr(param->gpuaddr, len_from_vma(param->hostptr));
 	if (buf)
-		buf->gpuaddr = param->gpuaddr;
+		buffer_set_gpuaddr(buf, param->gpuaddr);
 	printf("\t\tgpuaddr:\t%08x\n", param->gpuaddr);
 }
 
@@ -925,8 +1265,8 @@ static void kgsl_ioctl_gpumem_alloc_post(int fd,
 	printf("\t\tgpuaddr:\t%08lx\n", param->gpuaddr);
 	/* NOTE: host addr comes from mmap'ing w/ gpuaddr as offset */
 	buf = register_buffer(NULL, param->flags, param->size, 0);
-	buf->gpuaddr = param->gpuaddr;
-	buf->offset = param->gpuaddr;
+	buffer_set_gpuaddr(buf, param->gpuaddr);
+	buffer_set_offset(buf, param->gpuaddr);
 }
 
 static void kgsl_ioctl_gpumem_alloc_id_pre(int fd,
@@ -957,9 +1297,9 @@ static void kgsl_ioctl_gpumem_alloc_id_post(int fd,
 	printf("\t\tgpuaddr:\t%08lx\n", param->gpuaddr);
 	/* NOTE: host addr comes from mmap'ing w/ gpuaddr as offset */
 	buf = register_buffer(NULL, param->flags, param->size, 0);
-	buf->id = param->id;
-	buf->gpuaddr = param->gpuaddr;
-	buf->offset = param->gpuaddr;
+	buffer_set_id(buf, param->id);
+	buffer_set_gpuaddr(buf, param->gpuaddr);
+	buffer_set_offset(buf, param->gpuaddr);
 }
 
 static void kgsl_ioctl_gpumem_free_id_pre(int fd,
@@ -1050,7 +1390,7 @@ static void kgls_ioctl_gpuobj_alloc_post(int fd,
 	printf("\t\tid:\t%u\n", param->id);
 	/* NOTE: host addr comes from mmap'ing w/ gpuaddr as offset */
 	buf = register_buffer(NULL, param->flags, param->size, 0);
-	buf->id = param->id;
+	buffer_set_id(buf, param->id);
 }
 
 static void kgls_ioctl_gpuobj_free_pre(int fd,
@@ -1084,8 +1424,8 @@ static void kgsl_ioclt_gpuobj_info_post(int fd,
 	log_gpuaddr(param->gpuaddr, param->size);
 	printf("\t\tid:\t%u\n", param->id);
 	printf("\t\tgpuaddr:\t%08lx\n", param->gpuaddr);
-	buf->gpuaddr = param->gpuaddr;
-	buf->offset = param->gpuaddr;
+	buffer_set_gpuaddr(buf, param->gpuaddr);
+	buffer_set_offset(buf, param->gpuaddr);
 }
 
 static void kgls_ioctl_gpuobj_gpu_command_pre(int fd,
@@ -1209,7 +1549,11 @@ static void kgsl_ioctl_post(int fd, unsigned long int request, void *ptr, int re
 }
 
 // XXX android/bionic has messed up ioctl signature:
+#ifdef BIONIC
 int ioctl(int fd, int request, ...)
+#else
+int ioctl(int fd, unsigned long request, ...)
+#endif
 {
 	int ioc_size = _IOC_SIZE(request);
 	int ret;
@@ -1319,7 +1663,9 @@ void * mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset
 	if (!ret) {
 #ifdef FAKE
 		if ((fd >= 0) && file_table[fd].is_emulated) {
-			ret = malloc(length);
+			/* page aligned like a real mapping, so WRAP_DIRTY works: */
+			ret = orig_mmap(NULL, length, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 		} else {
 			ret = orig_mmap(addr, length, prot, flags, fd, offset);
 		}
@@ -1332,7 +1678,7 @@ void * mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset
 		//struct buffer *buf = find_buffer(NULL, 0, offset, 0, 0);
 		struct buffer *buf = find_buffer(NULL, 0, 0, 0, offset >> 12); // XXX only id's are used now
 		if (buf)
-			buf->hostptr = ret;
+			buffer_set_hostptr(buf, ret);
 		else {
 			/*
 			 * when a buffer is allocated using IOCTL_KGSL_GPUMEM_ALLOC_ID
@@ -1341,7 +1687,7 @@ void * mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset
 			 */
 			buf = find_buffer(NULL, 0, 0, 0, offset >> 12);
 			if (buf)
-				buf->hostptr = ret;
+				buffer_set_hostptr(buf, ret);
 		}
 		printf("< [%4d]         : mmap: -> (%p)\n", fd, ret);
 	}
@@ -1375,7 +1721,8 @@ void *mmap64(void *addr, size_t length, int prot, int flags, int fd, int64_t off
 	if (!ret) {
 #ifdef FAKE
 		if ((fd >= 0) && file_table[fd].is_emulated) {
-			ret = calloc(1, length);
+			ret = orig_mmap64(NULL, length, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 		} else {
 			ret = orig_mmap64(addr, length, prot, flags, fd, offset);
 		}
@@ -1388,7 +1735,7 @@ void *mmap64(void *addr, size_t length, int prot, int flags, int fd, int64_t off
 		//struct buffer *buf = find_buffer(NULL, 0, offset, 0, 0);
 		struct buffer *buf = find_buffer(NULL, 0, 0, 0, offset >> 12); // XXX only id's are used now
 		if (buf)
-			buf->hostptr = ret;
+			buffer_set_hostptr(buf, ret);
 		else {
 			/*
 			 * when a buffer is allocated using IOCTL_KGSL_GPUMEM_ALLOC_ID
@@ -1397,7 +1744,7 @@ void *mmap64(void *addr, size_t length, int prot, int flags, int fd, int64_t off
 			 */
 			buf = find_buffer(NULL, 0, 0, 0, offset >> 12);
 			if (buf)
-				buf->hostptr = ret;
+				buffer_set_hostptr(buf, ret);
 		}
 		printf("< [%4d]         : mmap64: -> (%p), buf=%p\n", fd, ret, buf);
 	}
@@ -22,9 +22,21 @@
  */
 
 #include "wrap.h"
+#include "fnv.h"
+
+#include <zlib.h>
 
 static int fd = -1;
+static gzFile gz;            /* non-NULL if writing compressed */
+static uint64_t offset;      /* uncompressed offset of next section */
 static unsigned int gpu_id;
+static unsigned int serial;
+
+static void rd_async_flush(void);
+static void rd_dedup_reset(void);
+static void rd_close(void);
+static void rd_index_write(void);
+static void rd_index_add(enum rd_sect_type type);
 
 #ifdef USE_PTHREADS
 static pthread_mutex_t l = PTHREAD_RECURSIVE_MUTEX_INITIALIZER;
@@ -72,11 +84,15 @@ int wrap_printf(const char *format, ...)
 void rd_start(const char *name, const char *fmt, ...)
 {
 	char buf[256];
-	static int cnt = 0;
+	static int cnt = 0, registered = 0;
 	int n = cnt++;
 	const char *testnum;
 	va_list  args;
 
+	/* make sure anything still queued for the previous file lands there: */
+	rd_async_flush();
+	rd_dedup_reset();
+
 	testnum = getenv("TESTNUM");
 	if (testnum) {
 		n = strtol(testnum, NULL, 0);
@@ -85,7 +101,34 @@ void rd_start(const char *name, const char *fmt, ...)
 		sprintf(buf, "/sdcard/trace.rd");
 	}
 
+	if (wrap_compress())
+		strcat(buf, ".gz");
+
+	rd_close();
+
 	fd = open(buf, O_WRONLY| O_TRUNC | O_CREAT, 0644);
+	serial++;
+
+	offset = 0;
+
+	if (!registered) {
+		/* the gzip stream needs to be properly terminated, and the index
+		 * written, even if the app does not call rd_end():
+		 */
+		atexit(rd_close);
+		registered = 1;
+	}
+
+	if (wrap_compress()) {
+		char mode[8];
+
+		sprintf(mode, "wb%u", min(wrap_compress(), 9));
+		gz = gzdopen(fd, mode);
+		if (!gz) {
+			printf("could not open compressed stream\n");
+			exit(-1);
+		}
+	}
 
 	va_start(args, fmt);
 	vsprintf(buf, fmt, args);
@@ -104,8 +147,7 @@ void rd_start(const char *name, const char *fmt, ...)
 
 void rd_end(void)
 {
-	close(fd);
-	fd = -1;
+	rd_close();
 }
 
 #if 0
@@ -114,25 +156,36 @@ volatile int*  __errno( void );
 #define errno (*__errno())
 #endif
 
-static void rd_write(const void *buf, int sz)
+/* get everything written so far onto disk: */
+static void rd_sync(void)
 {
-	const uint8_t *cbuf = buf;
-	while (sz > 0) {
-		int ret = write(fd, cbuf, sz);
-		if (ret < 0) {
-			printf("error: %d (%s)\n", ret, strerror(errno));
-			printf("fd=%d, buf=%p, sz=%d\n", fd, buf, sz);
-			exit(-1);
-		}
-		cbuf += ret;
-		sz -= ret;
-	}
+	if (gz)
+		gzflush(gz, Z_SYNC_FLUSH);
+	fsync(fd);
 }
 
-void rd_write_section(enum rd_sect_type type, const void *buf, int sz)
+static void rd_close(void)
 {
-	uint32_t val = ~0;
+	if (fd == -1)
+		return;
+
+	rd_index_write();
+	rd_async_flush();
 
+	if (gz) {
+		/* note: also closes fd */
+		gzclose(gz);
+		gz = NULL;
+	} else {
+		close(fd);
+	}
+
+	fd = -1;
+}
+
+/* open the rd file on first use, if rd_start() was not called explicitly: */
+static void rd_open(void)
+{
 	if (fd == -1) {
 		const char *name = getenv("TESTNAME");
 		if (!name)
@@ -140,24 +193,456 @@ void rd_write_section(enum rd_sect_type type, const void *buf, int sz)
 		rd_start(name, "");
 		printf("opened rd, %d\n", fd);
 	}
+}
+
+/* changes each time a new rd file is started, so callers can tell if
+ * something already written went to a previous file:
+ */
+unsigned int rd_serial(void)
+{
+	rd_open();
+	return serial;
+}
+
+static void rd_writev(struct iovec *iov, int iovcnt)
+{
+	if (gz) {
+		int i;
+		for (i = 0; i < iovcnt; i++) {
+			if (iov[i].iov_len && !gzwrite(gz, iov[i].iov_base, iov[i].iov_len)) {
+				int err;
+				printf("error: %s\n", gzerror(gz, &err));
+				exit(-1);
+			}
+		}
+		return;
+	}
+
+	while (iovcnt > 0) {
+		ssize_t ret = writev(fd, iov, iovcnt);
+		if (ret < 0) {
+			printf("error: %d (%s)\n", (int)ret, strerror(errno));
+			printf("fd=%d, iov=%p, iovcnt=%d\n", fd, iov, iovcnt);
+			exit(-1);
+		}
+		/* skip over what was written, and retry the remainder: */
+		while ((iovcnt > 0) && (ret >= iov->iov_len)) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+}
+
+/*
+ * Async writer: in async mode sections are copied into a ring of large
+ * preallocated buffers, and a background thread drains the filled ones
+ * with writev().  The thread calling ioctl() never blocks on the disk,
+ * unless the writer falls a full ring behind, in which case it waits for
+ * a buffer to free up (so memory usage stays bounded).
+ *
+ * The ring is single-producer/single-consumer: 'head' counts buffers
+ * handed to the writer, 'tail' counts buffers the writer is done with.
+ * Buffers [tail, head) belong to the writer, bufs[head % N] is the one
+ * currently being filled.  The mutex/cond are only used to sleep/wake,
+ * appending to the current buffer is lockless.
+ */
+#define ASYNC_NBUFS  4
+#define ASYNC_BUFSZ  (4 * 1024 * 1024)
+
+static struct {
+	struct {
+		uint8_t *data;
+		unsigned int len;
+	} bufs[ASYNC_NBUFS];
+	volatile unsigned int head, tail;
+	int enabled, exiting;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} async = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void * rd_async_thread(void *arg)
+{
+	while (1) {
+		struct iovec iov[ASYNC_NBUFS];
+		unsigned int i, tail = async.tail, head;
+
+		pthread_mutex_lock(&async.lock);
+		while (((head = async.head) == tail) && !async.exiting)
+			pthread_cond_wait(&async.cond, &async.lock);
+		pthread_mutex_unlock(&async.lock);
+
+		if (head == tail)
+			break;
+
+		/* pick up the contents of the buffers before looking at them: */
+		__sync_synchronize();
+
+		for (i = 0; (tail + i) != head; i++) {
+			unsigned int n = (tail + i) % ASYNC_NBUFS;
+			iov[i].iov_base = async.bufs[n].data;
+			iov[i].iov_len  = async.bufs[n].len;
+		}
+
+		rd_writev(iov, i);
+
+		for (i = tail; i != head; i++)
+			async.bufs[i % ASYNC_NBUFS].len = 0;
+
+		__sync_synchronize();
+
+		pthread_mutex_lock(&async.lock);
+		async.tail = head;
+		pthread_cond_broadcast(&async.cond);
+		pthread_mutex_unlock(&async.lock);
+	}
+
+	return NULL;
+}
+
+/* hand the buffer currently being filled over to the writer thread: */
+static void rd_async_submit(void)
+{
+	if (!async.bufs[async.head % ASYNC_NBUFS].len)
+		return;
+
+	__sync_synchronize();
+
+	pthread_mutex_lock(&async.lock);
+	async.head++;
+	pthread_cond_broadcast(&async.cond);
+	/* backpressure, wait until the writer frees up the next buffer: */
+	while ((async.head - async.tail) >= ASYNC_NBUFS)
+		pthread_cond_wait(&async.cond, &async.lock);
+	pthread_mutex_unlock(&async.lock);
+}
+
+/* block until everything queued so far is written: */
+static void rd_async_flush(void)
+{
+	if (!async.enabled)
+		return;
+
+	rd_async_submit();
+
+	pthread_mutex_lock(&async.lock);
+	while (async.tail != async.head)
+		pthread_cond_wait(&async.cond, &async.lock);
+	pthread_mutex_unlock(&async.lock);
+}
+
+static void rd_async_fini(void)
+{
+	rd_async_flush();
+
+	pthread_mutex_lock(&async.lock);
+	async.exiting = 1;
+	pthread_cond_broadcast(&async.cond);
+	pthread_mutex_unlock(&async.lock);
+
+	pthread_join(async.thread, NULL);
+	async.enabled = 0;
+
+	if (fd != -1)
+		rd_sync();
+}
+
+static int rd_async_init(void)
+{
+	static int initialized = 0;
+	int i;
+
+	if (initialized)
+		return async.enabled;
+	initialized = 1;
+
+	/* safe mode wants every section on disk before we continue: */
+	if (!wrap_async() || wrap_safe())
+		return 0;
+
+	for (i = 0; i < ASYNC_NBUFS; i++) {
+		async.bufs[i].data = malloc(ASYNC_BUFSZ);
+		if (!async.bufs[i].data) {
+			printf("could not allocate async buffers, falling back to sync\n");
+			while (i--)
+				free(async.bufs[i].data);
+			return 0;
+		}
+	}
+
+	if (pthread_create(&async.thread, NULL, rd_async_thread, NULL)) {
+		printf("could not create writer thread, falling back to sync\n");
+		for (i = 0; i < ASYNC_NBUFS; i++)
+			free(async.bufs[i].data);
+		return 0;
+	}
+
+	async.enabled = 1;
+	atexit(rd_async_fini);
+
+	return 1;
+}
+
+static void rd_async_append(const void *buf, int sz)
+{
+	typeof(async.bufs[0]) *b = &async.bufs[async.head % ASYNC_NBUFS];
+	memcpy(b->data + b->len, buf, sz);
+	b->len += sz;
+}
+
+/* write a section whose payload is gathered from multiple pieces: */
+void rd_write_sectionv(enum rd_sect_type type, const struct iovec *iov, int iovcnt)
+{
+	static const uint32_t zero = 0;
+	struct iovec v[8];
+	uint32_t hdr[4];
+	int i, sz = 0, pad;
+
+	assert(iovcnt <= (ARRAY_SIZE(v) - 2));
+
+	for (i = 0; i < iovcnt; i++)
+		sz += iov[i].iov_len;
+	pad = ALIGN(sz, 4) - sz;
+
+	hdr[0] = ~0;
+	hdr[1] = ~0;
+	hdr[2] = type;
+	hdr[3] = ALIGN(sz, 4);
+
+	rd_open();
 
 	if (type == RD_GPU_ID) {
-		gpu_id = *(unsigned int *)buf;
+		gpu_id = *(unsigned int *)iov[0].iov_base;
 	}
 
-	rd_write(&val, 4);
-	rd_write(&val, 4);
+	rd_index_add(type);
+	offset += sizeof(hdr) + sz + pad;
 
-	rd_write(&type, 4);
-	val = ALIGN(sz, 4);
-	rd_write(&val, 4);
-	rd_write(buf, sz);
+	if (rd_async_init()) {
+		unsigned int total = sizeof(hdr) + sz + pad;
 
-	val = 0;
-	rd_write(&val, ALIGN(sz, 4) - sz);
+		if ((async.bufs[async.head % ASYNC_NBUFS].len + total) > ASYNC_BUFSZ)
+			rd_async_submit();
+
+		if (total <= ASYNC_BUFSZ) {
+			rd_async_append(hdr, sizeof(hdr));
+			for (i = 0; i < iovcnt; i++)
+				rd_async_append(iov[i].iov_base, iov[i].iov_len);
+			rd_async_append(&zero, pad);
+			return;
+		}
+
+		/* too big to ever fit in a buffer, so let the writer catch up
+		 * and then write it directly:
+		 */
+		rd_async_flush();
+	}
+
+	v[0].iov_base = hdr;
+	v[0].iov_len  = sizeof(hdr);
+	memcpy(&v[1], iov, iovcnt * sizeof(*iov));
+	v[iovcnt + 1].iov_base = (void *)&zero;
+	v[iovcnt + 1].iov_len  = pad;
+
+	rd_writev(v, iovcnt + 2);
 
 	if (wrap_safe())
-		fsync(fd);
+		rd_sync();
+}
+
+void rd_write_section(enum rd_sect_type type, const void *buf, int sz)
+{
+	struct iovec iov = { .iov_base = (void *)buf, .iov_len = sz };
+	rd_write_sectionv(type, &iov, 1);
+}
+
+/*
+ * Buffer dedup: in dedup mode, buffer contents are hashed and only the
+ * first copy of a given blob is written to the rd file (tagged with an
+ * RD_BUFFER_HASH section).  Later dumps of identical contents (ie. the
+ * same texture re-dumped every frame) just emit an RD_BUFFER_REF with
+ * the hash.  The table of written blobs is per rd file.
+ *
+ * Submits can come from multiple threads, so the table is protected by
+ * the lock, which is also held while writing the RD_BUFFER_HASH and
+ * RD_BUFFER_CONTENTS pair, so they can't end up separated in the file.
+ */
+static struct {
+	struct {
+		uint64_t hash;
+		uint32_t len;
+	} *entries;
+	unsigned int size, count;   /* size is power of two, or zero */
+} dedup;
+
+static void rd_dedup_reset(void)
+{
+#ifdef USE_PTHREADS
+	pthread_mutex_lock(&l);
+#endif
+	free(dedup.entries);
+	dedup.entries = NULL;
+	dedup.size = dedup.count = 0;
+#ifdef USE_PTHREADS
+	pthread_mutex_unlock(&l);
+#endif
+}
+
+static uint64_t rd_hash(const void *buf, int sz)
+{
+	const uint8_t *p = buf;
+	uint64_t h = FNV64_INIT ^ sz;
+
+	while (sz >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		h ^= v * 0x9e3779b97f4a7c15ull;
+		h = ((h << 31) | (h >> 33)) * 0xc2b2ae3d27d4eb4full;
+		p += 8;
+		sz -= 8;
+	}
+
+	h = fnv64(h, p, sz);
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+
+	return h;
+}
+
+/* returns true if already present, otherwise adds it: */
+static int rd_dedup_lookup(uint64_t hash, uint32_t len)
+{
+	unsigned int i;
+
+	if ((dedup.count + 1) * 2 > dedup.size) {
+		typeof(dedup) old = dedup;
+
+		dedup.size = old.size ? old.size * 2 : 256;
+		dedup.entries = calloc(dedup.size, sizeof(dedup.entries[0]));
+		dedup.count = 0;
+
+		for (i = 0; i < old.size; i++)
+			if (old.entries[i].len)
+				rd_dedup_lookup(old.entries[i].hash, old.entries[i].len);
+
+		free(old.entries);
+	}
+
+	for (i = hash & (dedup.size - 1); dedup.entries[i].len;
+			i = (i + 1) & (dedup.size - 1)) {
+		if ((dedup.entries[i].hash == hash) && (dedup.entries[i].len == len))
+			return 1;
+	}
+
+	dedup.entries[i].hash = hash;
+	dedup.entries[i].len  = len;
+	dedup.count++;
+
+	return 0;
+}
+
+void rd_write_buffer(const void *buf, int sz)
+{
+	uint32_t sect[2];
+	uint64_t hash;
+
+	if (!wrap_dedup() || (sz <= 0)) {
+		rd_write_section(RD_BUFFER_CONTENTS, buf, sz);
+		return;
+	}
+
+	/* make sure the rd file is opened (and dedup table reset) first: */
+	rd_open();
+
+	hash = rd_hash(buf, sz);
+	sect[0] = hash;
+	sect[1] = hash >> 32;
+
+#ifdef USE_PTHREADS
+	pthread_mutex_lock(&l);
+#endif
+
+	if (rd_dedup_lookup(hash, sz)) {
+		rd_write_section(RD_BUFFER_REF, sect, sizeof(sect));
+	} else {
+		rd_write_section(RD_BUFFER_HASH, sect, sizeof(sect));
+		rd_write_section(RD_BUFFER_CONTENTS, buf, sz);
+	}
+
+#ifdef USE_PTHREADS
+	pthread_mutex_unlock(&l);
+#endif
+}
+
+/*
+ * Index: optionally, at the end of the rd file, write an RD_INDEX section
+ * mapping each RD_GPUADDR/RD_BUFFER_PARTIAL/RD_CMDSTREAM_ADDR section to its
+ * submit number and file offset, followed by an RD_INDEX_OFFSET section
+ * pointing back to it.  That way readers can find the index by looking at
+ * the last section, and jump directly to a given submit.  RD_BUFFER_HASH
+ * sections are indexed too, so readers know there are refs which can only
+ * be resolved by reading from the start.
+ */
+static struct {
+	struct rd_index_entry *entries;
+	unsigned int count, size;
+	unsigned int submit;
+} idx;
+
+/* called by the wrapper at the start of each submit ioctl: */
+void rd_begin_submit(void)
+{
+	idx.submit++;
+}
+
+static void rd_index_add(enum rd_sect_type type)
+{
+	struct rd_index_entry *e;
+
+	if (!wrap_index())
+		return;
+
+	if ((type != RD_GPUADDR) && (type != RD_BUFFER_PARTIAL) &&
+			(type != RD_CMDSTREAM_ADDR) && (type != RD_BUFFER_HASH))
+		return;
+
+	if (idx.count == idx.size) {
+		idx.size = max(2 * idx.size, 1024);
+		idx.entries = realloc(idx.entries, idx.size * sizeof(idx.entries[0]));
+	}
+
+	e = &idx.entries[idx.count++];
+	e->type = type;
+	e->submit = idx.submit;
+	e->offset_lo = offset;
+	e->offset_hi = offset >> 32;
+}
+
+static void rd_index_write(void)
+{
+	uint32_t sect[2];
+
+	if (!wrap_index())
+		return;
+
+	sect[0] = offset;
+	sect[1] = offset >> 32;
+
+	rd_write_section(RD_INDEX, idx.entries, idx.count * sizeof(idx.entries[0]));
+	rd_write_section(RD_INDEX_OFFSET, sect, sizeof(sect));
+
+	idx.count = 0;
+	idx.submit = 0;
 }
 
 unsigned int env2u(const char *name)
@@ -181,6 +666,69 @@ unsigned int wrap_safe(void)
 	return val;
 }
 
+/* in async mode, rd sections are queued up in memory and written out by
+ * a background thread, to keep the disk out of the ioctl path.  Ignored
+ * in safe mode.
+ */
+unsigned int wrap_async(void)
+{
+	static unsigned int val = -1;
+	if (val == -1) {
+		val = env2u("WRAP_ASYNC");
+	}
+	return val;
+}
+
+/* in dedup mode, identical buffer contents are only written once per
+ * rd file, later copies are written as a reference to the first.
+ */
+unsigned int wrap_dedup(void)
+{
+	static unsigned int val = -1;
+	if (val == -1) {
+		val = env2u("WRAP_DEDUP");
+	}
+	return val;
+}
+
+/* if non-zero, the rd file is written gzip compressed (as .rd.gz), with
+ * the value as the compression level (1 is fastest).  Readers handle
+ * compressed and uncompressed files transparently.
+ */
+unsigned int wrap_compress(void)
+{
+	static unsigned int val = -1;
+	if (val == -1) {
+		val = env2u("WRAP_COMPRESS");
+	}
+	return val;
+}
+
+/* if non-zero, write an index of the submits at the end of the rd file,
+ * for random access.
+ */
+unsigned int wrap_index(void)
+{
+	static unsigned int val = -1;
+	if (val == -1) {
+		val = env2u("WRAP_INDEX");
+	}
+	return val;
+}
+
+/* in dirty tracking mode, mapped buffers are write protected after they
+ * are dumped, and only the pages written since are dumped on the next
+ * submit.
+ */
+unsigned int wrap_dirty(void)
+{
+	static unsigned int val = -1;
+	if (val == -1) {
+		val = env2u("WRAP_DIRTY");
+	}
+	return val;
+}
+
 /* if non-zero, emulate a different gpu-id.  The issueibcmds will be stubbed
  * so we don't actually submit cmds to the gpu.  This is useful to generate
  * cmdstream dumps for different gpu versions for comparision.
@@ -235,6 +783,8 @@ void * __rd_dlsym_helper(const char *name)
 		libc_dl = dlopen("/lib/arm-linux-gnueabihf/libc-2.15.so", RTLD_LAZY);
 	if (!libc_dl)
 		libc_dl = dlopen("/lib/libc-2.16.so", RTLD_LAZY);
+	if (!libc_dl)
+		libc_dl = dlopen("libc.so.6", RTLD_LAZY);
 #endif
 	if (!libc_dl)
 		libc_dl = dlopen("libc.so", RTLD_LAZY);
@@ -25,11 +25,12 @@
 #define WRAP_H_
 
 #ifndef BIONIC
+#  define _GNU_SOURCE
 #  include <dlfcn.h>
 #endif
 
 #define USE_PTHREADS
-#ifdef USE_PTHREADS
+#if defined(USE_PTHREADS) && defined(BIONIC)
 /* big hack: */
 #  define _PTHREAD_H 1
 #  define _BITS_PTHREADTYPES_H 1
@@ -41,11 +42,13 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <errno.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <assert.h>
 
 #define __user
@@ -54,6 +57,7 @@
 #include "android_pmem.h"
 #include "z180.h"
 #include "list.h"
+#include "itree.h"
 #include "redump.h"
 
 #if 0 /* uncomment for printf in logcat */
@@ -69,8 +73,17 @@ void * __rd_dlsym_helper(const char *name);
 		orig_##func = __rd_dlsym_helper(#func);	\
 
 
+void rd_write_sectionv(enum rd_sect_type type, const struct iovec *iov, int iovcnt);
+unsigned int rd_serial(void);
+void rd_begin_submit(void);
+
 unsigned int env2u(const char *name);
 unsigned int wrap_safe(void);
+unsigned int wrap_async(void);
+unsigned int wrap_dedup(void);
+unsigned int wrap_dirty(void);
+unsigned int wrap_compress(void);
+unsigned int wrap_index(void);
 unsigned int wrap_gpu_id(void);
 unsigned int wrap_gpu_id_patchid(void);
 unsigned int wrap_gmem_size(void);
@@ -114,4 +127,9 @@ int pthread_mutex_timedlock(pthread_mutex_t *mutex, struct timespec*  ts);
 #include <pthread.h>
 #endif
 
+/* glibc only has the non-portable name: */
+#if defined(USE_PTHREADS) && !defined(PTHREAD_RECURSIVE_MUTEX_INITIALIZER)
+#  define PTHREAD_RECURSIVE_MUTEX_INITIALIZER PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#endif
+
 #endif /* WRAP_H_ */